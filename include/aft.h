@@ -0,0 +1,168 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * This header file contains the public interface of the aft library.
+ *
+ * The library performs the PMI and uGNI wire-up that every example
+ * otherwise repeats: the communication domain, the completion queues,
+ * an endpoint and an SMSG mailbox for each rank.  The time spent in each
+ * phase of the initialization is recorded, so that the cost of the
+ * wire-up can be reported along with the benchmark results.
+ */
+
+#ifndef AFT_H
+#define AFT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gni_pub.h"
+
+#define AFT_EXPORT __attribute__ ((visibility("default")))
+
+/*
+ * aft return codes
+ */
+
+#define AFT_SUCCESS              0
+#define AFT_ERR_PMI             -1
+#define AFT_ERR_GNI             -2
+#define AFT_ERR_NOMEM           -3
+#define AFT_ERR_INVALID         -4
+#define AFT_ERR_TRANSACTION     -5
+#define AFT_ERR_TRUNCATE        -6
+#define AFT_ERR_TIMEOUT         -7
+
+/*
+ * aft_init phases, in the order they are performed
+ */
+
+typedef enum {
+	AFT_PHASE_PMI_INIT = 0,
+	AFT_PHASE_CDM_CREATE,
+	AFT_PHASE_CDM_ATTACH,
+	AFT_PHASE_CQ_CREATE,
+	AFT_PHASE_MBOX_REGISTER,
+	AFT_PHASE_ALLGATHER,
+	AFT_PHASE_EP_SETUP,
+	AFT_PHASE_BARRIER,
+	AFT_PHASE_COUNT
+} aft_phase_t;
+
+typedef struct {
+	uint64_t phase_nsec[AFT_PHASE_COUNT];
+	uint64_t total_nsec;
+} aft_timings_t;
+
+/*
+ * endpoint table statistics, table_bytes includes the gathered per rank
+ * addresses that the endpoints are created from.  mailbox_bytes is the
+ * SMSG mailbox space, which is allocated for every rank in aft_init
+ * whether or not an endpoint to the rank is ever created.
+ */
+
+typedef struct {
+	uint64_t created;
+	uint64_t evicted;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t live;
+	uint64_t max_live;
+	uint64_t table_bytes;
+	uint64_t mailbox_bytes;
+} aft_ep_stats_t;
+
+/*
+ * the endpoint, memory handle and address of a peer's exposed memory
+ */
+
+typedef struct {
+	gni_ep_handle_t ep;
+	gni_mem_handle_t mdh;
+	uint64_t addr;
+} aft_mdh_addr_t;
+
+/*
+ * a buffer that is registered once and exchanged with a peer, so that a
+ * sequence of benchmark kernels can reuse the registration
+ */
+
+typedef struct {
+	int peer_rank;
+	size_t length;
+	char *buffer;
+	gni_mem_handle_t mdh;
+	aft_mdh_addr_t peer;
+} aft_region_t;
+
+/*
+ * the ways aft_gather_put sends non-contiguous data
+ */
+
+typedef enum {
+	AFT_GATHER_SEGMENTS = 0,
+	AFT_GATHER_FMA,
+	AFT_GATHER_PACK,
+	AFT_GATHER_COUNT
+} aft_gather_t;
+
+/*
+ * prototypes for aft functions
+ */
+
+AFT_EXPORT int aft_init(int cdm_modes);
+AFT_EXPORT int aft_reinit(int cdm_modes);
+AFT_EXPORT int aft_finalize(void);
+AFT_EXPORT int aft_get_rank(void);
+AFT_EXPORT int aft_get_size(void);
+AFT_EXPORT const aft_timings_t *aft_get_init_timings(void);
+AFT_EXPORT const char *aft_phase_name(aft_phase_t phase);
+AFT_EXPORT const aft_ep_stats_t *aft_get_ep_stats(void);
+AFT_EXPORT int aft_mem_register(void *addr, size_t length,
+				gni_mem_handle_t *mdh);
+AFT_EXPORT int aft_get_peer_mdh_addr(int peer_rank,
+				     aft_mdh_addr_t *peer_mdh_addr);
+AFT_EXPORT int aft_pmi_allgather(void *in, void *out, size_t len);
+AFT_EXPORT int aft_allgather(void *in, void *out, size_t len);
+AFT_EXPORT int aft_barrier(void);
+AFT_EXPORT int aft_pmi_barrier(void);
+AFT_EXPORT int aft_ping(int niters, int peer_rank, size_t tlen,
+			uint16_t dlvr_mode, uint64_t *elapsed_nsec);
+AFT_EXPORT int aft_send(int peer_rank, const void *buf, size_t len);
+AFT_EXPORT int aft_recv(int peer_rank, void *buf, size_t len,
+			size_t *received);
+AFT_EXPORT size_t aft_get_eager_limit(void);
+AFT_EXPORT int aft_set_eager_limit(size_t limit);
+AFT_EXPORT int aft_msg_calibrate(int peer_rank, size_t *limit);
+AFT_EXPORT int aft_msg_register_buffer(void *addr, size_t length);
+AFT_EXPORT int aft_msg_deregister_buffer(void *addr);
+AFT_EXPORT int aft_region_create(aft_region_t *region, int peer_rank,
+				 size_t length);
+AFT_EXPORT void aft_region_destroy(aft_region_t *region);
+AFT_EXPORT int aft_register_cost(size_t length, int niters,
+				 uint64_t *register_nsec,
+				 uint64_t *deregister_nsec);
+AFT_EXPORT int aft_put_bw(aft_region_t *region, int niters, size_t tlen,
+			  uint16_t dlvr_mode, uint64_t *elapsed_nsec);
+AFT_EXPORT int aft_fma_put_rate(aft_region_t *region, int niters,
+				size_t tlen, int chain,
+				uint64_t *elapsed_nsec, uint64_t *post_nsec);
+AFT_EXPORT int aft_gather_put(aft_region_t *region, aft_gather_t method,
+			      void *source, const size_t *offsets, int nsegs,
+			      size_t seg_len, int niters,
+			      uint64_t *elapsed_nsec, uint64_t *reg_nsec);
+AFT_EXPORT int aft_get_lat(aft_region_t *region, int niters, size_t tlen,
+			   uint64_t *elapsed_nsec);
+AFT_EXPORT int aft_amo_lat(aft_region_t *region, int niters,
+			   uint64_t *elapsed_nsec);
+AFT_EXPORT int aft_cqwrite_ping(aft_region_t *region, int niters,
+				uint64_t *elapsed_nsec);
+AFT_EXPORT int aft_smsg_ping(aft_region_t *region, int niters, size_t tlen,
+			     uint64_t *elapsed_nsec);
+AFT_EXPORT int aft_msg_ping(aft_region_t *region, int niters, size_t tlen,
+			    uint64_t *elapsed_nsec);
+AFT_EXPORT int aft_msg_stream(aft_region_t *region, int niters, size_t tlen,
+			      uint64_t *elapsed_nsec);
+
+#endif /* AFT_H */
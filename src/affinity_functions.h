@@ -0,0 +1,272 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * This header file contains the functions used to pin ranks and threads
+ * to cores and to place buffers on a chosen NUMA node.
+ *
+ * The system calls are made directly, so that neither libnuma nor
+ * _GNU_SOURCE is required by the examples.
+ */
+
+#ifndef AFFINITY_FUNCTIONS_H
+#define AFFINITY_FUNCTIONS_H
+
+#include <dirent.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND                2
+#endif
+#ifndef MPOL_F_NODE
+#define MPOL_F_NODE              (1 << 0)
+#endif
+#ifndef MPOL_F_ADDR
+#define MPOL_F_ADDR              (1 << 1)
+#endif
+#ifndef MPOL_MF_STRICT
+#define MPOL_MF_STRICT           (1 << 0)
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE             (1 << 1)
+#endif
+
+#define MAXIMUM_CORES            1024
+#define MAXIMUM_NUMA_NODES       64
+#define NIC_NUMA_NODE_FILE       "/sys/class/gni/kgni0/device/numa_node"
+#define NUMA_NODE_DIRECTORY      "/sys/devices/system/node"
+#define NUMA_NODE_UNSPECIFIED    -1
+#define BITS_PER_MASK_WORD       (8 * sizeof(unsigned long))
+
+/*
+ * parse_core_list converts a core list such as "0-7,16,18-19" into an
+ * array of core numbers.
+ *
+ *   Returns: the number of cores in the list, the array is returned
+ *            in cores and must be freed by the caller.
+ */
+
+static int
+parse_core_list(char *core_list, int **cores)
+{
+    char           *copy;
+    int             first;
+    int             last;
+    int             number_of_cores = 0;
+    char           *p_copy;
+    char           *token;
+
+    *cores = (int *) malloc(MAXIMUM_CORES * sizeof(int));
+    assert(*cores != NULL);
+
+    /*
+     * Copy the option string because strtok is desctructive.
+     */
+
+    p_copy = copy = strdup(core_list);
+
+    while ((token = strtok(p_copy, ",")) != NULL) {
+        /* for subsequent strtok calls to work. */
+        p_copy = NULL;
+
+        if (sscanf(token, "%d-%d", &first, &last) != 2) {
+            last = first = atoi(token);
+        }
+
+        while ((first <= last) && (number_of_cores < MAXIMUM_CORES)) {
+            (*cores)[number_of_cores++] = first++;
+        }
+    }
+
+    free(copy);
+
+    return number_of_cores;
+}
+
+/*
+ * get_node_local_rank determines the index of this rank among the
+ * ranks that share its node, from the gathered NIC addresses.
+ *
+ *   Returns: the node local rank.
+ */
+
+static int
+get_node_local_rank(unsigned int *all_nic_addresses, int number_of_ranks,
+                    int rank)
+{
+    int             i;
+    int             local_rank = 0;
+
+    for (i = 0; i < rank && i < number_of_ranks; i++) {
+        if (all_nic_addresses[i] == all_nic_addresses[rank]) {
+            local_rank++;
+        }
+    }
+
+    return local_rank;
+}
+
+/*
+ * bind_to_core pins the calling thread to a single core.
+ *
+ *   Returns:  0 on success
+ *            -1 on an error
+ */
+
+static int
+bind_to_core(int core)
+{
+    unsigned long   mask[MAXIMUM_CORES / BITS_PER_MASK_WORD];
+
+    if ((core < 0) || (core >= MAXIMUM_CORES)) {
+        return -1;
+    }
+
+    memset(mask, 0, sizeof(mask));
+    mask[core / BITS_PER_MASK_WORD] = 1UL << (core % BITS_PER_MASK_WORD);
+
+    /*
+     * A pid of zero applies the mask to the calling thread only.
+     */
+
+    if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * get_number_of_numa_nodes counts the NUMA nodes that are online.
+ *
+ *   Returns: the number of NUMA nodes, at least 1.
+ */
+
+static int
+get_number_of_numa_nodes(void)
+{
+    DIR            *directory;
+    struct dirent  *entry;
+    int             number_of_nodes = 0;
+
+    directory = opendir(NUMA_NODE_DIRECTORY);
+    if (directory == NULL) {
+        return 1;
+    }
+
+    while ((entry = readdir(directory)) != NULL) {
+        if ((strncmp(entry->d_name, "node", 4) == 0) &&
+            (entry->d_name[4] >= '0') && (entry->d_name[4] <= '9')) {
+            number_of_nodes++;
+        }
+    }
+
+    closedir(directory);
+
+    return (number_of_nodes > 0) ? number_of_nodes : 1;
+}
+
+/*
+ * get_nic_numa_node determines the NUMA node that the Aries NIC is
+ * attached to.
+ *
+ *   Returns: the NUMA node of the NIC, or 0 if it is not known.
+ */
+
+static int
+get_nic_numa_node(void)
+{
+    FILE           *file;
+    int             numa_node = 0;
+
+    file = fopen(NIC_NUMA_NODE_FILE, "r");
+    if (file != NULL) {
+        if ((fscanf(file, "%d", &numa_node) != 1) || (numa_node < 0)) {
+            numa_node = 0;
+        }
+
+        fclose(file);
+    }
+
+    return numa_node;
+}
+
+/*
+ * parse_numa_node converts a NUMA node option into a node number.
+ * The option may be a node number, "local" for the node the NIC is
+ * attached to or "remote" for the first node that is not local.
+ *
+ *   Returns: the NUMA node number.
+ */
+
+static int
+parse_numa_node(char *option)
+{
+    int             nic_node;
+
+    if (strcmp(option, "local") == 0) {
+        return get_nic_numa_node();
+    } else if (strcmp(option, "remote") == 0) {
+        nic_node = get_nic_numa_node();
+
+        if (get_number_of_numa_nodes() < 2) {
+            return nic_node;
+        }
+
+        return (nic_node == 0) ? 1 : 0;
+    }
+
+    return atoi(option);
+}
+
+/*
+ * bind_buffer_to_numa_node binds the pages of a page aligned buffer to
+ * a NUMA node.  This must be done before the pages are first touched.
+ *
+ *   Returns:  0 on success
+ *            -1 on an error
+ */
+
+static int
+bind_buffer_to_numa_node(void *buffer, size_t length, int numa_node)
+{
+    unsigned long   node_mask[MAXIMUM_NUMA_NODES / BITS_PER_MASK_WORD];
+
+    if ((numa_node < 0) || (numa_node >= MAXIMUM_NUMA_NODES)) {
+        return -1;
+    }
+
+    memset(node_mask, 0, sizeof(node_mask));
+    node_mask[numa_node / BITS_PER_MASK_WORD] =
+        1UL << (numa_node % BITS_PER_MASK_WORD);
+
+    if (syscall(SYS_mbind, buffer, length, MPOL_BIND, node_mask,
+                MAXIMUM_NUMA_NODES + 1, MPOL_MF_STRICT | MPOL_MF_MOVE) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * get_buffer_numa_node determines the NUMA node that a page of a buffer
+ * is actually placed on.
+ *
+ *   Returns: the NUMA node, or -1 if it can not be determined.
+ */
+
+static int
+get_buffer_numa_node(void *address)
+{
+    int             numa_node = -1;
+
+    if (syscall(SYS_get_mempolicy, &numa_node, NULL, 0, address,
+                MPOL_F_NODE | MPOL_F_ADDR) != 0) {
+        return -1;
+    }
+
+    return numa_node;
+}
+
+#endif /* AFFINITY_FUNCTIONS_H */
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * aft allgather driver - times the PMI bootstrap allgather against the
+ * GNI Bruck allgather for a range of block sizes, and checks that both
+ * return every rank's block in rank order.
+ *
+ * Usage: aft_allgather [-m maximum_length] [-n iterations]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "aft.h"
+
+static double
+get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int
+check_blocks(uint64_t *out, int nranks, size_t words, int tag)
+{
+	int r;
+	size_t w;
+
+	for (r = 0; r < nranks; r++)
+		for (w = 0; w < words; w++)
+			if (out[r * words + w] !=
+			    (((uint64_t) r << 32) | (tag + w)))
+				return 1;
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, opt, rc, my_rank, nranks, which;
+	int errors = 0;
+	int niters = 100;
+	size_t len, w, words;
+	size_t max_len = 4096;
+	uint64_t *in, *out;
+	double start, usec[2];
+	int (*gather[2])(void *, void *, size_t) = {
+		aft_pmi_allgather, aft_allgather
+	};
+
+	while ((opt = getopt(argc, argv, "m:n:")) != -1) {
+		switch (opt) {
+		case 'm':
+			max_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			niters = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-m maximum_length] [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	rc = aft_init(0);
+	if (rc != AFT_SUCCESS) {
+		fprintf(stderr, "aft_init returned %d\n", rc);
+		return 1;
+	}
+
+	my_rank = aft_get_rank();
+	nranks = aft_get_size();
+
+	in = malloc(max_len);
+	out = malloc(max_len * nranks);
+	if ((in == NULL) || (out == NULL)) {
+		fprintf(stderr, "Rank: %4i malloc failed\n", my_rank);
+		return 1;
+	}
+
+	if (my_rank == 0)
+		fprintf(stdout, "%10s %16s %16s\n", "length",
+			"pmi usec", "gni usec");
+
+	for (len = sizeof(uint64_t); len <= max_len; len *= 2) {
+		words = len / sizeof(uint64_t);
+
+		for (which = 0; which < 2; which++) {
+
+			/*
+			 * only the allgathers are timed, the blocks are
+			 * tagged with the algorithm and checked afterwards.
+			 * The first call at a new length grows the GNI
+			 * region, so it is made before the timing starts.
+			 */
+
+			for (w = 0; w < words; w++)
+				in[w] = ((uint64_t) my_rank << 32) | (which + w);
+
+			rc = gather[which](in, out, len);
+			if (rc != AFT_SUCCESS) {
+				fprintf(stderr,
+					"Rank: %4i allgather returned %d\n",
+					my_rank, rc);
+				return 1;
+			}
+			memset(out, 0, len * nranks);
+
+			start = get_usec();
+
+			for (i = 0; i < niters; i++) {
+				rc = gather[which](in, out, len);
+				if (rc != AFT_SUCCESS) {
+					fprintf(stderr,
+						"Rank: %4i allgather returned %d\n",
+						my_rank, rc);
+					return 1;
+				}
+			}
+
+			usec[which] = (get_usec() - start) / niters;
+
+			errors += check_blocks(out, nranks, words, which);
+		}
+
+		if (my_rank == 0)
+			fprintf(stdout, "%10lu %16.3f %16.3f\n",
+				(unsigned long) len, usec[0], usec[1]);
+	}
+
+	if (errors != 0)
+		fprintf(stdout, "Rank: %4i %d allgathers returned bad data\n",
+			my_rank, errors);
+
+	free(in);
+	free(out);
+	aft_finalize();
+
+	return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * aft barrier driver - times the PMI barrier, which goes through the
+ * launcher, against the GNI dissemination barrier built from FMA flag
+ * puts.  Each rank times niters barriers of each kind, and rank 0 prints
+ * the average and the slowest rank's time per barrier.
+ *
+ * The cost of both grows with the job size, so run it at each size of
+ * interest, for example with aprun -n 2, 4, ... up to the whole machine.
+ * The first barrier of each kind is not timed, it sets up the GNI
+ * barrier's region.
+ *
+ * Usage: aft_barrier [-n iterations]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "aft.h"
+
+static double
+get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, r, opt, rc, my_rank, nranks, which;
+	int niters = 1000;
+	double start, usec[2], avg[2], max[2];
+	double *all;
+	int (*barrier[2])(void) = {
+		aft_pmi_barrier, aft_barrier
+	};
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			niters = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (niters <= 0) {
+		fprintf(stderr, "Usage: %s [-n iterations]\n", argv[0]);
+		return 1;
+	}
+
+	rc = aft_init(0);
+	if (rc != AFT_SUCCESS) {
+		fprintf(stderr, "aft_init returned %d\n", rc);
+		return 1;
+	}
+
+	my_rank = aft_get_rank();
+	nranks = aft_get_size();
+
+	all = malloc(2 * nranks * sizeof(double));
+	if (all == NULL) {
+		fprintf(stderr, "Rank: %4i malloc failed\n", my_rank);
+		return 1;
+	}
+
+	for (which = 0; which < 2; which++) {
+		rc = barrier[which]();
+		if (rc != AFT_SUCCESS) {
+			fprintf(stderr, "Rank: %4i barrier returned %d\n",
+				my_rank, rc);
+			return 1;
+		}
+
+		start = get_usec();
+
+		for (i = 0; i < niters; i++) {
+			rc = barrier[which]();
+			if (rc != AFT_SUCCESS) {
+				fprintf(stderr,
+					"Rank: %4i barrier returned %d\n",
+					my_rank, rc);
+				return 1;
+			}
+		}
+
+		usec[which] = (get_usec() - start) / niters;
+	}
+
+	rc = aft_allgather(usec, all, sizeof(usec));
+	if (rc != AFT_SUCCESS) {
+		fprintf(stderr, "Rank: %4i aft_allgather returned %d\n",
+			my_rank, rc);
+		return 1;
+	}
+
+	if (my_rank == 0) {
+		for (which = 0; which < 2; which++) {
+			avg[which] = max[which] = 0.0;
+			for (r = 0; r < nranks; r++) {
+				avg[which] += all[2 * r + which];
+				if (all[2 * r + which] > max[which])
+					max[which] = all[2 * r + which];
+			}
+			avg[which] /= nranks;
+		}
+
+		fprintf(stdout, "%10s %12s %12s %12s %12s %8s\n", "ranks",
+			"pmi avg", "pmi max", "gni avg", "gni max", "speedup");
+		fprintf(stdout, "%10d %12.3f %12.3f %12.3f %12.3f %7.1fx\n",
+			nranks, avg[0], max[0], avg[1], max[1],
+			(max[1] > 0.0) ? max[0] / max[1] : 0.0);
+	}
+
+	free(all);
+	aft_finalize();
+
+	return 0;
+}
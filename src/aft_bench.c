@@ -0,0 +1,1005 @@
+
+#include "aft_internal.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define AFT_PACK_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Benchmark kernels.
+ *
+ * The kernels share a region, a buffer that is registered once and
+ * exchanged with a peer, so that a driver running several of them in one
+ * job pays for the registration and the endpoint once.  Both ranks of a
+ * pair call a kernel with the same arguments, and the elapsed time
+ * covers only the timed loop.
+ */
+
+#define AFT_BENCH_WINDOW	64	/* puts outstanding at once */
+#define AFT_BENCH_ALIGN		64
+#define AFT_BENCH_PAGE		4096	/* MemRegisterSegments granule */
+
+int aft_region_create(aft_region_t *region, int peer_rank, size_t length)
+{
+	int rc;
+
+	if ((region == NULL) || (length == 0) || (peer_rank == aft_my_rank))
+		return AFT_ERR_INVALID;
+
+	memset(region, 0, sizeof(*region));
+
+	rc = posix_memalign((void **) &region->buffer, AFT_BENCH_ALIGN,
+			    length);
+	if (rc != 0) {
+		region->buffer = NULL;
+		return AFT_ERR_NOMEM;
+	}
+	memset(region->buffer, 0, length);
+
+	rc = aft_mem_register(region->buffer, length, &region->mdh);
+	if (rc != AFT_SUCCESS)
+		goto err;
+
+	rc = aft_get_peer_mdh_addr(peer_rank, &region->peer);
+	if (rc != AFT_SUCCESS)
+		goto err1;
+
+	region->peer_rank = peer_rank;
+	region->length = length;
+
+	return AFT_SUCCESS;
+
+err1:
+	GNI_MemDeregister(aft_nic.nic, &region->mdh);
+err:
+	free(region->buffer);
+	region->buffer = NULL;
+	return rc;
+}
+
+void aft_region_destroy(aft_region_t *region)
+{
+	if ((region == NULL) || (region->buffer == NULL))
+		return;
+
+	GNI_MemDeregister(aft_nic.nic, &region->mdh);
+	free(region->buffer);
+	region->buffer = NULL;
+}
+
+/*
+ * aft_register_cost registers and deregisters a length byte buffer niters
+ * times as aft_region_create does.  The times cover only the
+ * GNI_MemRegister and GNI_MemDeregister calls, the buffer is allocated
+ * and touched first, and nothing is exchanged with a peer.
+ */
+
+int aft_register_cost(size_t length, int niters, uint64_t *register_nsec,
+		      uint64_t *deregister_nsec)
+{
+	gni_mem_handle_t mdh;
+	gni_return_t status;
+	uint64_t start_time, reg = 0, dereg = 0;
+	char *buffer;
+	int i, rc = AFT_SUCCESS;
+
+	if ((length == 0) || (niters <= 0))
+		return AFT_ERR_INVALID;
+
+	if (posix_memalign((void **) &buffer, AFT_BENCH_ALIGN, length) != 0)
+		return AFT_ERR_NOMEM;
+	memset(buffer, 0, length);
+
+	for (i = 0; i < niters; i++) {
+		start_time = aft_get_nsec();
+		status = GNI_MemRegister(aft_nic.nic, (uint64_t) buffer,
+					 length, aft_nic.rx_cq,
+					 GNI_MEM_READWRITE, -1, &mdh);
+		reg += aft_get_nsec() - start_time;
+		if (status != GNI_RC_SUCCESS) {
+			AFT_WARN("GNI_MemRegister returned %s\n",
+				gni_err_str[status]);
+			rc = aft_gni_err_to_aft_err(status);
+			break;
+		}
+
+		start_time = aft_get_nsec();
+		status = GNI_MemDeregister(aft_nic.nic, &mdh);
+		dereg += aft_get_nsec() - start_time;
+		if (status != GNI_RC_SUCCESS) {
+			AFT_WARN("GNI_MemDeregister returned %s\n",
+				gni_err_str[status]);
+			rc = aft_gni_err_to_aft_err(status);
+			break;
+		}
+	}
+
+	free(buffer);
+
+	if (register_nsec != NULL)
+		*register_nsec = reg;
+	if (deregister_nsec != NULL)
+		*deregister_nsec = dereg;
+
+	return rc;
+}
+
+/*
+ * complete the next local transaction and return its descriptor, unlike
+ * aft_wait_tx_cqe the descriptor is released so that it can be reused
+ * while other transactions are outstanding
+ */
+
+static int
+aft_bench_complete(int peer_rank, gni_post_descriptor_t **desc)
+{
+	gni_cq_entry_t cqe;
+	gni_return_t status;
+	aft_spin_t spin;
+
+	aft_spin_init(&spin);
+
+	do {
+		status = GNI_CqGetEvent(aft_nic.tx_cq, &cqe);
+		if ((status == GNI_RC_NOT_DONE) && aft_spin_expired(&spin)) {
+			AFT_WARN("no local completion with rank %d\n",
+				 peer_rank);
+			return AFT_ERR_TIMEOUT;
+		}
+	} while (status == GNI_RC_NOT_DONE);
+
+	if (status != GNI_RC_SUCCESS)
+		return aft_cqe_error(cqe, peer_rank);
+
+	status = GNI_GetCompleted(aft_nic.tx_cq, cqe, desc);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_GetCompleted returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_put_bw streams niters RDMA puts of tlen bytes to the peer, keeping
+ * up to AFT_BENCH_WINDOW of them outstanding.  The puts cycle through
+ * the region, both ranks of the pair send at the same time.
+ */
+
+int aft_put_bw(aft_region_t *region, int niters, size_t tlen,
+	       uint16_t dlvr_mode, uint64_t *elapsed_nsec)
+{
+	gni_post_descriptor_t descs[AFT_BENCH_WINDOW];
+	gni_post_descriptor_t *free_descs[AFT_BENCH_WINDOW];
+	gni_post_descriptor_t *desc;
+	gni_return_t status;
+	uint64_t start_time;
+	size_t slot, slots;
+	int i, nfree, rc = AFT_SUCCESS;
+
+	if ((region == NULL) || (niters <= 0) || (tlen == 0) ||
+	    (tlen > region->length))
+		return AFT_ERR_INVALID;
+
+	slots = region->length / tlen;
+
+	memset(descs, 0, sizeof(descs));
+	for (i = 0; i < AFT_BENCH_WINDOW; i++) {
+		descs[i].type = GNI_POST_RDMA_PUT;
+		descs[i].cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+		descs[i].dlvr_mode = dlvr_mode;
+		descs[i].local_mem_hndl = region->mdh;
+		descs[i].remote_mem_hndl = region->peer.mdh;
+		descs[i].length = tlen;
+		descs[i].src_cq_hndl = aft_nic.tx_cq;
+		descs[i].post_id = (uint64_t) &descs[i];
+		free_descs[i] = &descs[i];
+	}
+	nfree = AFT_BENCH_WINDOW;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i++) {
+		if (nfree == 0) {
+			rc = aft_bench_complete(region->peer_rank,
+						&free_descs[nfree]);
+			if (rc != AFT_SUCCESS)
+				return rc;
+			nfree++;
+		}
+
+		desc = free_descs[--nfree];
+		slot = (i % slots) * tlen;
+		desc->local_addr = (uint64_t) region->buffer + slot;
+		desc->remote_addr = region->peer.addr + slot;
+
+		status = GNI_PostRdma(region->peer.ep, desc);
+		if (status != GNI_RC_SUCCESS) {
+			AFT_WARN("GNI_PostRdma returned %s\n",
+				gni_err_str[status]);
+			free_descs[nfree++] = desc;
+			rc = aft_gni_err_to_aft_err(status);
+			break;
+		}
+	}
+
+	/*
+	 * the global events mean the data is in the peer's memory
+	 */
+
+	while (nfree < AFT_BENCH_WINDOW) {
+		if (aft_bench_complete(region->peer_rank,
+				       &free_descs[nfree]) != AFT_SUCCESS)
+			return AFT_ERR_TRANSACTION;
+		nfree++;
+	}
+
+	if ((rc == AFT_SUCCESS) && (elapsed_nsec != NULL))
+		*elapsed_nsec = aft_get_nsec() - start_time;
+
+	return rc;
+}
+
+/*
+ * aft_fma_put_rate streams niters FMA puts of tlen bytes to the peer.
+ * With a chain of 1 every put is posted with GNI_PostFma and completes
+ * on its own.  A longer chain links that many descriptors through
+ * next_descr and posts them with a single GNI_CtPostFma, the chain
+ * completes with one event for its first descriptor.  Up to
+ * AFT_BENCH_WINDOW puts are outstanding either way.  post_nsec returns
+ * the time spent in the post calls, the CPU overhead of posting.
+ */
+
+int aft_fma_put_rate(aft_region_t *region, int niters, size_t tlen,
+		     int chain, uint64_t *elapsed_nsec, uint64_t *post_nsec)
+{
+	gni_post_descriptor_t descs[AFT_BENCH_WINDOW];
+	gni_post_descriptor_t *free_chains[AFT_BENCH_WINDOW];
+	gni_post_descriptor_t *desc, *head;
+	gni_return_t status;
+	uint64_t start_time, post_start, posting = 0;
+	size_t slots;
+	int c, i, k, n, nchains, nfree, rc = AFT_SUCCESS;
+
+	if ((region == NULL) || (niters <= 0) || (tlen == 0) ||
+	    (tlen > region->length) || (chain < 1) ||
+	    (chain > AFT_BENCH_WINDOW))
+		return AFT_ERR_INVALID;
+
+	slots = region->length / tlen;
+	nchains = AFT_BENCH_WINDOW / chain;
+
+	memset(descs, 0, sizeof(descs));
+	for (c = 0; c < nchains; c++) {
+		for (k = 0; k < chain; k++) {
+			desc = &descs[c * chain + k];
+			desc->type = GNI_POST_FMA_PUT;
+			desc->cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+			desc->dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+			desc->local_mem_hndl = region->mdh;
+			desc->remote_mem_hndl = region->peer.mdh;
+			desc->length = tlen;
+			desc->post_id = (uint64_t) desc;
+		}
+		free_chains[c] = &descs[c * chain];
+	}
+	nfree = nchains;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i += n) {
+		if (nfree == 0) {
+			rc = aft_bench_complete(region->peer_rank,
+						&free_chains[nfree]);
+			if (rc != AFT_SUCCESS)
+				return rc;
+			nfree++;
+		}
+
+		head = free_chains[--nfree];
+
+		/*
+		 * the last chain is cut short to end at niters
+		 */
+
+		n = niters - i;
+		if (n > chain)
+			n = chain;
+
+		for (k = 0; k < n; k++) {
+			desc = head + k;
+			desc->local_addr = (uint64_t) region->buffer +
+				((i + k) % slots) * tlen;
+			desc->remote_addr = region->peer.addr +
+				((i + k) % slots) * tlen;
+			desc->next_descr = (k + 1 < n) ? desc + 1 : NULL;
+		}
+
+		post_start = aft_get_nsec();
+		if (chain == 1)
+			status = GNI_PostFma(region->peer.ep, head);
+		else
+			status = GNI_CtPostFma(region->peer.ep, head);
+		posting += aft_get_nsec() - post_start;
+
+		if (status != GNI_RC_SUCCESS) {
+			AFT_WARN("%s returned %s\n",
+				 (chain == 1) ? "GNI_PostFma" : "GNI_CtPostFma",
+				 gni_err_str[status]);
+			free_chains[nfree++] = head;
+			rc = aft_gni_err_to_aft_err(status);
+			break;
+		}
+	}
+
+	while (nfree < nchains) {
+		if (aft_bench_complete(region->peer_rank,
+				       &free_chains[nfree]) != AFT_SUCCESS)
+			return AFT_ERR_TRANSACTION;
+		nfree++;
+	}
+
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+	if (post_nsec != NULL)
+		*post_nsec = posting;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * Pack kernels for aft_gather_put, they copy nsegs segments of seg_len
+ * bytes at the given offsets of src to consecutive bytes of dst.  SSE2 is
+ * always there on x86_64, AVX2 is picked at run time.  A segment of one
+ * word, a strided vector of doubles say, is where the per segment loop
+ * costs the most, the AVX2 kernel gathers four of them at a time.
+ */
+
+static void
+aft_pack_scalar(char *dst, const char *src, const size_t *offsets,
+		int nsegs, size_t seg_len)
+{
+	int k;
+
+	for (k = 0; k < nsegs; k++, dst += seg_len)
+		memcpy(dst, src + offsets[k], seg_len);
+}
+
+#ifdef AFT_PACK_X86
+static void
+aft_pack_sse2(char *dst, const char *src, const size_t *offsets,
+	      int nsegs, size_t seg_len)
+{
+	const char *s;
+	size_t j;
+	int k;
+
+	for (k = 0; k < nsegs; k++, dst += seg_len) {
+		s = src + offsets[k];
+		for (j = 0; j + 16 <= seg_len; j += 16)
+			_mm_storeu_si128((__m128i *) (dst + j),
+				_mm_loadu_si128((const __m128i *) (s + j)));
+		if (j < seg_len)
+			memcpy(dst + j, s + j, seg_len - j);
+	}
+}
+
+__attribute__ ((target("avx2"))) static void
+aft_pack_avx2(char *dst, const char *src, const size_t *offsets,
+	      int nsegs, size_t seg_len)
+{
+	const char *s;
+	size_t j;
+	int k = 0;
+
+	if (seg_len == sizeof(uint64_t)) {
+		for (; k + 4 <= nsegs; k += 4, dst += 4 * seg_len)
+			_mm256_storeu_si256((__m256i *) dst,
+				_mm256_i64gather_epi64((const long long *) src,
+					_mm256_loadu_si256((const __m256i *)
+							   (offsets + k)), 1));
+	}
+
+	for (; k < nsegs; k++, dst += seg_len) {
+		s = src + offsets[k];
+		for (j = 0; j + 32 <= seg_len; j += 32)
+			_mm256_storeu_si256((__m256i *) (dst + j),
+				_mm256_loadu_si256((const __m256i *) (s + j)));
+		if (j < seg_len)
+			memcpy(dst + j, s + j, seg_len - j);
+	}
+}
+#endif
+
+static void
+aft_pack(char *dst, const char *src, const size_t *offsets, int nsegs,
+	 size_t seg_len)
+{
+	static void (*pack)(char *, const char *, const size_t *, int, size_t);
+
+	if (pack == NULL) {
+		pack = aft_pack_scalar;
+#ifdef AFT_PACK_X86
+		__builtin_cpu_init();
+		pack = __builtin_cpu_supports("avx2") ? aft_pack_avx2 :
+						       aft_pack_sse2;
+#endif
+	}
+
+	pack(dst, src, offsets, nsegs, seg_len);
+}
+
+static int
+aft_gather_register(aft_gather_t method, char *source,
+		    const size_t *offsets, int nsegs, size_t seg_len,
+		    gni_mem_segment_t *segments, gni_mem_handle_t *mdh)
+{
+	gni_return_t status;
+	size_t lo, hi;
+	int k;
+
+	if (method == AFT_GATHER_SEGMENTS) {
+		status = GNI_MemRegisterSegments(aft_nic.nic, segments, nsegs,
+						 NULL, GNI_MEM_READWRITE, -1,
+						 mdh);
+		if (status != GNI_RC_SUCCESS) {
+			AFT_WARN("GNI_MemRegisterSegments returned %s\n",
+				gni_err_str[status]);
+			return aft_gni_err_to_aft_err(status);
+		}
+		return AFT_SUCCESS;
+	}
+
+	lo = hi = offsets[0];
+	for (k = 0; k < nsegs; k++) {
+		if (offsets[k] < lo)
+			lo = offsets[k];
+		if (offsets[k] > hi)
+			hi = offsets[k];
+	}
+
+	status = GNI_MemRegister(aft_nic.nic, (uint64_t) source + lo,
+				 hi + seg_len - lo, NULL, GNI_MEM_READWRITE,
+				 -1, mdh);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_MemRegister returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_gather_put sends nsegs segments of seg_len bytes, at the given
+ * offsets of source, to the start of the peer's region as one message,
+ * niters times:
+ *
+ *   AFT_GATHER_SEGMENTS registers the segments with
+ *	GNI_MemRegisterSegments and sends them with one RDMA put, the
+ *	segments must be whole pages
+ *   AFT_GATHER_FMA registers the span of source that holds the segments
+ *	and sends each segment with its own FMA put
+ *   AFT_GATHER_PACK packs the segments into the second half of the
+ *	region, which is already registered, and sends them with one RDMA
+ *	put
+ *
+ * A registration per message is what a library pays when the buffer is
+ * new to it, reg_nsec returns the time spent registering and
+ * deregistering so that the cost with a registration cache is
+ * elapsed_nsec less reg_nsec.  The RDMA methods need the message to be a
+ * multiple of 4 bytes.
+ */
+
+int aft_gather_put(aft_region_t *region, aft_gather_t method, void *source,
+		   const size_t *offsets, int nsegs, size_t seg_len,
+		   int niters, uint64_t *elapsed_nsec, uint64_t *reg_nsec)
+{
+	gni_post_descriptor_t descs[AFT_BENCH_WINDOW];
+	gni_post_descriptor_t *free_descs[AFT_BENCH_WINDOW];
+	gni_post_descriptor_t *desc;
+	gni_mem_segment_t *segments = NULL;
+	gni_mem_handle_t mdh;
+	gni_return_t status;
+	uint64_t start_time, reg_start, registering = 0;
+	size_t total;
+	char *bounce;
+	int i, k, nfree, nposts, rc = AFT_SUCCESS;
+
+	if ((region == NULL) || (source == NULL) || (offsets == NULL) ||
+	    (nsegs <= 0) || (seg_len == 0) || (niters <= 0) ||
+	    (method < 0) || (method >= AFT_GATHER_COUNT))
+		return AFT_ERR_INVALID;
+
+	total = nsegs * seg_len;
+	if ((total > region->length / 2) ||
+	    ((method != AFT_GATHER_FMA) && ((total & 3) != 0)))
+		return AFT_ERR_INVALID;
+
+	if (method == AFT_GATHER_SEGMENTS) {
+		if ((((uint64_t) source | seg_len) & (AFT_BENCH_PAGE - 1)) != 0)
+			return AFT_ERR_INVALID;
+
+		segments = malloc(nsegs * sizeof(*segments));
+		if (segments == NULL)
+			return AFT_ERR_NOMEM;
+
+		for (k = 0; k < nsegs; k++) {
+			if ((offsets[k] & (AFT_BENCH_PAGE - 1)) != 0) {
+				free(segments);
+				return AFT_ERR_INVALID;
+			}
+			segments[k].address = (uint64_t) source + offsets[k];
+			segments[k].length = seg_len;
+		}
+	}
+
+	bounce = region->buffer + region->length / 2;
+
+	memset(descs, 0, sizeof(descs));
+	for (k = 0; k < AFT_BENCH_WINDOW; k++) {
+		descs[k].type = (method == AFT_GATHER_FMA) ?
+			GNI_POST_FMA_PUT : GNI_POST_RDMA_PUT;
+		descs[k].cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+		descs[k].dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+		descs[k].remote_mem_hndl = region->peer.mdh;
+		descs[k].src_cq_hndl = aft_nic.tx_cq;
+		descs[k].post_id = (uint64_t) &descs[k];
+		free_descs[k] = &descs[k];
+	}
+	nfree = AFT_BENCH_WINDOW;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i++) {
+		if (method == AFT_GATHER_PACK) {
+			aft_pack(bounce, source, offsets, nsegs, seg_len);
+			mdh = region->mdh;
+		} else {
+			reg_start = aft_get_nsec();
+			rc = aft_gather_register(method, source, offsets, nsegs,
+						 seg_len, segments, &mdh);
+			registering += aft_get_nsec() - reg_start;
+			if (rc != AFT_SUCCESS)
+				break;
+		}
+
+		nposts = (method == AFT_GATHER_FMA) ? nsegs : 1;
+		status = GNI_RC_SUCCESS;
+
+		for (k = 0; k < nposts; k++) {
+			if (nfree == 0) {
+				rc = aft_bench_complete(region->peer_rank,
+							&free_descs[nfree]);
+				if (rc != AFT_SUCCESS)
+					break;
+				nfree++;
+			}
+
+			desc = free_descs[--nfree];
+			desc->local_mem_hndl = mdh;
+			desc->remote_addr = region->peer.addr + k * seg_len;
+			desc->length = total;
+
+			/*
+			 * the local address of a segmented handle is an offset
+			 * into the segments laid end to end
+			 */
+
+			if (method == AFT_GATHER_SEGMENTS) {
+				desc->local_addr = 0;
+			} else if (method == AFT_GATHER_PACK) {
+				desc->local_addr = (uint64_t) bounce;
+			} else {
+				desc->local_addr = (uint64_t) source + offsets[k];
+				desc->length = seg_len;
+			}
+
+			if (method == AFT_GATHER_FMA)
+				status = GNI_PostFma(region->peer.ep, desc);
+			else
+				status = GNI_PostRdma(region->peer.ep, desc);
+			if (status != GNI_RC_SUCCESS) {
+				AFT_WARN("%s returned %s\n",
+					 (method == AFT_GATHER_FMA) ?
+					 "GNI_PostFma" : "GNI_PostRdma",
+					 gni_err_str[status]);
+				free_descs[nfree++] = desc;
+				rc = aft_gni_err_to_aft_err(status);
+				break;
+			}
+		}
+
+		/*
+		 * the source may only be deregistered, or packed into again,
+		 * once the puts have read it
+		 */
+
+		while (nfree < AFT_BENCH_WINDOW) {
+			if (aft_bench_complete(region->peer_rank,
+					       &free_descs[nfree]) != AFT_SUCCESS) {
+				rc = AFT_ERR_TRANSACTION;
+				break;
+			}
+			nfree++;
+		}
+
+		if (method != AFT_GATHER_PACK) {
+			reg_start = aft_get_nsec();
+			GNI_MemDeregister(aft_nic.nic, &mdh);
+			registering += aft_get_nsec() - reg_start;
+		}
+
+		if (rc != AFT_SUCCESS)
+			break;
+	}
+
+	free(segments);
+
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+	if (reg_nsec != NULL)
+		*reg_nsec = registering;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_get_lat does niters RDMA gets of tlen bytes from the peer, one at a
+ * time.  The BTE needs the length to be a multiple of 4 bytes.
+ */
+
+int aft_get_lat(aft_region_t *region, int niters, size_t tlen,
+		uint64_t *elapsed_nsec)
+{
+	gni_post_descriptor_t get_desc;
+	gni_post_descriptor_t *desc;
+	gni_return_t status;
+	uint64_t start_time;
+	size_t slot, slots;
+	int i, rc;
+
+	if ((region == NULL) || (niters <= 0) || (tlen == 0) ||
+	    (tlen > region->length) || ((tlen & 3) != 0))
+		return AFT_ERR_INVALID;
+
+	slots = region->length / tlen;
+
+	memset(&get_desc, 0, sizeof(get_desc));
+	get_desc.type = GNI_POST_RDMA_GET;
+	get_desc.cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+	get_desc.dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+	get_desc.local_mem_hndl = region->mdh;
+	get_desc.remote_mem_hndl = region->peer.mdh;
+	get_desc.length = tlen;
+	get_desc.src_cq_hndl = aft_nic.tx_cq;
+	get_desc.post_id = (uint64_t) &get_desc;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i++) {
+		slot = (i % slots) * tlen;
+		get_desc.local_addr = (uint64_t) region->buffer + slot;
+		get_desc.remote_addr = region->peer.addr + slot;
+
+		status = GNI_PostRdma(region->peer.ep, &get_desc);
+		if (status != GNI_RC_SUCCESS) {
+			AFT_WARN("GNI_PostRdma returned %s\n",
+				gni_err_str[status]);
+			return aft_gni_err_to_aft_err(status);
+		}
+
+		rc = aft_bench_complete(region->peer_rank, &desc);
+		if (rc != AFT_SUCCESS)
+			return rc;
+	}
+
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_amo_lat does niters fetching adds of 1 to the first word of the
+ * peer's region, one at a time.  The fetched values are returned to the
+ * second word of this rank's region, and must count up by one because
+ * only this rank adds to the peer's word.
+ */
+
+int aft_amo_lat(aft_region_t *region, int niters, uint64_t *elapsed_nsec)
+{
+	gni_post_descriptor_t amo_desc;
+	gni_post_descriptor_t *desc;
+	gni_return_t status;
+	volatile uint64_t *result;
+	uint64_t expected, start_time;
+	int i, rc;
+
+	if ((region == NULL) || (niters <= 0) ||
+	    (region->length < 2 * sizeof(uint64_t)))
+		return AFT_ERR_INVALID;
+
+	result = (volatile uint64_t *) region->buffer + 1;
+
+	memset(&amo_desc, 0, sizeof(amo_desc));
+	amo_desc.type = GNI_POST_AMO;
+	amo_desc.cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+	amo_desc.dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+	amo_desc.local_addr = (uint64_t) result;
+	amo_desc.local_mem_hndl = region->mdh;
+	amo_desc.remote_addr = region->peer.addr;
+	amo_desc.remote_mem_hndl = region->peer.mdh;
+	amo_desc.length = sizeof(uint64_t);
+	amo_desc.amo_cmd = GNI_FMA_ATOMIC_FADD;
+	amo_desc.first_operand = 1;
+	amo_desc.post_id = (uint64_t) &amo_desc;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i++) {
+		status = GNI_PostFma(region->peer.ep, &amo_desc);
+		if (status != GNI_RC_SUCCESS) {
+			AFT_WARN("GNI_PostFma returned %s\n",
+				gni_err_str[status]);
+			return aft_gni_err_to_aft_err(status);
+		}
+
+		rc = aft_bench_complete(region->peer_rank, &desc);
+		if (rc != AFT_SUCCESS)
+			return rc;
+
+		/*
+		 * the peer's word holds whatever the earlier kernels left
+		 */
+
+		if (i == 0)
+			expected = *result;
+		else if (*result != ++expected) {
+			AFT_WARN("fetched 0x%lx from rank %d, expected 0x%lx\n",
+				 (unsigned long) *result, region->peer_rank,
+				 (unsigned long) expected);
+			return AFT_ERR_TRANSACTION;
+		}
+	}
+
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_cqwrite_ping bounces a CQ write between the ranks of the pair
+ * niters times, the lower rank sends first.
+ */
+
+int aft_cqwrite_ping(aft_region_t *region, int niters,
+		     uint64_t *elapsed_nsec)
+{
+	gni_post_descriptor_t cq_desc;
+	gni_post_descriptor_t *desc;
+	gni_cq_entry_t cqe;
+	gni_return_t status;
+	uint64_t start_time;
+	int i, pass, rc;
+
+	if ((region == NULL) || (niters <= 0))
+		return AFT_ERR_INVALID;
+
+	memset(&cq_desc, 0, sizeof(cq_desc));
+	cq_desc.type = GNI_POST_CQWRITE;
+	cq_desc.remote_mem_hndl = region->peer.mdh;
+	cq_desc.cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+	cq_desc.dlvr_mode = GNI_DLVMODE_IN_ORDER;
+	cq_desc.src_cq_hndl = aft_nic.tx_cq;
+	cq_desc.post_id = (uint64_t) &cq_desc;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i++) {
+		for (pass = 0; pass < 2; pass++) {
+			if ((pass == 0) == (aft_my_rank < region->peer_rank)) {
+				cq_desc.cqwrite_value = i;
+				status = GNI_PostCqWrite(region->peer.ep,
+							 &cq_desc);
+				if (status != GNI_RC_SUCCESS) {
+					AFT_WARN("GNI_PostCqWrite returned %s\n",
+						gni_err_str[status]);
+					return aft_gni_err_to_aft_err(status);
+				}
+
+				rc = aft_bench_complete(region->peer_rank,
+							&desc);
+			} else {
+				rc = aft_wait_rx_cqe(region->peer_rank, &cqe);
+				if ((rc == AFT_SUCCESS) &&
+				    (GNI_CQ_GET_DATA(cqe) != (uint64_t) i)) {
+					AFT_WARN("CQ write %d from rank %d carried %lu\n",
+						 i, region->peer_rank,
+						 (unsigned long) GNI_CQ_GET_DATA(cqe));
+					rc = AFT_ERR_TRANSACTION;
+				}
+			}
+
+			if (rc != AFT_SUCCESS)
+				return rc;
+		}
+	}
+
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_smsg_ping bounces a tlen byte message from the region's buffer
+ * between the ranks of the pair niters times through the mailboxes set up
+ * by aft_init, the lower rank sends first.
+ */
+
+int aft_smsg_ping(aft_region_t *region, int niters, size_t tlen,
+		  uint64_t *elapsed_nsec)
+{
+	gni_return_t status;
+	uint64_t start_time;
+	aft_spin_t spin;
+	void *msg;
+	int i, pass, rc;
+
+	if ((region == NULL) || (niters <= 0) || (tlen == 0) ||
+	    (tlen > region->length) || (tlen > aft_mbox_msg_maxsize))
+		return AFT_ERR_INVALID;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i++) {
+		for (pass = 0; pass < 2; pass++) {
+			if ((pass == 0) == (aft_my_rank < region->peer_rank)) {
+				aft_spin_init(&spin);
+				do {
+					status = GNI_SmsgSend(region->peer.ep,
+							      region->buffer,
+							      tlen,
+							      NULL, 0, 0);
+					if ((status == GNI_RC_NOT_DONE) &&
+					    aft_spin_expired(&spin)) {
+						AFT_WARN("no credit from rank %d\n",
+							 region->peer_rank);
+						return AFT_ERR_TIMEOUT;
+					}
+				} while (status == GNI_RC_NOT_DONE);
+				if (status != GNI_RC_SUCCESS) {
+					AFT_WARN("GNI_SmsgSend returned %s\n",
+						gni_err_str[status]);
+					return aft_gni_err_to_aft_err(status);
+				}
+
+				rc = aft_wait_tx_cqe(region->peer_rank);
+				if (rc != AFT_SUCCESS)
+					return rc;
+				continue;
+			}
+
+			rc = aft_wait_smsg(region->peer_rank,
+					   region->peer.ep, &msg);
+			if (rc != AFT_SUCCESS)
+				return rc;
+
+			GNI_SmsgRelease(region->peer.ep);
+		}
+	}
+
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_msg_ping bounces a tlen byte message between the ranks of the pair
+ * niters times with aft_send and aft_recv, the lower rank sends first.
+ * The messages go eagerly or by rendezvous as the eager limit decides,
+ * the region's buffer is registered for the rendezvous before the timing
+ * starts, as a caller that reuses its buffer would do.
+ */
+
+int aft_msg_ping(aft_region_t *region, int niters, size_t tlen,
+		 uint64_t *elapsed_nsec)
+{
+	uint64_t start_time;
+	size_t received;
+	int i, pass, rc;
+
+	if ((region == NULL) || (niters <= 0) || (tlen > region->length))
+		return AFT_ERR_INVALID;
+
+	rc = aft_msg_register_buffer(region->buffer, region->length);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i++) {
+		for (pass = 0; pass < 2; pass++) {
+			if ((pass == 0) == (aft_my_rank < region->peer_rank)) {
+				rc = aft_send(region->peer_rank,
+					      region->buffer, tlen);
+			} else {
+				rc = aft_recv(region->peer_rank,
+					      region->buffer, tlen, &received);
+				if ((rc == AFT_SUCCESS) && (received != tlen))
+					rc = AFT_ERR_TRANSACTION;
+			}
+			if (rc != AFT_SUCCESS)
+				goto out;
+		}
+	}
+
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+
+out:
+	aft_msg_deregister_buffer(region->buffer);
+	return rc;
+}
+
+/*
+ * aft_msg_stream sends niters messages of tlen bytes from the lower rank
+ * of the pair to the higher one, which answers the last with an empty
+ * message so that the time covers the delivery of all of them.  The
+ * region's buffer is registered for the rendezvous as in aft_msg_ping.
+ */
+
+int aft_msg_stream(aft_region_t *region, int niters, size_t tlen,
+		   uint64_t *elapsed_nsec)
+{
+	uint64_t start_time;
+	size_t received;
+	int i, rc;
+
+	if ((region == NULL) || (niters <= 0) || (tlen > region->length))
+		return AFT_ERR_INVALID;
+
+	rc = aft_msg_register_buffer(region->buffer, region->length);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	start_time = aft_get_nsec();
+
+	for (i = 0; i < niters; i++) {
+		if (aft_my_rank < region->peer_rank) {
+			rc = aft_send(region->peer_rank, region->buffer, tlen);
+		} else {
+			rc = aft_recv(region->peer_rank, region->buffer, tlen,
+				      &received);
+			if ((rc == AFT_SUCCESS) && (received != tlen))
+				rc = AFT_ERR_TRANSACTION;
+		}
+		if (rc != AFT_SUCCESS)
+			goto out;
+	}
+
+	if (aft_my_rank < region->peer_rank)
+		rc = aft_recv(region->peer_rank, region->buffer, 0, &received);
+	else
+		rc = aft_send(region->peer_rank, region->buffer, 0);
+	if (rc != AFT_SUCCESS)
+		goto out;
+
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+
+out:
+	aft_msg_deregister_buffer(region->buffer);
+	return rc;
+}
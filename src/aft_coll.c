@@ -0,0 +1,382 @@
+
+#include "aft_internal.h"
+
+/*
+ * Collectives.
+ *
+ * aft_pmi_allgather is the bootstrap allgather used before, and while,
+ * the endpoints are set up.  PMI_Allgather does not return the entries in
+ * rank order, so the order is gathered once and cached, and the staging
+ * buffer is kept between calls.
+ *
+ * aft_allgather is the GNI allgather, a Bruck allgather over FMA puts.
+ * In round k each rank puts the first min(2^k, n - 2^k) blocks it holds
+ * to the rank 2^k below it, then puts a flag.  After ceil(log2(n)) rounds
+ * every rank holds all of the blocks, rotated by its own rank.  The
+ * scratch buffers are double buffered by call, a rank can be at most one
+ * call ahead of another because finishing a call needs every rank's
+ * block for that call.
+ *
+ * aft_barrier is a dissemination barrier over the same region.  In round
+ * k each rank puts the barrier's sequence number into the round k flag
+ * of the rank 2^k above it, and waits for the rank 2^k below it to do
+ * the same.  After ceil(log2(n)) rounds every rank has heard from every
+ * other one, directly or not.  The sequence only grows and the puts from
+ * a rank land in order, so a rank that is already into the next barrier
+ * can overwrite a flag without losing the wakeup, and the flags are
+ * never reset.  aft_pmi_barrier is the PMI barrier, which goes through
+ * the launcher and is kept for the bootstrap and for comparison.
+ */
+
+#define AFT_COLL_MAX_ROUNDS	64
+#define AFT_COLL_ALIGN		64
+
+typedef struct {
+	gni_mem_handle_t mdh;
+	uint64_t addr;
+} aft_coll_peer_t;
+
+/*
+ * the registered region is laid out as:
+ *   flags[2][AFT_COLL_MAX_ROUNDS], seq word,
+ *   barrier flags[AFT_COLL_MAX_ROUNDS], barrier seq word,
+ *   padding, buffer[0], buffer[1]
+ */
+
+typedef struct {
+	volatile uint64_t flags[2][AFT_COLL_MAX_ROUNDS];
+	uint64_t seq;
+	volatile uint64_t barrier_flags[AFT_COLL_MAX_ROUNDS];
+	uint64_t barrier_seq;
+} aft_coll_header_t;
+
+#define AFT_COLL_HEADER_SIZE						\
+	((sizeof(aft_coll_header_t) + AFT_COLL_ALIGN - 1) &		\
+	 ~((size_t) AFT_COLL_ALIGN - 1))
+
+static int *aft_pmi_order;
+static int aft_pmi_in_rank_order = 1;
+static char *aft_pmi_staging;
+static size_t aft_pmi_staging_size;
+
+static char *aft_coll_region;
+static size_t aft_coll_capacity;	/* bytes per buffer */
+static gni_mem_handle_t aft_coll_mdh;
+static aft_coll_peer_t *aft_coll_peers;
+static uint64_t aft_coll_seq;
+static uint64_t aft_coll_barrier_seq;
+
+int aft_pmi_allgather(void *in, void *out, size_t len)
+{
+	int i, rc;
+	char *out_ptr = out;
+
+	if (aft_pmi_order == NULL) {
+		aft_pmi_order = malloc(aft_nranks * sizeof(int));
+		if (aft_pmi_order == NULL)
+			return AFT_ERR_NOMEM;
+
+		rc = PMI_Allgather(&aft_my_rank, aft_pmi_order, sizeof(int));
+		if (rc != PMI_SUCCESS) {
+			AFT_WARN("PMI_Allgather returned %d\n", rc);
+			free(aft_pmi_order);
+			aft_pmi_order = NULL;
+			return aft_pmi_err_to_aft_err(rc);
+		}
+
+		for (i = 0; i < aft_nranks; i++)
+			if (aft_pmi_order[i] != i)
+				aft_pmi_in_rank_order = 0;
+	}
+
+	if (aft_pmi_in_rank_order) {
+		rc = PMI_Allgather(in, out, len);
+		if (rc != PMI_SUCCESS)
+			AFT_WARN("PMI_Allgather returned %d\n", rc);
+		return aft_pmi_err_to_aft_err(rc);
+	}
+
+	if (aft_pmi_staging_size < aft_nranks * len) {
+		free(aft_pmi_staging);
+		aft_pmi_staging_size = aft_nranks * len;
+		aft_pmi_staging = malloc(aft_pmi_staging_size);
+		if (aft_pmi_staging == NULL) {
+			aft_pmi_staging_size = 0;
+			return AFT_ERR_NOMEM;
+		}
+	}
+
+	rc = PMI_Allgather(in, aft_pmi_staging, len);
+	if (rc != PMI_SUCCESS) {
+		AFT_WARN("PMI_Allgather returned %d\n", rc);
+		return aft_pmi_err_to_aft_err(rc);
+	}
+
+	for (i = 0; i < aft_nranks; i++)
+		memcpy(&out_ptr[len * aft_pmi_order[i]],
+		       &aft_pmi_staging[len * i], len);
+
+	return AFT_SUCCESS;
+}
+
+static void
+aft_coll_release(void)
+{
+	if (aft_coll_region == NULL)
+		return;
+
+	GNI_MemDeregister(aft_nic.nic, &aft_coll_mdh);
+	free(aft_coll_region);
+	aft_coll_region = NULL;
+	aft_coll_capacity = 0;
+}
+
+/*
+ * make sure the registered buffers hold the whole result, a length of 0
+ * sets up the header alone.  All ranks call with the same length, so
+ * they all grow together and exchange the new region through the
+ * bootstrap allgather.
+ */
+
+static int
+aft_coll_reserve(size_t bytes)
+{
+	aft_coll_peer_t me;
+	gni_return_t status;
+	size_t capacity;
+	int rc;
+
+	if ((aft_coll_region != NULL) && (bytes <= aft_coll_capacity))
+		return AFT_SUCCESS;
+
+	capacity = (bytes + AFT_COLL_ALIGN - 1) & ~((size_t) AFT_COLL_ALIGN - 1);
+
+	aft_coll_release();
+
+	rc = posix_memalign((void **) &aft_coll_region, AFT_COLL_ALIGN,
+			    AFT_COLL_HEADER_SIZE + 2 * capacity);
+	if (rc != 0) {
+		aft_coll_region = NULL;
+		return AFT_ERR_NOMEM;
+	}
+	memset(aft_coll_region, 0, AFT_COLL_HEADER_SIZE);
+
+	status = GNI_MemRegister(aft_nic.nic,
+				 (uint64_t) aft_coll_region,
+				 AFT_COLL_HEADER_SIZE + 2 * capacity,
+				 NULL,
+				 GNI_MEM_READWRITE,
+				 -1,
+				 &aft_coll_mdh);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_MemRegister returned %s\n",
+			gni_err_str[status]);
+		free(aft_coll_region);
+		aft_coll_region = NULL;
+		return aft_gni_err_to_aft_err(status);
+	}
+	aft_coll_capacity = capacity;
+
+	if (aft_coll_peers == NULL) {
+		aft_coll_peers = malloc(aft_nranks * sizeof(aft_coll_peer_t));
+		if (aft_coll_peers == NULL) {
+			aft_coll_release();
+			return AFT_ERR_NOMEM;
+		}
+	}
+
+	me.mdh = aft_coll_mdh;
+	me.addr = (uint64_t) aft_coll_region;
+
+	rc = aft_pmi_allgather(&me, aft_coll_peers, sizeof(me));
+	if (rc != AFT_SUCCESS)
+		aft_coll_release();
+
+	return rc;
+}
+
+static int
+aft_coll_put(int peer, uint64_t local_addr, uint64_t remote_addr,
+	     size_t length)
+{
+	gni_post_descriptor_t desc;
+	gni_return_t status;
+	gni_ep_handle_t ep;
+	int rc;
+
+	rc = aft_get_ep(peer, &ep);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.type = GNI_POST_FMA_PUT;
+	desc.cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+	desc.dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+	desc.local_addr = local_addr;
+	desc.local_mem_hndl = aft_coll_mdh;
+	desc.remote_addr = remote_addr;
+	desc.remote_mem_hndl = aft_coll_peers[peer].mdh;
+	desc.length = length;
+	desc.post_id = (uint64_t) &desc;
+
+	status = GNI_PostFma(ep, &desc);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_PostFma returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	/*
+	 * the global event means the data is in the peer's memory
+	 */
+
+	return aft_wait_tx_cqe(peer);
+}
+
+int aft_allgather(void *in, void *out, size_t len)
+{
+	aft_coll_header_t *header;
+	char *buffer;
+	char *out_ptr = out;
+	size_t buffer_offset, count, distance;
+	uint64_t remote;
+	aft_spin_t spin;
+	int i, k, parity, peer, rc;
+
+	if ((len == 0) || (aft_peer_attrs == NULL))
+		return AFT_ERR_INVALID;
+
+	rc = aft_coll_reserve(aft_nranks * len);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	header = (aft_coll_header_t *) aft_coll_region;
+	parity = ++aft_coll_seq & 1;
+	header->seq = aft_coll_seq;
+	buffer_offset = AFT_COLL_HEADER_SIZE + parity * aft_coll_capacity;
+	buffer = aft_coll_region + buffer_offset;
+
+	memcpy(buffer, in, len);
+
+	for (k = 0, distance = 1; distance < (size_t) aft_nranks;
+	     k++, distance <<= 1) {
+		count = aft_nranks - distance;
+		if (count > distance)
+			count = distance;
+		peer = (aft_my_rank + aft_nranks - distance) % aft_nranks;
+		remote = aft_coll_peers[peer].addr;
+
+		rc = aft_coll_put(peer, (uint64_t) buffer,
+				  remote + buffer_offset + distance * len,
+				  count * len);
+		if (rc != AFT_SUCCESS)
+			return rc;
+
+		rc = aft_coll_put(peer, (uint64_t) &header->seq,
+				  remote + offsetof(aft_coll_header_t,
+						    flags[parity][k]),
+				  sizeof(uint64_t));
+		if (rc != AFT_SUCCESS)
+			return rc;
+
+		/*
+		 * the flag comes from the rank distance above, which puts
+		 * to this one
+		 */
+
+		aft_spin_init(&spin);
+		while (header->flags[parity][k] != aft_coll_seq) {
+			if (aft_spin_expired(&spin)) {
+				AFT_WARN("no allgather flag from rank %d\n",
+					 (int) ((aft_my_rank + distance) %
+						aft_nranks));
+				return AFT_ERR_TIMEOUT;
+			}
+			sched_yield();
+		}
+	}
+
+	/*
+	 * block i came from rank (my_rank + i) % nranks
+	 */
+
+	for (i = 0; i < aft_nranks; i++)
+		memcpy(&out_ptr[len * ((aft_my_rank + i) % aft_nranks)],
+		       &buffer[len * i], len);
+
+	return AFT_SUCCESS;
+}
+
+int aft_barrier(void)
+{
+	aft_coll_header_t *header;
+	size_t distance;
+	uint64_t remote;
+	aft_spin_t spin;
+	int k, peer, rc;
+
+	if (aft_peer_attrs == NULL)
+		return AFT_ERR_INVALID;
+
+	/*
+	 * the first call sets up the region, an allgather that has
+	 * already run has done it
+	 */
+
+	rc = aft_coll_reserve(0);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	header = (aft_coll_header_t *) aft_coll_region;
+	header->barrier_seq = ++aft_coll_barrier_seq;
+
+	for (k = 0, distance = 1; distance < (size_t) aft_nranks;
+	     k++, distance <<= 1) {
+		peer = (aft_my_rank + distance) % aft_nranks;
+		remote = aft_coll_peers[peer].addr;
+
+		rc = aft_coll_put(peer, (uint64_t) &header->barrier_seq,
+				  remote + offsetof(aft_coll_header_t,
+						    barrier_flags[k]),
+				  sizeof(uint64_t));
+		if (rc != AFT_SUCCESS)
+			return rc;
+
+		aft_spin_init(&spin);
+		while (header->barrier_flags[k] < aft_coll_barrier_seq) {
+			if (aft_spin_expired(&spin)) {
+				AFT_WARN("no barrier flag from rank %d\n",
+					 (int) ((aft_my_rank + aft_nranks -
+						 distance) % aft_nranks));
+				return AFT_ERR_TIMEOUT;
+			}
+			sched_yield();
+		}
+	}
+
+	return AFT_SUCCESS;
+}
+
+int aft_pmi_barrier(void)
+{
+	int rc;
+
+	rc = PMI_Barrier();
+	if (rc != PMI_SUCCESS)
+		AFT_WARN("PMI_Barrier returned %d\n", rc);
+
+	return aft_pmi_err_to_aft_err(rc);
+}
+
+void aft_coll_finalize(void)
+{
+	aft_coll_release();
+	free(aft_coll_peers);
+	aft_coll_peers = NULL;
+	free(aft_pmi_order);
+	aft_pmi_order = NULL;
+	aft_pmi_in_rank_order = 1;
+	free(aft_pmi_staging);
+	aft_pmi_staging = NULL;
+	aft_pmi_staging_size = 0;
+}
@@ -0,0 +1,391 @@
+
+#include "aft_internal.h"
+
+/*
+ * On demand endpoints.
+ *
+ * Rather than creating and binding an endpoint for every rank during
+ * aft_init, the endpoint to a peer is created, bound and has its mailbox
+ * initialized the first time it is used.  The endpoints live in an open
+ * addressing hash table keyed by rank, so the memory used grows with the
+ * number of peers actually talked to rather than with the job size.
+ *
+ * When AFT_EP_CACHE_SIZE is set, at most that many endpoints are kept and
+ * the least recently used one is torn down to make room.  An endpoint
+ * whose mailbox has carried messages is never torn down, because the
+ * peer's mailbox state can not be reset from this side, and neither is
+ * one with transactions still in flight.
+ *
+ * AFT_EAGER_EPS=1 creates all of the endpoints in aft_init instead, so
+ * that the two approaches can be compared.
+ */
+
+#define AFT_EP_TABLE_MIN	64
+
+typedef struct {
+	int rank;		/* -1 when the slot is empty */
+	int pinned;
+	int busy;		/* refused an unbind during this eviction */
+	uint64_t last_use;
+	gni_ep_handle_t ep;
+} aft_ep_entry_t;
+
+static aft_ep_entry_t *aft_ep_table;
+static uint32_t aft_ep_table_size;	/* always a power of 2 */
+static uint32_t aft_ep_cache_size;	/* 0 is unlimited */
+static uint64_t aft_ep_clock;
+static aft_ep_stats_t aft_ep_stats;
+
+static inline uint32_t
+aft_ep_hash(int rank)
+{
+	/* Fibonacci hashing spreads neighbouring ranks apart */
+	return (uint32_t) (((uint64_t) rank * 0x9e3779b97f4a7c15UL) >> 32) &
+		(aft_ep_table_size - 1);
+}
+
+static int
+aft_ep_table_alloc(uint32_t size)
+{
+	uint32_t i;
+
+	aft_ep_table = malloc(size * sizeof(aft_ep_entry_t));
+	if (aft_ep_table == NULL)
+		return AFT_ERR_NOMEM;
+
+	for (i = 0; i < size; i++)
+		aft_ep_table[i].rank = -1;
+	aft_ep_table_size = size;
+
+	return AFT_SUCCESS;
+}
+
+static aft_ep_entry_t *
+aft_ep_lookup(int rank)
+{
+	uint32_t slot = aft_ep_hash(rank);
+
+	while (aft_ep_table[slot].rank != -1) {
+		if (aft_ep_table[slot].rank == rank)
+			return &aft_ep_table[slot];
+		slot = (slot + 1) & (aft_ep_table_size - 1);
+	}
+
+	return NULL;
+}
+
+static aft_ep_entry_t *
+aft_ep_insert(int rank)
+{
+	uint32_t slot = aft_ep_hash(rank);
+
+	while (aft_ep_table[slot].rank != -1)
+		slot = (slot + 1) & (aft_ep_table_size - 1);
+
+	aft_ep_table[slot].rank = rank;
+	aft_ep_table[slot].pinned = 0;
+	aft_ep_table[slot].busy = 0;
+	aft_ep_table[slot].ep = NULL;
+
+	return &aft_ep_table[slot];
+}
+
+/*
+ * remove an entry, shifting back the entries that follow it in its probe
+ * sequence so that no tombstones are needed
+ */
+
+static void
+aft_ep_remove(aft_ep_entry_t *entry)
+{
+	uint32_t mask = aft_ep_table_size - 1;
+	uint32_t hole = entry - aft_ep_table;
+	uint32_t slot = hole;
+	uint32_t home;
+
+	for (;;) {
+		slot = (slot + 1) & mask;
+		if (aft_ep_table[slot].rank == -1)
+			break;
+
+		home = aft_ep_hash(aft_ep_table[slot].rank);
+		if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+			aft_ep_table[hole] = aft_ep_table[slot];
+			hole = slot;
+		}
+	}
+
+	aft_ep_table[hole].rank = -1;
+}
+
+static int
+aft_ep_table_grow(void)
+{
+	aft_ep_entry_t *old_table = aft_ep_table;
+	uint32_t old_size = aft_ep_table_size;
+	aft_ep_entry_t *entry;
+	uint32_t i;
+	int rc;
+
+	rc = aft_ep_table_alloc(old_size * 2);
+	if (rc != AFT_SUCCESS) {
+		aft_ep_table = old_table;
+		return rc;
+	}
+
+	for (i = 0; i < old_size; i++) {
+		if (old_table[i].rank == -1)
+			continue;
+		entry = aft_ep_insert(old_table[i].rank);
+		*entry = old_table[i];
+	}
+	free(old_table);
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * tear down the least recently used endpoint that is not pinned.
+ * GNI_EpUnbind refuses an endpoint that still has transactions in flight,
+ * that endpoint is left alone and the next least recently used one is
+ * tried.
+ *
+ *   Returns: 1 if an endpoint was torn down, 0 if all are pinned or busy.
+ */
+
+static int
+aft_ep_evict(void)
+{
+	aft_ep_entry_t *victim;
+	gni_return_t status;
+	uint32_t i;
+	int evicted = 0;
+
+	for (;;) {
+		victim = NULL;
+		for (i = 0; i < aft_ep_table_size; i++) {
+			if ((aft_ep_table[i].rank == -1) ||
+			    aft_ep_table[i].pinned || aft_ep_table[i].busy)
+				continue;
+			if ((victim == NULL) ||
+			    (aft_ep_table[i].last_use < victim->last_use))
+				victim = &aft_ep_table[i];
+		}
+
+		if (victim == NULL)
+			break;
+
+		status = GNI_EpUnbind(victim->ep);
+		if (status != GNI_RC_SUCCESS) {
+			victim->busy = 1;
+			continue;
+		}
+
+		GNI_EpDestroy(victim->ep);
+		aft_ep_remove(victim);
+		aft_ep_stats.live--;
+		aft_ep_stats.evicted++;
+		evicted = 1;
+		break;
+	}
+
+	for (i = 0; i < aft_ep_table_size; i++)
+		aft_ep_table[i].busy = 0;
+
+	return evicted;
+}
+
+/*
+ * create and bind an endpoint to a peer and initialize the mailbox pair.
+ * The mailboxes were zeroed when they were allocated, so a message that
+ * the peer sends before this side has initialized its endpoint is not
+ * lost.
+ */
+
+static int
+aft_ep_connect(int rank, gni_ep_handle_t *ep)
+{
+	gni_return_t status;
+	gni_smsg_attr_t local_attr;
+	gni_smsg_attr_t remote_attr;
+
+	status = GNI_EpCreate(aft_nic.nic, aft_nic.tx_cq, ep);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_EpCreate returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	status = GNI_EpBind(*ep, aft_peer_attrs[rank].addr, rank);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_EpBind returned %s\n",
+			gni_err_str[status]);
+		GNI_EpDestroy(*ep);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	/*
+	 * my mailbox for the rank is at the rank's offset in my
+	 * buffer, and my mailbox in the rank's buffer is at mine
+	 */
+
+	local_attr = my_smsg_attr.smsg_attr;
+	local_attr.mbox_offset = aft_bytes_per_smsg * rank;
+	remote_attr = aft_peer_attrs[rank].smsg_attr;
+	remote_attr.mbox_offset = aft_bytes_per_smsg * aft_my_rank;
+
+	status = GNI_SmsgInit(*ep, &local_attr, &remote_attr);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_SmsgInit returned %s\n",
+			gni_err_str[status]);
+		GNI_EpUnbind(*ep);
+		GNI_EpDestroy(*ep);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_ep_init sets up the endpoint table, and creates every endpoint
+ * when AFT_EAGER_EPS is set.
+ */
+
+int aft_ep_init(void)
+{
+	char *p_ptr;
+	gni_ep_handle_t ep;
+	uint32_t size = AFT_EP_TABLE_MIN;
+	int eager = 0;
+	int i, rc;
+
+	memset(&aft_ep_stats, 0, sizeof(aft_ep_stats));
+	aft_ep_clock = 0;
+	aft_ep_cache_size = 0;
+
+	p_ptr = getenv("AFT_EP_CACHE_SIZE");
+	if (p_ptr != NULL)
+		aft_ep_cache_size = strtoul(p_ptr, NULL, 0);
+
+	p_ptr = getenv("AFT_EAGER_EPS");
+	if ((p_ptr != NULL) && (atoi(p_ptr) != 0)) {
+		eager = 1;
+		aft_ep_cache_size = 0;
+	}
+
+	/*
+	 * keep the load factor at or below one half
+	 */
+
+	while ((eager && (size < 2 * (uint32_t) aft_nranks)) ||
+	       (size < 2 * aft_ep_cache_size))
+		size *= 2;
+
+	rc = aft_ep_table_alloc(size);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	if (!eager)
+		return AFT_SUCCESS;
+
+	for (i = 0; i < aft_nranks; i++) {
+		rc = aft_get_ep(i, &ep);
+		if (rc != AFT_SUCCESS)
+			return rc;
+	}
+
+	return AFT_SUCCESS;
+}
+
+void aft_ep_finalize(void)
+{
+	uint32_t i;
+
+	if (aft_ep_table == NULL)
+		return;
+
+	for (i = 0; i < aft_ep_table_size; i++) {
+		if (aft_ep_table[i].rank == -1)
+			continue;
+		GNI_EpUnbind(aft_ep_table[i].ep);
+		GNI_EpDestroy(aft_ep_table[i].ep);
+	}
+
+	free(aft_ep_table);
+	aft_ep_table = NULL;
+	aft_ep_table_size = 0;
+	aft_ep_stats.live = 0;
+}
+
+/*
+ * aft_get_ep returns the endpoint to a rank, creating it on first use.
+ */
+
+int aft_get_ep(int rank, gni_ep_handle_t *ep)
+{
+	aft_ep_entry_t *entry;
+	int rc;
+
+	if ((rank < 0) || (rank >= aft_nranks) || (aft_ep_table == NULL))
+		return AFT_ERR_INVALID;
+
+	entry = aft_ep_lookup(rank);
+	if (entry != NULL) {
+		aft_ep_stats.hits++;
+		entry->last_use = ++aft_ep_clock;
+		*ep = entry->ep;
+		return AFT_SUCCESS;
+	}
+
+	aft_ep_stats.misses++;
+
+	if ((aft_ep_cache_size != 0) &&
+	    (aft_ep_stats.live >= aft_ep_cache_size))
+		aft_ep_evict();
+
+	if (2 * (aft_ep_stats.live + 1) > aft_ep_table_size) {
+		rc = aft_ep_table_grow();
+		if (rc != AFT_SUCCESS)
+			return rc;
+	}
+
+	rc = aft_ep_connect(rank, ep);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	entry = aft_ep_insert(rank);
+	entry->ep = *ep;
+	entry->last_use = ++aft_ep_clock;
+
+	aft_ep_stats.created++;
+	aft_ep_stats.live++;
+	if (aft_ep_stats.live > aft_ep_stats.max_live)
+		aft_ep_stats.max_live = aft_ep_stats.live;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_pin_ep keeps the endpoint to a rank from being torn down, once its
+ * mailbox is in use.
+ */
+
+void aft_pin_ep(int rank)
+{
+	aft_ep_entry_t *entry;
+
+	entry = aft_ep_lookup(rank);
+	if (entry != NULL)
+		entry->pinned = 1;
+}
+
+const aft_ep_stats_t *aft_get_ep_stats(void)
+{
+	aft_ep_stats.table_bytes =
+		aft_ep_table_size * sizeof(aft_ep_entry_t) +
+		aft_nranks * sizeof(aft_smsg_w_addr_t);
+	aft_ep_stats.mailbox_bytes =
+		(uint64_t) aft_bytes_per_smsg * aft_nranks;
+
+	return &aft_ep_stats;
+}
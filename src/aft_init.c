@@ -3,43 +3,181 @@
 
 aft_nic_t aft_nic;
 aft_smsg_w_addr_t my_smsg_attr;
-gni_ep_handle_t *aft_ep_hndls;
-
-int aft_init(int cdm_modes)
+aft_smsg_w_addr_t *aft_peer_attrs;
+uint32_t aft_bytes_per_smsg;
+int aft_my_rank;
+int aft_nranks;
+aft_mdh_addr_msg_t aft_local_mdh_addr;
+uint64_t aft_timeout_nsec = AFT_TIMEOUT_DEFAULT * 1000000000UL;
+uint32_t aft_mbox_msg_maxsize = AFT_MBOX_MSG_MAXSIZE;
+
+static aft_timings_t aft_init_timings;
+
+/*
+ * PMI stays up when a failed aft_reinit leaves the NIC released, so
+ * aft_finalize still has PMI to shut down
+ */
+
+static int aft_pmi_up;
+
+/*
+ * the RX CQ events that were taken off the queue while looking for the
+ * mailbox events, oldest first, for aft_wait_rx_cqe
+ */
+
+static gni_cq_entry_t *aft_rx_pending;
+static uint32_t aft_rx_pending_size;
+static uint32_t aft_rx_pending_head;
+static uint32_t aft_rx_pending_tail;
+
+static const char *aft_phase_names[AFT_PHASE_COUNT] = {
+	"pmi_init",
+	"cdm_create",
+	"cdm_attach",
+	"cq_create",
+	"mbox_register",
+	"allgather",
+	"ep_setup",
+	"barrier"
+};
+
+/*
+ * record the time since the start of a phase, and start the next one
+ */
+
+#define AFT_PHASE_DONE(phase, start)					\
+	do {								\
+		uint64_t __now = aft_get_nsec();			\
+		aft_init_timings.phase_nsec[phase] = __now - (start);	\
+		(start) = __now;					\
+	} while (0)
+
+/*
+ * __get_credential finds the index'th value of a colon separated PMI
+ * credential, or the last one available.  By default uGNI uses the
+ * second value assigned by ALPS, PTAG_INDEX=n selects another one.
+ */
+
+static uint32_t
+__get_credential(const char *name)
 {
-	int spawned;
-	int i, rc, my_rank, nranks;
-	int device_id = 0; /* only 1 aries nic/node */
-	uint32_t bytes_per_smsg;
-	gni_smsg_attr_t smsg_attr;
-	gni_smsg_attr_t *all_smsg_attrs = NULL;
-#if 0
-	uint32_t modes = GNI_CDM_MODE_USE_PCI_IOMMU;
-#define GNI_CDM_MODE_FLBTE_DISABLE          0x00100000
-#endif
-	gni_smsg_attr_t my_smsg_attr = {0};
+	char *copy, *p_copy, *p_ptr, *token;
+	int index = 0;
+	int ptag_index = 1;
+	uint32_t value = 0;
+
+	p_ptr = getenv("PTAG_INDEX");
+	if (p_ptr != NULL)
+		ptag_index = atoi(p_ptr);
+
+	p_ptr = getenv(name);
+	if (p_ptr == NULL)
+		return 0;
 
 	/*
-	 * Fire up PMI
+	 * Copy the environment variable string because strtok is destructive.
 	 */
 
-	rc = PMI_Init(&first_spawned);
-	if (rc != PMI_SUCCESS) {
-		AFT_WARN("PMI_Init returned %d\n",rc);
-		goto err;
+	p_copy = copy = strdup(p_ptr);
+	while ((token = strtok(p_copy, ":")) != NULL) {
+		p_copy = NULL;
+		value = (uint32_t) atoi(token);
+		if (index++ == ptag_index)
+			break;
 	}
+	free(copy);
 
-	rc = PMI_Get_size(&nranks);
-	if (rc != PMI_SUCCESS) {
-		AFT_WARN("PMI_Get_size returned %d\n",rc);
-		goto err;
-	}
+	return value;
+}
 
-	rc = PMI_Get_rank(&my_rank);
-	if (rc != PMI_SUCCESS) {
-		AFT_WARN("PMI_Get_size returned %d\n",rc);
-		goto err;
+static uint8_t
+__get_ptag(void)
+{
+	return (uint8_t) __get_credential("PMI_GNI_PTAG");
+}
+
+static uint32_t
+__get_cookie(void)
+{
+	return __get_credential("PMI_GNI_COOKIE");
+}
+
+int aft_gni_err_to_aft_err(gni_return_t status)
+{
+	switch (status) {
+	case GNI_RC_SUCCESS:
+		return AFT_SUCCESS;
+	case GNI_RC_ERROR_NOMEM:
+	case GNI_RC_ERROR_RESOURCE:
+		return AFT_ERR_NOMEM;
+	case GNI_RC_INVALID_PARAM:
+		return AFT_ERR_INVALID;
+	case GNI_RC_TRANSACTION_ERROR:
+		return AFT_ERR_TRANSACTION;
+	default:
+		return AFT_ERR_GNI;
 	}
+}
+
+int aft_pmi_err_to_aft_err(int rc)
+{
+	return (rc == PMI_SUCCESS) ? AFT_SUCCESS : AFT_ERR_PMI;
+}
+
+int aft_cqe_error(gni_cq_entry_t cqe, int peer_rank)
+{
+	char buffer[1024];
+	gni_return_t status;
+
+	status = GNI_CqErrorStr(cqe, buffer, sizeof(buffer));
+	if (status == GNI_RC_SUCCESS)
+		AFT_WARN("transaction error with rank %d: %s\n",
+			 peer_rank, buffer);
+	else
+		AFT_WARN("transaction error with rank %d: cqe 0x%016lx\n",
+			 peer_rank, (unsigned long) cqe);
+
+	return AFT_ERR_TRANSACTION;
+}
+
+int aft_get_rank(void)
+{
+	return aft_my_rank;
+}
+
+int aft_get_size(void)
+{
+	return aft_nranks;
+}
+
+const aft_timings_t *aft_get_init_timings(void)
+{
+	return &aft_init_timings;
+}
+
+const char *aft_phase_name(aft_phase_t phase)
+{
+	if ((phase < 0) || (phase >= AFT_PHASE_COUNT))
+		return "unknown";
+
+	return aft_phase_names[phase];
+}
+
+/*
+ * __aft_nic_init creates the CDM, the NIC state and the mailboxes, the
+ * part of the initialization that aft_reinit repeats with other CDM
+ * modes.  On an error everything it set up is released again.
+ */
+
+static int
+__aft_nic_init(int cdm_modes, uint64_t phase_start)
+{
+	int rc;
+	int device_id = 0; /* only 1 aries nic/node */
+	uint8_t ptag;
+	uint32_t cookie, local_address;
+	gni_return_t status;
+	gni_smsg_attr_t smsg_attr;
 
 	/*
 	 * Get the GNI RDMA credentials from PMI
@@ -48,7 +186,7 @@ int aft_init(int cdm_modes)
 	ptag = __get_ptag();
 	cookie = __get_cookie();
 
-	status = GNI_CdmCreate(my_rank,
+	status = GNI_CdmCreate(aft_my_rank,
 			       ptag,
 			       cookie,
 			       cdm_modes,
@@ -56,8 +194,9 @@ int aft_init(int cdm_modes)
 	if (status != GNI_RC_SUCCESS) {
 		AFT_WARN("GNI_CdmCreate returned %s\n",
 			gni_err_str[status]);
-		goto err;
+		return aft_gni_err_to_aft_err(status);
 	}
+	AFT_PHASE_DONE(AFT_PHASE_CDM_CREATE, phase_start);
 
 	status = GNI_CdmAttach(aft_nic.cdm_hndl,
 			       device_id,
@@ -66,10 +205,12 @@ int aft_init(int cdm_modes)
 	if (status != GNI_RC_SUCCESS) {
 		AFT_WARN("GNI_CdmAttach returned %s\n",
 			gni_err_str[status]);
+		rc = aft_gni_err_to_aft_err(status);
 		goto err1;
 	}
+	AFT_PHASE_DONE(AFT_PHASE_CDM_ATTACH, phase_start);
 
-	my_smsg_attr.rank = my_rank;
+	my_smsg_attr.my_rank = aft_my_rank;
 	my_smsg_attr.addr = local_address;
 
 	/*
@@ -77,7 +218,7 @@ int aft_init(int cdm_modes)
 	 */
 
 	status = GNI_CqCreate(aft_nic.nic,
-			      number_of_cq_entries,
+			      AFT_TX_CQ_ENTRIES,
 			      0,
 			      GNI_CQ_NOBLOCK | GNI_CQ_PHYS_PAGES,
 			      NULL,
@@ -86,14 +227,17 @@ int aft_init(int cdm_modes)
 	if (status != GNI_RC_SUCCESS) {
 		AFT_WARN("GNI_CqCreate returned %s\n",
 			gni_err_str[status]);
+		rc = aft_gni_err_to_aft_err(status);
 		goto err1;
 	}
 
 	/*
 	 * create a RX CQ
 	 */
-        status = GNI_CqCreate(aft_nic.nic,
-			      number_of_rx_cq_entries,
+
+	status = GNI_CqCreate(aft_nic.nic,
+			      AFT_RX_CQ_ENTRIES,
+			      0,
 			      GNI_CQ_NOBLOCK | GNI_CQ_PHYS_PAGES,
 			      NULL,
 			      NULL,
@@ -101,8 +245,10 @@ int aft_init(int cdm_modes)
 	if (status != GNI_RC_SUCCESS) {
 		AFT_WARN("GNI_CqCreate returned %s\n",
 			gni_err_str[status]);
+		rc = aft_gni_err_to_aft_err(status);
 		goto err2;
 	}
+	AFT_PHASE_DONE(AFT_PHASE_CQ_CREATE, phase_start);
 
 	/*
 	 * set up space for mailboxes - these don't need to
@@ -110,96 +256,79 @@ int aft_init(int cdm_modes)
 	 * memhndl/vaddr info
 	 */
 
+	memset(&smsg_attr, 0, sizeof(smsg_attr));
 	smsg_attr.msg_type = GNI_SMSG_TYPE_MBOX_AUTO_RETRANSMIT;
-	smsg_attr.mbox_maxcredit = 16;
-	smsg_attr.msg_maxsize = 512;
+	smsg_attr.mbox_maxcredit = AFT_MBOX_MAXCREDIT;
+	smsg_attr.msg_maxsize = aft_mbox_msg_maxsize;
 
-	status = GNI_SmsgBufferSizeNeeded(&my_smsg_attr,
-					  &bytes_per_smsg);
+	status = GNI_SmsgBufferSizeNeeded(&smsg_attr,
+					  &aft_bytes_per_smsg);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_SmsgBufferSizeNeeded returned %s\n",
+			gni_err_str[status]);
+		rc = aft_gni_err_to_aft_err(status);
+		goto err3;
+	}
 
-	smsg_attr.msg_buffer = malloc(bytes_per_smsg * nranks);
-	if (smsg_buffer == NULL) {
+	smsg_attr.buff_size = aft_bytes_per_smsg;
+	smsg_attr.msg_buffer = calloc(aft_nranks, aft_bytes_per_smsg);
+	if (smsg_attr.msg_buffer == NULL) {
 		AFT_WARN("malloc of smsg space failed\n");
+		rc = AFT_ERR_NOMEM;
 		goto err3;
 	}
 
 	/*
-	 * now register the smsg buffer
+	 * now register the smsg buffer, the incoming messages
+	 * generate events on the RX CQ
 	 */
 
 	status = GNI_MemRegister(aft_nic.nic,
-				 my_smsg_attr.msg_buffer,
-				 bytes_per_smsg * nranks,
-				 NULL,
+				 (uint64_t) smsg_attr.msg_buffer,
+				 aft_bytes_per_smsg * aft_nranks,
+				 aft_nic.rx_cq,
 				 GNI_MEM_READWRITE,
 				 -1,
-				 &my_smsg_attr.mem_hndl);
+				 &smsg_attr.mem_hndl);
 	if (status != GNI_RC_SUCCESS) {
 		AFT_WARN("GNI_MemRegister returned %s\n",
 			gni_err_str[status]);
-		goto err3;
+		rc = aft_gni_err_to_aft_err(status);
+		goto err4;
 	}
+	AFT_PHASE_DONE(AFT_PHASE_MBOX_REGISTER, phase_start);
 
 	/*
 	 * now we can gather addresses and smsg_attr's
 	 */
 
 	memcpy(&my_smsg_attr.smsg_attr,
-		&smsg_attr, sizeof(aft_smsg_w_addr_t));
+		&smsg_attr, sizeof(gni_smsg_attr_t));
 
-	all_smsg_attrs = malloc(nranks * sizeof(my_smsg_attr));
-	if (all_smsg_attrs == NULL) {
+	aft_peer_attrs = malloc(aft_nranks * sizeof(my_smsg_attr));
+	if (aft_peer_attrs == NULL) {
 		AFT_WARN("malloc of %lu failed\n",
-			 nranks * sizeof(my_smsg_attr));
-		goto err3;
+			 aft_nranks * sizeof(my_smsg_attr));
+		rc = AFT_ERR_NOMEM;
+		goto err5;
 	}
 
-	rc = PMI_Allgather(&my_smsg_attr,
-			   all_smsg_attrs,
-                           sizeof(my_smsg_attr));
-	if (rc != PMI_SUCCESS) {
-		AFT_WARN("PMI_Allgather returned %d\n", rc);
-		goto err3;
-	}
+	rc = aft_pmi_allgather(&my_smsg_attr,
+			       aft_peer_attrs,
+			       sizeof(my_smsg_attr));
+	if (rc != AFT_SUCCESS)
+		goto err6;
+	AFT_PHASE_DONE(AFT_PHASE_ALLGATHER, phase_start);
 
 	/*
-	 * Set up the endpoints
+	 * Set up the endpoint table, the endpoints themselves are
+	 * created on first use unless AFT_EAGER_EPS is set
 	 */
 
-	aft_ep_hndls  = malloc(nranks * sizeof(gni_ep_handle_t));
-	if (ep_hndls == NULL) {
-		AFT_WARN("calloc of ep_hndls failed\n");
-		goto err3;
-	}
-
-	i = 0;
-	while(i < nranks) {
-		the_rank = all_smsg_attrs[i].my_rank;
-        	status = GNI_EpCreate(aft_nic.nic,
-					aft_nic.tx_cq,
-					&aft_ep_hndls[the_rank]);
-		if (status != GNI_RC_SUCCESS) {
-			AFT_WARN("GNI_MemRegister returned %s\n",
-				gni_err_str[status]);
-			goto err3;
-		}
-		all_smsg_attrs[i].smsg_attr.mbox_offset = bytes_per_smsg * the_rank;
-
-		smsg_attr.msg_type = GNI_SMSG_TYPE_MBOX_AUTO_RETRANSMIT;
-		smsg_attr.mbox_maxcredit = 16;
-		smsg_attr.msg_maxsize = 512;
-		smsg_attr.mbox_offset = bytes_per_smsg * the_rank;
-
-		status = GNI_SmsgInit(aft_ep_hndls[the_rank],
-					&smsg_attr,
-					&all_smsg_attrs[i]);
-		if (status != GNI_RC_SUCCESS) {
-			AFT_WARN("GNI_MemRegister returned %s\n",
-				gni_err_str[status]);
-			goto err3;
-		}
-		++i;;
-	}
+	rc = aft_ep_init();
+	if (rc != AFT_SUCCESS)
+		goto err6;
+	AFT_PHASE_DONE(AFT_PHASE_EP_SETUP, phase_start);
 
 	/*
 	 * need to barrier here to make sure all ranks have
@@ -208,26 +337,420 @@ int aft_init(int cdm_modes)
 
 	rc = PMI_Barrier();
 	if (rc != PMI_SUCCESS) {
-		AFT_WARN("GNI_MemRegister returned %s\n",
-			gni_err_str[status]);
-		goto err;
+		AFT_WARN("PMI_Barrier returned %d\n", rc);
+		rc = aft_pmi_err_to_aft_err(rc);
+		goto err6;
 	}
-
-	return 0;
-
+	AFT_PHASE_DONE(AFT_PHASE_BARRIER, phase_start);
+
+	return AFT_SUCCESS;
+
+err6:
+	aft_ep_finalize();
+	free(aft_peer_attrs);
+	aft_peer_attrs = NULL;
+err5:
+	aft_coll_finalize();
+	GNI_MemDeregister(aft_nic.nic, &my_smsg_attr.smsg_attr.mem_hndl);
+err4:
+	free(smsg_attr.msg_buffer);
 err3:
 	GNI_CqDestroy(aft_nic.rx_cq);
 err2:
 	GNI_CqDestroy(aft_nic.tx_cq);
 err1:
-	GNI_CdmDestroy(aft_nic.cdm);
+	GNI_CdmDestroy(aft_nic.cdm_hndl);
+	return rc;
+}
+
+/*
+ * __aft_nic_finalize releases what __aft_nic_init set up
+ */
+
+static void
+__aft_nic_finalize(void)
+{
+	aft_ep_finalize();
+	aft_coll_finalize();
+	aft_msg_finalize();
+	free(aft_peer_attrs);
+	aft_peer_attrs = NULL;
+
+	GNI_MemDeregister(aft_nic.nic, &my_smsg_attr.smsg_attr.mem_hndl);
+	free(my_smsg_attr.smsg_attr.msg_buffer);
+
+	GNI_CqDestroy(aft_nic.rx_cq);
+	GNI_CqDestroy(aft_nic.tx_cq);
+	GNI_CdmDestroy(aft_nic.cdm_hndl);
+
+	free(aft_rx_pending);
+	aft_rx_pending = NULL;
+	aft_rx_pending_size = 0;
+	aft_rx_pending_head = aft_rx_pending_tail = 0;
+}
+
+int aft_init(int cdm_modes)
+{
+	int first_spawned;
+	int rc, my_rank, nranks;
+	uint64_t init_start, phase_start;
+	unsigned long value;
+	char *p_ptr;
+
+	memset(&aft_init_timings, 0, sizeof(aft_init_timings));
+	init_start = phase_start = aft_get_nsec();
+
+	/*
+	 * AFT_TIMEOUT=seconds is how long a wait for a peer may make no
+	 * progress before it fails with AFT_ERR_TIMEOUT, 0 waits forever
+	 */
+
+	p_ptr = getenv("AFT_TIMEOUT");
+	if (p_ptr != NULL)
+		aft_timeout_nsec = strtoul(p_ptr, NULL, 0) * 1000000000UL;
+
+	/*
+	 * AFT_MBOX_MSG_MAXSIZE=bytes sizes the mailbox messages, which bounds
+	 * the eager messages of aft_send.  Every rank must set the same value,
+	 * the mailbox memory grows with it.
+	 */
+
+	p_ptr = getenv("AFT_MBOX_MSG_MAXSIZE");
+	if (p_ptr != NULL) {
+		value = strtoul(p_ptr, NULL, 0);
+		if (value < AFT_MBOX_MSG_MAXSIZE)
+			value = AFT_MBOX_MSG_MAXSIZE;
+		if (value > AFT_MBOX_MSG_MAXSIZE_MAX)
+			value = AFT_MBOX_MSG_MAXSIZE_MAX;
+		aft_mbox_msg_maxsize = (uint32_t) value;
+	}
+
+	/*
+	 * Fire up PMI
+	 */
+
+	rc = PMI_Init(&first_spawned);
+	if (rc != PMI_SUCCESS) {
+		AFT_WARN("PMI_Init returned %d\n", rc);
+		return aft_pmi_err_to_aft_err(rc);
+	}
+
+	rc = PMI_Get_size(&nranks);
+	if (rc != PMI_SUCCESS) {
+		AFT_WARN("PMI_Get_size returned %d\n", rc);
+		rc = aft_pmi_err_to_aft_err(rc);
+		goto err;
+	}
+
+	rc = PMI_Get_rank(&my_rank);
+	if (rc != PMI_SUCCESS) {
+		AFT_WARN("PMI_Get_rank returned %d\n", rc);
+		rc = aft_pmi_err_to_aft_err(rc);
+		goto err;
+	}
+
+	aft_my_rank = my_rank;
+	aft_nranks = nranks;
+	AFT_PHASE_DONE(AFT_PHASE_PMI_INIT, phase_start);
+
+	rc = __aft_nic_init(cdm_modes, phase_start);
+	if (rc != AFT_SUCCESS)
+		goto err;
+
+	aft_init_timings.total_nsec = aft_get_nsec() - init_start;
+	aft_pmi_up = 1;
+
+	return AFT_SUCCESS;
+
 err:
-	if (all_smsg_attrs != NULL)
-		free(all_smsg_attrs);
-	if (aft_ep_hndls != NULL)
-		free(aft_ep_hndls);
+	PMI_Finalize();
+	return rc;
+}
+
+/*
+ * aft_reinit tears down the CDM and everything built on it and creates
+ * them again with other CDM modes, PMI stays up.  All of the ranks must
+ * call it, and the caller's registrations and regions must be released
+ * first because the NIC handle they belong to goes away.  The init
+ * timings are those of the new CDM, without a PMI phase.  When the new
+ * CDM can not be set up the NIC is left released, and only aft_reinit
+ * and aft_finalize may be called until a later aft_reinit succeeds.
+ */
+
+int aft_reinit(int cdm_modes)
+{
+	int rc;
+	uint64_t init_start;
+
+	if (!aft_pmi_up)
+		return AFT_ERR_INVALID;
+
+	rc = PMI_Barrier();
+	if (rc != PMI_SUCCESS) {
+		AFT_WARN("PMI_Barrier returned %d\n", rc);
+		return aft_pmi_err_to_aft_err(rc);
+	}
+
+	if (aft_peer_attrs != NULL)
+		__aft_nic_finalize();
+
+	memset(&aft_init_timings, 0, sizeof(aft_init_timings));
+	init_start = aft_get_nsec();
+
+	rc = __aft_nic_init(cdm_modes, init_start);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	aft_init_timings.total_nsec = aft_get_nsec() - init_start;
+
+	return AFT_SUCCESS;
+}
+
+int aft_finalize(void)
+{
+	if (!aft_pmi_up)
+		return AFT_ERR_INVALID;
+
+	PMI_Barrier();
+
+	if (aft_peer_attrs != NULL)
+		__aft_nic_finalize();
 
 	PMI_Finalize();
-	return -1;
+	aft_pmi_up = 0;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_mem_register registers a buffer whose incoming transfers generate
+ * events on the RX CQ, and makes it the buffer that is exposed to peers
+ * by aft_get_peer_mdh_addr.
+ */
+
+int aft_mem_register(void *addr, size_t length, gni_mem_handle_t *mdh)
+{
+	gni_return_t status;
+
+	status = GNI_MemRegister(aft_nic.nic,
+				 (uint64_t) addr,
+				 length,
+				 aft_nic.rx_cq,
+				 GNI_MEM_READWRITE,
+				 -1,
+				 mdh);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_MemRegister returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	aft_local_mdh_addr.my_rank = aft_my_rank;
+	aft_local_mdh_addr.mdh = *mdh;
+	aft_local_mdh_addr.addr = (uint64_t) addr;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_wait_tx_cqe waits for the completion of the oldest local
+ * transaction.
+ */
+
+int aft_wait_tx_cqe(int peer_rank)
+{
+	gni_cq_entry_t cqe;
+	gni_return_t status;
+	aft_spin_t spin;
+
+	aft_spin_init(&spin);
+
+	do {
+		status = GNI_CqGetEvent(aft_nic.tx_cq, &cqe);
+		if ((status == GNI_RC_NOT_DONE) && aft_spin_expired(&spin)) {
+			AFT_WARN("no local completion with rank %d\n",
+				 peer_rank);
+			return AFT_ERR_TIMEOUT;
+		}
+	} while (status == GNI_RC_NOT_DONE);
+
+	if (status != GNI_RC_SUCCESS)
+		return aft_cqe_error(cqe, peer_rank);
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_wait_rx_cqe waits for the next remote event.  The events for the
+ * incoming mailbox messages are skipped, the messages themselves are
+ * picked up from the mailbox.  The events that aft_drain_rx_cq set
+ * aside come first.
+ */
+
+int aft_wait_rx_cqe(int peer_rank, gni_cq_entry_t *cqe)
+{
+	gni_return_t status;
+	aft_spin_t spin;
+
+	if (aft_rx_pending_head != aft_rx_pending_tail) {
+		*cqe = aft_rx_pending[aft_rx_pending_head++ &
+				      (aft_rx_pending_size - 1)];
+		return AFT_SUCCESS;
+	}
+
+	aft_spin_init(&spin);
+
+	for (;;) {
+		status = GNI_CqGetEvent(aft_nic.rx_cq, cqe);
+		if (status == GNI_RC_NOT_DONE) {
+			if (aft_spin_expired(&spin)) {
+				AFT_WARN("no remote event from rank %d\n",
+					 peer_rank);
+				return AFT_ERR_TIMEOUT;
+			}
+			continue;
+		}
+		if (status != GNI_RC_SUCCESS)
+			return aft_cqe_error(*cqe, peer_rank);
+		if (GNI_CQ_GET_TYPE(*cqe) != GNI_CQ_EVENT_TYPE_SMSG)
+			return AFT_SUCCESS;
+	}
+}
+
+/*
+ * aft_drain_rx_cq takes the queued events off the RX CQ so that the
+ * mailbox events can not overrun it.  The mailbox events are dropped,
+ * the messages are picked up from the mailboxes, and any other event,
+ * such as a CQ write or the remote event of a put, is set aside for
+ * aft_wait_rx_cqe.
+ */
+
+int aft_drain_rx_cq(int peer_rank)
+{
+	gni_cq_entry_t cqe, *pending;
+	gni_return_t status;
+	uint32_t i, size;
+
+	for (;;) {
+		status = GNI_CqGetEvent(aft_nic.rx_cq, &cqe);
+		if (status == GNI_RC_NOT_DONE)
+			return AFT_SUCCESS;
+		if (status != GNI_RC_SUCCESS)
+			return aft_cqe_error(cqe, peer_rank);
+		if (GNI_CQ_GET_TYPE(cqe) == GNI_CQ_EVENT_TYPE_SMSG)
+			continue;
+
+		if (aft_rx_pending_tail - aft_rx_pending_head ==
+		    aft_rx_pending_size) {
+			size = (aft_rx_pending_size == 0) ?
+				16 : 2 * aft_rx_pending_size;
+			pending = malloc(size * sizeof(gni_cq_entry_t));
+			if (pending == NULL)
+				return AFT_ERR_NOMEM;
+			for (i = 0; aft_rx_pending_head + i !=
+				    aft_rx_pending_tail; i++)
+				pending[i] = aft_rx_pending[
+					(aft_rx_pending_head + i) &
+					(aft_rx_pending_size - 1)];
+			free(aft_rx_pending);
+			aft_rx_pending = pending;
+			aft_rx_pending_size = size;
+			aft_rx_pending_tail = i;
+			aft_rx_pending_head = 0;
+		}
+
+		aft_rx_pending[aft_rx_pending_tail++ &
+			       (aft_rx_pending_size - 1)] = cqe;
+	}
+}
+
+/*
+ * aft_wait_smsg waits for the next message in the mailbox of a peer and
+ * then drains the RX CQ of the mailbox events.
+ */
+
+int aft_wait_smsg(int peer_rank, gni_ep_handle_t ep, void **msg)
+{
+	gni_return_t status;
+	aft_spin_t spin;
+
+	aft_spin_init(&spin);
+
+	do {
+		status = GNI_SmsgGetNext(ep, msg);
+		if ((status == GNI_RC_NOT_DONE) && aft_spin_expired(&spin)) {
+			AFT_WARN("no message from rank %d\n", peer_rank);
+			return AFT_ERR_TIMEOUT;
+		}
+	} while (status == GNI_RC_NOT_DONE);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_SmsgGetNext returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	return aft_drain_rx_cq(peer_rank);
+}
+
+/*
+ * aft_get_peer_mdh_addr exchanges the buffer registered by
+ * aft_mem_register with a peer through the mailboxes.  Both ranks
+ * must call it.
+ */
+
+int aft_get_peer_mdh_addr(int peer_rank, aft_mdh_addr_t *peer_mdh_addr)
+{
+	int rc;
+	gni_return_t status;
+	gni_ep_handle_t ep;
+	aft_mdh_addr_msg_t *msg;
+	aft_spin_t spin;
+
+	if ((peer_rank < 0) || (peer_rank >= aft_nranks) ||
+	    (peer_mdh_addr == NULL))
+		return AFT_ERR_INVALID;
+
+	rc = aft_get_ep(peer_rank, &ep);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	/*
+	 * the mailbox state can not be reset, so the endpoint stays
+	 */
+
+	aft_pin_ep(peer_rank);
+
+	aft_spin_init(&spin);
+	do {
+		status = GNI_SmsgSend(ep,
+				      &aft_local_mdh_addr,
+				      sizeof(aft_local_mdh_addr),
+				      NULL, 0, 0);
+		if ((status == GNI_RC_NOT_DONE) && aft_spin_expired(&spin)) {
+			AFT_WARN("no credit from rank %d\n", peer_rank);
+			return AFT_ERR_TIMEOUT;
+		}
+	} while (status == GNI_RC_NOT_DONE);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_SmsgSend returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	rc = aft_wait_tx_cqe(peer_rank);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	rc = aft_wait_smsg(peer_rank, ep, (void **) &msg);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	assert(msg->my_rank == peer_rank);
+	peer_mdh_addr->ep = ep;
+	peer_mdh_addr->mdh = msg->mdh;
+	peer_mdh_addr->addr = msg->addr;
+
+	GNI_SmsgRelease(ep);
 
+	return AFT_SUCCESS;
 }
@@ -6,6 +6,9 @@
  * This header file contains the common utility functions.
  */
 
+#ifndef AFT_INTERNAL_H
+#define AFT_INTERNAL_H
+
 #include <stdio.h>
 #include <stdint.h>
 #include <fcntl.h>
@@ -16,7 +19,23 @@
 #include <assert.h>
 #include <malloc.h>
 #include <sched.h>
+#include <stddef.h>
+#include <time.h>
 #include "gni_pub.h"
+#include "pmi.h"
+#include "aft.h"
+
+#define AFT_WARN(fmt, ...)						\
+	fprintf(stderr, "aft rank %d %s: " fmt, aft_my_rank,		\
+		__func__, ##__VA_ARGS__)
+
+#define AFT_MBOX_MAXCREDIT	16
+#define AFT_MBOX_MSG_MAXSIZE	512	/* bytes, AFT_MBOX_MSG_MAXSIZE raises */
+#define AFT_MBOX_MSG_MAXSIZE_MAX (64 * 1024)
+#define AFT_TX_CQ_ENTRIES	1024
+#define AFT_RX_CQ_ENTRIES	1024
+#define AFT_TIMEOUT_DEFAULT	60	/* seconds, AFT_TIMEOUT overrides */
+#define AFT_SPIN_CHECK		1024	/* polls between clock reads */
 
 /*
  * aft typedefs
@@ -29,25 +48,101 @@ typedef struct {
 } aft_smsg_w_addr_t;
 
 typedef struct {
-	gnic_nic_handle_t cdm_hndl;
+	gni_cdm_handle_t cdm_hndl;
 	gni_nic_handle_t nic;
 	gni_cq_handle_t  tx_cq;
 	gni_cq_handle_t  rx_cq;
 } aft_nic_t;
 
+/*
+ * the message used to exchange exposed memory with a peer
+ */
+
+typedef struct {
+	int my_rank;
+	gni_mem_handle_t mdh;
+	uint64_t addr;
+} aft_mdh_addr_msg_t;
+
 /*
  * globals
  */
 
 extern aft_nic_t aft_nic;
 extern aft_smsg_w_addr_t my_smsg_attr;
-extern gni_ep_handle_t *aft_ep_hndls;
+extern aft_smsg_w_addr_t *aft_peer_attrs;
+extern uint32_t aft_bytes_per_smsg;
+extern int aft_my_rank;
+extern int aft_nranks;
+extern aft_mdh_addr_msg_t aft_local_mdh_addr;
+extern uint64_t aft_timeout_nsec;
+extern uint32_t aft_mbox_msg_maxsize;
 
 /*
  * prototypes for aft internal functions
  */
 
 int aft_cqe_error(gni_cq_entry_t cqe, int peer_rank);
-int aft_init(void);
+int aft_gni_err_to_aft_err(gni_return_t status);
+int aft_pmi_err_to_aft_err(int rc);
+int aft_wait_tx_cqe(int peer_rank);
+int aft_wait_rx_cqe(int peer_rank, gni_cq_entry_t *cqe);
+int aft_wait_smsg(int peer_rank, gni_ep_handle_t ep, void **msg);
+int aft_drain_rx_cq(int peer_rank);
+int aft_ep_init(void);
+void aft_ep_finalize(void);
+int aft_get_ep(int rank, gni_ep_handle_t *ep);
+void aft_pin_ep(int rank);
+void aft_coll_finalize(void);
+void aft_msg_finalize(void);
+
+/*
+ * aft_get_nsec returns a monotonic time stamp in nanoseconds.
+ */
+
+static inline uint64_t
+aft_get_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*
+ * a spin wait gives up when it has made no progress for aft_timeout_nsec,
+ * so that a rank whose peer died does not poll forever.  The clock is
+ * read every AFT_SPIN_CHECK polls, the first read starts the timeout.
+ */
+
+typedef struct {
+	uint64_t deadline;
+	uint32_t polls;
+} aft_spin_t;
+
+static inline void
+aft_spin_init(aft_spin_t *spin)
+{
+	spin->deadline = 0;
+	spin->polls = 0;
+}
+
+static inline int
+aft_spin_expired(aft_spin_t *spin)
+{
+	uint64_t now;
+
+	if ((aft_timeout_nsec == 0) ||
+	    ((++spin->polls & (AFT_SPIN_CHECK - 1)) != 0))
+		return 0;
+
+	now = aft_get_nsec();
+	if (spin->deadline == 0) {
+		spin->deadline = now + aft_timeout_nsec;
+		return 0;
+	}
 
+	return now > spin->deadline;
+}
 
+#endif /* AFT_INTERNAL_H */
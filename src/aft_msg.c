@@ -0,0 +1,783 @@
+
+#include "aft_internal.h"
+
+/*
+ * Point to point messages.
+ *
+ * aft_send and aft_recv move a buffer between a pair of ranks over the
+ * mailboxes that aft_init sets up, in one of two ways:
+ *
+ *   eager       a message of up to the eager limit goes in one SMSG
+ *               message, a short header followed by the data
+ *   rendezvous  a larger message is announced with an RTS message that
+ *               carries the memory handle and address of the sender's
+ *               buffer, the receiver pulls the data with an RDMA get and
+ *               answers with a FIN message, after which the sender's
+ *               buffer may be reused
+ *
+ * Both calls block.  The messages between a pair are received in the
+ * order they were sent, there are no tags.  A send above the eager limit
+ * waits for the peer to receive it, so two ranks must not both start
+ * with one.  The rendezvous registers the buffers on every message,
+ * unless they lie in a buffer the caller registered with
+ * aft_msg_register_buffer, whose registration is kept until
+ * aft_msg_deregister_buffer.  There is no registration cache beyond that,
+ * the caller says which buffers it reuses.
+ *
+ * The eager limit can not be above aft_msg_eager_max(), which is what
+ * fits in a mailbox message, AFT_MBOX_MSG_MAXSIZE in the environment
+ * makes the mailbox messages larger.  The limit is AFT_EAGER_LIMIT from
+ * the environment, or aft_msg_eager_max(), until aft_set_eager_limit or
+ * aft_msg_calibrate changes it.
+ *
+ * A sender waiting for its FIN may find other messages from the peer in
+ * the mailbox first, those are copied aside and handed to aft_recv
+ * before anything newer.
+ */
+
+#define AFT_MSG_EAGER		1
+#define AFT_MSG_RTS		2
+#define AFT_MSG_FIN		3
+
+#define AFT_MSG_ALIGN		64
+#define AFT_MSG_CALIBRATE_ITERS	100
+#define AFT_MSG_CALIBRATE_REPS	3
+#define AFT_MSG_BUFFERS		16
+
+typedef struct {
+	uint32_t type;
+	uint32_t length;	/* eager data bytes */
+} aft_msg_hdr_t;
+
+typedef struct {
+	aft_msg_hdr_t hdr;
+	uint32_t skew;		/* bytes from addr to the data */
+	uint32_t pad;
+	uint64_t length;
+	uint64_t addr;		/* 4 byte aligned */
+	gni_mem_handle_t mdh;
+} aft_msg_rts_t;
+
+/*
+ * a message copied out of the mailbox while waiting for a FIN
+ */
+
+typedef struct aft_msg_stash {
+	struct aft_msg_stash *next;
+	uint32_t length;
+	char msg[];
+} aft_msg_stash_t;
+
+/*
+ * a buffer registered by aft_msg_register_buffer, rounded out to 4 bytes
+ * as a rendezvous needs it
+ */
+
+typedef struct {
+	uint64_t base;
+	size_t span;
+	gni_mem_handle_t mdh;
+	int used;
+} aft_msg_buffer_t;
+
+static aft_msg_stash_t **aft_msg_stash_heads;
+static aft_msg_stash_t **aft_msg_stash_tails;
+static aft_msg_buffer_t aft_msg_buffers[AFT_MSG_BUFFERS];
+static size_t aft_msg_eager_limit;
+static int aft_msg_limit_set;
+
+static inline size_t
+aft_msg_eager_max(void)
+{
+	return aft_mbox_msg_maxsize - sizeof(aft_msg_hdr_t);
+}
+
+static inline size_t
+aft_msg_round4(size_t n)
+{
+	return (n + 3) & ~((size_t) 3);
+}
+
+static void
+aft_msg_default_limit(void)
+{
+	char *p_ptr;
+
+	if (aft_msg_limit_set)
+		return;
+
+	aft_msg_eager_limit = aft_msg_eager_max();
+	p_ptr = getenv("AFT_EAGER_LIMIT");
+	if (p_ptr != NULL) {
+		aft_msg_eager_limit = strtoul(p_ptr, NULL, 0);
+		if (aft_msg_eager_limit > aft_msg_eager_max())
+			aft_msg_eager_limit = aft_msg_eager_max();
+	}
+	aft_msg_limit_set = 1;
+}
+
+/*
+ * look up and pin the endpoint to a peer, its mailbox is about to carry
+ * messages
+ */
+
+static int
+aft_msg_ep(int peer_rank, gni_ep_handle_t *ep)
+{
+	int rc;
+
+	if ((peer_rank < 0) || (peer_rank >= aft_nranks) ||
+	    (peer_rank == aft_my_rank))
+		return AFT_ERR_INVALID;
+
+	rc = aft_get_ep(peer_rank, ep);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	aft_pin_ep(peer_rank);
+	aft_msg_default_limit();
+
+	return AFT_SUCCESS;
+}
+
+static int
+aft_msg_send_smsg(int peer_rank, gni_ep_handle_t ep, void *header,
+		  uint32_t header_length, const void *data,
+		  uint32_t data_length)
+{
+	gni_return_t status;
+	aft_spin_t spin;
+
+	/*
+	 * NOT_DONE means no credits, the peer returns them as it
+	 * releases its mailbox
+	 */
+
+	aft_spin_init(&spin);
+	do {
+		status = GNI_SmsgSend(ep, header, header_length,
+				      (void *) data, data_length, 0);
+		if ((status == GNI_RC_NOT_DONE) && aft_spin_expired(&spin)) {
+			AFT_WARN("no credit from rank %d\n", peer_rank);
+			return AFT_ERR_TIMEOUT;
+		}
+	} while (status == GNI_RC_NOT_DONE);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_SmsgSend returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	return aft_wait_tx_cqe(peer_rank);
+}
+
+static int
+aft_msg_stash(int peer_rank, const void *msg)
+{
+	const aft_msg_hdr_t *hdr = msg;
+	aft_msg_stash_t *entry;
+	uint32_t length;
+
+	if (aft_msg_stash_heads == NULL) {
+		aft_msg_stash_heads = calloc(aft_nranks,
+					     sizeof(aft_msg_stash_t *));
+		aft_msg_stash_tails = calloc(aft_nranks,
+					     sizeof(aft_msg_stash_t *));
+		if ((aft_msg_stash_heads == NULL) ||
+		    (aft_msg_stash_tails == NULL)) {
+			free(aft_msg_stash_heads);
+			free(aft_msg_stash_tails);
+			aft_msg_stash_heads = aft_msg_stash_tails = NULL;
+			return AFT_ERR_NOMEM;
+		}
+	}
+
+	if (hdr->type == AFT_MSG_EAGER)
+		length = sizeof(*hdr) + hdr->length;
+	else
+		length = sizeof(aft_msg_rts_t);
+
+	entry = malloc(sizeof(*entry) + length);
+	if (entry == NULL)
+		return AFT_ERR_NOMEM;
+
+	entry->next = NULL;
+	entry->length = length;
+	memcpy(entry->msg, msg, length);
+
+	if (aft_msg_stash_tails[peer_rank] == NULL)
+		aft_msg_stash_heads[peer_rank] = entry;
+	else
+		aft_msg_stash_tails[peer_rank]->next = entry;
+	aft_msg_stash_tails[peer_rank] = entry;
+
+	return AFT_SUCCESS;
+}
+
+static aft_msg_stash_t *
+aft_msg_unstash(int peer_rank)
+{
+	aft_msg_stash_t *entry;
+
+	if ((aft_msg_stash_heads == NULL) ||
+	    (aft_msg_stash_heads[peer_rank] == NULL))
+		return NULL;
+
+	entry = aft_msg_stash_heads[peer_rank];
+	aft_msg_stash_heads[peer_rank] = entry->next;
+	if (entry->next == NULL)
+		aft_msg_stash_tails[peer_rank] = NULL;
+
+	return entry;
+}
+
+static int
+aft_msg_register(void *addr, size_t length, gni_mem_handle_t *mdh)
+{
+	gni_return_t status;
+
+	status = GNI_MemRegister(aft_nic.nic, (uint64_t) addr, length, NULL,
+				 GNI_MEM_READWRITE, -1, mdh);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_MemRegister returned %s\n",
+			gni_err_str[status]);
+		return aft_gni_err_to_aft_err(status);
+	}
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * find a registered buffer that covers span bytes from base, a
+ * rendezvous on it needs no registration of its own
+ */
+
+static int
+aft_msg_lookup(uint64_t base, size_t span, gni_mem_handle_t *mdh)
+{
+	aft_msg_buffer_t *buffer;
+	int i;
+
+	for (i = 0; i < AFT_MSG_BUFFERS; i++) {
+		buffer = &aft_msg_buffers[i];
+		if (buffer->used && (base >= buffer->base) &&
+		    (base + span <= buffer->base + buffer->span)) {
+			*mdh = buffer->mdh;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * aft_msg_register_buffer registers length bytes at addr for the
+ * rendezvous of aft_send and aft_recv, which then skip their own
+ * registration for any message that lies inside it.  The registration is
+ * kept until aft_msg_deregister_buffer, or the NIC is released.
+ *
+ *   Returns: AFT_ERR_NOMEM if AFT_MSG_BUFFERS buffers are registered.
+ */
+
+int aft_msg_register_buffer(void *addr, size_t length)
+{
+	aft_msg_buffer_t *buffer = NULL;
+	uint64_t base;
+	int i, rc;
+
+	if ((addr == NULL) || (length == 0))
+		return AFT_ERR_INVALID;
+
+	for (i = 0; i < AFT_MSG_BUFFERS; i++) {
+		if (!aft_msg_buffers[i].used) {
+			buffer = &aft_msg_buffers[i];
+			break;
+		}
+	}
+	if (buffer == NULL)
+		return AFT_ERR_NOMEM;
+
+	base = (uint64_t) addr & ~(uint64_t) 3;
+	buffer->base = base;
+	buffer->span = aft_msg_round4((uint64_t) addr - base + length);
+
+	rc = aft_msg_register((void *) base, buffer->span, &buffer->mdh);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	buffer->used = 1;
+
+	return AFT_SUCCESS;
+}
+
+int aft_msg_deregister_buffer(void *addr)
+{
+	aft_msg_buffer_t *buffer;
+	uint64_t base;
+	int i;
+
+	base = (uint64_t) addr & ~(uint64_t) 3;
+
+	for (i = 0; i < AFT_MSG_BUFFERS; i++) {
+		buffer = &aft_msg_buffers[i];
+		if (buffer->used && (buffer->base == base)) {
+			GNI_MemDeregister(aft_nic.nic, &buffer->mdh);
+			buffer->used = 0;
+			return AFT_SUCCESS;
+		}
+	}
+
+	return AFT_ERR_INVALID;
+}
+
+/*
+ * the sender's side of a rendezvous.  The registration covers the
+ * buffer rounded out to 4 bytes, because the get has to be 4 byte
+ * aligned, the extra bytes are in the same pages.
+ */
+
+static int
+aft_msg_send_rndv(int peer_rank, gni_ep_handle_t ep, const void *buf,
+		  size_t len)
+{
+	aft_msg_rts_t rts;
+	aft_msg_hdr_t *hdr;
+	uint64_t base;
+	size_t span;
+	int registered = 0;
+	void *msg;
+	int rc;
+
+	base = (uint64_t) buf & ~(uint64_t) 3;
+
+	memset(&rts, 0, sizeof(rts));
+	rts.hdr.type = AFT_MSG_RTS;
+	rts.skew = (uint64_t) buf - base;
+	rts.length = len;
+	rts.addr = base;
+
+	span = aft_msg_round4(rts.skew + len);
+	if (!aft_msg_lookup(base, span, &rts.mdh)) {
+		rc = aft_msg_register((void *) base, span, &rts.mdh);
+		if (rc != AFT_SUCCESS)
+			return rc;
+		registered = 1;
+	}
+
+	rc = aft_msg_send_smsg(peer_rank, ep, &rts, sizeof(rts), NULL, 0);
+	if (rc != AFT_SUCCESS)
+		goto out;
+
+	for (;;) {
+		rc = aft_wait_smsg(peer_rank, ep, &msg);
+		if (rc != AFT_SUCCESS)
+			goto out;
+
+		hdr = msg;
+		if (hdr->type == AFT_MSG_FIN) {
+			GNI_SmsgRelease(ep);
+			break;
+		}
+
+		rc = aft_msg_stash(peer_rank, msg);
+		GNI_SmsgRelease(ep);
+		if (rc != AFT_SUCCESS)
+			goto out;
+	}
+
+out:
+	if (registered)
+		GNI_MemDeregister(aft_nic.nic, &rts.mdh);
+	return rc;
+}
+
+/*
+ * the receiver's side of a rendezvous, the data goes straight into buf
+ * when buf, the sender's buffer and the length are all 4 byte aligned,
+ * and through a bounce buffer otherwise
+ */
+
+static int
+aft_msg_recv_rndv(int peer_rank, gni_ep_handle_t ep,
+		  const aft_msg_rts_t *rts, void *buf, size_t len)
+{
+	gni_post_descriptor_t get_desc;
+	gni_post_descriptor_t *desc;
+	gni_mem_handle_t mdh;
+	gni_cq_entry_t cqe;
+	gni_return_t status;
+	aft_spin_t spin;
+	aft_msg_hdr_t fin;
+	char *bounce = NULL;
+	char *local = buf;
+	size_t span;
+	int registered = 0;
+	int rc, fin_rc;
+
+	span = aft_msg_round4(rts->skew + len);
+
+	if (len == 0) {
+		rc = AFT_SUCCESS;
+		goto fin;
+	}
+
+	if ((rts->skew != 0) || (((uint64_t) buf & 3) != 0) ||
+	    ((len & 3) != 0)) {
+		if (posix_memalign((void **) &bounce, AFT_MSG_ALIGN,
+				   span) != 0) {
+			rc = AFT_ERR_NOMEM;
+			goto fin;
+		}
+		local = bounce;
+	} else {
+		span = len;
+	}
+
+	if ((bounce != NULL) ||
+	    !aft_msg_lookup((uint64_t) local, span, &mdh)) {
+		rc = aft_msg_register(local, span, &mdh);
+		if (rc != AFT_SUCCESS)
+			goto fin;
+		registered = 1;
+	}
+
+	memset(&get_desc, 0, sizeof(get_desc));
+	get_desc.type = GNI_POST_RDMA_GET;
+	get_desc.cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+	get_desc.dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+	get_desc.local_addr = (uint64_t) local;
+	get_desc.local_mem_hndl = mdh;
+	get_desc.remote_addr = rts->addr;
+	get_desc.remote_mem_hndl = rts->mdh;
+	get_desc.length = span;
+	get_desc.src_cq_hndl = aft_nic.tx_cq;
+	get_desc.post_id = (uint64_t) &get_desc;
+
+	status = GNI_PostRdma(ep, &get_desc);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_PostRdma returned %s\n",
+			gni_err_str[status]);
+		rc = aft_gni_err_to_aft_err(status);
+		goto dereg;
+	}
+
+	aft_spin_init(&spin);
+	do {
+		status = GNI_CqGetEvent(aft_nic.tx_cq, &cqe);
+		if ((status == GNI_RC_NOT_DONE) && aft_spin_expired(&spin)) {
+			AFT_WARN("no get completion from rank %d\n",
+				 peer_rank);
+			rc = AFT_ERR_TIMEOUT;
+			goto dereg;
+		}
+	} while (status == GNI_RC_NOT_DONE);
+	if (status != GNI_RC_SUCCESS) {
+		rc = aft_cqe_error(cqe, peer_rank);
+		goto dereg;
+	}
+
+	status = GNI_GetCompleted(aft_nic.tx_cq, cqe, &desc);
+	if (status != GNI_RC_SUCCESS) {
+		AFT_WARN("GNI_GetCompleted returned %s\n",
+			gni_err_str[status]);
+		rc = aft_gni_err_to_aft_err(status);
+		goto dereg;
+	}
+
+	if (bounce != NULL)
+		memcpy(buf, bounce + rts->skew, len);
+
+dereg:
+	if (registered)
+		GNI_MemDeregister(aft_nic.nic, &mdh);
+
+	/*
+	 * the sender is waiting whatever happened here
+	 */
+
+fin:
+	free(bounce);
+
+	memset(&fin, 0, sizeof(fin));
+	fin.type = AFT_MSG_FIN;
+	fin_rc = aft_msg_send_smsg(peer_rank, ep, &fin, sizeof(fin), NULL, 0);
+
+	return (rc != AFT_SUCCESS) ? rc : fin_rc;
+}
+
+/*
+ * aft_send sends len bytes of buf to a peer, eagerly up to the eager
+ * limit and by rendezvous above it.  buf may be reused on return.
+ */
+
+int aft_send(int peer_rank, const void *buf, size_t len)
+{
+	gni_ep_handle_t ep;
+	aft_msg_hdr_t hdr;
+	int rc;
+
+	if ((buf == NULL) && (len != 0))
+		return AFT_ERR_INVALID;
+
+	rc = aft_msg_ep(peer_rank, &ep);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	if (len > aft_msg_eager_limit)
+		return aft_msg_send_rndv(peer_rank, ep, buf, len);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.type = AFT_MSG_EAGER;
+	hdr.length = len;
+
+	return aft_msg_send_smsg(peer_rank, ep, &hdr, sizeof(hdr), buf, len);
+}
+
+/*
+ * aft_recv receives the next message from a peer into buf, which holds
+ * len bytes.  The length of the message is returned in received.
+ *
+ *   Returns: AFT_ERR_TRUNCATE if the message was longer than len, the
+ *   first len bytes are received.
+ */
+
+int aft_recv(int peer_rank, void *buf, size_t len, size_t *received)
+{
+	aft_msg_stash_t *entry;
+	aft_msg_rts_t rts;
+	aft_msg_hdr_t *hdr;
+	gni_ep_handle_t ep;
+	size_t length;
+	void *msg;
+	int rndv = 0;
+	int rc;
+
+	if ((buf == NULL) && (len != 0))
+		return AFT_ERR_INVALID;
+
+	rc = aft_msg_ep(peer_rank, &ep);
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	entry = aft_msg_unstash(peer_rank);
+	if (entry != NULL) {
+		msg = entry->msg;
+	} else {
+		rc = aft_wait_smsg(peer_rank, ep, &msg);
+		if (rc != AFT_SUCCESS)
+			return rc;
+	}
+
+	/*
+	 * copy out what is needed and give the mailbox slot back before
+	 * a rendezvous get
+	 */
+
+	hdr = msg;
+	if (hdr->type == AFT_MSG_EAGER) {
+		length = hdr->length;
+		memcpy(buf, hdr + 1, (length < len) ? length : len);
+	} else if (hdr->type == AFT_MSG_RTS) {
+		memcpy(&rts, msg, sizeof(rts));
+		length = rts.length;
+		rndv = 1;
+	} else {
+		AFT_WARN("unexpected message type %u from rank %d\n",
+			 hdr->type, peer_rank);
+		length = 0;
+		rc = AFT_ERR_TRANSACTION;
+	}
+
+	if (entry != NULL)
+		free(entry);
+	else
+		GNI_SmsgRelease(ep);
+
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	if (rndv)
+		rc = aft_msg_recv_rndv(peer_rank, ep, &rts, buf,
+				       (length < len) ? length : len);
+
+	if (received != NULL)
+		*received = length;
+
+	if ((rc == AFT_SUCCESS) && (length > len))
+		rc = AFT_ERR_TRUNCATE;
+
+	return rc;
+}
+
+size_t aft_get_eager_limit(void)
+{
+	aft_msg_default_limit();
+
+	return aft_msg_eager_limit;
+}
+
+int aft_set_eager_limit(size_t limit)
+{
+	if (limit > aft_msg_eager_max())
+		return AFT_ERR_INVALID;
+
+	aft_msg_eager_limit = limit;
+	aft_msg_limit_set = 1;
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * time a ping-pong of tlen bytes with the current eager limit, the
+ * lower rank sends first.  The shortest of a few runs is taken, to keep
+ * a stray interruption from deciding the limit.
+ */
+
+static int
+aft_msg_calibrate_ping(int peer_rank, char *buf, size_t tlen,
+		       uint64_t *nsec)
+{
+	uint64_t start_time, elapsed;
+	int i, pass, rep, rc;
+
+	*nsec = UINT64_MAX;
+
+	for (rep = 0; rep < AFT_MSG_CALIBRATE_REPS; rep++) {
+		start_time = aft_get_nsec();
+
+		for (i = 0; i < AFT_MSG_CALIBRATE_ITERS; i++) {
+			for (pass = 0; pass < 2; pass++) {
+				if ((pass == 0) == (aft_my_rank < peer_rank))
+					rc = aft_send(peer_rank, buf, tlen);
+				else
+					rc = aft_recv(peer_rank, buf, tlen,
+						      NULL);
+				if (rc != AFT_SUCCESS)
+					return rc;
+			}
+		}
+
+		elapsed = aft_get_nsec() - start_time;
+		if (elapsed < *nsec)
+			*nsec = elapsed;
+	}
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * aft_msg_calibrate picks the eager limit for the pair from ping-pongs
+ * with each protocol, at powers of two up to aft_msg_eager_max().  The
+ * limit is the largest size up to which eager is never slower, the
+ * lower rank decides and sends the limit to the other.  Both ranks of
+ * the pair must call it, and both are left with the limit, which is
+ * also returned in limit.
+ *
+ * The buffer is registered once with aft_msg_register_buffer, so the
+ * rendezvous is timed as the get and its messages, the way it runs for a
+ * caller that registers its buffers, and not as a registration per
+ * message.  The sweep only reaches sizes that fit a mailbox message, so
+ * AFT_MBOX_MSG_MAXSIZE has to be raised for the crossover to show up
+ * above a few hundred bytes.
+ */
+
+int aft_msg_calibrate(int peer_rank, size_t *limit)
+{
+	uint64_t eager_nsec, rndv_nsec, chosen;
+	size_t tlen, max, found = 0, previous;
+	int stop = 0;
+	char *buf;
+	int rc;
+
+	if ((peer_rank < 0) || (peer_rank >= aft_nranks) ||
+	    (peer_rank == aft_my_rank))
+		return AFT_ERR_INVALID;
+
+	max = aft_msg_eager_max();
+
+	rc = posix_memalign((void **) &buf, AFT_MSG_ALIGN, max);
+	if (rc != 0)
+		return AFT_ERR_NOMEM;
+	memset(buf, 0, max);
+
+	rc = aft_msg_register_buffer(buf, max);
+	if (rc != AFT_SUCCESS) {
+		free(buf);
+		return rc;
+	}
+
+	previous = aft_get_eager_limit();
+
+	for (tlen = 8; ; tlen *= 2) {
+		if (tlen > max)
+			tlen = max;
+
+		aft_set_eager_limit(max);
+		rc = aft_msg_calibrate_ping(peer_rank, buf, tlen,
+					    &eager_nsec);
+		if (rc != AFT_SUCCESS)
+			goto out;
+
+		aft_set_eager_limit(0);
+		rc = aft_msg_calibrate_ping(peer_rank, buf, tlen, &rndv_nsec);
+		if (rc != AFT_SUCCESS)
+			goto out;
+
+		if (eager_nsec > rndv_nsec)
+			stop = 1;
+		if (!stop)
+			found = tlen;
+
+		/*
+		 * both ranks run every size, so the ping-pongs stay
+		 * matched whatever each of them measured
+		 */
+
+		if (tlen == max)
+			break;
+	}
+
+	chosen = found;
+	aft_set_eager_limit(max);
+	if (aft_my_rank < peer_rank)
+		rc = aft_send(peer_rank, &chosen, sizeof(chosen));
+	else
+		rc = aft_recv(peer_rank, &chosen, sizeof(chosen), NULL);
+	if (rc != AFT_SUCCESS)
+		goto out;
+
+	previous = chosen;
+	if (limit != NULL)
+		*limit = chosen;
+
+out:
+	aft_set_eager_limit(previous);
+	aft_msg_deregister_buffer(buf);
+	free(buf);
+	return rc;
+}
+
+void aft_msg_finalize(void)
+{
+	aft_msg_stash_t *entry;
+	int i;
+
+	if (aft_msg_stash_heads != NULL) {
+		for (i = 0; i < aft_nranks; i++)
+			while ((entry = aft_msg_unstash(i)) != NULL)
+				free(entry);
+	}
+
+	free(aft_msg_stash_heads);
+	free(aft_msg_stash_tails);
+	aft_msg_stash_heads = aft_msg_stash_tails = NULL;
+	aft_msg_limit_set = 0;
+
+	for (i = 0; i < AFT_MSG_BUFFERS; i++) {
+		if (aft_msg_buffers[i].used) {
+			GNI_MemDeregister(aft_nic.nic,
+					  &aft_msg_buffers[i].mdh);
+			aft_msg_buffers[i].used = 0;
+		}
+	}
+}
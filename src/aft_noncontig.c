@@ -0,0 +1,364 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * aft noncontig driver - compares three ways of sending a message that is
+ * scattered over segments of the sender's memory, for a range of segment
+ * counts and sizes:
+ *
+ *   seg   register the segments with GNI_MemRegisterSegments and send
+ *         them with one RDMA put, only for segments of whole pages
+ *   fma   register the span of the segments and send each segment with
+ *         its own FMA put
+ *   pack  pack the segments into a registered bounce buffer and send it
+ *         with one RDMA put
+ *
+ * seg and fma register and deregister for every message, as a library
+ * does with a buffer that it has not seen before.  The seg+reg and
+ * fma+reg columns include that cost, the seg and fma columns leave it
+ * out and are what a registration cache would give.  The last two
+ * columns name the fastest method with and without the registration.
+ * Times are in usec per message, the average over the ranks, each even
+ * rank sending to the next odd rank while that rank sends back.
+ *
+ * The layouts are:
+ *
+ *   vector   segments of seg_len bytes every 2 * seg_len bytes
+ *   indexed  the same segments in a shuffled order
+ *
+ * Usage: aft_noncontig [-n iterations] [-c count,...] [-s seg_len,...]
+ *                      [-L layout,...]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aft.h"
+
+#define NONCONTIG_PAGE		4096
+#define NONCONTIG_MAX_LIST	16
+
+typedef enum {
+	LAYOUT_VECTOR = 0,
+	LAYOUT_INDEXED,
+	LAYOUT_COUNT
+} noncontig_layout_t;
+
+static const char *layout_names[LAYOUT_COUNT] = { "vector", "indexed" };
+static const char *method_names[AFT_GATHER_COUNT] = { "seg", "fma", "pack" };
+
+/*
+ * one rank's result for a case, usec[m][0] includes the registration and
+ * usec[m][1] does not.  ran[m] is 0 when the method does not apply to
+ * the case.
+ */
+
+typedef struct {
+	double usec[AFT_GATHER_COUNT][2];
+	int ran[AFT_GATHER_COUNT];
+	int rc;
+} noncontig_result_t;
+
+static void
+usage(char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-n iterations] [-c count,...] [-s seg_len,...]\n"
+		"       [-L vector,indexed]\n", name);
+}
+
+static int
+parse_list(char *arg, size_t *list, int *count)
+{
+	char *token;
+
+	*count = 0;
+	for (token = strtok(arg, ","); token != NULL;
+	     token = strtok(NULL, ",")) {
+		if (*count == NONCONTIG_MAX_LIST)
+			return 1;
+		list[*count] = strtoul(token, NULL, 0);
+		if (list[*count] == 0)
+			return 1;
+		(*count)++;
+	}
+
+	return (*count == 0);
+}
+
+/*
+ * build the offsets of a layout, the shuffle is seeded the same way on
+ * every rank
+ */
+
+static void
+build_offsets(noncontig_layout_t layout, size_t *offsets, int nsegs,
+	      size_t seg_len)
+{
+	unsigned int seed = 12345;
+	size_t tmp;
+	int j, k;
+
+	for (k = 0; k < nsegs; k++)
+		offsets[k] = k * 2 * seg_len;
+
+	if (layout != LAYOUT_INDEXED)
+		return;
+
+	for (k = nsegs - 1; k > 0; k--) {
+		j = rand_r(&seed) % (k + 1);
+		tmp = offsets[k];
+		offsets[k] = offsets[j];
+		offsets[j] = tmp;
+	}
+}
+
+/*
+ * run every method for one case, all of the ranks take part so that
+ * rank 0 can report
+ */
+
+static int
+run_case(aft_region_t *region, int paired, noncontig_layout_t layout,
+	 int nsegs, size_t seg_len, int niters, noncontig_result_t *all,
+	 int nranks, int my_rank)
+{
+	noncontig_result_t mine;
+	uint64_t elapsed, reg;
+	double avg[AFT_GATHER_COUNT][2];
+	size_t j, *offsets = NULL;
+	char *source = NULL;
+	int best[2], i, m, n, r, rc;
+
+	memset(&mine, 0, sizeof(mine));
+
+	if (paired) {
+		offsets = malloc(nsegs * sizeof(size_t));
+		if ((offsets == NULL) ||
+		    (posix_memalign((void **) &source, NONCONTIG_PAGE,
+				    2 * nsegs * seg_len) != 0)) {
+			fprintf(stderr, "Rank: %4i allocation failed\n",
+				my_rank);
+			source = NULL;
+			mine.rc = AFT_ERR_NOMEM;
+			paired = 0;
+		} else {
+			for (j = 0; j < 2 * nsegs * seg_len; j++)
+				source[j] = (char) (j + my_rank);
+			build_offsets(layout, offsets, nsegs, seg_len);
+		}
+	}
+
+	for (m = 0; m < AFT_GATHER_COUNT; m++) {
+		aft_barrier();
+
+		if (!paired)
+			continue;
+
+		rc = aft_gather_put(region, m, source, offsets, nsegs,
+				    seg_len, niters, &elapsed, &reg);
+		if (rc == AFT_ERR_INVALID)
+			continue;
+
+		if (rc != AFT_SUCCESS) {
+			fprintf(stderr,
+				"Rank: %4i %s %s %d x %zu returned %d\n",
+				my_rank, layout_names[layout],
+				method_names[m], nsegs, seg_len, rc);
+			mine.rc = rc;
+			continue;
+		}
+
+		mine.usec[m][0] = elapsed / 1000.0 / niters;
+		mine.usec[m][1] = (elapsed - reg) / 1000.0 / niters;
+		mine.ran[m] = 1;
+	}
+
+	free(source);
+	free(offsets);
+
+	rc = aft_allgather(&mine, all, sizeof(mine));
+	if (rc != AFT_SUCCESS) {
+		fprintf(stderr, "Rank: %4i aft_allgather returned %d\n",
+			my_rank, rc);
+		return 1;
+	}
+
+	if (my_rank != 0)
+		return (mine.rc != AFT_SUCCESS);
+
+	best[0] = best[1] = -1;
+	for (m = 0; m < AFT_GATHER_COUNT; m++) {
+		avg[m][0] = avg[m][1] = 0.0;
+		for (r = n = 0; r < nranks; r++) {
+			if (!all[r].ran[m])
+				continue;
+			avg[m][0] += all[r].usec[m][0];
+			avg[m][1] += all[r].usec[m][1];
+			n++;
+		}
+		if (n == 0) {
+			avg[m][0] = avg[m][1] = -1.0;
+			continue;
+		}
+		avg[m][0] /= n;
+		avg[m][1] /= n;
+
+		for (i = 0; i < 2; i++)
+			if ((best[i] < 0) || (avg[m][i] < avg[best[i]][i]))
+				best[i] = m;
+	}
+
+	fprintf(stdout, "%-8s %6d %8zu %10zu", layout_names[layout], nsegs,
+		seg_len, nsegs * seg_len);
+
+	/*
+	 * pack has no registration, it is printed once
+	 */
+
+	for (m = 0; m < AFT_GATHER_COUNT; m++) {
+		for (i = 0; i < ((m == AFT_GATHER_PACK) ? 1 : 2); i++) {
+			if (avg[m][i] < 0.0)
+				fprintf(stdout, " %9s", "-");
+			else
+				fprintf(stdout, " %9.2f", avg[m][i]);
+		}
+	}
+
+	fprintf(stdout, " %-5s %-5s\n",
+		(best[0] < 0) ? "-" : method_names[best[0]],
+		(best[1] < 0) ? "-" : method_names[best[1]]);
+
+	for (r = 0; r < nranks; r++)
+		if (all[r].rc != AFT_SUCCESS)
+			return 1;
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t counts[NONCONTIG_MAX_LIST] = { 1, 8, 64, 512 };
+	size_t sizes[NONCONTIG_MAX_LIST] = { 8, 64, 512, 4096, 16384 };
+	int layouts[LAYOUT_COUNT] = { LAYOUT_VECTOR, LAYOUT_INDEXED };
+	int ncounts = 4, nsizes = 5, nlayouts = LAYOUT_COUNT;
+	int c, l, s, opt, rc, my_rank, nranks, paired;
+	int niters = 100, failures = 0;
+	size_t half = 0;
+	noncontig_result_t *all;
+	aft_region_t region;
+	char *token;
+
+	while ((opt = getopt(argc, argv, "n:c:s:L:")) != -1) {
+		switch (opt) {
+		case 'n':
+			niters = atoi(optarg);
+			break;
+		case 'c':
+			if (parse_list(optarg, counts, &ncounts) != 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 's':
+			if (parse_list(optarg, sizes, &nsizes) != 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'L':
+			nlayouts = 0;
+			for (token = strtok(optarg, ","); token != NULL;
+			     token = strtok(NULL, ",")) {
+				for (l = 0; l < LAYOUT_COUNT; l++)
+					if (strcmp(token, layout_names[l]) == 0)
+						break;
+				if ((l == LAYOUT_COUNT) ||
+				    (nlayouts == LAYOUT_COUNT)) {
+					fprintf(stderr, "unknown layout %s\n",
+						token);
+					usage(argv[0]);
+					return 1;
+				}
+				layouts[nlayouts++] = l;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (niters <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/*
+	 * the first half of the region receives the messages, the second is
+	 * the bounce buffer of pack, both hold the largest message
+	 */
+
+	for (c = 0; c < ncounts; c++)
+		for (s = 0; s < nsizes; s++)
+			if (counts[c] * sizes[s] > half)
+				half = counts[c] * sizes[s];
+	half = (half + NONCONTIG_PAGE - 1) & ~((size_t) NONCONTIG_PAGE - 1);
+
+	rc = aft_init(0);
+	if (rc != AFT_SUCCESS) {
+		fprintf(stderr, "aft_init returned %d\n", rc);
+		return 1;
+	}
+
+	my_rank = aft_get_rank();
+	nranks = aft_get_size();
+
+	all = malloc(nranks * sizeof(noncontig_result_t));
+	if (all == NULL) {
+		fprintf(stderr, "Rank: %4i malloc failed\n", my_rank);
+		aft_finalize();
+		return 1;
+	}
+
+	/*
+	 * an odd rank out has no partner, it only joins the reports
+	 */
+
+	memset(&region, 0, sizeof(region));
+	paired = ((my_rank ^ 1) < nranks);
+	if (paired) {
+		rc = aft_region_create(&region, my_rank ^ 1, 2 * half);
+		if (rc != AFT_SUCCESS) {
+			fprintf(stderr,
+				"Rank: %4i aft_region_create returned %d\n",
+				my_rank, rc);
+			paired = 0;
+			failures++;
+		}
+	}
+
+	if (my_rank == 0)
+		fprintf(stdout,
+			"%-8s %6s %8s %10s %9s %9s %9s %9s %9s %-5s %-5s\n",
+			"layout", "count", "seg_len", "total", "seg+reg",
+			"seg", "fma+reg", "fma", "pack", "best", "cached");
+
+	for (l = 0; l < nlayouts; l++)
+		for (c = 0; c < ncounts; c++)
+			for (s = 0; s < nsizes; s++)
+				failures += run_case(&region, paired,
+						     layouts[l], counts[c],
+						     sizes[s], niters, all,
+						     nranks, my_rank);
+
+	aft_region_destroy(&region);
+	free(all);
+	aft_finalize();
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * aft ping driver - pairs each even rank with the next odd rank and runs
+ * aft_ping between them, after reporting the time spent in each phase
+ * of the libaft wire-up and the endpoint table statistics.
+ *
+ * Usage: aft_ping [-l transfer_length] [-n iterations]
+ *
+ * Set AFT_EAGER_EPS=1 to compare the startup time and memory with
+ * creating every endpoint in aft_init.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "aft.h"
+
+int
+main(int argc, char **argv)
+{
+	int i, opt, rc, my_rank, nranks, peer_rank;
+	int niters = 1000;
+	size_t tlen = 8;
+	uint64_t elapsed_nsec = 0;
+	const aft_timings_t *timings;
+	const aft_ep_stats_t *ep_stats;
+
+	while ((opt = getopt(argc, argv, "l:n:")) != -1) {
+		switch (opt) {
+		case 'l':
+			tlen = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			niters = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-l transfer_length] [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	rc = aft_init(0);
+	if (rc != AFT_SUCCESS) {
+		fprintf(stderr, "aft_init returned %d\n", rc);
+		return 1;
+	}
+
+	my_rank = aft_get_rank();
+	nranks = aft_get_size();
+
+	timings = aft_get_init_timings();
+	for (i = 0; i < AFT_PHASE_COUNT; i++)
+		fprintf(stdout, "Rank: %4i aft_init %-14s %10.3f usec\n",
+			my_rank, aft_phase_name(i),
+			timings->phase_nsec[i] / 1000.0);
+	fprintf(stdout, "Rank: %4i aft_init %-14s %10.3f usec\n",
+		my_rank, "total", timings->total_nsec / 1000.0);
+
+	/*
+	 * an odd rank out has no partner
+	 */
+
+	peer_rank = my_rank ^ 1;
+	if (peer_rank < nranks) {
+		rc = aft_ping(niters, peer_rank, tlen,
+			      GNI_DLVMODE_PERFORMANCE, &elapsed_nsec);
+		if (rc != AFT_SUCCESS) {
+			fprintf(stderr, "Rank: %4i aft_ping returned %d\n",
+				my_rank, rc);
+		} else if (my_rank < peer_rank) {
+			fprintf(stdout,
+				"Rank: %4i peer: %4i length: %8lu half round trip: %10.3f usec\n",
+				my_rank, peer_rank, (unsigned long) tlen,
+				elapsed_nsec / (2000.0 * niters));
+		}
+	}
+
+	ep_stats = aft_get_ep_stats();
+	fprintf(stdout,
+		"Rank: %4i endpoints created: %lu evicted: %lu live: %lu table bytes: %lu mailbox bytes: %lu\n",
+		my_rank, (unsigned long) ep_stats->created,
+		(unsigned long) ep_stats->evicted,
+		(unsigned long) ep_stats->live,
+		(unsigned long) ep_stats->table_bytes,
+		(unsigned long) ep_stats->mailbox_bytes);
+
+	aft_finalize();
+
+	return (rc == AFT_SUCCESS) ? 0 : 1;
+}
@@ -26,36 +26,35 @@
 #include "aft_internal.h"
 
 /*
- * simple uni-directional ping test using the
- * Aries BTE to do an RDMA write of a given
- * transferi size for a number of iterations.
+ * simple ping-pong test using the Aries BTE
+ * to do an RDMA write of a given transfer size
+ * for a number of iterations.  Both ranks of
+ * the pair must call it.
  */
 
 int
-aft_ping(int niters, int peer_rank, size_t tlen, uint16_t dlvr_mode)
+aft_ping(int niters, int peer_rank, size_t tlen, uint16_t dlvr_mode,
+	 uint64_t *elapsed_nsec)
 {
 	int i, my_rank, rc;
+	gni_return_t status;
 	gni_post_descriptor_t put_desc;
 	gni_post_descriptor_t cq_desc;
-	gni_cq_entry_t cq_entry;
+	gni_cq_entry_t cqe_entry;
+	gni_mem_handle_t source_memory_handle;
 	aft_mdh_addr_t peer_mdh_addr;
-	char *send_buffer;
+	char *send_buffer = NULL;
 	uint64_t the_cq_data;
+	uint64_t start_time;
 
-	rc = PMI_Get_rank(&my_rank);
-	if (rc != PMI_SUCCESS) {
-		ret = aft_pmi_err_to_aft_err(rc);
-		goto err;
-	}
-
-	rc = aft_get_peer_mdh_addr(peer_rank, &peer_mdh_addr);
-	if (rc != AFT_SUCCESS)
-		goto err;
+	my_rank = aft_get_rank();
+	if ((niters <= 0) || (tlen == 0) || (peer_rank == my_rank))
+		return AFT_ERR_INVALID;
 
 	rc = posix_memalign((void **)&send_buffer, 64,
 			    (tlen * niters));
 	if (rc != 0)
-		goto err;
+		return AFT_ERR_NOMEM;
 
 	/*
 	 * Initialize the buffer to a value
@@ -63,72 +62,60 @@ aft_ping(int niters, int peer_rank, size_t tlen, uint16_t dlvr_mode)
 
 	memset(send_buffer, 8, (tlen * niters));
 
-	status = GNI_MemRegister(nic_handle,
-				 (uint64_t) send_buffer,
-				 (tlen * niters),
-				 NULL,
-				 GNI_MEM_READWRITE,
-				 -1,
-				 &source_memory_handle);
-	if (status != GNI_RC_SUCCESS) {
-		rc = gni_err_to_aft_err(status);
+	rc = aft_mem_register(send_buffer, (tlen * niters),
+			      &source_memory_handle);
+	if (rc != AFT_SUCCESS)
 		goto err;
-	}
+
+	rc = aft_get_peer_mdh_addr(peer_rank, &peer_mdh_addr);
+	if (rc != AFT_SUCCESS)
+		goto err1;
 
 	/*
 	 * sync with my partner using CQ's
 	 */
 
+	memset(&cq_desc, 0, sizeof(cq_desc));
 	cq_desc.type = GNI_POST_CQWRITE;
-	cq_desc.cqwrite_value = my_rank;
 	cq_desc.remote_mem_hndl  = peer_mdh_addr.mdh;
 	cq_desc.cq_mode = GNI_CQMODE_GLOBAL_EVENT;
 	cq_desc.dlvr_mode = GNI_DLVMODE_IN_ORDER;
 	cq_desc.src_cq_hndl = aft_nic.tx_cq;
-	cq_desc.post_id  = (uint64_t)&pdesc;
+	cq_desc.post_id  = (uint64_t)&cq_desc;
 
-	for (i  0; i < 64; i++) {
+	for (i = 0; i < 64; i++) {
 
-		cq_desc.cqwrite_value = (my_rank | (i << 32));
-		status = GNI_CqWrite(peer_mdh_addr.ep,
-				     &cq_desc);
+		cq_desc.cqwrite_value = (my_rank | ((uint64_t) i << 32));
+		status = GNI_PostCqWrite(peer_mdh_addr.ep,
+					 &cq_desc);
 		if (status != GNI_RC_SUCCESS) {
 			rc = aft_gni_err_to_aft_err(status);
-			goto err;
+			goto err1;
 		}
 
-		status = GNI_RC_NOT_DONE;
-		while (1) {
-			GNI_CqGetEvent(aft_nic.tx_cq,
-					&cqe_entry);
-			if (status == GNI_RC_SUCCESS)
-				break;
-			if (status == GNI_RC_TRANSACTION_ERROR) {
-				aft_cqe_error(cqe_entry, peer_rank);
-				goto err;
-			}
-		}
-		while (1) {
-			GNI_CqGetEvent(aft_nic.rx_cq,
-					&cqe_entry);
-			if (status == GNI_RC_SUCCESS) {
-				the data = GNI_CQ_GET_DATA(cqe_entry);
-				assert (the_cq_data ==
-					(peer_rank | ( i << 32)));
-				break;
-			}
-			if (status == GNI_RC_TRANSACTION_ERROR) {
-				aft_cqe_error(cqe_entry, peer_rank);
-				goto err;
-			}
-		}
+		rc = aft_wait_tx_cqe(peer_rank);
+		if (rc != AFT_SUCCESS)
+			goto err1;
+
+		rc = aft_wait_rx_cqe(peer_rank, &cqe_entry);
+		if (rc != AFT_SUCCESS)
+			goto err1;
+
+		/*
+		 * the CQ write data is 56 bits wide
+		 */
+
+		the_cq_data = GNI_CQ_GET_DATA(cqe_entry);
+		assert(the_cq_data ==
+		       ((peer_rank | ((uint64_t) i << 32)) &
+			0x00ffffffffffffffUL));
 	}
 
+	memset(&put_desc, 0, sizeof(put_desc));
 	put_desc.type = GNI_POST_RDMA_PUT;
 	put_desc.cq_mode = GNI_CQMODE_GLOBAL_EVENT |
 				GNI_CQMODE_REMOTE_EVENT;
 	put_desc.dlvr_mode = dlvr_mode;
-	put_desc.local_addr = (uint64_t) send_buffer;
 	put_desc.local_mem_hndl = source_memory_handle;
 	put_desc.remote_mem_hndl = peer_mdh_addr.mdh;
 	put_desc.length = tlen;
@@ -136,54 +123,74 @@ aft_ping(int niters, int peer_rank, size_t tlen, uint16_t dlvr_mode)
 	put_desc.rdma_mode = 0;
 	put_desc.post_id = (uint64_t) &put_desc;
 
+	start_time = aft_get_nsec();
+
 	for (i = 0; i < niters; i++) {
 
-		put_desc.local_addr += i * tlen;
-		put_desc.remote_addr = peer_mdh_addr.addr;
-		put_desc.remote_addr += i * tlen;
+		put_desc.local_addr = (uint64_t) send_buffer + i * tlen;
+		put_desc.remote_addr = peer_mdh_addr.addr + i * tlen;
 
-		if (my_rank < send_to) {
+		if (my_rank < peer_rank) {
 
-			start_timer;
 			/*
 			 * Send the data.
 			 */
 
 			status = GNI_PostRdma(peer_mdh_addr.ep,
 					      &put_desc);
-			if (status != GNI_RC_SUCCESS)
-				goto err;
+			if (status != GNI_RC_SUCCESS) {
+				rc = aft_gni_err_to_aft_err(status);
+				goto err1;
+			}
 
-			status = GNI_RC_NOT_DONE;
-			while (status != GNI_RC_SUCCESS)
-				status = GNI_CqGetEvent(tx_cq, &current_event);
-			check_tx_cqe(current_event);
+			rc = aft_wait_tx_cqe(peer_rank);
+			if (rc != AFT_SUCCESS)
+				goto err1;
 
 			/*
 			 * wait for rx CQE from peer
 			 */
 
-			status = GNI_RC_NOT_DONE;
-			while (status != GNI_RC_SUCCESS)
-				status = GNI_CqGetEvent(rx_cq, &current_event);
-			check_rx_cqe(current_event);
-
-			stop_timer;
+			rc = aft_wait_rx_cqe(peer_rank, &cqe_entry);
+			if (rc != AFT_SUCCESS)
+				goto err1;
 
 		} else {
 			/*
 			 * wait for RX CQE
 			 */
 
+			rc = aft_wait_rx_cqe(peer_rank, &cqe_entry);
+			if (rc != AFT_SUCCESS)
+				goto err1;
+
 			/*
 			 * send the data
 			 */
 
+			status = GNI_PostRdma(peer_mdh_addr.ep,
+					      &put_desc);
+			if (status != GNI_RC_SUCCESS) {
+				rc = aft_gni_err_to_aft_err(status);
+				goto err1;
+			}
+
 			/*
 			 * wait for TX CQE
 			 */
+
+			rc = aft_wait_tx_cqe(peer_rank);
+			if (rc != AFT_SUCCESS)
+				goto err1;
 		}
 	}			/* end of for loop for niters */
 
+	if (elapsed_nsec != NULL)
+		*elapsed_nsec = aft_get_nsec() - start_time;
+
+err1:
+	GNI_MemDeregister(aft_nic.nic, &source_memory_handle);
+err:
+	free(send_buffer);
 	return rc;
 }
@@ -0,0 +1,1333 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * aft suite driver - runs a list of benchmark modules in one job, so that
+ * PMI_Init, the CDM attach and the wire-up are paid for once rather than
+ * once per example.  Each even rank is paired with the next odd rank,
+ * and each pair registers one region that all of the modules reuse.
+ * Rank 0 prints one report with the minimum, average and maximum of
+ * every module's result over the ranks that ran it.  Before the modules,
+ * the init row is the time of aft_init, and the register and deregister
+ * rows are the times of GNI_MemRegister and GNI_MemDeregister of a buffer
+ * the size of the region.
+ *
+ * Usage: aft_suite [-l transfer_length] [-n iterations] [-m module,...]
+ *                  [-c chain_length] [-T soak_seconds [-I interval_seconds]]
+ *                  [-M cdm_modes,...] [-E eager_limit|auto]
+ *
+ *   -m selects the modules and their order, all of them by default:
+ *      ping     RDMA put ping-pong, half round trip
+ *      put      streamed RDMA puts, bandwidth
+ *      get      RDMA gets one at a time, latency
+ *      amo      FMA fetching adds one at a time, latency
+ *      cqwrite  CQ write ping-pong, half round trip
+ *      smsg     SMSG ping-pong, half round trip
+ *      fma      FMA puts posted one at a time, message rate
+ *      fmapost  CPU time in GNI_PostFma per message
+ *      chain    FMA puts posted in chains by GNI_CtPostFma, message rate
+ *      chainpost  CPU time in GNI_CtPostFma per message
+ *      msgping    aft_send/aft_recv ping-pong, half round trip
+ *      msgstream  aft_send/aft_recv one way stream, bandwidth
+ *      allgather  GNI allgather of transfer_length bytes per rank
+ *      barrier    GNI dissemination barrier
+ *      pmibarrier PMI barrier
+ *
+ *   -c sets the number of puts in each chain of the chain modules, 16 by
+ *      default and at most 64.
+ *
+ *   -T runs the modules in turn for soak_seconds instead of once, and
+ *      every -I interval_seconds (10 by default) prints each module's
+ *      rate, percentiles, errors and the largest resident set size, to
+ *      show a decay in throughput or a leak over a long soak.  Every call
+ *      of a module with -n iterations is one sample, so -n 1 times every
+ *      operation of the latency modules.
+ *
+ *   -E sets the eager limit of aft_send, the largest message that goes
+ *      in one mailbox message rather than by rendezvous.  auto has each
+ *      pair pick it with aft_msg_calibrate, and the limits are reported
+ *      as the eager row.  The limit is at most a mailbox message, which
+ *      AFT_MBOX_MSG_MAXSIZE in the environment of every rank raises.
+ *
+ *   -M runs everything once for each set of CDM modes, tearing the CDM
+ *      down and creating it again in between, and ends with a table of
+ *      each row's change from the first set.  A set is a '+' separated
+ *      list of default, bte1, fmashared, fmadedicated, iommu, noflbte
+ *      or numbers, for example -M default,bte1,iommu,bte1+noflbte.
+ *      A set that can not be created stops the matrix, the table then
+ *      covers the sets that ran.
+ *
+ * The MSGQ, datagram and CE examples set up their own job wide state,
+ * the message queue, the datagram matching or a CE tree, and still run
+ * as separate binaries.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "aft.h"
+
+#define SUITE_MAX_MODULES	16
+#define SUITE_MAX_CONFIGS	16
+#define SUITE_REGION_SLOTS	64
+#define SUITE_CHAIN		16
+#define SUITE_CHAIN_MAX		64	/* the puts the kernel keeps outstanding */
+#define SUITE_EAGER_DEFAULT	-1
+#define SUITE_EAGER_AUTO	-2
+#define SUITE_REGISTER_ITERS	100	/* at most, of the register rows */
+
+/*
+ * the rows before the modules: init, register and deregister
+ */
+
+#define SUITE_FIXED_ROWS	3
+
+/*
+ * whose operations a rank times, for the soak's rate
+ */
+
+#define SUITE_OPS_RANK		0	/* its own */
+#define SUITE_OPS_PAIR		1	/* the same ones as its partner */
+#define SUITE_OPS_JOB		2	/* the same ones as every rank */
+
+typedef struct {
+	double value;
+	int ran;
+	int rc;
+} suite_result_t;
+
+typedef struct {
+	const char *name;
+	int pairwise;
+	int ops;
+	const char *units;
+	int (*run)(aft_region_t *region, int niters, size_t tlen,
+		   double *value);
+} suite_module_t;
+
+static int suite_chain = SUITE_CHAIN;
+static long suite_eager = SUITE_EAGER_DEFAULT;
+
+static double
+get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int
+run_ping(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_ping(niters, region->peer_rank, tlen,
+		      GNI_DLVMODE_PERFORMANCE, &elapsed_nsec);
+	*value = elapsed_nsec / (2000.0 * niters);
+
+	return rc;
+}
+
+static int
+run_put(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_put_bw(region, niters, tlen, GNI_DLVMODE_PERFORMANCE,
+			&elapsed_nsec);
+	*value = (double) niters * tlen * 1000.0 / elapsed_nsec;
+
+	return rc;
+}
+
+static int
+run_get(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_get_lat(region, niters, tlen, &elapsed_nsec);
+	*value = elapsed_nsec / (1000.0 * niters);
+
+	return rc;
+}
+
+static int
+run_amo(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_amo_lat(region, niters, &elapsed_nsec);
+	*value = elapsed_nsec / (1000.0 * niters);
+
+	return rc;
+}
+
+static int
+run_cqwrite(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_cqwrite_ping(region, niters, &elapsed_nsec);
+	*value = elapsed_nsec / (2000.0 * niters);
+
+	return rc;
+}
+
+static int
+run_smsg(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_smsg_ping(region, niters, tlen, &elapsed_nsec);
+	*value = elapsed_nsec / (2000.0 * niters);
+
+	return rc;
+}
+
+static int
+run_fma(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_fma_put_rate(region, niters, tlen, 1, &elapsed_nsec, NULL);
+	*value = niters * 1000.0 / elapsed_nsec;
+
+	return rc;
+}
+
+static int
+run_fma_post(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t post_nsec;
+	int rc;
+
+	rc = aft_fma_put_rate(region, niters, tlen, 1, NULL, &post_nsec);
+	*value = post_nsec / (1000.0 * niters);
+
+	return rc;
+}
+
+static int
+run_chain(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_fma_put_rate(region, niters, tlen, suite_chain, &elapsed_nsec,
+			      NULL);
+	*value = niters * 1000.0 / elapsed_nsec;
+
+	return rc;
+}
+
+static int
+run_chain_post(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t post_nsec;
+	int rc;
+
+	rc = aft_fma_put_rate(region, niters, tlen, suite_chain, NULL,
+			      &post_nsec);
+	*value = post_nsec / (1000.0 * niters);
+
+	return rc;
+}
+
+static int
+run_msg_ping(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_msg_ping(region, niters, tlen, &elapsed_nsec);
+	*value = elapsed_nsec / (2000.0 * niters);
+
+	return rc;
+}
+
+static int
+run_msg_stream(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	uint64_t elapsed_nsec;
+	int rc;
+
+	rc = aft_msg_stream(region, niters, tlen, &elapsed_nsec);
+	*value = (double) niters * tlen * 1000.0 / elapsed_nsec;
+
+	return rc;
+}
+
+static int
+run_allgather(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	char *in, *out;
+	double start;
+	int i, rc = AFT_SUCCESS;
+
+	in = calloc(1, tlen);
+	out = malloc(tlen * aft_get_size());
+	if ((in == NULL) || (out == NULL)) {
+		free(in);
+		free(out);
+		return AFT_ERR_NOMEM;
+	}
+
+	/*
+	 * the first call at a length grows the region, it is not timed
+	 */
+
+	rc = aft_allgather(in, out, tlen);
+
+	start = get_usec();
+	for (i = 0; (i < niters) && (rc == AFT_SUCCESS); i++)
+		rc = aft_allgather(in, out, tlen);
+	*value = (get_usec() - start) / niters;
+
+	free(in);
+	free(out);
+
+	return rc;
+}
+
+static int
+run_barrier(aft_region_t *region, int niters, size_t tlen, double *value)
+{
+	double start;
+	int i, rc = AFT_SUCCESS;
+
+	start = get_usec();
+	for (i = 0; (i < niters) && (rc == AFT_SUCCESS); i++)
+		rc = aft_barrier();
+	*value = (get_usec() - start) / niters;
+
+	return rc;
+}
+
+static int
+run_pmi_barrier(aft_region_t *region, int niters, size_t tlen,
+		double *value)
+{
+	double start;
+	int i, rc = AFT_SUCCESS;
+
+	start = get_usec();
+	for (i = 0; (i < niters) && (rc == AFT_SUCCESS); i++)
+		rc = aft_pmi_barrier();
+	*value = (get_usec() - start) / niters;
+
+	return rc;
+}
+
+static const suite_module_t suite_modules[] = {
+	{ "ping",	1, SUITE_OPS_PAIR,	"usec",	run_ping },
+	{ "put",	1, SUITE_OPS_RANK,	"MB/s",	run_put },
+	{ "get",	1, SUITE_OPS_RANK,	"usec",	run_get },
+	{ "amo",	1, SUITE_OPS_RANK,	"usec",	run_amo },
+	{ "cqwrite",	1, SUITE_OPS_PAIR,	"usec",	run_cqwrite },
+	{ "smsg",	1, SUITE_OPS_PAIR,	"usec",	run_smsg },
+	{ "fma",	1, SUITE_OPS_RANK,	"Mmsg/s", run_fma },
+	{ "fmapost",	1, SUITE_OPS_RANK,	"usec",	run_fma_post },
+	{ "chain",	1, SUITE_OPS_RANK,	"Mmsg/s", run_chain },
+	{ "chainpost",	1, SUITE_OPS_RANK,	"usec",	run_chain_post },
+	{ "msgping",	1, SUITE_OPS_PAIR,	"usec",	run_msg_ping },
+	{ "msgstream",	1, SUITE_OPS_PAIR,	"MB/s",	run_msg_stream },
+	{ "allgather",	0, SUITE_OPS_JOB,	"usec",	run_allgather },
+	{ "barrier",	0, SUITE_OPS_JOB,	"usec",	run_barrier },
+	{ "pmibarrier",	0, SUITE_OPS_JOB,	"usec",	run_pmi_barrier }
+};
+
+#define SUITE_MODULE_COUNT (sizeof(suite_modules) / sizeof(suite_modules[0]))
+
+static int
+find_module(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < SUITE_MODULE_COUNT; i++)
+		if (strcmp(suite_modules[i].name, name) == 0)
+			return i;
+
+	return -1;
+}
+
+/*
+ * The CDM mode flags that -M takes by name.
+ */
+
+static const struct {
+	const char *name;
+	int mode;
+} suite_cdm_flags[] = {
+	{ "default",	0 },
+	{ "bte1",	GNI_CDM_MODE_BTE_SINGLE_CHANNEL },
+	{ "fmashared",	GNI_CDM_MODE_FMA_SHARED },
+	{ "fmadedicated", GNI_CDM_MODE_FMA_DEDICATED },
+	{ "iommu",	GNI_CDM_MODE_USE_PCI_IOMMU },
+	{ "noflbte",	GNI_CDM_MODE_FLBTE_DISABLE }
+};
+
+#define SUITE_CDM_FLAG_COUNT (sizeof(suite_cdm_flags) / sizeof(suite_cdm_flags[0]))
+
+/*
+ * parse_cdm_modes sets modes from a '+' separated list of flag names
+ * and numbers.
+ *
+ *   Returns: 0, or -1 for an unknown flag.
+ */
+
+static int
+parse_cdm_modes(const char *spec, int *modes)
+{
+	char flag[32];
+	char *end;
+	size_t length;
+	unsigned int i;
+
+	*modes = 0;
+
+	while (*spec != '\0') {
+		length = strcspn(spec, "+");
+		if ((length == 0) || (length >= sizeof(flag)))
+			return -1;
+		memcpy(flag, spec, length);
+		flag[length] = '\0';
+		spec += length;
+		if (*spec == '+')
+			spec++;
+
+		for (i = 0; i < SUITE_CDM_FLAG_COUNT; i++)
+			if (strcmp(suite_cdm_flags[i].name, flag) == 0)
+				break;
+
+		if (i < SUITE_CDM_FLAG_COUNT) {
+			*modes |= suite_cdm_flags[i].mode;
+		} else {
+			*modes |= (int) strtoul(flag, &end, 0);
+			if (*end != '\0')
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+usage(char *name)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"Usage: %s [-l transfer_length] [-n iterations] [-m module,...]\n"
+		"          [-c chain_length] [-T soak_seconds [-I interval_seconds]]\n"
+		"          [-M cdm_modes,...] [-E eager_limit|auto]\n"
+		"  modules:", name);
+	for (i = 0; i < SUITE_MODULE_COUNT; i++)
+		fprintf(stderr, " %s", suite_modules[i].name);
+	fprintf(stderr, "\n  cdm modes, joined by '+':");
+	for (i = 0; i < SUITE_CDM_FLAG_COUNT; i++)
+		fprintf(stderr, " %s", suite_cdm_flags[i].name);
+	fprintf(stderr, "\n");
+}
+
+/*
+ * report gathers one value from every rank, and rank 0 prints the
+ * minimum, average and maximum over the ranks that ran the module.  The
+ * average is returned in avg, NAN when no rank ran the module.
+ *
+ *   Returns: the number of ranks whose module failed.
+ */
+
+static int
+report(const char *name, size_t tlen, const char *units,
+       suite_result_t *mine, suite_result_t *all, int nranks, int my_rank,
+       double *avg)
+{
+	double min = 0.0, max = 0.0, sum = 0.0;
+	int i, ran = 0, failed = 0;
+
+	*avg = NAN;
+
+	if (aft_pmi_allgather(mine, all, sizeof(*mine)) != AFT_SUCCESS)
+		return nranks;
+
+	for (i = 0; i < nranks; i++) {
+		if (all[i].rc != AFT_SUCCESS) {
+			failed++;
+			continue;
+		}
+		if (!all[i].ran)
+			continue;
+
+		if ((ran == 0) || (all[i].value < min))
+			min = all[i].value;
+		if ((ran == 0) || (all[i].value > max))
+			max = all[i].value;
+		sum += all[i].value;
+		ran++;
+	}
+
+	if (ran > 0)
+		*avg = sum / ran;
+
+	if (my_rank == 0) {
+		if (ran > 0)
+			fprintf(stdout,
+				"%-10s %10lu %6d %12.3f %12.3f %12.3f %-6s",
+				name, (unsigned long) tlen, ran, min,
+				sum / ran, max, units);
+		else
+			fprintf(stdout, "%-10s %10lu %6d %12s %12s %12s %-6s",
+				name, (unsigned long) tlen, 0, "-", "-", "-",
+				units);
+
+		if (failed > 0)
+			fprintf(stdout, " %d ranks failed", failed);
+		fprintf(stdout, "\n");
+	}
+
+	return failed;
+}
+
+/*
+ * Soak mode.
+ *
+ * The modules run in turn for the whole soak.  Every interval each module
+ * runs a number of batches, a batch being one call of the module with
+ * niters iterations, and each batch's result is one sample.  The batch
+ * counts are worked out from the gathered interval times, so that every
+ * rank runs the same number of batches and the ping-pong modules stay
+ * matched, and the modules share the interval about equally.
+ *
+ * The samples go into a log bucketed sketch, bucket i holding the values
+ * between gamma^(i-1) and gamma^i, so a quantile is within about 1% of
+ * the exact value and the memory does not grow with the soak.
+ */
+
+#define SUITE_SKETCH_BUCKETS	2048
+#define SUITE_SKETCH_GAMMA	1.02
+
+typedef struct {
+	uint32_t counts[SUITE_SKETCH_BUCKETS];
+	uint64_t count;
+	double sum;
+	double min;
+	double max;
+} suite_sketch_t;
+
+typedef struct {
+	suite_sketch_t interval;
+	suite_sketch_t total;
+	int batches;
+	int errors;
+	uint64_t total_errors;
+	double elapsed;
+} suite_soak_t;
+
+/*
+ * One rank's interval of one module, as gathered.
+ */
+
+typedef struct {
+	double elapsed;		/* usec spent in the module's batches */
+	double soak;		/* usec since the start of the soak */
+	double p50;
+	double p90;
+	double p99;
+	double worst;
+	uint64_t samples;
+	int errors;
+	int ran;
+	long rss_kb;
+} suite_interval_t;
+
+static void
+sketch_reset(suite_sketch_t *sketch)
+{
+	memset(sketch, 0, sizeof(*sketch));
+}
+
+static void
+sketch_add(suite_sketch_t *sketch, double value)
+{
+	int i = 0;
+
+	if (value > 0.0) {
+		i = (int) ceil(log(value) / log(SUITE_SKETCH_GAMMA)) +
+			SUITE_SKETCH_BUCKETS / 2;
+		if (i < 0)
+			i = 0;
+		if (i >= SUITE_SKETCH_BUCKETS)
+			i = SUITE_SKETCH_BUCKETS - 1;
+	}
+
+	if ((sketch->count == 0) || (value < sketch->min))
+		sketch->min = value;
+	if ((sketch->count == 0) || (value > sketch->max))
+		sketch->max = value;
+
+	sketch->counts[i]++;
+	sketch->count++;
+	sketch->sum += value;
+}
+
+/*
+ * sketch_quantile returns the value that q of the samples are at or
+ * below, the middle of its bucket clamped to the exact minimum and
+ * maximum.
+ */
+
+static double
+sketch_quantile(suite_sketch_t *sketch, double q)
+{
+	uint64_t rank, seen = 0;
+	double value;
+	int i;
+
+	if (sketch->count == 0)
+		return 0.0;
+
+	rank = (uint64_t) (q * (sketch->count - 1));
+
+	for (i = 0; i < SUITE_SKETCH_BUCKETS - 1; i++) {
+		seen += sketch->counts[i];
+		if (seen > rank)
+			break;
+	}
+
+	value = 2.0 * pow(SUITE_SKETCH_GAMMA, i - SUITE_SKETCH_BUCKETS / 2) /
+		(SUITE_SKETCH_GAMMA + 1.0);
+
+	if (value < sketch->min)
+		value = sketch->min;
+	if (value > sketch->max)
+		value = sketch->max;
+
+	return value;
+}
+
+/*
+ * For the rates, the units with a '/', the tail is the low side.
+ */
+
+static int
+higher_is_better(const char *units)
+{
+	return strchr(units, '/') != NULL;
+}
+
+static long
+get_rss_kb(void)
+{
+	FILE *file;
+	long pages = 0, rss = 0;
+
+	file = fopen("/proc/self/statm", "r");
+	if (file == NULL)
+		return 0;
+
+	if (fscanf(file, "%ld %ld", &pages, &rss) != 2)
+		rss = 0;
+	fclose(file);
+
+	return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*
+ * suite_barrier separates the modules.  A barrier that fails leaves the
+ * ranks out of step, so the callers stop running modules after one.
+ */
+
+static int
+suite_barrier(int my_rank)
+{
+	int rc;
+
+	rc = aft_barrier();
+	if (rc != AFT_SUCCESS)
+		fprintf(stderr, "Rank: %4i aft_barrier returned %d\n",
+			my_rank, rc);
+
+	return rc;
+}
+
+static int
+module_runs(const suite_module_t *module, aft_region_t *region,
+	    int peer_rank, int nranks)
+{
+	return (!module->pairwise) ||
+		((peer_rank < nranks) && (region->buffer != NULL));
+}
+
+/*
+ * soak_batches works out the next interval's batch count from the
+ * slowest rank's time, the same on every rank as they all see the same
+ * gathered times.
+ */
+
+static int
+soak_batches(int batches, double share, suite_interval_t *all, int nranks)
+{
+	double slowest = 0.0;
+	double next;
+	int i;
+
+	for (i = 0; i < nranks; i++)
+		if (all[i].ran && (all[i].elapsed > slowest))
+			slowest = all[i].elapsed;
+
+	if (slowest <= 0.0)
+		return batches;
+
+	next = batches * share / slowest;
+	if (next < 1.0)
+		return 1;
+	if (next > 1000000000.0)
+		return 1000000000;
+
+	return (int) next;
+}
+
+/*
+ * soak_report gathers one module's interval and rank 0 prints a line of
+ * it.  The rate is the job's operations per second: the ranks' own
+ * operations are summed, the two ranks of a pair time the same
+ * ping-pongs or stream so each counts for half, and every rank times
+ * the same collectives so they are averaged.  p50 and p90 are averaged
+ * over the ranks, p99 and worst are those of the worst rank.
+ *
+ *   Returns: AFT_SUCCESS, or the error of the gather.
+ */
+
+static int
+soak_report(const suite_module_t *module, size_t tlen, int niters,
+	    suite_interval_t *mine, suite_interval_t *all, int nranks,
+	    int my_rank)
+{
+	double rate = 0.0, p50 = 0.0, p90 = 0.0, p99 = 0.0, worst = 0.0;
+	double soak = 0.0, share;
+	long rss = 0;
+	int i, rc, ran = 0, errors = 0;
+	int high = higher_is_better(module->units);
+
+	rc = aft_pmi_allgather(mine, all, sizeof(*mine));
+	if (rc != AFT_SUCCESS)
+		return rc;
+
+	share = (module->ops == SUITE_OPS_PAIR) ? 0.5 : 1.0;
+
+	for (i = 0; i < nranks; i++) {
+		errors += all[i].errors;
+		if (all[i].rss_kb > rss)
+			rss = all[i].rss_kb;
+		if (all[i].soak > soak)
+			soak = all[i].soak;
+		if ((!all[i].ran) || (all[i].samples == 0))
+			continue;
+
+		if (all[i].elapsed > 0.0)
+			rate += share * all[i].samples * (double) niters *
+				1000000.0 / all[i].elapsed;
+		p50 += all[i].p50;
+		p90 += all[i].p90;
+		if ((ran == 0) || (high ? (all[i].p99 < p99) : (all[i].p99 > p99)))
+			p99 = all[i].p99;
+		if ((ran == 0) ||
+		    (high ? (all[i].worst < worst) : (all[i].worst > worst)))
+			worst = all[i].worst;
+		ran++;
+	}
+
+	if ((module->ops == SUITE_OPS_JOB) && (ran > 0))
+		rate /= ran;
+
+	if (my_rank == 0) {
+		if (ran > 0)
+			fprintf(stdout,
+				"%8.0f %-10s %10lu %6d %12.0f %10.3f %10.3f %10.3f %10.3f %-6s %6d %10ld\n",
+				soak / 1000000.0, module->name,
+				(unsigned long) tlen, ran, rate, p50 / ran,
+				p90 / ran, p99, worst, module->units, errors,
+				rss);
+		else
+			fprintf(stdout,
+				"%8.0f %-10s %10lu %6d %12s %10s %10s %10s %10s %-6s %6d %10ld\n",
+				soak / 1000000.0, module->name,
+				(unsigned long) tlen, 0, "-", "-", "-", "-",
+				"-", module->units, errors, rss);
+		fflush(stdout);
+	}
+
+	return AFT_SUCCESS;
+}
+
+/*
+ * soak runs the modules in turn until soak_seconds have passed on the
+ * slowest rank, printing every module's statistics each interval.  The
+ * average of each module's samples is returned in averages.
+ *
+ *   Returns: the number of ranks whose modules failed, as report.
+ */
+
+static int
+soak(int *modules, int module_count, aft_region_t *region, int peer_rank,
+     int niters, size_t tlen, int soak_seconds, int interval_seconds,
+     int nranks, int my_rank, double *averages)
+{
+	const suite_module_t *module;
+	suite_soak_t *state;
+	suite_interval_t mine;
+	suite_interval_t *all;
+	suite_result_t result;
+	suite_result_t *results;
+	double share, start, soak_start, value;
+	int b, i, rc, done = 0, failures = 0, high;
+
+	state = calloc(module_count, sizeof(*state));
+	all = malloc(nranks * sizeof(*all));
+	results = malloc(nranks * sizeof(*results));
+	if ((state == NULL) || (all == NULL) || (results == NULL)) {
+		free(state);
+		free(all);
+		free(results);
+		return nranks;
+	}
+
+	share = interval_seconds * 1000000.0 / module_count;
+
+	if (my_rank == 0)
+		fprintf(stdout, "%8s %-10s %10s %6s %12s %10s %10s %10s %10s %-6s %6s %10s\n",
+			"seconds", "module", "length", "ranks", "ops/s",
+			"p50", "p90", "p99", "worst", "units", "errors",
+			"rss_kb");
+
+	/*
+	 * one batch of each module gives the first batch counts
+	 */
+
+	for (i = 0; i < module_count; i++) {
+		module = &suite_modules[modules[i]];
+		state[i].batches = 1;
+
+		memset(&mine, 0, sizeof(mine));
+		if (module_runs(module, region, peer_rank, nranks)) {
+			start = get_usec();
+			module->run(region, niters, tlen, &value);
+			mine.elapsed = get_usec() - start;
+			mine.ran = 1;
+		}
+
+		if (aft_pmi_allgather(&mine, all, sizeof(mine)) != AFT_SUCCESS) {
+			failures = nranks;
+			goto out;
+		}
+		state[i].batches = soak_batches(1, share, all, nranks);
+
+		if (suite_barrier(my_rank) != AFT_SUCCESS) {
+			failures = nranks;
+			goto out;
+		}
+	}
+
+	soak_start = get_usec();
+
+	while (!done) {
+		for (i = 0; i < module_count; i++) {
+			module = &suite_modules[modules[i]];
+
+			sketch_reset(&state[i].interval);
+			state[i].errors = 0;
+			state[i].elapsed = 0.0;
+
+			if (module_runs(module, region, peer_rank, nranks)) {
+				start = get_usec();
+				for (b = 0; b < state[i].batches; b++) {
+					rc = module->run(region, niters, tlen,
+							 &value);
+					if (rc != AFT_SUCCESS) {
+						state[i].errors++;
+						continue;
+					}
+					sketch_add(&state[i].interval, value);
+					sketch_add(&state[i].total, value);
+				}
+				state[i].elapsed = get_usec() - start;
+				state[i].total_errors += state[i].errors;
+			}
+
+			if (suite_barrier(my_rank) != AFT_SUCCESS) {
+				failures = nranks;
+				goto out;
+			}
+		}
+
+		for (i = 0; i < module_count; i++) {
+			module = &suite_modules[modules[i]];
+			high = higher_is_better(module->units);
+
+			memset(&mine, 0, sizeof(mine));
+			mine.elapsed = state[i].elapsed;
+			mine.soak = get_usec() - soak_start;
+			mine.p50 = sketch_quantile(&state[i].interval, 0.5);
+			mine.p90 = sketch_quantile(&state[i].interval,
+						   high ? 0.1 : 0.9);
+			mine.p99 = sketch_quantile(&state[i].interval,
+						   high ? 0.01 : 0.99);
+			mine.worst = high ? state[i].interval.min :
+				state[i].interval.max;
+			mine.samples = state[i].interval.count;
+			mine.errors = state[i].errors;
+			mine.ran = module_runs(module, region, peer_rank,
+					       nranks);
+			mine.rss_kb = get_rss_kb();
+
+			if (soak_report(module, tlen, niters, &mine, all,
+					nranks, my_rank) != AFT_SUCCESS) {
+				failures = nranks;
+				goto out;
+			}
+
+			state[i].batches = soak_batches(state[i].batches,
+							share, all, nranks);
+
+			/*
+			 * every rank sees the same gathered soak times, so
+			 * they all stop after the same interval
+			 */
+
+			for (b = 0; b < nranks; b++)
+				if (all[b].soak >= soak_seconds * 1000000.0)
+					done = 1;
+		}
+	}
+
+	/*
+	 * the summary has the average of every sample of the soak, and the
+	 * ranks with errors count as failed
+	 */
+
+	if (my_rank == 0)
+		fprintf(stdout, "\n%-10s %10s %6s %12s %12s %12s %-6s\n",
+			"module", "length", "ranks", "min", "avg", "max",
+			"units");
+
+	for (i = 0; i < module_count; i++) {
+		module = &suite_modules[modules[i]];
+
+		memset(&result, 0, sizeof(result));
+		if (state[i].total.count > 0) {
+			result.value = state[i].total.sum /
+				state[i].total.count;
+			result.ran = 1;
+		}
+		if (state[i].total_errors > 0)
+			result.rc = AFT_ERR_GNI;
+
+		failures += report(module->name, tlen, module->units, &result,
+				   results, nranks, my_rank, &averages[i]);
+	}
+
+out:
+	free(state);
+	free(all);
+	free(results);
+
+	return failures;
+}
+
+/*
+ * run_config registers the region and runs the modules once, or for the
+ * soak, under the CDM modes that are set up now.  averages returns the
+ * average of the init, register, deregister and module rows in that
+ * order.  For the matrix the init row leaves out PMI_Init, which only the
+ * first configuration pays for.  The register rows time GNI_MemRegister
+ * and GNI_MemDeregister of a buffer the size of the region alone, not the
+ * allocation or the exchange with the peer.
+ *
+ *   Returns: the number of failed ranks over all of the rows.
+ */
+
+static int
+run_config(int *modules, int module_count, int niters, size_t tlen,
+	   int soak_seconds, int interval_seconds, int matrix, int nranks,
+	   int my_rank, double *averages)
+{
+	const aft_timings_t *timings;
+	const suite_module_t *module;
+	aft_region_t region;
+	suite_result_t mine, dereg;
+	suite_result_t *all;
+	uint64_t register_nsec, deregister_nsec;
+	double eager;
+	int i, rc, peer_rank, reg_iters, failures = 0;
+
+	all = malloc(nranks * sizeof(suite_result_t));
+	if (all == NULL) {
+		fprintf(stderr, "Rank: %4i malloc failed\n", my_rank);
+		return nranks;
+	}
+
+	/*
+	 * an odd rank out has no partner, it only runs the collective
+	 * modules
+	 */
+
+	peer_rank = my_rank ^ 1;
+	memset(&region, 0, sizeof(region));
+
+	if (my_rank == 0)
+		fprintf(stdout, "%-10s %10s %6s %12s %12s %12s %-6s\n",
+			"module", "length", "ranks", "min", "avg", "max",
+			"units");
+
+	timings = aft_get_init_timings();
+
+	memset(&mine, 0, sizeof(mine));
+	mine.value = timings->total_nsec / 1000.0;
+	if (matrix)
+		mine.value -= timings->phase_nsec[AFT_PHASE_PMI_INIT] / 1000.0;
+	mine.ran = 1;
+	failures += report("init", 0, "usec", &mine, all, nranks, my_rank,
+			   &averages[0]);
+
+	reg_iters = (niters < SUITE_REGISTER_ITERS) ?
+		niters : SUITE_REGISTER_ITERS;
+	memset(&mine, 0, sizeof(mine));
+	memset(&dereg, 0, sizeof(dereg));
+	mine.rc = dereg.rc = aft_register_cost(tlen * SUITE_REGION_SLOTS,
+					       reg_iters, &register_nsec,
+					       &deregister_nsec);
+	mine.value = register_nsec / (1000.0 * reg_iters);
+	dereg.value = deregister_nsec / (1000.0 * reg_iters);
+	mine.ran = dereg.ran = 1;
+	if (mine.rc != AFT_SUCCESS)
+		fprintf(stderr, "Rank: %4i aft_register_cost returned %d\n",
+			my_rank, mine.rc);
+
+	/*
+	 * the region the modules share, a failure to set it up is reported
+	 * as a failure of the register row
+	 */
+
+	if (peer_rank < nranks) {
+		rc = aft_region_create(&region, peer_rank,
+				       tlen * SUITE_REGION_SLOTS);
+		if (rc != AFT_SUCCESS) {
+			fprintf(stderr,
+				"Rank: %4i aft_region_create returned %d\n",
+				my_rank, rc);
+			if (mine.rc == AFT_SUCCESS)
+				mine.rc = rc;
+		}
+	}
+
+	failures += report("register", tlen * SUITE_REGION_SLOTS, "usec",
+			   &mine, all, nranks, my_rank, &averages[1]);
+	failures += report("deregister", tlen * SUITE_REGION_SLOTS, "usec",
+			   &dereg, all, nranks, my_rank, &averages[2]);
+
+	/*
+	 * the eager limit goes back to its default with a new CDM, so it
+	 * is set, or calibrated, for every configuration
+	 */
+
+	if (suite_eager != SUITE_EAGER_DEFAULT) {
+		memset(&mine, 0, sizeof(mine));
+		if (suite_eager != SUITE_EAGER_AUTO) {
+			mine.rc = aft_set_eager_limit(suite_eager);
+			mine.ran = 1;
+		} else if (region.buffer != NULL) {
+			mine.rc = aft_msg_calibrate(peer_rank, NULL);
+			mine.ran = 1;
+		}
+		mine.value = aft_get_eager_limit();
+		if (mine.rc != AFT_SUCCESS)
+			fprintf(stderr, "Rank: %4i eager limit returned %d\n",
+				my_rank, mine.rc);
+		failures += report("eager", 0, "bytes", &mine, all, nranks,
+				   my_rank, &eager);
+	}
+
+	if (soak_seconds > 0) {
+		failures += soak(modules, module_count, &region, peer_rank,
+				 niters, tlen, soak_seconds, interval_seconds,
+				 nranks, my_rank, &averages[SUITE_FIXED_ROWS]);
+		goto out;
+	}
+
+	for (i = 0; i < module_count; i++) {
+		module = &suite_modules[modules[i]];
+
+		memset(&mine, 0, sizeof(mine));
+		if (module_runs(module, &region, peer_rank, nranks)) {
+			mine.rc = module->run(&region, niters, tlen,
+					      &mine.value);
+			mine.ran = 1;
+			if (mine.rc != AFT_SUCCESS)
+				fprintf(stderr, "Rank: %4i %s returned %d\n",
+					my_rank, module->name, mine.rc);
+		}
+
+		failures += report(module->name, tlen, module->units, &mine,
+				   all, nranks, my_rank,
+				   &averages[SUITE_FIXED_ROWS + i]);
+
+		if (suite_barrier(my_rank) != AFT_SUCCESS) {
+			failures += nranks;
+			goto out;
+		}
+	}
+
+out:
+	aft_region_destroy(&region);
+	free(all);
+
+	return failures;
+}
+
+/*
+ * reinit_failures returns the number of ranks whose aft_reinit failed.
+ * The count is gathered with aft_pmi_allgather, which needs no NIC, and
+ * a rank that can not take part counts all of the ranks as failed.
+ */
+
+static int
+reinit_failures(int rc, int nranks)
+{
+	int *all_rc;
+	int i, failed = 0;
+
+	all_rc = malloc(nranks * sizeof(int));
+	if (all_rc == NULL)
+		return nranks;
+
+	if (aft_pmi_allgather(&rc, all_rc, sizeof(int)) != AFT_SUCCESS) {
+		free(all_rc);
+		return nranks;
+	}
+
+	for (i = 0; i < nranks; i++)
+		if (all_rc[i] != AFT_SUCCESS)
+			failed++;
+
+	free(all_rc);
+
+	return failed;
+}
+
+/*
+ * print_deltas prints every row of every configuration of the matrix
+ * next to its change from the first configuration.
+ */
+
+static void
+print_deltas(int *modules, int module_count, int configs,
+	     char **config_names,
+	     double averages[][SUITE_MAX_MODULES + SUITE_FIXED_ROWS])
+{
+	const char *name, *units;
+	double base, value;
+	int c, i;
+
+	fprintf(stdout, "\n%-10s %-24s %12s %-6s %8s\n", "module",
+		"cdm modes", "avg", "units", "change");
+
+	for (i = 0; i < module_count + SUITE_FIXED_ROWS; i++) {
+		if (i == 0) {
+			name = "init";
+			units = "usec";
+		} else if (i == 1) {
+			name = "register";
+			units = "usec";
+		} else if (i == 2) {
+			name = "deregister";
+			units = "usec";
+		} else {
+			name = suite_modules[modules[i - SUITE_FIXED_ROWS]].name;
+			units = suite_modules[modules[i - SUITE_FIXED_ROWS]].units;
+		}
+
+		base = averages[0][i];
+		for (c = 0; c < configs; c++) {
+			value = averages[c][i];
+			if (isnan(value)) {
+				fprintf(stdout, "%-10s %-24s %12s %-6s %8s\n",
+					name, config_names[c], "-", units,
+					"-");
+			} else if ((c == 0) || isnan(base) || (base == 0.0)) {
+				fprintf(stdout,
+					"%-10s %-24s %12.3f %-6s %8s\n",
+					name, config_names[c], value, units,
+					"-");
+			} else {
+				fprintf(stdout,
+					"%-10s %-24s %12.3f %-6s %+7.1f%%\n",
+					name, config_names[c], value, units,
+					100.0 * (value - base) / base);
+			}
+		}
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int c, i, opt, rc, my_rank, nranks;
+	int niters = 1000;
+	int failures = 0;
+	int module_count = 0;
+	int soak_seconds = 0;
+	int interval_seconds = 10;
+	int modules[SUITE_MAX_MODULES];
+	int configs = 1;
+	int reinit_failed;
+	int cdm_modes[SUITE_MAX_CONFIGS] = { 0 };
+	char *config_names[SUITE_MAX_CONFIGS] = { "default" };
+	double averages[SUITE_MAX_CONFIGS][SUITE_MAX_MODULES + SUITE_FIXED_ROWS];
+	size_t tlen = 8;
+	char *list = NULL;
+	char *matrix = NULL;
+	char *token;
+
+	while ((opt = getopt(argc, argv, "c:E:I:l:M:m:n:T:")) != -1) {
+		switch (opt) {
+		case 'c':
+			suite_chain = atoi(optarg);
+			break;
+		case 'E':
+			if (strcmp(optarg, "auto") == 0)
+				suite_eager = SUITE_EAGER_AUTO;
+			else
+				suite_eager = atol(optarg);
+			break;
+		case 'I':
+			interval_seconds = atoi(optarg);
+			break;
+		case 'l':
+			tlen = strtoul(optarg, NULL, 0);
+			break;
+		case 'M':
+			matrix = optarg;
+			break;
+		case 'm':
+			list = optarg;
+			break;
+		case 'n':
+			niters = atoi(optarg);
+			break;
+		case 'T':
+			soak_seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((tlen == 0) || (niters <= 0) || (soak_seconds < 0) ||
+	    (interval_seconds <= 0) || (suite_chain < 1) ||
+	    (suite_chain > SUITE_CHAIN_MAX) ||
+	    ((suite_eager < 0) && (suite_eager != SUITE_EAGER_DEFAULT) &&
+	     (suite_eager != SUITE_EAGER_AUTO))) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (list == NULL) {
+		for (i = 0; i < (int) SUITE_MODULE_COUNT; i++)
+			modules[module_count++] = i;
+	} else {
+		for (token = strtok(list, ","); token != NULL;
+		     token = strtok(NULL, ",")) {
+			i = find_module(token);
+			if ((i < 0) || (module_count == SUITE_MAX_MODULES)) {
+				fprintf(stderr, "unknown module %s\n", token);
+				usage(argv[0]);
+				return 1;
+			}
+			modules[module_count++] = i;
+		}
+	}
+
+	if (matrix != NULL) {
+		configs = 0;
+		for (token = strtok(matrix, ","); token != NULL;
+		     token = strtok(NULL, ",")) {
+			if ((configs == SUITE_MAX_CONFIGS) ||
+			    (parse_cdm_modes(token, &cdm_modes[configs]) != 0)) {
+				fprintf(stderr, "bad cdm modes %s\n", token);
+				usage(argv[0]);
+				return 1;
+			}
+			config_names[configs++] = token;
+		}
+	}
+
+	rc = aft_init(cdm_modes[0]);
+	if (rc != AFT_SUCCESS) {
+		fprintf(stderr, "aft_init returned %d\n", rc);
+		return 1;
+	}
+
+	my_rank = aft_get_rank();
+	nranks = aft_get_size();
+
+	for (c = 0; c < configs; c++) {
+		if (c > 0) {
+			rc = aft_reinit(cdm_modes[c]);
+			if (rc != AFT_SUCCESS)
+				fprintf(stderr,
+					"Rank: %4i aft_reinit 0x%x returned %d\n",
+					my_rank, cdm_modes[c], rc);
+
+			/*
+			 * a rank whose reinit failed has no NIC, so every
+			 * rank stops the matrix with the configurations that
+			 * completed, the result is gathered through PMI
+			 */
+
+			reinit_failed = reinit_failures(rc, nranks);
+			if (reinit_failed != 0) {
+				if (my_rank == 0)
+					fprintf(stderr,
+						"cdm modes %s (0x%x) failed on "
+						"%d ranks, stopping the matrix\n",
+						config_names[c], cdm_modes[c],
+						reinit_failed);
+				failures++;
+				configs = c;
+				break;
+			}
+		}
+
+		if ((configs > 1) && (my_rank == 0))
+			fprintf(stdout, "%scdm modes: %s (0x%x)\n",
+				(c > 0) ? "\n" : "", config_names[c],
+				cdm_modes[c]);
+
+		failures += run_config(modules, module_count, niters, tlen,
+				       soak_seconds, interval_seconds,
+				       configs > 1, nranks, my_rank,
+				       averages[c]);
+	}
+
+	if ((configs > 1) && (my_rank == 0))
+		print_deltas(modules, module_count, configs, config_names,
+			     averages);
+
+	aft_finalize();
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * This header file contains the functions used to allocate and register
+ * the data buffers of the examples with a selectable page size, with or
+ * without pre-faulting and locking of the pages.
+ *
+ * The buffer mode is a comma separated list given with the '-H' option:
+ *     4k          regular pages (the default)
+ *     thp         transparent huge pages
+ *     2m          2 MB hugetlbfs pages
+ *     1g          1 GB hugetlbfs pages
+ *     populate    pre-fault all of the pages before registration (the default)
+ *     nopopulate  leave the pages to be faulted in by GNI_MemRegister
+ *     mlock       lock all of the pages in memory
+ */
+
+#ifndef BUFFER_FUNCTIONS_H
+#define BUFFER_FUNCTIONS_H
+
+#include <sys/mman.h>
+#include "affinity_functions.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT           26
+#endif
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE            14
+#endif
+
+#define BUFFER_PAGE_4K           0x01
+#define BUFFER_PAGE_THP          0x02
+#define BUFFER_PAGE_2M           0x04
+#define BUFFER_PAGE_1G           0x08
+#define BUFFER_PAGE_MASK         0x0f
+#define BUFFER_POPULATE          0x10
+#define BUFFER_MLOCK             0x20
+#define BUFFER_MODE_DEFAULT      (BUFFER_PAGE_4K | BUFFER_POPULATE)
+#define HUGE_PAGE_SIZE_2M        (1UL << 21)
+#define HUGE_PAGE_SIZE_1G        (1UL << 30)
+
+int             buffer_mode = BUFFER_MODE_DEFAULT;
+uint64_t        registration_bytes = 0;
+uint64_t        registration_count = 0;
+uint64_t        registration_nsec = 0;
+
+/*
+ * parse_buffer_mode converts a '-H' option string into a buffer mode.
+ * The pages are pre-faulted unless 'nopopulate' is given.
+ *
+ *   Returns: the buffer mode, or -1 for an unknown mode.
+ */
+
+static int
+parse_buffer_mode(char *option)
+{
+    char           *copy;
+    int             mode = BUFFER_MODE_DEFAULT;
+    char           *p_copy;
+    char           *token;
+
+    /*
+     * Copy the option string because strtok is desctructive.
+     */
+
+    p_copy = copy = strdup(option);
+
+    while ((token = strtok(p_copy, ",")) != NULL) {
+        /* for subsequent strtok calls to work. */
+        p_copy = NULL;
+
+        if (strcasecmp(token, "4k") == 0) {
+            mode = (mode & ~BUFFER_PAGE_MASK) | BUFFER_PAGE_4K;
+        } else if (strcasecmp(token, "thp") == 0) {
+            mode = (mode & ~BUFFER_PAGE_MASK) | BUFFER_PAGE_THP;
+        } else if (strcasecmp(token, "2m") == 0) {
+            mode = (mode & ~BUFFER_PAGE_MASK) | BUFFER_PAGE_2M;
+        } else if (strcasecmp(token, "1g") == 0) {
+            mode = (mode & ~BUFFER_PAGE_MASK) | BUFFER_PAGE_1G;
+        } else if (strcasecmp(token, "populate") == 0) {
+            mode |= BUFFER_POPULATE;
+        } else if (strcasecmp(token, "nopopulate") == 0) {
+            mode &= ~BUFFER_POPULATE;
+        } else if (strcasecmp(token, "mlock") == 0) {
+            mode |= BUFFER_MLOCK;
+        } else {
+            mode = -1;
+            break;
+        }
+    }
+
+    free(copy);
+
+    return mode;
+}
+
+/*
+ * buffer_mode_string describes a buffer mode, e.g. "2m,populate".
+ *
+ *   Returns: the description in a static string.
+ */
+
+static char *
+buffer_mode_string(int mode)
+{
+    static char     mode_string[64];
+
+    snprintf(mode_string, sizeof(mode_string), "%s%s%s",
+             (mode & BUFFER_PAGE_1G) ? "1g" :
+             (mode & BUFFER_PAGE_2M) ? "2m" :
+             (mode & BUFFER_PAGE_THP) ? "thp" : "4k",
+             (mode & BUFFER_POPULATE) ? ",populate" : "",
+             (mode & BUFFER_MLOCK) ? ",mlock" : "");
+
+    return mode_string;
+}
+
+/*
+ * buffer_mapping_length rounds a buffer length up to a whole number of
+ * pages of the buffer mode's page size.
+ *
+ *   Returns: the length of the mapping.
+ */
+
+static size_t
+buffer_mapping_length(size_t length, int mode)
+{
+    size_t          page_size;
+
+    if (mode & BUFFER_PAGE_1G) {
+        page_size = HUGE_PAGE_SIZE_1G;
+    } else if (mode & (BUFFER_PAGE_2M | BUFFER_PAGE_THP)) {
+        page_size = HUGE_PAGE_SIZE_2M;
+    } else {
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+
+    if (length == 0) {
+        length = 1;
+    }
+
+    return (length + page_size - 1) & ~(page_size - 1);
+}
+
+/*
+ * allocate_buffer allocates a zeroed, page aligned buffer.
+ *
+ *   buffer returns the address of the buffer.
+ *   length is the number of bytes needed.
+ *   mode is the buffer mode.
+ *   numa_node is the NUMA node the pages are bound to, or
+ *       NUMA_NODE_UNSPECIFIED for the default placement.
+ *
+ *   Returns:  0 on success
+ *            -1 on an error
+ */
+
+static int
+allocate_buffer(void **buffer, size_t length, int mode, int numa_node)
+{
+    char           *address;
+    int             flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    size_t          i;
+    size_t          mapping_length;
+    size_t          offset;
+    long            page_size;
+
+    mapping_length = buffer_mapping_length(length, mode);
+    page_size = sysconf(_SC_PAGESIZE);
+
+    if (mode & BUFFER_PAGE_1G) {
+        flags |= MAP_HUGETLB | (30 << MAP_HUGE_SHIFT);
+    } else if (mode & BUFFER_PAGE_2M) {
+        flags |= MAP_HUGETLB | (21 << MAP_HUGE_SHIFT);
+    }
+
+    /*
+     * The pages can only be pre-faulted by the mmap if they do not have
+     * to be bound to a NUMA node first.
+     */
+
+    if ((mode & BUFFER_POPULATE) && (numa_node == NUMA_NODE_UNSPECIFIED)) {
+        flags |= MAP_POPULATE;
+    }
+
+    if (mode & BUFFER_PAGE_THP) {
+
+        /*
+         * Over allocate so that the buffer can start on a huge page
+         * boundary, then trim the ends of the mapping.
+         */
+
+        address = mmap(NULL, mapping_length + HUGE_PAGE_SIZE_2M,
+                       PROT_READ | PROT_WRITE, flags & ~MAP_POPULATE, -1, 0);
+        if (address == MAP_FAILED) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i allocate_buffer   ERROR mode: %s length: %lu errno: %d\n",
+                    uts_info.nodename, rank_id, buffer_mode_string(mode),
+                    (unsigned long) length, errno);
+            return -1;
+        }
+
+        offset = (HUGE_PAGE_SIZE_2M -
+                  ((uint64_t) address & (HUGE_PAGE_SIZE_2M - 1))) &
+                 (HUGE_PAGE_SIZE_2M - 1);
+
+        if (offset != 0) {
+            munmap(address, offset);
+        }
+
+        munmap(address + offset + mapping_length, HUGE_PAGE_SIZE_2M - offset);
+        address += offset;
+
+        madvise(address, mapping_length, MADV_HUGEPAGE);
+    } else {
+        address = mmap(NULL, mapping_length, PROT_READ | PROT_WRITE, flags,
+                       -1, 0);
+        if (address == MAP_FAILED) {
+
+            /*
+             * This usually means that not enough huge pages have been
+             * reserved on the node.
+             */
+
+            fprintf(stdout,
+                    "[%s] Rank: %4i allocate_buffer   ERROR mode: %s length: %lu errno: %d\n",
+                    uts_info.nodename, rank_id, buffer_mode_string(mode),
+                    (unsigned long) length, errno);
+            return -1;
+        }
+    }
+
+    if (numa_node != NUMA_NODE_UNSPECIFIED) {
+        if (bind_buffer_to_numa_node(address, mapping_length, numa_node) != 0) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i allocate_buffer   ERROR binding to NUMA node: %i errno: %d\n",
+                    uts_info.nodename, rank_id, numa_node, errno);
+            munmap(address, mapping_length);
+            return -1;
+        }
+    }
+
+    if ((mode & BUFFER_POPULATE) &&
+        ((mode & BUFFER_PAGE_THP) || (numa_node != NUMA_NODE_UNSPECIFIED))) {
+
+        /*
+         * The mmap did not pre-fault these pages, so touch one word in
+         * each of them.
+         */
+
+        for (i = 0; i < mapping_length; i += page_size) {
+            address[i] = 0;
+        }
+    }
+
+    if (mode & BUFFER_MLOCK) {
+        if (mlock(address, mapping_length) != 0) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i allocate_buffer   WARNING mlock of %lu bytes failed errno: %d\n",
+                    uts_info.nodename, rank_id,
+                    (unsigned long) mapping_length, errno);
+        }
+    }
+
+    *buffer = address;
+
+    return 0;
+}
+
+/*
+ * free_buffer releases a buffer that was allocated by allocate_buffer.
+ */
+
+static void
+free_buffer(void *buffer, size_t length, int mode)
+{
+    size_t          mapping_length;
+
+    if (buffer == NULL) {
+        return;
+    }
+
+    mapping_length = buffer_mapping_length(length, mode);
+
+    if (mode & BUFFER_MLOCK) {
+        munlock(buffer, mapping_length);
+    }
+
+    munmap(buffer, mapping_length);
+}
+
+/*
+ * timed_mem_register registers memory with the NIC exactly like
+ * GNI_MemRegister and adds the time it took to registration_nsec.  The
+ * totals are updated atomically, so that threads may register memory
+ * concurrently.
+ *
+ *   Returns: the status from GNI_MemRegister.
+ */
+
+static gni_return_t
+timed_mem_register(gni_nic_handle_t nic_handle, uint64_t address,
+                   uint64_t length, gni_cq_handle_t dst_cq_handle,
+                   uint32_t flags, uint32_t vmdh_index,
+                   gni_mem_handle_t *memory_handle)
+{
+    double          start_time;
+    gni_return_t    status;
+
+    start_time = get_timestamp();
+
+    status = GNI_MemRegister(nic_handle, address, length, dst_cq_handle,
+                             flags, vmdh_index, memory_handle);
+
+    __sync_fetch_and_add(&registration_nsec,
+                         (uint64_t) ((get_timestamp() - start_time) * 1.0e9));
+
+    if (status == GNI_RC_SUCCESS) {
+        __sync_fetch_and_add(&registration_bytes, length);
+        __sync_fetch_and_add(&registration_count, 1);
+    }
+
+    return status;
+}
+
+/*
+ * print_buffer_statistics reports the time that was spent registering
+ * memory with the buffer mode that was used.  All of the ranks must
+ * call this function.
+ */
+
+static void
+print_buffer_statistics(void)
+{
+    char            label[128];
+
+    snprintf(label, sizeof(label),
+             "GNI_MemRegister mode: %s regions: %lu bytes: %lu time",
+             buffer_mode_string(buffer_mode), registration_count,
+             registration_bytes);
+
+    print_rank_statistic(label, registration_nsec / 1.0e3, "usec",
+                         RESULT_LOWER_IS_BETTER);
+}
+
+#endif /* BUFFER_FUNCTIONS_H */
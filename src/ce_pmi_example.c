@@ -49,6 +49,7 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "trace_functions.h"
 
 void print_help(void)
 {
@@ -311,8 +312,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -320,6 +323,12 @@ main(int argc, char **argv)
     rc = PMI_Get_rank(&rank_id);
     assert(rc == PMI_SUCCESS);
 
+    rc = trace_init(rank_id, uts_info.nodename, command_name);
+    if (rc != 0) {
+        fprintf(stdout, "[%s] Rank: %4i trace_init WARNING failed, running with tracing disabled\n",
+                uts_info.nodename, rank_id);
+    }
+
     status = GNI_GetDeviceType(&interconnect);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout, "[%s] Rank: %4i GNI_GetDeviceType failed, Error status: %d\n",
@@ -525,8 +534,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     if (use_short == 1) {
 
@@ -689,6 +700,16 @@ main(int argc, char **argv)
 
     cdm_id = rank_id * CDM_ID_MULTIPLIER;
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("ce_command", "0x%x", (unsigned int) ce_command);
+    add_result_metadata("branches", "%u", branches);
+    add_result_metadata("only_leaders", "%u", only_leaders);
+    add_result_metadata("short", "%i", use_short);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+
     /*
      * Create a handle to the communication domain.
      *    cdm_id is the rank of this instance of the job.
@@ -699,7 +720,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate     ERROR status: %s (%d)\n",
@@ -723,7 +746,9 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status = GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -759,8 +784,10 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status = GNI_CqCreate(nic_handle, number_of_cq_entries, 0, cq_mode,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      local ERROR status: %s (%d)\n",
@@ -788,12 +815,16 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
 
     /*
      * Create the endpoints to all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_EP_SETUP);
+
     for (i = 0; i < number_of_ranks; i++) {
         if ((only_leaders == 0) || ((node_leader == 1) && (node_leaders[i] == 1))) {
             /*
@@ -860,11 +891,17 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * wait for all the processes to initialize their communication paths
      */
+    trace_mark(TRACE_BARRIER_ENTER);
     rc = PMI_Barrier();
     assert(rc == PMI_SUCCESS);
+    trace_mark(TRACE_BARRIER_EXIT);
+
+    print_startup_profile();
 
     if (node_leader == 1) {
         local_endpoint_handles_array = (gni_ep_handle_t *)calloc(number_of_ranks_on_node,
@@ -1361,8 +1398,10 @@ main(int argc, char **argv)
     /*
      * wait for all the processes to sync up before sending requests
      */
+    trace_mark(TRACE_BARRIER_ENTER);
     rc = PMI_Barrier();
     assert(rc == PMI_SUCCESS);
+    trace_mark(TRACE_BARRIER_EXIT);
 
     if ((only_leaders == 0) || (node_leader == 1)) {
         memset(result_buffer, 0, sizeof(*result_buffer));
@@ -1977,6 +2016,10 @@ main(int argc, char **argv)
          * Post the request.
          */
 
+        if (TRACE_ENABLED) {
+            trace_record(TRACE_POST_CE, -1, 0, 0, 0, 0, 0, post_desc.ce_cmd, 0);
+        }
+
         status = GNI_PostFma(leaf_ep, &post_desc);
         if (status != GNI_RC_SUCCESS) {
             if ((ce_command == GNI_FMA_CE_FPADD) && (status == GNI_RC_ILLEGAL_OP)) {
@@ -2019,6 +2062,12 @@ main(int argc, char **argv)
 
             status = GNI_GetCompleted(cq_handle, current_event, &completed_post_desc_ptr);
             if (status == GNI_RC_SUCCESS) {
+                if (TRACE_ENABLED) {
+                    trace_record(TRACE_COMPLETED_CE, -1, 0,
+                                 completed_post_desc_ptr->ce_cmd, 0, 0, 0,
+                                 current_event, 0);
+                }
+
                 if (v_option > 1) {
                     fprintf(stdout,
                             "[%s] Rank: %4i GNI_GetCompleted  cmd: 0x%04x, event: 0x%016lx\n",
@@ -2033,6 +2082,10 @@ main(int argc, char **argv)
                     sched_yield();
                 }
 
+                if (TRACE_ENABLED) {
+                    trace_record(TRACE_CE_RESULT, -1, 0, 0, 0, 0, 0, 0, status);
+                }
+
                 if (status != GNI_RC_SUCCESS && status != GNI_RC_TRANSACTION_ERROR) {
                     fprintf(stdout,
                             "[%s] Rank: %4i GNI_CeCheckResult ERROR status: %s (%d)\n",
@@ -2390,8 +2443,10 @@ main(int argc, char **argv)
      * Wait for all the processes to finish before we clean up and exit.
      */
 
+    trace_mark(TRACE_BARRIER_ENTER);
     rc = PMI_Barrier();
     assert(rc == PMI_SUCCESS);
+    trace_mark(TRACE_BARRIER_EXIT);
 
     sleep(1);
 
@@ -2561,6 +2616,8 @@ main(int argc, char **argv)
 
   EXIT_TEST:
 
+    trace_finish();
+
     /*
      * Display the results from this test.
      */
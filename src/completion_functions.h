@@ -0,0 +1,274 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * This header file contains the functions used to drain the completion
+ * queue in batches.
+ *
+ * Each posted transfer's post_id is entered in an open addressing table
+ * along with the transfer's index.  The completed descriptors are found
+ * in the table, so the transfers may complete in any order, as they can
+ * with GNI_DLVMODE_PERFORMANCE, and the number of outstanding transfers
+ * does not change the cost of matching a completion.  A post_id of 0
+ * marks an empty slot and can not be used.
+ *
+ * The indexes of zero and above are the transfer numbers, a completion
+ * with a lower index than one before it is counted as out of order.
+ * Other posts, such as flags, are entered with indexes below -1 and are
+ * not counted.
+ */
+
+#ifndef COMPLETION_FUNCTIONS_H
+#define COMPLETION_FUNCTIONS_H
+
+#define CQ_DRAIN_BATCH           64
+#define POST_ID_HASH_MULTIPLIER  0x9e3779b97f4a7c15UL
+
+typedef struct {
+    uint64_t        post_id;
+    int             index;
+} post_id_slot_t;
+
+typedef struct {
+    post_id_slot_t *slots;
+    uint64_t        mask;
+    unsigned int    shift;
+    uint64_t        outstanding;
+    int             highest_index;  /* highest index completed so far */
+    uint64_t        out_of_order;   /* completed after a later transfer */
+    uint64_t        drains;
+    uint64_t        events;
+} post_id_table_t;
+
+/*
+ * post_id_table_init sizes the table for the maximum number of
+ * outstanding transfers, the table is kept at most half full.
+ */
+
+static void
+post_id_table_init(post_id_table_t *table, int max_outstanding)
+{
+    uint64_t        size = 2;
+    unsigned int    bits = 1;
+
+    while (size < 2 * (uint64_t) max_outstanding) {
+        size <<= 1;
+        bits++;
+    }
+
+    memset(table, 0, sizeof(post_id_table_t));
+    table->slots = (post_id_slot_t *) calloc(size, sizeof(post_id_slot_t));
+    assert(table->slots != NULL);
+    table->mask = size - 1;
+    table->shift = 64 - bits;
+    table->highest_index = -1;
+}
+
+static void
+post_id_table_free(post_id_table_t *table)
+{
+    free(table->slots);
+    table->slots = NULL;
+}
+
+static inline uint64_t
+post_id_hash(post_id_table_t *table, uint64_t post_id)
+{
+    return (post_id * POST_ID_HASH_MULTIPLIER) >> table->shift;
+}
+
+/*
+ * post_id_table_insert enters a posted transfer.
+ */
+
+static void
+post_id_table_insert(post_id_table_t *table, uint64_t post_id, int index)
+{
+    uint64_t        slot;
+
+    assert(post_id != 0);
+    assert(table->outstanding <= table->mask / 2);
+
+    slot = post_id_hash(table, post_id);
+    while (table->slots[slot].post_id != 0) {
+        slot = (slot + 1) & table->mask;
+    }
+
+    table->slots[slot].post_id = post_id;
+    table->slots[slot].index = index;
+    table->outstanding++;
+}
+
+/*
+ * post_id_table_remove finds a completed transfer and removes it.  The
+ * entries after it are shifted back, so no tombstones are left behind.
+ *
+ *   Returns: the transfer's index, or -1 if the post_id is not in the table.
+ */
+
+static int
+post_id_table_remove(post_id_table_t *table, uint64_t post_id)
+{
+    uint64_t        home;
+    int             index;
+    uint64_t        next;
+    uint64_t        slot;
+
+    slot = post_id_hash(table, post_id);
+    while (table->slots[slot].post_id != post_id) {
+        if (table->slots[slot].post_id == 0) {
+            return -1;
+        }
+        slot = (slot + 1) & table->mask;
+    }
+
+    index = table->slots[slot].index;
+    table->outstanding--;
+
+    next = (slot + 1) & table->mask;
+    while (table->slots[next].post_id != 0) {
+        home = post_id_hash(table, table->slots[next].post_id);
+
+        /*
+         * Move the entry into the hole unless its home is between the
+         * hole and the entry.
+         */
+
+        if (((next - home) & table->mask) >= ((next - slot) & table->mask)) {
+            table->slots[slot] = table->slots[next];
+            slot = next;
+        }
+        next = (next + 1) & table->mask;
+    }
+    table->slots[slot].post_id = 0;
+
+    if (index < 0) {
+        return index;
+    }
+
+    if (index < table->highest_index) {
+        table->out_of_order++;
+    } else {
+        table->highest_index = index;
+    }
+
+    return index;
+}
+
+/*
+ * collect_cq_events removes up to max_events events from the completion
+ * queue and matches each completed descriptor to its transfer.
+ *
+ *   cq_handle is the completion queue handle.
+ *   table holds the outstanding transfers.
+ *   label names the transfers in the error messages.
+ *   max_events is the size of the completed arrays.
+ *   wait is 1 to wait for the first event, 0 to return when the
+ *       completion queue is empty.
+ *   completed returns the index of each completed transfer.
+ *   completed_events returns the event of each completed transfer.
+ *   error returns 0, or the reason the drain stopped early:
+ *       1, 2 or 3 as returned by get_cq_event
+ *       4 when GNI_GetCompleted failed
+ *       5 when the post_id is not an outstanding transfer
+ *
+ * Only the first event is waited for, the rest of the batch are the
+ * events that are already in the completion queue.
+ *
+ *   Returns: the number of completed transfers.
+ */
+
+static int
+collect_cq_events(gni_cq_handle_t cq_handle, post_id_table_t *table,
+                  char *label, int max_events, int wait, int *completed,
+                  gni_cq_entry_t *completed_events, int *error)
+{
+    gni_cq_entry_t  current_event;
+    gni_post_descriptor_t *event_post_desc_ptr;
+    int             count = 0;
+    int             index;
+    int             rc;
+    gni_return_t    status;
+
+    *error = 0;
+    table->drains++;
+
+    while (count < max_events) {
+        rc = get_cq_event(cq_handle, uts_info, rank_id, 1,
+                          ((count == 0) && wait) ? 1 : 0, &current_event);
+        if ((rc == 3) && ((count > 0) || !wait)) {
+            /*
+             * The completion queue is empty.
+             */
+
+            break;
+        } else if (rc != 0) {
+            *error = rc;
+            break;
+        }
+
+        table->events++;
+
+        /*
+         * Complete the event, which removes the current event's post
+         * descriptor from the event queue.
+         */
+
+        status = GNI_GetCompleted(cq_handle, current_event, &event_post_desc_ptr);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i GNI_GetCompleted  %s ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, label, gni_err_str[status], status);
+            *error = 4;
+            break;
+        }
+
+        index = post_id_table_remove(table, event_post_desc_ptr->post_id);
+        if (index < 0) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Completed %s ERROR received post_id: %lu is not outstanding\n",
+                    uts_info.nodename, rank_id, label,
+                    event_post_desc_ptr->post_id);
+            *error = 5;
+            break;
+        }
+
+        completed[count] = index;
+        completed_events[count] = current_event;
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * drain_cq_events waits for at least one completed transfer, see
+ * collect_cq_events.
+ */
+
+static inline int
+drain_cq_events(gni_cq_handle_t cq_handle, post_id_table_t *table,
+                char *label, int max_events, int *completed,
+                gni_cq_entry_t *completed_events, int *error)
+{
+    return collect_cq_events(cq_handle, table, label, max_events, 1,
+                             completed, completed_events, error);
+}
+
+/*
+ * poll_cq_events only takes the completed transfers that are already in
+ * the completion queue, it returns 0 without an error when there are
+ * none.  See collect_cq_events.
+ */
+
+static inline int
+poll_cq_events(gni_cq_handle_t cq_handle, post_id_table_t *table,
+               char *label, int max_events, int *completed,
+               gni_cq_entry_t *completed_events, int *error)
+{
+    return collect_cq_events(cq_handle, table, label, max_events, 0,
+                             completed, completed_events, error);
+}
+
+#endif /* COMPLETION_FUNCTIONS_H */
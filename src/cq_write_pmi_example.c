@@ -125,8 +125,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -176,8 +178,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     /*
      * Determine the number of passes required for this test to be successful.
@@ -193,6 +197,15 @@ main(int argc, char **argv)
                                               sizeof(gni_post_descriptor_t));
     assert(data_desc != NULL);
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%u", transfers);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) TRANSFER_LENGTH_IN_BYTES);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+
     /*
      * Create a handle to the communication domain.
      *    rank_id is the rank of the instance of the job.
@@ -203,7 +216,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(rank_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate     ERROR status: %s (%d)\n",
@@ -227,8 +242,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status =
         GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -266,9 +283,11 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      sourceERROR status: %s (%d)\n",
@@ -308,9 +327,11 @@ main(int argc, char **argv)
      *          newly created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_dest_cq_entries, 0,
                      GNI_CQ_NOBLOCK, NULL, NULL, &destination_cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      destination ERROR status: %s (%d)\n",
@@ -338,12 +359,16 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
 
     /*
      * Create the endpoints to all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_EP_SETUP);
+
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
             continue;
@@ -413,6 +438,8 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * Allocate the buffer that will receive the data.
      */
@@ -440,11 +467,13 @@ main(int argc, char **argv)
      *     remote_memory_handle is the handle for this memory region.
      */
 
+    startup_phase_begin(STARTUP_MEM_REGISTER);
     status = GNI_MemRegister(nic_handle, (uint64_t) receive_buffer,
                              TRANSFER_LENGTH_IN_BYTES,
                              destination_cq_handle,
                              GNI_MEM_READWRITE,
                              vmdh_index, &remote_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   receive_buffer ERROR status: %s (%d)\n",
@@ -477,8 +506,12 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&memory_handle, remote_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -228,8 +228,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -357,8 +359,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     /*
      * If using rank 0 as a server, then bind all of the other ranks.
@@ -402,6 +406,17 @@ main(int argc, char **argv)
         }
     }
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%u", transfers);
+    add_result_metadata("bound", "%i", use_bound);
+    add_result_metadata("probe", "%i", use_probe);
+    add_result_metadata("wait", "%i", use_wait);
+    add_result_metadata("timeout", "%i", (int) timeout_value);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+
     /*
      * Create a handle to the communication domain.
      *    rank_id is the rank of the instance of the job.
@@ -412,7 +427,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(rank_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate          ERROR status: %s (%d)\n",
@@ -436,8 +453,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status = GNI_CdmAttach(cdm_handle, device_id, &local_address,
                            &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach          ERROR status: %s (%d)\n",
@@ -479,8 +498,10 @@ main(int argc, char **argv)
      *          this newly created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status = GNI_CqCreate(nic_handle, number_of_cq_entries, 0,
                           GNI_CQ_NOBLOCK, NULL, NULL, &source_cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate           source ERROR status: %s (%d)\n",
@@ -508,12 +529,16 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
 
     /*
      * Create the endpoints to all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_EP_SETUP);
+
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
             continue;
@@ -607,6 +632,10 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
+    print_startup_profile();
+
     /*
      * Allocate memory to hold the datagrams from the remote nodes.
      */
@@ -53,6 +53,7 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "buffer_functions.h"
 
 void print_help(void)
 {
@@ -90,12 +91,17 @@ void print_help(void)
 "      2.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
 "      3.  '-f' use a fetching AMO command.\n"
 "      4.  '-h' prints the help information for this example.\n"
-"      5.  '-I' for FPIMAX or FPIMIN reverse the comparision values.\n"
-"      6.  '-m' use the FPIMIN AMO command.\n"
-"      7.  '-M' use the FPIMAX AMO command.\n"
-"      8.  '-n' specifies the number of data transactions that will be sent.\n"
+"      5.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      6.  '-I' for FPIMAX or FPIMIN reverse the comparision values.\n"
+"      7.  '-m' use the FPIMIN AMO command.\n"
+"      8.  '-M' use the FPIMAX AMO command.\n"
+"      9.  '-n' specifies the number of data transactions that will be sent.\n"
 "          The default value is 440 data transactions to be sent.\n"
-"      9.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
+"      10. '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
 "          messages to be displayed.  With each additional 'v' more\n"
 "          information will be displayed.\n"
 "          The default value is no output or debug messages will be\n"
@@ -203,8 +209,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -231,7 +239,7 @@ main(int argc, char **argv)
 
     local_event_id = rank_id;
 
-    while ((opt = getopt(argc, argv, "CefhImMn:v")) != -1) {
+    while ((opt = getopt(argc, argv, "CefhH:ImMn:v")) != -1) {
         switch (opt) {
         case 'C':
             use_cache_request = 1;
@@ -259,6 +267,26 @@ main(int argc, char **argv)
 
             exit(0);
 
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
         case 'I':
             do_invalid_compare = 1;
 
@@ -303,8 +331,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     if (use_fetch == 1) {
         switch (amo_command) {
@@ -356,6 +386,17 @@ main(int argc, char **argv)
     expected_passed = transfers * 5;
     cdm_id = rank_id * CDM_ID_MULTIPLIER;
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%u", transfers);
+    add_result_metadata("amo_command", "0x%x", (unsigned int) amo_command);
+    add_result_metadata("fetch", "%i", use_fetch);
+    add_result_metadata("cache_request", "%i", use_cache_request);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
     /*
      * Create a handle to the communication domain.
      *    cdm_id is the rank of this instance of the job.
@@ -366,7 +407,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate     ERROR status: %s (%d)\n",
@@ -390,7 +433,9 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status = GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -427,8 +472,10 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status = GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      local ERROR status: %s (%d)\n",
@@ -466,8 +513,10 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status = GNI_CqCreate(nic_handle, number_of_source_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &source_cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      source ERROR status: %s (%d)\n",
@@ -495,12 +544,16 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
 
     /*
      * Create the endpoints to all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_EP_SETUP);
+
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
             continue;
@@ -590,13 +643,17 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * Allocate the buffer that will contain the data to be sent.
      */
 
-    rc = posix_memalign((void **) &source_buffer, byte_alignment,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &source_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
+    assert(((uint64_t) source_buffer % byte_alignment) == 0);
 
     /*
      * Register the memory associated for the source buffer with the NIC.
@@ -613,10 +670,12 @@ main(int argc, char **argv)
      *     source_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) source_buffer,
-                             (TRANSFER_LENGTH_IN_BYTES * transfers),
-                             source_cq_handle, GNI_MEM_READWRITE,
-                             vmdh_index, &source_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) source_buffer,
+                                (TRANSFER_LENGTH_IN_BYTES * transfers),
+                                source_cq_handle, GNI_MEM_READWRITE,
+                                vmdh_index, &source_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   source_buffer ERROR status: %s (%d)\n",
@@ -638,9 +697,11 @@ main(int argc, char **argv)
      * all of the transfers.
      */
 
-    rc = posix_memalign((void **) &target_buffer, byte_alignment,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &target_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
+    assert(((uint64_t) target_buffer % byte_alignment) == 0);
 
     /*
      * Register the memory associated for the receive buffer with the NIC.
@@ -658,10 +719,12 @@ main(int argc, char **argv)
      *     target_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) target_buffer,
-                             (TRANSFER_LENGTH_IN_BYTES * transfers), NULL,
-                             GNI_MEM_READWRITE, vmdh_index,
-                             &target_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) target_buffer,
+                                (TRANSFER_LENGTH_IN_BYTES * transfers), NULL,
+                                GNI_MEM_READWRITE, vmdh_index,
+                                &target_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
 
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
@@ -695,8 +758,12 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&my_memory_handle, source_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -1320,7 +1387,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(target_buffer);
+        free_buffer(target_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_SOURCE:
@@ -1348,7 +1416,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(source_buffer);
+        free_buffer(source_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
   EXIT_ENDPOINT:
@@ -1472,6 +1541,12 @@ main(int argc, char **argv)
 
   EXIT_TEST:
 
+    /*
+     * Display the time spent registering the data buffers.
+     */
+
+    print_buffer_statistics();
+
     /*
      * Display the results from this test.
      */
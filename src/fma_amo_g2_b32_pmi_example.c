@@ -53,6 +53,7 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "buffer_functions.h"
 
 void print_help(void)
 {
@@ -79,9 +80,14 @@ void print_help(void)
 "      5.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
 "      6.  '-f' use a fetching AMO command.\n"
 "      7.  '-h' prints the help information for this example.\n"
-"      8.  '-I' use an invalid compare operand for the COMPARE and SWAP AMO\n"
+"      8.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      9.  '-I' use an invalid compare operand for the COMPARE and SWAP AMO\n"
 "          command or for IMAX or IMIN reverse the comparision values.\n"
-"      9.  '-m' use the IMIN AMO command.\n"
+"      10. '-m' use the IMIN AMO command.\n"
 "     10.  '-M' use the IMAX AMO command.\n"
 "     11.  '-n' specifies the number of data transactions that will be sent.\n"
 "          The default value is 440 data transactions to be sent.\n"
@@ -241,8 +247,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -269,7 +277,7 @@ main(int argc, char **argv)
 
     local_event_id = rank_id;
 
-    while ((opt = getopt(argc, argv, "ab:cCefhImMn:osvxX")) != -1) {
+    while ((opt = getopt(argc, argv, "ab:cCefhH:ImMn:osvxX")) != -1) {
         switch (opt) {
         case 'a':
             amo_command = GNI_FMA_ATOMIC2_IADD_S;
@@ -322,6 +330,26 @@ main(int argc, char **argv)
 
             exit(0);
 
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
         case 'I':
             do_invalid_compare = 1;
             invalid_compare_value = INVALID_COMPARE_VALUE;
@@ -390,8 +418,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     if (use_fetch == 1) {
         switch (amo_command) {
@@ -504,6 +534,20 @@ main(int argc, char **argv)
 
     cdm_id = rank_id * CDM_ID_MULTIPLIER;
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%u", transfers);
+    add_result_metadata("amo_command", "0x%x", (unsigned int) amo_command);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) transfer_length_in_bytes);
+    add_result_metadata("buffer_size", "%u", buffer_size);
+    add_result_metadata("fetch", "%i", use_fetch);
+    add_result_metadata("cache_request", "%i", use_cache_request);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
     /*
      * Create a handle to the communication domain.
      *    cdm_id is the rank of this instance of the job.
@@ -514,7 +558,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate     ERROR status: %s (%d)\n",
@@ -538,7 +584,9 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status = GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -575,8 +623,10 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status = GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      local ERROR status: %s (%d)\n",
@@ -614,8 +664,10 @@ main(int argc, char **argv)
      *          this newly created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status = GNI_CqCreate(nic_handle, number_of_source_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &source_cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      source ERROR status: %s (%d)\n",
@@ -643,12 +695,16 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
 
     /*
      * Create the endpoints to all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_EP_SETUP);
+
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
             continue;
@@ -738,13 +794,17 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * Allocate the buffer that will contain the data to be sent.
      */
 
-    rc = posix_memalign((void **) &source_buffer, byte_alignment,
-                        (transfer_length_in_bytes * transfers));
+    rc = allocate_buffer((void **) &source_buffer,
+                         (transfer_length_in_bytes * transfers), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
+    assert(((uint64_t) source_buffer % byte_alignment) == 0);
 
     /*
      * Register the memory associated for the source buffer with the NIC.
@@ -761,10 +821,12 @@ main(int argc, char **argv)
      *     source_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) source_buffer,
-                             (transfer_length_in_bytes * transfers),
-                             source_cq_handle, GNI_MEM_READWRITE,
-                             vmdh_index, &source_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) source_buffer,
+                                (transfer_length_in_bytes * transfers),
+                                source_cq_handle, GNI_MEM_READWRITE,
+                                vmdh_index, &source_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   source_buffer ERROR status: %s (%d)\n",
@@ -786,9 +848,11 @@ main(int argc, char **argv)
      * all of the transfers.
      */
 
-    rc = posix_memalign((void **) &target_buffer, byte_alignment,
-                        (transfer_length_in_bytes * transfers));
+    rc = allocate_buffer((void **) &target_buffer,
+                         (transfer_length_in_bytes * transfers), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
+    assert(((uint64_t) target_buffer % byte_alignment) == 0);
 
     /*
      * Register the memory associated for the receive buffer with the NIC.
@@ -806,10 +870,12 @@ main(int argc, char **argv)
      *     target_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) target_buffer,
-                             (transfer_length_in_bytes * transfers), NULL,
-                             GNI_MEM_READWRITE, vmdh_index,
-                             &target_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) target_buffer,
+                                (transfer_length_in_bytes * transfers), NULL,
+                                GNI_MEM_READWRITE, vmdh_index,
+                                &target_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
 
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
@@ -843,8 +909,12 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&my_memory_handle, source_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -1701,7 +1771,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(target_buffer);
+        free_buffer(target_buffer, (transfer_length_in_bytes * transfers),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_SOURCE:
@@ -1729,7 +1800,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(source_buffer);
+        free_buffer(source_buffer, (transfer_length_in_bytes * transfers),
+                    buffer_mode);
     }
 
   EXIT_ENDPOINT:
@@ -1853,6 +1925,12 @@ main(int argc, char **argv)
 
   EXIT_TEST:
 
+    /*
+     * Display the time spent registering the data buffers.
+     */
+
+    print_buffer_statistics();
+
     /*
      * Display the results from this test.
      */
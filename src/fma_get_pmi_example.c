@@ -44,6 +44,8 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "buffer_functions.h"
+#include "pattern_functions.h"
 
 void print_help(void)
 {
@@ -68,10 +70,15 @@ void print_help(void)
 "          be created.\n"
 "      2.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
 "      3.  '-h' prints the help information for this example.\n"
-"      4.  '-n' specifies the number of data transactions that will be\n"
+"      4.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      5.  '-n' specifies the number of data transactions that will be\n"
 "          received.\n"
 "          The default value is 10 data transactions to be received.\n"
-"      5.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
+"      6.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
 "          messages to be displayed.  With each additional 'v' more\n"
 "          information will be displayed.\n"
 "          The default value is no output or debug messages will be\n"
@@ -154,8 +161,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -165,7 +174,7 @@ main(int argc, char **argv)
 
     local_event_id = rank_id;
 
-    while ((opt = getopt(argc, argv, "Dehn:v")) != -1) {
+    while ((opt = getopt(argc, argv, "DehH:n:v")) != -1) {
         switch (opt) {
         case 'D':
             /* Do not create a destination completion queue. */
@@ -190,6 +199,26 @@ main(int argc, char **argv)
 
             exit(0);
 
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
         case 'n':
 
             /*
@@ -217,8 +246,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     /*
      * Determine the number of passes required for this test to be successful.
@@ -240,6 +271,17 @@ main(int argc, char **argv)
 
     cdm_id = rank_id * CDM_ID_MULTIPLIER;
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%u", transfers);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) TRANSFER_LENGTH_IN_BYTES);
+    add_result_metadata("destination_cq", "%i", create_destination_cq);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
     /*
      * Create a handle to the communication domain.
      *    cdm_id is the rank of this instance of the job.
@@ -250,7 +292,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate     ERROR status: %s (%d)\n",
@@ -274,8 +318,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status =
         GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -312,9 +358,11 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      source ERROR status: %s (%d)\n",
@@ -353,10 +401,12 @@ main(int argc, char **argv)
          *          this newly created completion queue.
          */
 
+        startup_phase_begin(STARTUP_CQ_CREATE);
         status =
             GNI_CqCreate(nic_handle, number_of_dest_cq_entries, 0,
                          GNI_CQ_NOBLOCK, NULL, NULL,
                          &destination_cq_handle);
+        startup_phase_end(STARTUP_CQ_CREATE);
         if (status != GNI_RC_SUCCESS) {
             fprintf(stdout,
                     "[%s] Rank: %4i GNI_CqCreate      destination ERROR status: %s (%d)\n",
@@ -385,12 +435,16 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
 
     /*
      * Create the endpoints to all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_EP_SETUP);
+
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
             continue;
@@ -482,19 +536,16 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * Allocate the buffer that will contain the data to be sent.
      */
 
-    rc = posix_memalign((void **) &source_buffer, 64, TRANSFER_LENGTH_IN_BYTES);
+    rc = allocate_buffer((void **) &source_buffer, TRANSFER_LENGTH_IN_BYTES,
+                         buffer_mode, NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(source_buffer, 0, TRANSFER_LENGTH_IN_BYTES);
-
     /*
      * Register the memory associated for the source buffer with the NIC.
      * We are sending the data from this buffer not receiving into it.
@@ -510,10 +561,12 @@ main(int argc, char **argv)
      *     source_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) source_buffer,
-                             TRANSFER_LENGTH_IN_BYTES,
-                             destination_cq_handle, GNI_MEM_READWRITE,
-                             vmdh_index, &source_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) source_buffer,
+                                TRANSFER_LENGTH_IN_BYTES,
+                                destination_cq_handle, GNI_MEM_READWRITE,
+                                vmdh_index, &source_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   source_buffer ERROR status: %s (%d)\n",
@@ -535,16 +588,11 @@ main(int argc, char **argv)
      * all of the transfers.
      */
 
-    rc = posix_memalign((void **) &target_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &target_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(target_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
-
     /*
      * Register the memory associated for the receive buffer with the NIC.
      * We are receiving the data into this buffer.
@@ -561,11 +609,13 @@ main(int argc, char **argv)
      *     target_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) target_buffer,
-                             TRANSFER_LENGTH_IN_BYTES *
-                             transfers, NULL,
-                             GNI_MEM_READWRITE, vmdh_index,
-                             &target_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) target_buffer,
+                                TRANSFER_LENGTH_IN_BYTES *
+                                transfers, NULL,
+                                GNI_MEM_READWRITE, vmdh_index,
+                                &target_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   target_buffer ERROR status: %s (%d)\n",
@@ -598,8 +648,12 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&my_memory_handle, source_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -656,9 +710,7 @@ main(int argc, char **argv)
 
         data = SEND_DATA + my_id + i + 1;
 
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
-            source_buffer[j] = data;
-        }
+        fill_pattern(source_buffer, TRANSFER_LENGTH, data);
 
         /*
          * Detemine what the received data will look like.
@@ -860,7 +912,15 @@ main(int argc, char **argv)
 
         compare_data_failed = 0;
 
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
+        /*
+         * Skip the elements that match using the vector compare, the loop
+         * below only reports the elements that do not.
+         */
+
+        j = verify_pattern(&target_buffer[TRANSFER_LENGTH * i],
+                           TRANSFER_LENGTH, target_data);
+
+        for (; j < TRANSFER_LENGTH; j++) {
             if (target_buffer[j + (TRANSFER_LENGTH * i)] != target_data) {
 
                 /*
@@ -969,7 +1029,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(target_buffer);
+        free_buffer(target_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_SOURCE:
@@ -997,7 +1058,7 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(source_buffer);
+        free_buffer(source_buffer, TRANSFER_LENGTH_IN_BYTES, buffer_mode);
     }
 
   EXIT_ENDPOINT:
@@ -1137,6 +1198,12 @@ main(int argc, char **argv)
 
     free(fma_data_desc);
 
+    /*
+     * Display the time spent registering the data buffers.
+     */
+
+    print_buffer_statistics();
+
     /*
      * Display the results from this test.
      */
@@ -46,6 +46,8 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "buffer_functions.h"
+#include "pattern_functions.h"
 
 void print_help(void)
 {
@@ -69,15 +71,20 @@ void print_help(void)
 "          be created.\n"
 "      2.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
 "      3.  '-h' prints the help information for this example.\n"
-"      4.  '-n' specifies the number of data transactions that will be sent.\n"
+"      4.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      5.  '-n' specifies the number of data transactions that will be sent.\n"
 "          The default value is 10 data transactions to be sent.\n"
-"      5.  '-O' specifies that the destination completion queue will be\n"
+"      6.  '-O' specifies that the destination completion queue will be\n"
 "          created with a very small number of entries.  This will cause an\n"
 "          overrun condition on the destination complete queue.\n"
 "          The default value is that the destination completion queue will\n"
 "          be created with a sufficient number of entries to not cause\n"
 "          the overrun condition to occur.  This implies that '-D' is ignored.\n"
-"      6.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
+"      7.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
 "          messages to be displayed.  With each additional 'v' more\n"
 "          information will be displayed.\n"
 "          The default value is no output or debug messages will be\n"
@@ -169,8 +176,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -180,7 +189,7 @@ main(int argc, char **argv)
 
     local_event_id = rank_id;
 
-    while ((opt = getopt(argc, argv, "Dehn:Ov")) != -1) {
+    while ((opt = getopt(argc, argv, "DehH:n:Ov")) != -1) {
         switch (opt) {
         case 'D':
             /* Do not create a destination completion queue. */
@@ -207,6 +216,26 @@ main(int argc, char **argv)
 
             exit(0);
 
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
         case 'n':
 
             /*
@@ -244,8 +273,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     /*
      * Determine the number of passes required for this test to be successful.
@@ -275,6 +306,18 @@ main(int argc, char **argv)
 
     cdm_id = rank_id * CDM_ID_MULTIPLIER;
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%u", transfers);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) TRANSFER_LENGTH_IN_BYTES);
+    add_result_metadata("destination_cq", "%i", create_destination_cq);
+    add_result_metadata("destination_overrun", "%i", create_destination_overrun);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
     /*
      * Create a handle to the communication domain.
      *    cdm_id is the rank of this instance of the job.
@@ -285,7 +328,9 @@ main(int argc, char **argv)
      *        the communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate     ERROR status: %s (%d)\n",
@@ -309,8 +354,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status =
         GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -347,9 +394,11 @@ main(int argc, char **argv)
      *          newly created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      source ERROR status: %s (%d)\n",
@@ -404,10 +453,12 @@ main(int argc, char **argv)
          *          newly created completion queue.
          */
 
+        startup_phase_begin(STARTUP_CQ_CREATE);
         status =
             GNI_CqCreate(nic_handle, number_of_dest_cq_entries, 0,
                          GNI_CQ_NOBLOCK, NULL, NULL,
                          &destination_cq_handle);
+        startup_phase_end(STARTUP_CQ_CREATE);
         if (status != GNI_RC_SUCCESS) {
             fprintf(stdout,
                     "[%s] Rank: %4i GNI_CqCreate      destination ERROR status: %s (%d)\n",
@@ -436,12 +487,16 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
 
     /*
      * Create the endpoints to all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_EP_SETUP);
+
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
             continue;
@@ -534,6 +589,8 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * Register the memory associated for the flag with the NIC.
      *     nic_handle is our NIC handle.
@@ -548,10 +605,12 @@ main(int argc, char **argv)
      *     my_flag_memory_handle is the handle for this memory region.
      */
 
+    startup_phase_begin(STARTUP_MEM_REGISTER);
     status =
         GNI_MemRegister(nic_handle, (uint64_t) & flag, length,
                         NULL, GNI_MEM_READWRITE,
                         vmdh_index, &my_flag_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   flag ERROR status: %s (%d)\n",
@@ -570,15 +629,10 @@ main(int argc, char **argv)
      * Allocate the buffer that will contain the data to be sent.
      */
 
-    rc = posix_memalign((void **) &send_buffer, 64, TRANSFER_LENGTH_IN_BYTES);
+    rc = allocate_buffer((void **) &send_buffer, TRANSFER_LENGTH_IN_BYTES,
+                         buffer_mode, NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(send_buffer, 0, TRANSFER_LENGTH_IN_BYTES);
-
     /*
      * Register the memory associated for the send buffer with the NIC.
      * We are sending the data from this buffer not receiving into it.
@@ -595,10 +649,12 @@ main(int argc, char **argv)
      *     source_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) send_buffer,
-                             TRANSFER_LENGTH_IN_BYTES,
-                             NULL, GNI_MEM_READWRITE,
-                             vmdh_index, &source_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) send_buffer,
+                                TRANSFER_LENGTH_IN_BYTES,
+                                NULL, GNI_MEM_READWRITE,
+                                vmdh_index, &source_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   send_buffer ERROR status: %s (%d)\n",
@@ -620,16 +676,11 @@ main(int argc, char **argv)
      * all of the transfers.
      */
 
-    rc = posix_memalign((void **) &receive_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &receive_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(receive_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
-
     /*
      * Register the memory associated for the receive buffer with the NIC.
      * We are receiving the data into this buffer.
@@ -645,11 +696,13 @@ main(int argc, char **argv)
      *     remote_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) receive_buffer,
-                             TRANSFER_LENGTH_IN_BYTES *
-                             transfers, destination_cq_handle,
-                             GNI_MEM_READWRITE, vmdh_index,
-                             &remote_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) receive_buffer,
+                                TRANSFER_LENGTH_IN_BYTES *
+                                transfers, destination_cq_handle,
+                                GNI_MEM_READWRITE, vmdh_index,
+                                &remote_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   receive_buffer ERROR status: %s (%d)\n",
@@ -681,8 +734,12 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&my_memory_handle, remote_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -742,9 +799,7 @@ main(int argc, char **argv)
 
         data = SEND_DATA + my_id + i + 1;
 
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
-            send_buffer[j] = data;
-        }
+        fill_pattern(send_buffer, TRANSFER_LENGTH, data);
 
         /*
          * Initialize the flag to be sent.
@@ -1215,7 +1270,25 @@ main(int argc, char **argv)
 
         compare_data_failed = 0;
 
-        for (j = 1; j < TRANSFER_LENGTH; j++) {
+        j = 1;
+
+        if (v_option) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Received          data transfer: %4i recv from: %4i remote addr: %p data: 0x%16lx\n",
+                    uts_info.nodename, rank_id, (i + 1), receive_from,
+                    &(receive_buffer[j + (TRANSFER_LENGTH * i)]),
+                    receive_buffer[j + (TRANSFER_LENGTH * i)]);
+        }
+
+        /*
+         * Skip the elements that match using the vector compare, the loop
+         * below only reports the elements that do not.
+         */
+
+        j += verify_pattern(&receive_buffer[1 + (TRANSFER_LENGTH * i)],
+                            TRANSFER_LENGTH - 1, receive_data);
+
+        for (; j < TRANSFER_LENGTH; j++) {
             if (receive_buffer[j + (TRANSFER_LENGTH * i)] != receive_data) {
 
                 /*
@@ -1229,14 +1302,6 @@ main(int argc, char **argv)
                         uts_info.nodename, rank_id, (i + 1),
                         j + (TRANSFER_LENGTH * i),
                         receive_buffer[j + (TRANSFER_LENGTH * i)], data);
-            } else if (j == 1) {
-                if (v_option) {
-                    fprintf(stdout,
-                            "[%s] Rank: %4i Received          data transfer: %4i recv from: %4i remote addr: %p data: 0x%16lx\n",
-                            uts_info.nodename, rank_id, (i + 1), receive_from,
-                            &(receive_buffer[j + (TRANSFER_LENGTH * i)]),
-                            receive_buffer[j + (TRANSFER_LENGTH * i)]);
-                }
             }
 
             /*
@@ -1252,9 +1317,7 @@ main(int argc, char **argv)
          * Clear out the receive buffer.
          */
 
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
-            receive_buffer[j + (TRANSFER_LENGTH * i)] = 0;
-        }
+        fill_pattern(&receive_buffer[TRANSFER_LENGTH * i], TRANSFER_LENGTH, 0);
 
         if (compare_data_failed != 0) {
 
@@ -1329,7 +1392,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(receive_buffer);
+        free_buffer(receive_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_SOURCE:
@@ -1357,7 +1421,7 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(send_buffer);
+        free_buffer(send_buffer, TRANSFER_LENGTH_IN_BYTES, buffer_mode);
     }
 
   EXIT_MEMORY_FLAG:
@@ -1522,6 +1586,12 @@ main(int argc, char **argv)
      */
 
     free(fma_data_desc);
+    /*
+     * Display the time spent registering the data buffers.
+     */
+
+    print_buffer_statistics();
+
     /*
      * Display the results from this test.
      */
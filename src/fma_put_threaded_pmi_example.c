@@ -0,0 +1,1086 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * Multi-threaded FMA injection rate test example - this test only uses PMI
+ *
+ * Note: this test should not be run oversubscribed on nodes, i.e. more
+ * threads on a given node than cpus, owing to the busy wait for
+ * completion events.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <malloc.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/utsname.h>
+#include <errno.h>
+#include "gni_pub.h"
+#include "pmi.h"
+
+#define CACHELINE_SIZE           64
+#define CDM_ID_MULTIPLIER        1000
+#define MAXIMUM_THREADS          64
+#define NUMBER_OF_TRANSFERS      100000
+#define SEND_DATA                0xdddd000000000000
+#define TRANSFER_LENGTH_IN_BYTES 8
+#define WINDOW_SIZE              64
+
+typedef struct {
+    gni_mem_handle_t mdh;
+    uint64_t        addr;
+} mdh_addr_t;
+
+/*
+ * thread_info_t contains the uGNI resources and the results for
+ * one injecting thread.
+ */
+
+typedef struct {
+    int             thread_id;
+    pthread_t       thread;
+    gni_cdm_handle_t cdm_handle;
+    gni_nic_handle_t nic_handle;
+    gni_cq_handle_t cq_handle;
+    gni_ep_handle_t endpoint_handle;
+    uint64_t       *source_buffer;
+    gni_mem_handle_t source_memory_handle;
+    gni_mem_handle_t target_memory_handle;
+    gni_post_descriptor_t *fma_desc;
+    int            *free_desc;
+    uint64_t        completed;
+    uint64_t        errors;
+    double          elapsed_time;
+    int             setup_failed;
+} thread_info_t;
+
+int             compare_data_failed = 0;
+int             rank_id;
+struct utsname  uts_info;
+int             v_option = 0;
+
+#include "utility_functions.h"
+#include "affinity_functions.h"
+#include "buffer_functions.h"
+#include "pattern_functions.h"
+
+/*
+ * Test parameters and resources shared by all of the threads.
+ */
+
+unsigned int   *all_nic_addresses;
+int             abort_phase = 0;
+int             cookie;
+int            *cores = NULL;
+int             first_core_index = 0;
+int             modes = 0;
+int             number_of_cores = 0;
+int             number_of_threads;
+uint8_t         ptag;
+int             send_to;
+mdh_addr_t      my_memory_handles[MAXIMUM_THREADS];
+mdh_addr_t     *remote_memory_handle_array;
+gni_cdm_handle_t shared_cdm_handle;
+gni_nic_handle_t shared_nic_handle;
+uint64_t       *target_buffer;
+uint32_t        target_slot_length;
+pthread_barrier_t thread_barrier;
+uint32_t        transfer_length_in_bytes = TRANSFER_LENGTH_IN_BYTES;
+uint32_t        transfers = NUMBER_OF_TRANSFERS;
+int             use_amo = 0;
+int             use_shared_nic = 0;
+uint32_t        window_size = WINDOW_SIZE;
+
+void print_help(void)
+{
+    fprintf(stdout,
+"\n"
+"FMA_PUT_THREADED_PMI_EXAMPLE\n"
+"  Purpose:\n"
+"    The purpose of this example is to measure how the FMA injection\n"
+"    message rate of a rank scales with the number of threads that are\n"
+"    posting FMA Put or AMO requests at the same time.\n"
+"\n"
+"  APIs:\n"
+"    This example will concentrate on using the following uGNI APIs:\n"
+"      - GNI_CdmCreate() is used once per thread, with an instance id\n"
+"        offset from the rank's instance id, or once per rank when the\n"
+"        NIC is shared by the threads.\n"
+"      - GNI_PostFma() is used with the 'PUT' or 'AMO' type to send a\n"
+"        data transaction to the matching thread of the next rank.\n"
+"\n"
+"  Parameters:\n"
+"    Additional parameters for this example are:\n"
+"      1.  '-a' specifies that an AMO add will be posted instead of a Put.\n"
+"      2.  '-c' specifies a list of cores, e.g. '0-31', that the threads of\n"
+"          the ranks on a node will be pinned to in order.\n"
+"          The default value is that the threads are not pinned.\n"
+"      3.  '-F' specifies that the communication domains will be created\n"
+"          with GNI_CDM_MODE_FMA_SHARED, so that the FMA descriptors are\n"
+"          shared between the communication domains on a node.\n"
+"      4.  '-h' prints the help information for this example.\n"
+"      5.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      6.  '-l' specifies the length of each Put in bytes.\n"
+"          The default value is 8 bytes.\n"
+"      7.  '-n' specifies the number of transactions posted by each thread.\n"
+"          The default value is 100000 transactions.\n"
+"      8.  '-s' specifies that all of the threads will share one\n"
+"          communication domain and NIC handle.  Each thread still creates\n"
+"          its own completion queue and endpoint.\n"
+"          The default value is one communication domain per thread.\n"
+"      9.  '-t' specifies the maximum number of threads.  The test is run\n"
+"          for 1, 2, 4, ... threads up to this value.\n"
+"          The default value is 1 thread.\n"
+"      10. '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
+"          messages to be displayed.  With each additional 'v' more\n"
+"          information will be displayed.\n"
+"          The default value is no output or debug messages will be\n"
+"          displayed.\n"
+"      11. '-w' specifies the number of outstanding transactions for each\n"
+"          thread.\n"
+"          The default value is 64 transactions.\n"
+"\n"
+"  Execution:\n"
+"    The following is a list of suggested example executions with various\n"
+"    options:\n"
+"      - fma_put_threaded_pmi_example -t 16\n"
+"      - fma_put_threaded_pmi_example -t 16 -F\n"
+"      - fma_put_threaded_pmi_example -t 16 -s\n"
+"      - fma_put_threaded_pmi_example -t 16 -a\n"
+"      - fma_put_threaded_pmi_example -t 16 -c 0-31\n"
+"\n"
+    );
+}
+
+/*
+ * setup_thread_resources creates the communication domain, completion
+ * queue and endpoint for a thread and registers its memory.
+ *
+ *   Returns:  0 on success
+ *            -1 on an error
+ */
+
+static int
+setup_thread_resources(thread_info_t *info)
+{
+    uint32_t        cdm_id;
+    unsigned int    local_address;
+    int             rc;
+    gni_return_t    status;
+
+    if (use_shared_nic == 0) {
+
+        /*
+         * Each thread gets its own communication domain.  The instance
+         * id is offset from the rank's instance id by the thread number,
+         * so that it is unique on the node.
+         */
+
+        cdm_id = (rank_id * CDM_ID_MULTIPLIER) + info->thread_id + 1;
+
+        status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &info->cdm_handle);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_CdmCreate     ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, info->thread_id,
+                    gni_err_str[status], status);
+            return -1;
+        }
+
+        status = GNI_CdmAttach(info->cdm_handle, 0, &local_address,
+                               &info->nic_handle);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_CdmAttach     ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, info->thread_id,
+                    gni_err_str[status], status);
+            GNI_CdmDestroy(info->cdm_handle);
+            info->cdm_handle = NULL;
+            return -1;
+        }
+
+        if (v_option > 1) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_CdmCreate     inst_id: %u modes: 0x%x\n",
+                    uts_info.nodename, rank_id, info->thread_id, cdm_id, modes);
+        }
+    } else {
+        info->nic_handle = shared_nic_handle;
+    }
+
+    /*
+     * Every thread has its own completion queue, sized to hold all of
+     * its outstanding transactions.
+     */
+
+    status = GNI_CqCreate(info->nic_handle, window_size, 0, GNI_CQ_NOBLOCK,
+                          NULL, NULL, &info->cq_handle);
+    if (status != GNI_RC_SUCCESS) {
+        fprintf(stdout,
+                "[%s] Rank: %4i Thread: %3i GNI_CqCreate      ERROR status: %s (%d)\n",
+                uts_info.nodename, rank_id, info->thread_id,
+                gni_err_str[status], status);
+        return -1;
+    }
+
+    status = GNI_EpCreate(info->nic_handle, info->cq_handle,
+                          &info->endpoint_handle);
+    if (status != GNI_RC_SUCCESS) {
+        fprintf(stdout,
+                "[%s] Rank: %4i Thread: %3i GNI_EpCreate      ERROR status: %s (%d)\n",
+                uts_info.nodename, rank_id, info->thread_id,
+                gni_err_str[status], status);
+        return -1;
+    }
+
+    /*
+     * The source buffer is filled with a pattern that identifies this
+     * rank and thread.
+     */
+
+    rc = allocate_buffer((void **) &info->source_buffer, target_slot_length,
+                         buffer_mode, NUMA_NODE_UNSPECIFIED);
+    assert(rc == 0);
+
+    fill_pattern(info->source_buffer, target_slot_length / sizeof(uint64_t),
+                 SEND_DATA + ((rank_id & 0xffffff) << 24) + info->thread_id);
+
+    status = timed_mem_register(info->nic_handle,
+                                (uint64_t) info->source_buffer,
+                                target_slot_length, NULL, GNI_MEM_READWRITE,
+                                -1, &info->source_memory_handle);
+    if (status != GNI_RC_SUCCESS) {
+        fprintf(stdout,
+                "[%s] Rank: %4i Thread: %3i GNI_MemRegister   source ERROR status: %s (%d)\n",
+                uts_info.nodename, rank_id, info->thread_id,
+                gni_err_str[status], status);
+        return -1;
+    }
+
+    /*
+     * The target buffer is registered with this thread's NIC handle,
+     * the matching thread on the sending rank will write into this
+     * thread's slot.
+     */
+
+    status = timed_mem_register(info->nic_handle, (uint64_t) target_buffer,
+                                target_slot_length * number_of_threads, NULL,
+                                GNI_MEM_READWRITE, -1,
+                                &info->target_memory_handle);
+    if (status != GNI_RC_SUCCESS) {
+        fprintf(stdout,
+                "[%s] Rank: %4i Thread: %3i GNI_MemRegister   target ERROR status: %s (%d)\n",
+                uts_info.nodename, rank_id, info->thread_id,
+                gni_err_str[status], status);
+        return -1;
+    }
+
+    my_memory_handles[info->thread_id].mdh = info->target_memory_handle;
+    my_memory_handles[info->thread_id].addr = (uint64_t) target_buffer +
+        (info->thread_id * target_slot_length);
+
+    /*
+     * Allocate the descriptor window and the list of free descriptors.
+     */
+
+    info->fma_desc = (gni_post_descriptor_t *) calloc(window_size,
+                                            sizeof(gni_post_descriptor_t));
+    assert(info->fma_desc != NULL);
+
+    info->free_desc = (int *) malloc(window_size * sizeof(int));
+    assert(info->free_desc != NULL);
+
+    return 0;
+}
+
+/*
+ * cleanup_thread_resources releases everything that was created by
+ * setup_thread_resources.
+ */
+
+static void
+cleanup_thread_resources(thread_info_t *info)
+{
+    gni_return_t    status;
+
+    if (info->endpoint_handle != NULL) {
+        GNI_EpUnbind(info->endpoint_handle);
+
+        status = GNI_EpDestroy(info->endpoint_handle);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_EpDestroy     ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, info->thread_id,
+                    gni_err_str[status], status);
+        }
+    }
+
+    if (info->source_buffer != NULL) {
+        GNI_MemDeregister(info->nic_handle, &info->source_memory_handle);
+        GNI_MemDeregister(info->nic_handle, &info->target_memory_handle);
+        free_buffer(info->source_buffer, target_slot_length, buffer_mode);
+    }
+
+    if (info->cq_handle != NULL) {
+        status = GNI_CqDestroy(info->cq_handle);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_CqDestroy     ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, info->thread_id,
+                    gni_err_str[status], status);
+        }
+    }
+
+    if ((use_shared_nic == 0) && (info->cdm_handle != NULL)) {
+        status = GNI_CdmDestroy(info->cdm_handle);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_CdmDestroy    ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, info->thread_id,
+                    gni_err_str[status], status);
+        }
+    }
+
+    free(info->free_desc);
+    free(info->fma_desc);
+}
+
+/*
+ * inject_transfers posts the FMA requests for a thread, keeping up to
+ * window_size requests outstanding, and times the whole sequence.
+ */
+
+static void
+inject_transfers(thread_info_t *info)
+{
+    gni_cq_entry_t  current_event;
+    gni_post_descriptor_t *desc;
+    gni_post_descriptor_t *event_post_desc_ptr;
+    int             i;
+    int             number_free;
+    uint64_t        posted = 0;
+    mdh_addr_t     *remote;
+    double          start_time;
+    gni_return_t    status;
+
+    remote = &remote_memory_handle_array[(send_to * MAXIMUM_THREADS) +
+                                         info->thread_id];
+
+    for (i = 0; i < window_size; i++) {
+        desc = &info->fma_desc[i];
+
+        if (use_amo == 0) {
+            desc->type = GNI_POST_FMA_PUT;
+            desc->length = transfer_length_in_bytes;
+        } else {
+            desc->type = GNI_POST_AMO;
+            desc->amo_cmd = GNI_FMA_ATOMIC_ADD;
+            desc->first_operand = 1;
+            desc->length = sizeof(uint64_t);
+        }
+        desc->cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+        desc->dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+        desc->local_addr = (uint64_t) info->source_buffer;
+        desc->local_mem_hndl = info->source_memory_handle;
+        desc->remote_addr = remote->addr;
+        desc->remote_mem_hndl = remote->mdh;
+
+        info->free_desc[i] = i;
+    }
+
+    number_free = window_size;
+    info->completed = 0;
+    info->errors = 0;
+
+    start_time = get_timestamp();
+
+    while (info->completed < transfers) {
+
+        /*
+         * Fill the window with new requests.
+         */
+
+        while ((posted < transfers) && (number_free > 0)) {
+            desc = &info->fma_desc[info->free_desc[number_free - 1]];
+            desc->post_id = posted;
+
+            status = GNI_PostFma(info->endpoint_handle, desc);
+
+            if (status == GNI_RC_ERROR_RESOURCE) {
+
+                /*
+                 * No FMA descriptor is available right now, reap some
+                 * completions before trying again.
+                 */
+
+                break;
+            } else if (status != GNI_RC_SUCCESS) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i Thread: %3i GNI_PostFma       ERROR status: %s (%d)\n",
+                        uts_info.nodename, rank_id, info->thread_id,
+                        gni_err_str[status], status);
+                info->errors++;
+                goto EXIT_INJECTION;
+            }
+
+            number_free--;
+            posted++;
+        }
+
+        /*
+         * Reap one completion event and return its descriptor to the
+         * free list.
+         */
+
+        status = GNI_CqGetEvent(info->cq_handle, &current_event);
+        if (status == GNI_RC_NOT_DONE) {
+            continue;
+        } else if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_CqGetEvent    ERROR status: %s (%d) event: 0x%16.16lx\n",
+                    uts_info.nodename, rank_id, info->thread_id,
+                    gni_err_str[status], status, current_event);
+            info->errors++;
+            goto EXIT_INJECTION;
+        }
+
+        status = GNI_GetCompleted(info->cq_handle, current_event,
+                                  &event_post_desc_ptr);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_GetCompleted  ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, info->thread_id,
+                    gni_err_str[status], status);
+            info->errors++;
+
+            /*
+             * Only a transaction error returns the failed descriptor.
+             */
+
+            if (status != GNI_RC_TRANSACTION_ERROR) {
+                goto EXIT_INJECTION;
+            }
+        }
+
+        info->free_desc[number_free++] =
+            (int) (event_post_desc_ptr - info->fma_desc);
+        info->completed++;
+    }
+
+  EXIT_INJECTION:
+    info->elapsed_time = get_timestamp() - start_time;
+
+    if (v_option) {
+        fprintf(stdout,
+                "[%s] Rank: %4i Thread: %3i injected: %lu errors: %lu time: %.6f sec rate: %.3f Mmsg/s\n",
+                uts_info.nodename, rank_id, info->thread_id,
+                info->completed, info->errors, info->elapsed_time,
+                (info->elapsed_time > 0.0) ?
+                ((double) info->completed / info->elapsed_time) / 1.0e6 : 0.0);
+    }
+}
+
+/*
+ * injection_thread is the body of each injecting thread.  The main
+ * thread synchronizes with all of the injecting threads through
+ * thread_barrier between each step.
+ */
+
+static void *
+injection_thread(void *arg)
+{
+    int             core;
+    thread_info_t  *info = (thread_info_t *) arg;
+    uint32_t        remote_id;
+    gni_return_t    status;
+
+    if (number_of_cores > 0) {
+
+        /*
+         * Pin this thread before it touches any of its resources.
+         */
+
+        core = cores[(first_core_index + info->thread_id) % number_of_cores];
+
+        if (bind_to_core(core) != 0) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i bind_to_core      ERROR core: %i\n",
+                    uts_info.nodename, rank_id, info->thread_id, core);
+        } else if (v_option > 1) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i bind_to_core      core: %i\n",
+                    uts_info.nodename, rank_id, info->thread_id, core);
+        }
+    }
+
+    if (setup_thread_resources(info) != 0) {
+        info->setup_failed = 1;
+    }
+
+    /*
+     * Setup is complete, the main thread now gathers the memory handles.
+     */
+
+    pthread_barrier_wait(&thread_barrier);
+
+    /*
+     * The memory handles have been gathered.
+     */
+
+    pthread_barrier_wait(&thread_barrier);
+
+    if (abort_phase == 0) {
+
+        /*
+         * Bind to the matching thread of the next rank.
+         */
+
+        if (use_shared_nic == 0) {
+            remote_id = (send_to * CDM_ID_MULTIPLIER) + info->thread_id + 1;
+        } else {
+            remote_id = send_to * CDM_ID_MULTIPLIER;
+        }
+
+        status = GNI_EpBind(info->endpoint_handle, all_nic_addresses[send_to],
+                            remote_id);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Thread: %3i GNI_EpBind        ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, info->thread_id,
+                    gni_err_str[status], status);
+            info->errors++;
+        }
+    }
+
+    /*
+     * Start all of the threads at the same time.
+     */
+
+    pthread_barrier_wait(&thread_barrier);
+
+    if ((abort_phase == 0) && (info->errors == 0)) {
+        inject_transfers(info);
+    }
+
+    /*
+     * Injection is complete, the main thread now verifies the data.
+     */
+
+    pthread_barrier_wait(&thread_barrier);
+
+    /*
+     * All of the ranks have finished with this phase.
+     */
+
+    pthread_barrier_wait(&thread_barrier);
+
+    cleanup_thread_resources(info);
+
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    double          aggregate_rate;
+    double         *all_rates;
+    char           *core_list = NULL;
+    uint64_t        expected_data;
+    int             first_spawned;
+    double          first_rate = 0.0;
+    int             i;
+    int             j;
+    double          max_elapsed_time;
+    int             maximum_threads = 1;
+    double          min_rate;
+    int             my_receive_from;
+    int             number_of_ranks;
+    char            opt;
+    extern char    *optarg;
+    extern int      optopt;
+    double          rank_rate;
+    int             rc;
+    int             receive_from;
+    gni_return_t    status = GNI_RC_SUCCESS;
+    uint64_t       *target_slot;
+    char           *text_pointer;
+    thread_info_t  *thread_info;
+    unsigned int    local_address;
+
+    command_name = ((text_pointer = rindex(argv[0], '/')) != NULL) ?
+        strdup(++text_pointer) : strdup(argv[0]);
+
+    if ((i = uname(&uts_info)) != 0) {
+        fprintf(stderr, "uname(2) failed, errno=%d\n", errno);
+        exit(1);
+    }
+
+    /*
+     * Get job attributes from PMI.
+     */
+
+    rc = PMI_Init(&first_spawned);
+    assert(rc == PMI_SUCCESS);
+
+    rc = PMI_Get_size(&number_of_ranks);
+    assert(rc == PMI_SUCCESS);
+
+    rc = PMI_Get_rank(&rank_id);
+    assert(rc == PMI_SUCCESS);
+
+    while ((opt = getopt(argc, argv, "ac:FhH:l:n:st:vw:")) != -1) {
+        switch (opt) {
+        case 'a':
+            use_amo = 1;
+            break;
+
+        case 'c':
+            core_list = optarg;
+            break;
+
+        case 'F':
+            modes |= GNI_CDM_MODE_FMA_SHARED;
+            break;
+
+        case 'h':
+            if (rank_id == 0) {
+                print_help();
+            }
+
+            /*
+             * Clean up the PMI information.
+             */
+
+            PMI_Finalize();
+
+            exit(0);
+
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
+        case 'l':
+
+            /*
+             * Set the length of each Put, rounded up to a whole
+             * number of 64 bit words.
+             */
+
+            transfer_length_in_bytes = atoi(optarg);
+            if (transfer_length_in_bytes < sizeof(uint64_t)) {
+                transfer_length_in_bytes = TRANSFER_LENGTH_IN_BYTES;
+            }
+
+            transfer_length_in_bytes = (transfer_length_in_bytes +
+                                        sizeof(uint64_t) - 1) &
+                                       ~(sizeof(uint64_t) - 1);
+            break;
+
+        case 'n':
+
+            /*
+             * Set the number of transactions posted by each thread.
+             */
+
+            transfers = atoi(optarg);
+            if (transfers < 1) {
+                transfers = NUMBER_OF_TRANSFERS;
+            }
+
+            break;
+
+        case 's':
+            use_shared_nic = 1;
+            break;
+
+        case 't':
+            maximum_threads = atoi(optarg);
+            if (maximum_threads < 1) {
+                maximum_threads = 1;
+            } else if (maximum_threads > MAXIMUM_THREADS) {
+                maximum_threads = MAXIMUM_THREADS;
+            }
+
+            break;
+
+        case 'v':
+            v_option++;
+            break;
+
+        case 'w':
+            window_size = atoi(optarg);
+            if (window_size < 1) {
+                window_size = WINDOW_SIZE;
+            }
+
+            break;
+
+        case '?':
+            break;
+        }
+    }
+
+    if (use_amo == 1) {
+        transfer_length_in_bytes = sizeof(uint64_t);
+    }
+
+    /*
+     * Each thread's target slot is padded to a cacheline so that the
+     * threads do not share a cacheline.
+     */
+
+    target_slot_length = (transfer_length_in_bytes + CACHELINE_SIZE - 1) &
+                         ~(CACHELINE_SIZE - 1);
+
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%u", transfers);
+    add_result_metadata("transfer_length", "%u", transfer_length_in_bytes);
+    add_result_metadata("threads", "%i", maximum_threads);
+    add_result_metadata("window", "%u", window_size);
+    add_result_metadata("amo", "%i", use_amo);
+    add_result_metadata("shared_nic", "%i", use_shared_nic);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
+    /*
+     * Get job attributes from PMI.
+     */
+
+    ptag = get_ptag();
+    cookie = get_cookie();
+
+    send_to = (rank_id + 1) % number_of_ranks;
+    receive_from = (number_of_ranks + rank_id - 1) % number_of_ranks;
+    my_receive_from = (receive_from & 0xffffff) << 24;
+
+    /*
+     * Get all of the NIC address for all of the ranks.
+     */
+
+    all_nic_addresses = (unsigned int *) gather_nic_addresses();
+
+    if (core_list != NULL) {
+
+        /*
+         * The threads of each rank on a node take the next
+         * maximum_threads cores from the list.
+         */
+
+        number_of_cores = parse_core_list(core_list, &cores);
+        first_core_index = get_node_local_rank(all_nic_addresses,
+                                               number_of_ranks, rank_id) *
+                           maximum_threads;
+    }
+
+    if (use_shared_nic == 1) {
+
+        /*
+         * All of the threads share one communication domain.
+         */
+
+        status = GNI_CdmCreate(rank_id * CDM_ID_MULTIPLIER, ptag, cookie,
+                               modes, &shared_cdm_handle);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i GNI_CdmCreate     ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, gni_err_str[status], status);
+            INCREMENT_ABORTED;
+            goto EXIT_TEST;
+        }
+
+        status = GNI_CdmAttach(shared_cdm_handle, 0, &local_address,
+                               &shared_nic_handle);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, gni_err_str[status], status);
+            INCREMENT_ABORTED;
+            goto EXIT_DOMAIN;
+        }
+    }
+
+    thread_info = (thread_info_t *) calloc(maximum_threads,
+                                           sizeof(thread_info_t));
+    assert(thread_info != NULL);
+
+    remote_memory_handle_array = (mdh_addr_t *)
+        calloc(number_of_ranks * MAXIMUM_THREADS, sizeof(mdh_addr_t));
+    assert(remote_memory_handle_array != NULL);
+
+    all_rates = (double *) calloc(number_of_ranks, sizeof(double));
+    assert(all_rates != NULL);
+
+    rc = allocate_buffer((void **) &target_buffer,
+                         target_slot_length * maximum_threads, buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
+    assert(rc == 0);
+
+    if (rank_id == 0) {
+        fprintf(stdout,
+                "[%s] Rank: %4i %s: %s ranks: %i transfers: %u length: %u window: %u %s%s\n",
+                uts_info.nodename, rank_id, command_name,
+                (use_amo == 0) ? "FMA Put" : "FMA AMO add",
+                number_of_ranks, transfers, transfer_length_in_bytes,
+                window_size,
+                (use_shared_nic == 0) ? "cdm per thread" : "shared nic",
+                (modes & GNI_CDM_MODE_FMA_SHARED) ? " FMA_SHARED" : "");
+    }
+
+    number_of_threads = 1;
+    while (number_of_threads <= maximum_threads) {
+        expected_passed += number_of_threads * 2;
+
+        memset(target_buffer, 0, target_slot_length * maximum_threads);
+        memset(thread_info, 0, maximum_threads * sizeof(thread_info_t));
+        memset(my_memory_handles, 0, sizeof(my_memory_handles));
+        abort_phase = 0;
+
+        rc = pthread_barrier_init(&thread_barrier, NULL,
+                                  number_of_threads + 1);
+        assert(rc == 0);
+
+        for (i = 0; i < number_of_threads; i++) {
+            thread_info[i].thread_id = i;
+
+            rc = pthread_create(&thread_info[i].thread, NULL,
+                                injection_thread, &thread_info[i]);
+            assert(rc == 0);
+        }
+
+        /*
+         * Wait for the threads to set up their resources.
+         */
+
+        pthread_barrier_wait(&thread_barrier);
+
+        for (i = 0; i < number_of_threads; i++) {
+            if (thread_info[i].setup_failed != 0) {
+                abort_phase = 1;
+            }
+        }
+
+        /*
+         * Gather up the target memory handles for all of the threads of
+         * all of the ranks.  This also acts as a barrier, so every target
+         * buffer has been cleared before any data is sent.
+         */
+
+        allgather(my_memory_handles, remote_memory_handle_array,
+                  sizeof(my_memory_handles));
+
+        pthread_barrier_wait(&thread_barrier);
+
+        /*
+         * Let the threads start injecting.
+         */
+
+        pthread_barrier_wait(&thread_barrier);
+
+        /*
+         * Wait for the threads to finish injecting.
+         */
+
+        pthread_barrier_wait(&thread_barrier);
+
+        /*
+         * Wait for the other ranks to finish sending into this rank's
+         * target buffer.
+         */
+
+        rc = PMI_Barrier();
+        assert(rc == PMI_SUCCESS);
+
+        max_elapsed_time = 0.0;
+
+        for (i = 0; i < number_of_threads; i++) {
+            if (thread_info[i].elapsed_time > max_elapsed_time) {
+                max_elapsed_time = thread_info[i].elapsed_time;
+            }
+
+            if ((abort_phase != 0) || (thread_info[i].errors != 0) ||
+                (thread_info[i].completed != transfers)) {
+                INCREMENT_FAILED;
+            } else {
+                INCREMENT_PASSED;
+            }
+
+            /*
+             * Verify the data written into this thread's slot by the
+             * matching thread of the previous rank.
+             */
+
+            target_slot = (uint64_t *) ((char *) target_buffer +
+                                        (i * target_slot_length));
+
+            if (use_amo == 0) {
+                expected_data = SEND_DATA + my_receive_from + i;
+            } else {
+                expected_data = transfers;
+            }
+
+            compare_data_failed = 0;
+
+            j = verify_pattern(target_slot,
+                               transfer_length_in_bytes / sizeof(uint64_t),
+                               expected_data);
+
+            if (j < (transfer_length_in_bytes / sizeof(uint64_t))) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i Thread: %3i Received data ERROR element: %4i received data: 0x%016lx expected data: 0x%016lx\n",
+                        uts_info.nodename, rank_id, i, j,
+                        target_slot[j], expected_data);
+                compare_data_failed++;
+            }
+
+            if (compare_data_failed != 0) {
+                INCREMENT_FAILED;
+            } else {
+                INCREMENT_PASSED;
+            }
+        }
+
+        /*
+         * Release the threads to clean up.
+         */
+
+        pthread_barrier_wait(&thread_barrier);
+
+        for (i = 0; i < number_of_threads; i++) {
+            pthread_join(thread_info[i].thread, NULL);
+        }
+
+        pthread_barrier_destroy(&thread_barrier);
+
+        /*
+         * The rank's message rate is based on the slowest thread.
+         */
+
+        rank_rate = (max_elapsed_time > 0.0) ?
+            ((double) number_of_threads * transfers) / max_elapsed_time : 0.0;
+
+        allgather(&rank_rate, all_rates, sizeof(double));
+
+        if (rank_id == 0) {
+            aggregate_rate = 0.0;
+            min_rate = all_rates[0];
+
+            for (i = 0; i < number_of_ranks; i++) {
+                aggregate_rate += all_rates[i];
+                if (all_rates[i] < min_rate) {
+                    min_rate = all_rates[i];
+                }
+            }
+
+            if (number_of_threads == 1) {
+                first_rate = aggregate_rate;
+            }
+
+            fprintf(stdout,
+                    "[%s] Rank: %4i threads: %3i aggregate rate: %10.3f Mmsg/s per rank min: %8.3f avg: %8.3f Mmsg/s per thread: %8.3f Mmsg/s scaling: %5.2f\n",
+                    uts_info.nodename, rank_id, number_of_threads,
+                    aggregate_rate / 1.0e6, min_rate / 1.0e6,
+                    (aggregate_rate / number_of_ranks) / 1.0e6,
+                    (aggregate_rate / number_of_ranks / number_of_threads) / 1.0e6,
+                    (first_rate > 0.0) ?
+                    aggregate_rate / (first_rate * number_of_threads) : 0.0);
+        }
+
+        if (v_option) {
+            fflush(stdout);
+        }
+
+        if (abort_phase != 0) {
+            INCREMENT_ABORTED;
+            break;
+        }
+
+        /*
+         * Double the number of threads, finishing with the maximum.
+         */
+
+        if ((number_of_threads < maximum_threads) &&
+            ((number_of_threads * 2) > maximum_threads)) {
+            number_of_threads = maximum_threads;
+        } else {
+            number_of_threads *= 2;
+        }
+    }
+
+    free_buffer(target_buffer, target_slot_length * maximum_threads,
+                buffer_mode);
+    free(all_rates);
+    free(remote_memory_handle_array);
+    free(thread_info);
+
+  EXIT_DOMAIN:
+
+    if (use_shared_nic == 1) {
+
+        /*
+         * Clean up the shared communication domain handle.
+         */
+
+        status = GNI_CdmDestroy(shared_cdm_handle);
+        if (status != GNI_RC_SUCCESS) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i GNI_CdmDestroy    ERROR status: %s (%d)\n",
+                    uts_info.nodename, rank_id, gni_err_str[status], status);
+        }
+    }
+
+  EXIT_TEST:
+
+    free(cores);
+    free(all_nic_addresses);
+
+    /*
+     * Display the time spent registering the data buffers.
+     */
+
+    print_buffer_statistics();
+
+    /*
+     * Display the results from this test.
+     */
+
+    rc = print_results();
+
+    /*
+     * Clean up the PMI information.
+     */
+
+    PMI_Finalize();
+
+    return rc;
+}
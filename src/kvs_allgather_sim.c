@@ -0,0 +1,605 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * KVS allgather simulator - compares the wire-up cost of the SLURM_PMI
+ * PMI_Allgather emulation in kvs_functions.h against a local KVS
+ * stand-in, without needing a job of the size being modeled.
+ *
+ *   flat: every rank puts its value, then reads every other rank's key,
+ *         the scheme that the tree replaced.
+ *   tree: PMI_Allgather from kvs_functions.h, the k-ary tree gather and
+ *         the distribution of the result back down the tree.
+ *
+ * The tree is the shipped code, run for every rank.  Each rank is a
+ * context of its own in a single process and PMI_Barrier switches back
+ * to the scheduler, so that the ranks run in lock step between barriers.
+ * The PMI KVS and glib base64 calls that it makes go to the stand-ins
+ * below.  The flat scheme is no longer in the tree, it is modeled here,
+ * and as every rank does the same work it is run for a sample of the
+ * ranks and scaled up.
+ *
+ * A modeled cost per KVS read and per barrier may be added to the
+ * measured time, to account for a remote PMI server.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define DEFAULT_FANOUT           16
+#define DEFAULT_LENGTH           sizeof(uint64_t)
+#define DEFAULT_VALUE_MAX        1024
+#define SAMPLE_RANKS             16
+#define KVS_TABLE_SIZE           (1 << 22)
+#define SIM_STACK_SIZE           (64 * 1024)
+#define PMI_SUCCESS              0
+
+typedef struct {
+    char           *key;
+    char           *value;
+} kvs_entry_t;
+
+typedef struct {
+    uint64_t        barriers;
+    double          gets;
+    double          get_bytes;
+    uint64_t        puts;
+    double          seconds;
+} kvs_cost_t;
+
+typedef char     gchar;
+typedef unsigned char guchar;
+
+static kvs_entry_t *kvs_table;
+static char       **kvs_values;
+static uint64_t     kvs_entries;
+static int          kvs_value_max = DEFAULT_VALUE_MAX;
+static kvs_cost_t  *cost;
+static double       scale = 1.0;
+
+static ucontext_t   sim_scheduler;
+static ucontext_t  *sim_contexts;
+static int          sim_current;
+static int          sim_in_barrier;
+static size_t       sim_len;
+static int          sim_nranks;
+
+static const char   base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static double
+get_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+/*
+ * Stand-ins for the glib base64 functions.
+ */
+
+static gchar *
+g_base64_encode(const guchar *in, size_t len)
+{
+    char           *out = malloc(((len + 2) / 3) * 4 + 1);
+    char           *p = out;
+    size_t          i;
+    uint32_t        v;
+
+    assert(out != NULL);
+
+    for (i = 0; i < len; i += 3) {
+        v = in[i] << 16;
+        if (i + 1 < len) v |= in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        *p++ = base64_chars[(v >> 18) & 0x3f];
+        *p++ = base64_chars[(v >> 12) & 0x3f];
+        *p++ = (i + 1 < len) ? base64_chars[(v >> 6) & 0x3f] : '=';
+        *p++ = (i + 2 < len) ? base64_chars[v & 0x3f] : '=';
+    }
+    *p = '\0';
+
+    return out;
+}
+
+static guchar *
+g_base64_decode(const gchar *in, size_t *out_len)
+{
+    static signed char decode[256];
+    unsigned char  *out = malloc((strlen(in) / 4) * 3 + 3);
+    size_t          n = 0;
+    uint32_t        v = 0;
+    int             bits = 0;
+    int             i;
+
+    assert(out != NULL);
+
+    if (decode['B'] == 0) {
+        memset(decode, -1, sizeof(decode));
+        for (i = 0; i < 64; i++) {
+            decode[(unsigned char) base64_chars[i]] = i;
+        }
+    }
+
+    for (; *in != '\0' && *in != '='; in++) {
+        v = (v << 6) | (uint32_t) decode[(unsigned char) *in];
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[n++] = (v >> bits) & 0xff;
+        }
+    }
+
+    *out_len = n;
+    return out;
+}
+
+#define g_free free
+
+static uint64_t
+kvs_hash(const char *key)
+{
+    uint64_t        h = 0xcbf29ce484222325UL;
+
+    while (*key != '\0') {
+        h = (h ^ (unsigned char) *key++) * 0x100000001b3UL;
+    }
+
+    return h;
+}
+
+/*
+ * kvs_intern returns the stored copy of a value.  The ranks that pass the
+ * result down the tree all publish the same values, so each is only kept
+ * once.
+ */
+
+static char *
+kvs_intern(const char *value)
+{
+    uint64_t        slot = kvs_hash(value) & (KVS_TABLE_SIZE - 1);
+
+    while (kvs_values[slot] != NULL) {
+        if (strcmp(kvs_values[slot], value) == 0) {
+            return kvs_values[slot];
+        }
+        slot = (slot + 1) & (KVS_TABLE_SIZE - 1);
+    }
+
+    kvs_values[slot] = strdup(value);
+    return kvs_values[slot];
+}
+
+static void
+kvs_put(const char *key, const char *value)
+{
+    uint64_t        slot = kvs_hash(key) & (KVS_TABLE_SIZE - 1);
+
+    while (kvs_table[slot].key != NULL) {
+        slot = (slot + 1) & (KVS_TABLE_SIZE - 1);
+    }
+
+    kvs_table[slot].key = strdup(key);
+    kvs_table[slot].value = kvs_intern(value);
+    kvs_entries++;
+    cost->puts++;
+}
+
+static const char *
+kvs_get(const char *key)
+{
+    uint64_t        slot = kvs_hash(key) & (KVS_TABLE_SIZE - 1);
+
+    cost->gets += scale;
+
+    while (kvs_table[slot].key != NULL) {
+        if (strcmp(kvs_table[slot].key, key) == 0) {
+            cost->get_bytes += scale * strlen(kvs_table[slot].value);
+            return kvs_table[slot].value;
+        }
+        slot = (slot + 1) & (KVS_TABLE_SIZE - 1);
+    }
+
+    fprintf(stderr, "missing key %s\n", key);
+    exit(1);
+}
+
+static void
+kvs_clear(void)
+{
+    uint64_t        i;
+
+    for (i = 0; i < KVS_TABLE_SIZE; i++) {
+        free(kvs_table[i].key);
+        free(kvs_values[i]);
+    }
+    memset(kvs_table, 0, KVS_TABLE_SIZE * sizeof(kvs_entry_t));
+    memset(kvs_values, 0, KVS_TABLE_SIZE * sizeof(char *));
+    kvs_entries = 0;
+}
+
+/*
+ * Stand-ins for the PMI calls made by kvs_functions.h.  sim_current is the
+ * rank that is running.
+ */
+
+static int
+PMI_Get_rank(int *rank)
+{
+    *rank = sim_current;
+    return PMI_SUCCESS;
+}
+
+static int
+PMI_Get_size(int *size)
+{
+    *size = sim_nranks;
+    return PMI_SUCCESS;
+}
+
+static int
+PMI_Barrier(void)
+{
+    sim_in_barrier = 1;
+    swapcontext(&sim_contexts[sim_current], &sim_scheduler);
+    return PMI_SUCCESS;
+}
+
+static int
+PMI_KVS_Get_name_length_max(int *length)
+{
+    *length = 16;
+    return PMI_SUCCESS;
+}
+
+static int
+PMI_KVS_Get_my_name(char *kvsname, int length)
+{
+    snprintf(kvsname, length, "sim");
+    return PMI_SUCCESS;
+}
+
+static int
+PMI_KVS_Get_value_length_max(int *length)
+{
+    *length = kvs_value_max;
+    return PMI_SUCCESS;
+}
+
+static int
+PMI_KVS_Put(const char *kvsname, const char *key, const char *value)
+{
+    kvs_put(key, value);
+    return PMI_SUCCESS;
+}
+
+static int
+PMI_KVS_Commit(const char *kvsname)
+{
+    return PMI_SUCCESS;
+}
+
+static int
+PMI_KVS_Get(const char *kvsname, const char *key, char *value, int length)
+{
+    snprintf(value, length, "%s", kvs_get(key));
+    return PMI_SUCCESS;
+}
+
+#include "kvs_functions.h"
+
+static void
+fill_value(unsigned char *value, int rank, size_t len)
+{
+    size_t          i;
+
+    for (i = 0; i < len; i++) {
+        value[i] = (unsigned char) (rank * 31 + i);
+    }
+}
+
+static int
+check_result(unsigned char *result, int nranks, size_t len)
+{
+    unsigned char   expected[len];
+    int             rank;
+
+    for (rank = 0; rank < nranks; rank++) {
+        fill_value(expected, rank, len);
+        if (memcmp(&result[rank * len], expected, len) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+simulate_flat(int nranks, size_t len)
+{
+    unsigned char  *result = malloc(nranks * len);
+    unsigned char   value[len];
+    int             errors = 0;
+    int             rank;
+    int             sample;
+    int             sender;
+    double          start = get_seconds();
+
+    for (rank = 0; rank < nranks; rank++) {
+        gnitRank = rank;
+        fill_value(value, rank, len);
+        send_data("flat", value, len);
+    }
+    cost->barriers++;
+
+    /*
+     * Every rank reads every key, so only a sample of the ranks is run.
+     */
+
+    sample = (nranks < SAMPLE_RANKS) ? nranks : SAMPLE_RANKS;
+    scale = (double) nranks / sample;
+    cost->seconds += get_seconds() - start;
+    start = get_seconds();
+
+    for (rank = 0; rank < sample; rank++) {
+        for (sender = 0; sender < nranks; sender++) {
+            receive_data("flat", sender, &result[sender * len], len);
+        }
+        errors += check_result(result, nranks, len);
+    }
+
+    cost->seconds += (get_seconds() - start) * scale;
+    scale = 1.0;
+    free(result);
+    return errors;
+}
+
+/*
+ * sim_rank runs PMI_Allgather as one rank, the rank and its buffers are
+ * set by the scheduler before it is first switched to.
+ */
+
+static unsigned char *sim_value;
+static unsigned char *sim_result;
+
+static void
+sim_rank(void)
+{
+    PMI_Allgather(sim_value, sim_result, sim_len);
+}
+
+static int
+simulate_tree(int nranks, size_t len)
+{
+    char           *stacks;
+    int            *done;
+    int             errors = 0;
+    int             finished = 0;
+    int             rank;
+    unsigned char  *results;
+    size_t          result_bytes = nranks * len;
+    size_t          result_stride;
+    double          start;
+    unsigned char  *values;
+
+    /*
+     * The results are only touched by the ranks that have received them,
+     * and are dropped once they have been checked, so each starts on a
+     * page of its own.
+     */
+
+    result_stride = (result_bytes + getpagesize() - 1) &
+        ~((size_t) getpagesize() - 1);
+
+    stacks = mmap(NULL, (size_t) nranks * SIM_STACK_SIZE,
+                  PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    results = mmap(NULL, (size_t) nranks * result_stride,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    values = malloc(nranks * len);
+    sim_contexts = calloc(nranks, sizeof(ucontext_t));
+    done = calloc(nranks, sizeof(int));
+    assert((stacks != MAP_FAILED) && (results != MAP_FAILED) &&
+           (values != NULL) && (sim_contexts != NULL) && (done != NULL));
+
+    sim_len = len;
+    sim_nranks = nranks;
+
+    for (rank = 0; rank < nranks; rank++) {
+        fill_value(&values[rank * len], rank, len);
+        getcontext(&sim_contexts[rank]);
+        sim_contexts[rank].uc_stack.ss_sp = &stacks[(size_t) rank * SIM_STACK_SIZE];
+        sim_contexts[rank].uc_stack.ss_size = SIM_STACK_SIZE;
+        sim_contexts[rank].uc_link = &sim_scheduler;
+        makecontext(&sim_contexts[rank], sim_rank, 0);
+    }
+
+    /*
+     * Run each rank up to its next barrier, or to the end, in turn.
+     */
+
+    while (finished < nranks) {
+        for (rank = 0; rank < nranks; rank++) {
+            if (done[rank]) {
+                continue;
+            }
+
+            sim_current = gnitRank = rank;
+            sim_value = &values[rank * len];
+            sim_result = &results[(size_t) rank * result_stride];
+            kvs_allgather_count = 0;
+
+            start = get_seconds();
+            swapcontext(&sim_scheduler, &sim_contexts[rank]);
+            cost->seconds += get_seconds() - start;
+
+            /*
+             * A rank that is back without having stopped at a barrier
+             * has returned from PMI_Allgather.
+             */
+
+            if (!sim_in_barrier) {
+                done[rank] = 1;
+                finished++;
+                errors += check_result(sim_result, nranks, len);
+                madvise(sim_result, result_bytes, MADV_DONTNEED);
+            }
+            sim_in_barrier = 0;
+        }
+
+        if (finished < nranks) {
+            cost->barriers++;
+        }
+    }
+
+    munmap(stacks, (size_t) nranks * SIM_STACK_SIZE);
+    munmap(results, (size_t) nranks * result_stride);
+    free(values);
+    free(sim_contexts);
+    free(done);
+    return errors;
+}
+
+static void
+print_help(char *command)
+{
+    fprintf(stdout,
+            "Usage: %s [-b barrier_usec] [-f fanout] [-g get_usec] [-l length]\n"
+            "          [-r ranks[,ranks...]] [-v value_max]\n"
+            "  '-b' modeled cost of a PMI_Barrier, default 0\n"
+            "  '-f' tree fan out, default %d\n"
+            "  '-g' modeled cost of a PMI_KVS_Get, default 0\n"
+            "  '-l' bytes gathered from each rank, default %d\n"
+            "  '-r' job sizes, default 1000,2000,5000,10000,20000,50000\n"
+            "  '-v' PMI_KVS_Get_value_length_max, default %d\n",
+            command, DEFAULT_FANOUT, (int) DEFAULT_LENGTH, DEFAULT_VALUE_MAX);
+}
+
+int
+main(int argc, char **argv)
+{
+    double          barrier_usec = 0.0;
+    kvs_cost_t      costs[2];
+    int             errors;
+    int             fanout = DEFAULT_FANOUT;
+    char            fanout_string[16];
+    double          get_usec = 0.0;
+    int             i;
+    size_t          len = DEFAULT_LENGTH;
+    int             nranks;
+    int             opt;
+    char           *rank_list = "1000,2000,5000,10000,20000,50000";
+    char           *token;
+    int             value_max = DEFAULT_VALUE_MAX;
+    double          wire_up[2];
+
+    while ((opt = getopt(argc, argv, "b:f:g:hl:r:v:")) != -1) {
+        switch (opt) {
+        case 'b':
+            barrier_usec = atof(optarg);
+            break;
+
+        case 'f':
+            fanout = atoi(optarg);
+            if (fanout < 2) {
+                fanout = 2;
+            }
+            break;
+
+        case 'g':
+            get_usec = atof(optarg);
+            break;
+
+        case 'h':
+            print_help(argv[0]);
+            return 0;
+
+        case 'l':
+            len = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'r':
+            rank_list = strdup(optarg);
+            break;
+
+        case 'v':
+            value_max = atoi(optarg);
+            if ((value_max < 5) || (value_max > DEFAULT_VALUE_MAX)) {
+                value_max = DEFAULT_VALUE_MAX;
+            }
+            break;
+
+        default:
+            print_help(argv[0]);
+            return 1;
+        }
+    }
+
+    /*
+     * kvs_functions.h reads the fan out from the environment.
+     */
+
+    snprintf(fanout_string, sizeof(fanout_string), "%d", fanout);
+    setenv("PMI_ALLGATHER_FANOUT", fanout_string, 1);
+
+    kvs_value_max = value_max;
+    kvs_table = calloc(KVS_TABLE_SIZE, sizeof(kvs_entry_t));
+    kvs_values = calloc(KVS_TABLE_SIZE, sizeof(char *));
+    assert((kvs_table != NULL) && (kvs_values != NULL));
+
+    fprintf(stdout, "%8s %6s %14s %14s %9s %12s %14s\n", "ranks",
+            "method", "kvs gets", "kvs bytes", "barriers", "kvs sec",
+            "wire-up sec");
+
+    for (token = strtok(strdup(rank_list), ","); token != NULL;
+         token = strtok(NULL, ",")) {
+        nranks = atoi(token);
+        if (nranks < 1) {
+            continue;
+        }
+
+        for (i = 0; i < 2; i++) {
+            memset(&costs[i], 0, sizeof(kvs_cost_t));
+            cost = &costs[i];
+
+            errors = (i == 0) ? simulate_flat(nranks, len) :
+                simulate_tree(nranks, len);
+            kvs_clear();
+
+            if (errors != 0) {
+                fprintf(stdout, "%8d %6s returned bad data\n", nranks,
+                        (i == 0) ? "flat" : "tree");
+            }
+
+            /*
+             * The stand-in time and the reads of the whole job are spread
+             * over the ranks that issue them in parallel.
+             */
+
+            wire_up[i] = costs[i].seconds / nranks +
+                (costs[i].gets / nranks) * get_usec / 1.0e6 +
+                costs[i].barriers * barrier_usec / 1.0e6;
+
+            fprintf(stdout, "%8d %6s %14.0f %14.0f %9lu %12.3f %14.6f\n",
+                    nranks, (i == 0) ? "flat" : "tree",
+                    costs[i].gets, costs[i].get_bytes,
+                    (unsigned long) costs[i].barriers, costs[i].seconds,
+                    wire_up[i]);
+        }
+    }
+
+    free(kvs_table);
+    free(kvs_values);
+    return 0;
+}
@@ -0,0 +1,300 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * This header file contains the functions needed for an implementation
+ * of PMI_Allgather, which is not included with slurm pmi, on top of the
+ * PMI KVS.
+ *
+ * utility_functions.h includes it when SLURM_PMI is defined, and
+ * kvs_allgather_sim includes it to run PMI_Allgather against a KVS
+ * stand-in.  pmi.h and glib.h, or replacements for them, must be
+ * included first.
+ */
+
+#ifndef KVS_FUNCTIONS_H
+#define KVS_FUNCTIONS_H
+
+static int gnitRank;
+static char *kvsName;
+static int amRoot = 0;
+static int debug = 0;
+
+void
+util_init(void)
+{
+    int rc,first_spawned;
+    int len,rank;
+
+    rc = PMI_Get_rank(&rank);
+    assert(rc == PMI_SUCCESS);
+    gnitRank = rank;
+    if (rank==0) amRoot = 1;
+    rc = PMI_KVS_Get_name_length_max( &len );
+    assert(rc == PMI_SUCCESS);
+    kvsName = (char *)calloc( len, sizeof(char) );
+    rc = PMI_KVS_Get_my_name( kvsName, len );
+    assert(rc == PMI_SUCCESS);
+    if (debug) fprintf(stdout, "kvsName %s\n", kvsName);
+
+    PMI_Barrier();
+}
+
+/*
+ * The KVS values are base64 encoded, so a value holds 3 bytes of data for
+ * every 4 characters.  Larger blobs are split across several keys.
+ */
+
+static size_t
+kvs_chunk_size(void)
+{
+    static size_t   chunk_size = 0;
+    int             len;
+    int             rc;
+
+    if (chunk_size == 0) {
+        rc = PMI_KVS_Get_value_length_max(&len);
+        assert(rc == PMI_SUCCESS);
+        chunk_size = ((len - 1) / 4) * 3;
+        assert(chunk_size > 0);
+    }
+
+    return chunk_size;
+}
+
+static void
+send_data(char *kvs, void *buffer, size_t len)
+{
+    gchar *data;
+    char key[64];
+    int rc;
+    int chunk;
+    size_t chunk_size = kvs_chunk_size();
+    size_t offset;
+    char *b = buffer;
+
+    for (chunk = 0, offset = 0; offset < len; chunk++, offset += chunk_size) {
+        snprintf(key, 64, "%s_rank%d_%d", kvs, gnitRank, chunk);
+        data = g_base64_encode((guchar *) &b[offset],
+                               (len - offset) < chunk_size ? (len - offset) : chunk_size);
+        if (debug) fprintf(stdout, "send key:%s\n", key);
+        rc = PMI_KVS_Put( kvsName, key, data );
+        if (debug) fprintf(stdout, "PMI_KVS_Put data %s, rc %d\n", data, rc);
+        assert(rc == PMI_SUCCESS);
+        g_free(data);
+    }
+    rc = PMI_KVS_Commit( kvsName );
+    assert(rc == PMI_SUCCESS);
+}
+
+static void
+receive_data(char *kvs, int rank, void *buffer, size_t len)
+{
+    gchar *data;
+    char key[64];
+    static char *keyval = NULL;
+    static size_t keyval_size = 0;
+    int rc;
+    int chunk;
+    size_t chunk_size = kvs_chunk_size();
+    size_t offset;
+    size_t outlen;
+    char *b = buffer;
+
+    /*
+     * The value buffer is only allocated once.
+     */
+
+    if (keyval == NULL) {
+        keyval_size = (chunk_size / 3) * 4 + 1;
+        keyval = (char *) malloc(keyval_size);
+        assert(keyval != NULL);
+    }
+
+    for (chunk = 0, offset = 0; offset < len; chunk++, offset += chunk_size) {
+        snprintf(key, 64, "%s_rank%d_%d", kvs, rank, chunk);
+        if (debug) fprintf(stdout, "recv key:%s\n", key);
+        rc = PMI_KVS_Get( kvsName, key, keyval, keyval_size );
+        if (debug) fprintf(stdout, "PMI_KVS_Get keyval %s, rc %d\n", keyval, rc);
+        assert(rc == PMI_SUCCESS);
+        data = (gchar *) g_base64_decode(keyval, &outlen);
+        assert(data != NULL);
+        memcpy(&b[offset], data,
+               (len - offset) < outlen ? (len - offset) : outlen);
+        g_free(data);
+    }
+}
+
+/*
+ * The allgather is done over a k-ary tree of the ranks, rank r has the
+ * children k*r+1 ... k*r+k.  Each rank packs its own entry and its
+ * children's subtrees into one value, one level of the tree per barrier,
+ * so that each rank only reads its children's keys.  The root then puts
+ * the result in rank order and it is passed back down the tree the same
+ * way, each rank reads it from its parent and publishes it again for its
+ * own children.
+ *
+ * This replaces every rank reading every other rank's key, N^2 KVS reads
+ * for the job, with about N reads of the packed result, and no key is
+ * read by more than fan out ranks.  The fan out may be changed with
+ * PMI_ALLGATHER_FANOUT.
+ */
+
+#define KVS_TREE_FANOUT 16
+
+static int
+kvs_tree_fanout(void)
+{
+    static int      fanout = 0;
+    char           *p_ptr;
+
+    if (fanout == 0) {
+        fanout = KVS_TREE_FANOUT;
+        p_ptr = getenv("PMI_ALLGATHER_FANOUT");
+        if ((p_ptr != NULL) && (atoi(p_ptr) > 1)) {
+            fanout = atoi(p_ptr);
+        }
+    }
+
+    return fanout;
+}
+
+static int
+kvs_tree_depth(int rank, int fanout)
+{
+    int             depth = 0;
+
+    while (rank > 0) {
+        rank = (rank - 1) / fanout;
+        depth++;
+    }
+
+    return depth;
+}
+
+static int
+kvs_subtree_size(int rank, int nranks, int fanout)
+{
+    long            first = rank;
+    long            last = rank;
+    int             size = 0;
+
+    while (first < nranks) {
+        size += ((last < nranks) ? last : (nranks - 1)) - first + 1;
+        first = first * fanout + 1;
+        last = last * fanout + fanout;
+    }
+
+    return size;
+}
+
+/*
+ * kvs_allgather_count numbers the allgathers, so that each one uses its
+ * own keys.
+ */
+
+static int kvs_allgather_count = 0;
+
+int 
+PMI_Allgather(void *src, void *targ, size_t len_per_rank)
+{
+    int i,nranks;
+    char *blob;
+    int child;
+    int depth;
+    int fanout = kvs_tree_fanout();
+    char idstr[64];
+    int level;
+    int max_depth;
+    int  my_rank = gnitRank;
+    size_t offset;
+    int rank;
+    size_t record_size = sizeof(int) + len_per_rank;
+    size_t result_bytes;
+    size_t subtree_bytes;
+
+    PMI_Get_size( &nranks );
+    snprintf(idstr, 64, "allg%d", kvs_allgather_count++);
+    if (debug) fprintf(stdout, "PMI_Allgather cnt %d ranks %d\n",
+                       kvs_allgather_count, nranks);
+
+    /*
+     * Each record is the rank followed by its data.
+     */
+
+    depth = kvs_tree_depth(my_rank, fanout);
+    max_depth = kvs_tree_depth(nranks - 1, fanout);
+    result_bytes = nranks * len_per_rank;
+    blob = (char *) malloc(kvs_subtree_size(my_rank, nranks, fanout) *
+                           record_size);
+    assert(blob != NULL);
+
+    memcpy(blob, &my_rank, sizeof(int));
+    memcpy(&blob[sizeof(int)], src, len_per_rank);
+
+    /*
+     * Gather up the tree, the deepest level first.
+     */
+
+    for (level = max_depth; level >= 0; level--) {
+        if (depth != level) {
+            if (level > 0) {
+                PMI_Barrier();
+            }
+            continue;
+        }
+
+        offset = record_size;
+        for (i = 1; i <= fanout; i++) {
+            child = my_rank * fanout + i;
+            if (child >= nranks) {
+                break;
+            }
+            subtree_bytes = kvs_subtree_size(child, nranks, fanout) * record_size;
+            receive_data(idstr, child, &blob[offset], subtree_bytes);
+            offset += subtree_bytes;
+        }
+
+        if (level > 0) {
+            send_data(idstr, blob, offset);
+            PMI_Barrier();
+        }
+    }
+
+    /*
+     * The root puts the result in rank order, then it is passed down the
+     * tree, the shallowest level first.
+     */
+
+    strcat(idstr, "_all");
+
+    if (my_rank == 0) {
+        for (i = 0; i < nranks; i++) {
+            memcpy(&rank, &blob[i * record_size], sizeof(int));
+            memcpy(((char *) targ) + (rank * len_per_rank),
+                   &blob[i * record_size + sizeof(int)], len_per_rank);
+        }
+    }
+
+    for (level = 0; level <= max_depth; level++) {
+        if (depth == level) {
+            if (level > 0) {
+                receive_data(idstr, (my_rank - 1) / fanout, targ,
+                             result_bytes);
+            }
+
+            if ((long) my_rank * fanout + 1 < nranks) {
+                send_data(idstr, targ, result_bytes);
+            }
+        }
+
+        if (level < max_depth) {
+            PMI_Barrier();
+        }
+    }
+
+    free(blob);
+    return PMI_SUCCESS;
+}
+#endif /* KVS_FUNCTIONS_H */
@@ -50,6 +50,7 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "pattern_functions.h"
 
 void print_help(void)
 {
@@ -165,6 +166,8 @@ main(int argc, char **argv)
     mdh_addr_t      remote_memory_handle;
     mdh_addr_t     *remote_memory_handle_array = NULL;
     char           *request_type = "Put";
+    uint64_t        segment_data;
+    uint64_t        segment_flag;
     uint64_t       
         segment_patterns[SEGMENT_PATTERNS][NUMBER_OF_SEGMENTS];
     int             send_to;
@@ -194,8 +197,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -282,8 +287,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     /*
      * Determine the number of passes required for this test to be
@@ -307,6 +314,17 @@ main(int argc, char **argv)
         }
     }
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%i", number_of_transfers);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) TRANSFER_LENGTH_IN_BYTES);
+    add_result_metadata("get", "%i", use_get);
+    add_result_metadata("fma", "%i", use_fma);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+
     /*
      * Create a handle to the communication domain.
      *    rank_id is the rank of the instance of the job.
@@ -317,7 +335,9 @@ main(int argc, char **argv)
      *        the communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(rank_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate           ERROR status: %s (%d)\n",
@@ -341,8 +361,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status =
         GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach           ERROR status: %s (%d)\n",
@@ -381,9 +403,11 @@ main(int argc, char **argv)
      *          newly created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate            source ERROR status: %s (%d)\n",
@@ -437,9 +461,11 @@ main(int argc, char **argv)
      *          to this newly created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status = GNI_CqCreate(nic_handle, number_of_dest_cq_entries, 0,
                           GNI_CQ_NOBLOCK, NULL, NULL,
                           &destination_cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate            destination ERROR status: %s (%d)\n",
@@ -467,12 +493,16 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
 
     /*
      * Create the endpoints to all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_EP_SETUP);
+
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
             continue;
@@ -542,6 +572,10 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
+    print_startup_profile();
+
     if (use_get == 0) {
         
         /*
@@ -1085,33 +1119,32 @@ main(int argc, char **argv)
 
             for (logical_segment = 0; logical_segment < NUMBER_OF_SEGMENTS;
                  logical_segment++) {
-                for (j = 0; j < TRANSFER_LENGTH; j++) {
-                    /*
-                     * Initialize the data to be sent.
-                     * The source data will look like: 0xddrrppllqqmmsstt
-                     *     where: dd is the actual characters 'dd'
-                     *            rr is the rank for this process
-                     *            pp is the sending physical segment number
-                     *            ll is the sending logical segment number
-                     *            qq is the receiving physical segment number
-                     *            mm is the receiving logical segment number
-                     *            ss is the sending segment pattern
-                     *            tt is the receiving segment pattern
-                     */
+                /*
+                 * Initialize the data to be sent.
+                 * The source data will look like: 0xddrrppllqqmmsstt
+                 *     where: dd is the actual characters 'dd'
+                 *            rr is the rank for this process
+                 *            pp is the sending physical segment number
+                 *            ll is the sending logical segment number
+                 *            qq is the receiving physical segment number
+                 *            mm is the receiving logical segment number
+                 *            ss is the sending segment pattern
+                 *            tt is the receiving segment pattern
+                 */
 
-                    source_buffer[(segment_patterns[source_pattern]
-                                   [logical_segment] * TRANSFER_LENGTH) +
-                                  j] =
-                        DATA + my_id +
-                        (segment_patterns[source_pattern][logical_segment]
-                         << SHIFT_SOURCE_PHYSICAL) +
-                        (logical_segment << SHIFT_SOURCE_LOGICAL) +
-                        (segment_patterns[destination_pattern]
-                         [logical_segment] << SHIFT_DEST_PHYSICAL) +
-                        (logical_segment << SHIFT_DEST_LOGICAL) +
-                        (source_pattern << SHIFT_SEND_PATTERN) +
-                        destination_pattern;
-                }
+                fill_pattern(&source_buffer[segment_patterns[source_pattern]
+                                            [logical_segment] *
+                                            TRANSFER_LENGTH],
+                             TRANSFER_LENGTH,
+                             DATA + my_id +
+                             (segment_patterns[source_pattern]
+                              [logical_segment] << SHIFT_SOURCE_PHYSICAL) +
+                             (logical_segment << SHIFT_SOURCE_LOGICAL) +
+                             (segment_patterns[destination_pattern]
+                              [logical_segment] << SHIFT_DEST_PHYSICAL) +
+                             (logical_segment << SHIFT_DEST_LOGICAL) +
+                             (source_pattern << SHIFT_SEND_PATTERN) +
+                             destination_pattern);
 
                 if (v_option) {
                     fprintf(stdout,
@@ -1961,7 +1994,52 @@ PUT_NEXT_FMA_SEGMENT:
                  *            tt is the receiving segment pattern
                  */
 
-                for (j = 0; j < TRANSFER_LENGTH; j++) {
+                segment_flag =
+                    FLAG + my_receive_from +
+                    (source_physical_segment << SHIFT_SOURCE_PHYSICAL) +
+                    (physical_segment << SHIFT_DEST_PHYSICAL) +
+                    (source_pattern << SHIFT_SEND_PATTERN) +
+                    destination_pattern;
+                segment_data =
+                    DATA + my_receive_from +
+                    (source_physical_segment << SHIFT_SOURCE_PHYSICAL) +
+                    (logical_segment << SHIFT_SOURCE_LOGICAL) +
+                    (physical_segment << SHIFT_DEST_PHYSICAL) +
+                    (logical_segment << SHIFT_DEST_LOGICAL) +
+                    (source_pattern << SHIFT_SEND_PATTERN) +
+                    destination_pattern;
+
+                /*
+                 * Skip the elements that match using the vector compare,
+                 * the loop below only reports the elements that do not.
+                 * With a PUT the first element of the first logical
+                 * segment is the flag, the data follows it.
+                 */
+
+                j = 0;
+
+                if (v_option == 0) {
+                    if ((use_get == 0) &&
+                        (segment_patterns[destination_pattern][0] ==
+                         physical_segment)) {
+                        if (destination_buffer
+                            [TRANSFER_LENGTH * physical_segment] ==
+                            segment_flag) {
+                            j = 1 + verify_pattern(&destination_buffer
+                                                   [1 + (TRANSFER_LENGTH *
+                                                         physical_segment)],
+                                                   TRANSFER_LENGTH - 1,
+                                                   segment_data);
+                        }
+                    } else {
+                        j = verify_pattern(&destination_buffer
+                                           [TRANSFER_LENGTH *
+                                            physical_segment],
+                                           TRANSFER_LENGTH, segment_data);
+                    }
+                }
+
+                for (; j < TRANSFER_LENGTH; j++) {
 
                     if ((use_get == 0)
                         && (segment_patterns[destination_pattern][0] ==
@@ -1969,32 +2047,16 @@ PUT_NEXT_FMA_SEGMENT:
                         /*
                          * This is a PUT request, the first element in the
                          * first logical segment of the buffer is the flag.
-                         * Set up what the expected flag should look like.
                          */
 
-                        compare_data =
-                            FLAG + my_receive_from +
-                            (source_physical_segment <<
-                             SHIFT_SOURCE_PHYSICAL) +
-                            (physical_segment << SHIFT_DEST_PHYSICAL) +
-                            (source_pattern << SHIFT_SEND_PATTERN) +
-                            destination_pattern;
+                        compare_data = segment_flag;
                     } else {
                         /*
                          * For a PUT or GET request, all other elements
                          * will contain data.
-                         * Set up what the expected data should look like.
                          */
 
-                        compare_data =
-                            DATA + my_receive_from +
-                            (source_physical_segment <<
-                             SHIFT_SOURCE_PHYSICAL) +
-                            (logical_segment << SHIFT_SOURCE_LOGICAL) +
-                            (physical_segment << SHIFT_DEST_PHYSICAL) +
-                            (logical_segment << SHIFT_DEST_LOGICAL) +
-                            (source_pattern << SHIFT_SEND_PATTERN) +
-                            destination_pattern;
+                        compare_data = segment_data;
                     }
 
                     if (destination_buffer
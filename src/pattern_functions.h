@@ -0,0 +1,540 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * This header file contains the functions used to fill the send buffers
+ * with a data pattern and to verify the received data against it.
+ *
+ * Three patterns are supported:
+ *     constant  every element of a transfer holds the same value, e.g.
+ *               SEND_DATA + rank + transfer number
+ *     position  every element holds a base value plus its index
+ *     random    pseudo random data, verified by its CRC32C checksum
+ *
+ * On x86_64 the fill and verify loops are selected at run time from
+ * AVX-512, AVX2 or SSE2 versions, with a scalar version for everything
+ * else.  CRC32C checksums use the SSE4.2 crc32 instruction when it is
+ * available and a table otherwise.
+ */
+
+#ifndef PATTERN_FUNCTIONS_H
+#define PATTERN_FUNCTIONS_H
+
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PATTERN_USE_X86          1
+#include <immintrin.h>
+#else
+#define PATTERN_USE_X86          0
+#endif
+
+#define PATTERN_ISA_UNKNOWN      -1
+#define PATTERN_ISA_SCALAR       0
+#define PATTERN_ISA_SSE2         1
+#define PATTERN_ISA_AVX2         2
+#define PATTERN_ISA_AVX512       3
+#define CRC32C_POLYNOMIAL        0x82f63b78
+
+#define PATTERN_CONSTANT         0
+#define PATTERN_RANDOM           1
+#define PATTERN_POSITION         2
+
+/*
+ * In the checksum mode the flag carries the transfer number and the
+ * CRC32C of the data in one word, so that both arrive atomically:
+ *     0xfffennnncccccccc
+ *     where: fffe is the actual value
+ *            nnnn is the transfer number
+ *            cccccccc is the checksum of the data
+ */
+
+#define CHECKSUM_FLAG_DATA       0xfffe000000000000
+#define CHECKSUM_FLAG_MASK       0xffffffff00000000
+#define CHECKSUM_FLAG(transfer, checksum) \
+    (CHECKSUM_FLAG_DATA | (((uint64_t) (transfer) & 0xffff) << 32) | \
+     (uint32_t) (checksum))
+
+int             pattern_isa = PATTERN_ISA_UNKNOWN;
+pthread_once_t  crc32c_once = PTHREAD_ONCE_INIT;
+int             crc32c_use_sse42 = 0;
+uint32_t        crc32c_table[256];
+
+/*
+ * get_pattern_isa determines the widest vector instructions that the
+ * processor supports.
+ *
+ *   Returns: one of the PATTERN_ISA values.
+ */
+
+static int
+get_pattern_isa(void)
+{
+    if (pattern_isa == PATTERN_ISA_UNKNOWN) {
+#if PATTERN_USE_X86
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512f")) {
+            pattern_isa = PATTERN_ISA_AVX512;
+        } else if (__builtin_cpu_supports("avx2")) {
+            pattern_isa = PATTERN_ISA_AVX2;
+        } else {
+            pattern_isa = PATTERN_ISA_SSE2;
+        }
+#else
+        pattern_isa = PATTERN_ISA_SCALAR;
+#endif
+    }
+
+    return pattern_isa;
+}
+
+/*
+ * pattern_isa_string names the instructions used for the patterns.
+ */
+
+static char *
+pattern_isa_string(void)
+{
+    switch (get_pattern_isa()) {
+    case PATTERN_ISA_AVX512:
+        return "avx512";
+    case PATTERN_ISA_AVX2:
+        return "avx2";
+    case PATTERN_ISA_SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+/*
+ * The scalar versions also finish the elements that do not fill a whole
+ * vector, and locate the failing element once a vector has miscompared.
+ *
+ * The verify functions return the index of the first element that does
+ * not match, or count when all of the elements match.
+ */
+
+static void
+fill_pattern_scalar(uint64_t *buffer, size_t count, uint64_t value,
+                    uint64_t increment)
+{
+    size_t          i;
+
+    for (i = 0; i < count; i++) {
+        buffer[i] = value;
+        value += increment;
+    }
+}
+
+static size_t
+verify_pattern_scalar(const uint64_t *buffer, size_t count, uint64_t value,
+                      uint64_t increment)
+{
+    size_t          i;
+
+    for (i = 0; i < count; i++) {
+        if (buffer[i] != value) {
+            return i;
+        }
+
+        value += increment;
+    }
+
+    return count;
+}
+
+#if PATTERN_USE_X86
+
+/*
+ * SSE2 versions, two elements per vector.  The verify loops check four
+ * vectors at a time and only test the combined difference.
+ */
+
+static void
+fill_pattern_sse2(uint64_t *buffer, size_t count, uint64_t value,
+                  uint64_t increment)
+{
+    __m128i         data = _mm_set_epi64x(value + increment, value);
+    size_t          i;
+    __m128i         step = _mm_set1_epi64x(2 * increment);
+
+    for (i = 0; i + 2 <= count; i += 2) {
+        _mm_storeu_si128((__m128i *) &buffer[i], data);
+        data = _mm_add_epi64(data, step);
+    }
+
+    fill_pattern_scalar(&buffer[i], count - i, value + (i * increment),
+                        increment);
+}
+
+static size_t
+verify_pattern_sse2(const uint64_t *buffer, size_t count, uint64_t value,
+                    uint64_t increment)
+{
+    __m128i         difference;
+    __m128i         expected = _mm_set_epi64x(value + increment, value);
+    size_t          i;
+    size_t          j;
+    __m128i         step = _mm_set1_epi64x(2 * increment);
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        difference = _mm_setzero_si128();
+
+        for (j = 0; j < 8; j += 2) {
+            difference =
+                _mm_or_si128(difference,
+                             _mm_xor_si128(_mm_loadu_si128((__m128i *)
+                                                           &buffer[i + j]),
+                                           expected));
+            expected = _mm_add_epi64(expected, step);
+        }
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(difference,
+                                             _mm_setzero_si128())) != 0xffff) {
+            break;
+        }
+    }
+
+    return i + verify_pattern_scalar(&buffer[i], count - i,
+                                     value + (i * increment), increment);
+}
+
+/*
+ * AVX2 versions, four elements per vector.
+ */
+
+__attribute__ ((target("avx2")))
+static void
+fill_pattern_avx2(uint64_t *buffer, size_t count, uint64_t value,
+                  uint64_t increment)
+{
+    __m256i         data = _mm256_set_epi64x(value + (3 * increment),
+                                             value + (2 * increment),
+                                             value + increment, value);
+    size_t          i;
+    __m256i         step = _mm256_set1_epi64x(4 * increment);
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        _mm256_storeu_si256((__m256i *) &buffer[i], data);
+        data = _mm256_add_epi64(data, step);
+    }
+
+    fill_pattern_scalar(&buffer[i], count - i, value + (i * increment),
+                        increment);
+}
+
+__attribute__ ((target("avx2")))
+static size_t
+verify_pattern_avx2(const uint64_t *buffer, size_t count, uint64_t value,
+                    uint64_t increment)
+{
+    __m256i         difference;
+    __m256i         expected = _mm256_set_epi64x(value + (3 * increment),
+                                                 value + (2 * increment),
+                                                 value + increment, value);
+    size_t          i;
+    size_t          j;
+    __m256i         step = _mm256_set1_epi64x(4 * increment);
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        difference = _mm256_setzero_si256();
+
+        for (j = 0; j < 16; j += 4) {
+            difference =
+                _mm256_or_si256(difference,
+                                _mm256_xor_si256(_mm256_loadu_si256((__m256i *)
+                                                                    &buffer[i + j]),
+                                                 expected));
+            expected = _mm256_add_epi64(expected, step);
+        }
+
+        if (!_mm256_testz_si256(difference, difference)) {
+            break;
+        }
+    }
+
+    return i + verify_pattern_scalar(&buffer[i], count - i,
+                                     value + (i * increment), increment);
+}
+
+/*
+ * AVX-512 versions, eight elements per vector.
+ */
+
+__attribute__ ((target("avx512f")))
+static void
+fill_pattern_avx512(uint64_t *buffer, size_t count, uint64_t value,
+                    uint64_t increment)
+{
+    __m512i         data = _mm512_set_epi64(value + (7 * increment),
+                                            value + (6 * increment),
+                                            value + (5 * increment),
+                                            value + (4 * increment),
+                                            value + (3 * increment),
+                                            value + (2 * increment),
+                                            value + increment, value);
+    size_t          i;
+    __m512i         step = _mm512_set1_epi64(8 * increment);
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        _mm512_storeu_si512((void *) &buffer[i], data);
+        data = _mm512_add_epi64(data, step);
+    }
+
+    fill_pattern_scalar(&buffer[i], count - i, value + (i * increment),
+                        increment);
+}
+
+__attribute__ ((target("avx512f")))
+static size_t
+verify_pattern_avx512(const uint64_t *buffer, size_t count, uint64_t value,
+                      uint64_t increment)
+{
+    __m512i         difference;
+    __m512i         expected = _mm512_set_epi64(value + (7 * increment),
+                                                value + (6 * increment),
+                                                value + (5 * increment),
+                                                value + (4 * increment),
+                                                value + (3 * increment),
+                                                value + (2 * increment),
+                                                value + increment, value);
+    size_t          i;
+    size_t          j;
+    __m512i         step = _mm512_set1_epi64(8 * increment);
+
+    for (i = 0; i + 32 <= count; i += 32) {
+        difference = _mm512_setzero_si512();
+
+        for (j = 0; j < 32; j += 8) {
+            difference =
+                _mm512_or_si512(difference,
+                                _mm512_xor_si512(_mm512_loadu_si512((void *)
+                                                                    &buffer[i + j]),
+                                                 expected));
+            expected = _mm512_add_epi64(expected, step);
+        }
+
+        if (_mm512_test_epi64_mask(difference, difference) != 0) {
+            break;
+        }
+    }
+
+    return i + verify_pattern_scalar(&buffer[i], count - i,
+                                     value + (i * increment), increment);
+}
+
+/*
+ * SSE4.2 CRC32C, eight bytes per crc32 instruction.
+ */
+
+__attribute__ ((target("sse4.2")))
+static uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length)
+{
+    uint64_t        crc64 = crc;
+    uint64_t        word;
+
+    while (length >= sizeof(uint64_t)) {
+        memcpy(&word, data, sizeof(uint64_t));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += sizeof(uint64_t);
+        length -= sizeof(uint64_t);
+    }
+
+    crc = (uint32_t) crc64;
+
+    while (length > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        length--;
+    }
+
+    return crc;
+}
+
+#endif /* PATTERN_USE_X86 */
+
+/*
+ * fill_pattern fills count elements of a buffer with a constant value.
+ */
+
+static void
+fill_pattern(uint64_t *buffer, size_t count, uint64_t value)
+{
+    switch (get_pattern_isa()) {
+#if PATTERN_USE_X86
+    case PATTERN_ISA_AVX512:
+        fill_pattern_avx512(buffer, count, value, 0);
+        break;
+    case PATTERN_ISA_AVX2:
+        fill_pattern_avx2(buffer, count, value, 0);
+        break;
+    case PATTERN_ISA_SSE2:
+        fill_pattern_sse2(buffer, count, value, 0);
+        break;
+#endif
+    default:
+        fill_pattern_scalar(buffer, count, value, 0);
+        break;
+    }
+}
+
+/*
+ * fill_position_pattern fills count elements of a buffer with the base
+ * value plus the index of each element.
+ */
+
+static void
+fill_position_pattern(uint64_t *buffer, size_t count, uint64_t base)
+{
+    switch (get_pattern_isa()) {
+#if PATTERN_USE_X86
+    case PATTERN_ISA_AVX512:
+        fill_pattern_avx512(buffer, count, base, 1);
+        break;
+    case PATTERN_ISA_AVX2:
+        fill_pattern_avx2(buffer, count, base, 1);
+        break;
+    case PATTERN_ISA_SSE2:
+        fill_pattern_sse2(buffer, count, base, 1);
+        break;
+#endif
+    default:
+        fill_pattern_scalar(buffer, count, base, 1);
+        break;
+    }
+}
+
+/*
+ * verify_pattern checks that count elements of a buffer hold a constant
+ * value.
+ *
+ *   Returns: the index of the first element that does not match, or
+ *            count if all of the elements match.
+ */
+
+static size_t
+verify_pattern(const uint64_t *buffer, size_t count, uint64_t value)
+{
+    switch (get_pattern_isa()) {
+#if PATTERN_USE_X86
+    case PATTERN_ISA_AVX512:
+        return verify_pattern_avx512(buffer, count, value, 0);
+    case PATTERN_ISA_AVX2:
+        return verify_pattern_avx2(buffer, count, value, 0);
+    case PATTERN_ISA_SSE2:
+        return verify_pattern_sse2(buffer, count, value, 0);
+#endif
+    default:
+        return verify_pattern_scalar(buffer, count, value, 0);
+    }
+}
+
+/*
+ * verify_position_pattern checks that count elements of a buffer hold
+ * the base value plus the index of each element.
+ *
+ *   Returns: the index of the first element that does not match, or
+ *            count if all of the elements match.
+ */
+
+static size_t
+verify_position_pattern(const uint64_t *buffer, size_t count, uint64_t base)
+{
+    switch (get_pattern_isa()) {
+#if PATTERN_USE_X86
+    case PATTERN_ISA_AVX512:
+        return verify_pattern_avx512(buffer, count, base, 1);
+    case PATTERN_ISA_AVX2:
+        return verify_pattern_avx2(buffer, count, base, 1);
+    case PATTERN_ISA_SSE2:
+        return verify_pattern_sse2(buffer, count, base, 1);
+#endif
+    default:
+        return verify_pattern_scalar(buffer, count, base, 1);
+    }
+}
+
+/*
+ * fill_random_pattern fills count elements of a buffer with pseudo random
+ * data generated from a seed by splitmix64.  The data does not compress
+ * and no two elements are alike, so it is only checked by a checksum.
+ */
+
+static void
+fill_random_pattern(uint64_t *buffer, size_t count, uint64_t seed)
+{
+    size_t          i;
+    uint64_t        value;
+
+    for (i = 0; i < count; i++) {
+        value = seed + ((i + 1) * 0x9e3779b97f4a7c15UL);
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9UL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebUL;
+        buffer[i] = value ^ (value >> 31);
+    }
+}
+
+/*
+ * crc32c_init selects the SSE4.2 instruction or builds the table.  It runs
+ * once, through crc32c_once, so that the receive loop and the verification
+ * thread never see a partly built table.
+ */
+
+static void
+crc32c_init(void)
+{
+    int             i;
+    int             j;
+    uint32_t        value;
+
+    for (i = 0; i < 256; i++) {
+        value = i;
+
+        for (j = 0; j < 8; j++) {
+            value = (value >> 1) ^ ((value & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+
+        crc32c_table[i] = value;
+    }
+
+#if PATTERN_USE_X86
+    __builtin_cpu_init();
+    crc32c_use_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#endif
+}
+
+/*
+ * crc32c computes the CRC32C (Castagnoli) checksum of a buffer.  The
+ * checksum of several pieces is computed by passing the result for one
+ * piece as the crc for the next, starting with a crc of zero.
+ *
+ *   Returns: the checksum.
+ */
+
+static uint32_t
+crc32c(uint32_t crc, const void *buffer, size_t length)
+{
+    const unsigned char *data = (const unsigned char *) buffer;
+
+    pthread_once(&crc32c_once, crc32c_init);
+
+    crc = ~crc;
+
+#if PATTERN_USE_X86
+    if (crc32c_use_sse42 == 1) {
+        return ~crc32c_sse42(crc, data, length);
+    }
+#endif
+
+    while (length > 0) {
+        crc = crc32c_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+        length--;
+    }
+
+    return ~crc;
+}
+
+#endif /* PATTERN_FUNCTIONS_H */
@@ -46,6 +46,9 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "affinity_functions.h"
+#include "buffer_functions.h"
+#include "pattern_functions.h"
 
 void print_help(void)
 {
@@ -64,16 +67,28 @@ void print_help(void)
 "\n"
 "  Parameters:\n"
 "    Additional parameters for this example are:\n"
-"      1.  '-D' specifies that the destination completion queue will not be\n"
+"      1.  '-c' specifies a list of cores, e.g. '0-7,16', that the ranks on\n"
+"          a node will be pinned to in order.\n"
+"          The default value is that the ranks are not pinned.\n"
+"      2.  '-D' specifies that the destination completion queue will not be\n"
 "          created.\n"
 "          The default value is that the destination completion queue will\n"
 "          be created.\n"
-"      2.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
-"      3.  '-h' prints the help information for this example.\n"
-"      4.  '-n' specifies the number of data transactions that will be\n"
+"      3.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
+"      4.  '-h' prints the help information for this example.\n"
+"      5.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      6.  '-N' specifies the NUMA node that the source and target buffers\n"
+"          will be allocated and first touched on.  This is either a node\n"
+"          number, 'local' for the node of the NIC or 'remote'.\n"
+"          The default value is the node of the first touch.\n"
+"      7.  '-n' specifies the number of data transactions that will be\n"
 "          received.\n"
 "          The default value is 10 data transactions to be received.\n"
-"      5.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
+"      8.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
 "          messages to be displayed.  With each additional 'v' more\n"
 "          information will be displayed.\n"
 "          The default value is no output or debug messages will be\n"
@@ -86,6 +101,8 @@ void print_help(void)
 "      - rdma_get_pmi_example -e\n"
 "      - rdma_get_pmi_example -D\n"
 "      - rdma_get_pmi_example -D -e\n"
+"      - rdma_get_pmi_example -c 0-15 -N local -n 1000\n"
+"      - rdma_get_pmi_example -c 0-15 -N remote -n 1000\n"
 "\n"
     );
 }
@@ -98,6 +115,8 @@ main(int argc, char **argv)
     gni_cdm_handle_t cdm_handle;
     uint32_t        cdm_id;
     int             cookie;
+    char           *core_list = NULL;
+    int            *cores;
     gni_cq_handle_t cq_handle;
     int             create_destination_cq = 1;
     gni_cq_entry_t  current_event;
@@ -110,7 +129,10 @@ main(int argc, char **argv)
     uint32_t        expected_local_event_id;
     uint32_t        expected_remote_event_id;
     int             first_spawned;
+    double          get_start_time;
+    double          get_time = 0.0;
     int             get_from;
+    int             gets_completed = 0;
     int             i;
     int             j;
     unsigned int    local_address;
@@ -120,9 +142,11 @@ main(int argc, char **argv)
     int             my_id;
     mdh_addr_t      my_memory_handle;
     gni_nic_handle_t nic_handle;
+    int             number_of_cores;
     int             number_of_cq_entries;
     int             number_of_dest_cq_entries;
     int             number_of_ranks;
+    int             numa_node = NUMA_NODE_UNSPECIFIED;
     char            opt;
     extern char    *optarg;
     extern int      optopt;
@@ -155,8 +179,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -166,8 +192,12 @@ main(int argc, char **argv)
 
     local_event_id = rank_id;
 
-    while ((opt = getopt(argc, argv, "Dehn:v")) != -1) {
+    while ((opt = getopt(argc, argv, "c:DehH:N:n:v")) != -1) {
         switch (opt) {
+        case 'c':
+            core_list = optarg;
+            break;
+
         case 'D':
             /* Do not create a destination completion queue. */
 
@@ -191,6 +221,30 @@ main(int argc, char **argv)
 
             exit(0);
 
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
+        case 'N':
+            numa_node = parse_numa_node(optarg);
+            break;
+
         case 'n':
 
             /*
@@ -218,8 +272,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     /*
      * Determine the number of passes required for this test to be successful.
@@ -231,6 +287,17 @@ main(int argc, char **argv)
         expected_passed = transfers * 3;
     }
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%i", transfers);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) TRANSFER_LENGTH_IN_BYTES);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("dlvr_mode", "PERFORMANCE");
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
     /*
      * Allocate the rdma_data_desc array.
      */
@@ -251,7 +318,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmCreate     ERROR status: %s (%d)\n",
@@ -275,8 +344,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status =
         GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -313,9 +384,11 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      source ERROR status: %s (%d)\n",
@@ -354,10 +427,12 @@ main(int argc, char **argv)
          *          this newly created completion queue.
          */
 
+        startup_phase_begin(STARTUP_CQ_CREATE);
         status =
             GNI_CqCreate(nic_handle, number_of_dest_cq_entries, 0,
                          GNI_CQ_NOBLOCK, NULL, NULL,
                          &destination_cq_handle);
+        startup_phase_end(STARTUP_CQ_CREATE);
         if (status != GNI_RC_SUCCESS) {
             fprintf(stdout,
                     "[%s] Rank: %4i GNI_CqCreate      destination ERROR status: %s (%d)\n",
@@ -386,7 +461,36 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
+
+    if (core_list != NULL) {
+
+        /*
+         * Pin this rank to the next core in the list for its node.
+         */
+
+        number_of_cores = parse_core_list(core_list, &cores);
+        if (number_of_cores > 0) {
+            i = cores[get_node_local_rank(all_nic_addresses, number_of_ranks,
+                                          rank_id) % number_of_cores];
+
+            if (bind_to_core(i) != 0) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i bind_to_core      ERROR core: %i\n",
+                        uts_info.nodename, rank_id, i);
+            } else if (v_option > 1) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i bind_to_core      core: %i\n",
+                        uts_info.nodename, rank_id, i);
+            }
+        }
+
+        free(cores);
+    }
+
+    startup_phase_begin(STARTUP_EP_SETUP);
 
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
@@ -479,18 +583,17 @@ main(int argc, char **argv)
         }
     }
 
-    /*
-     * Allocate the buffer that will contain the data to be sent.
-     */
-
-    rc = posix_memalign((void **) &source_buffer, 64, TRANSFER_LENGTH_IN_BYTES);
-    assert(rc == 0);
+    startup_phase_end(STARTUP_EP_SETUP);
 
     /*
-     * Initialize the buffer to all zeros.
+     * Allocate the buffer that will contain the data to be sent.  The
+     * buffer is placed on the requested NUMA node and initialized to all
+     * zeros.
      */
 
-    memset(source_buffer, 0, TRANSFER_LENGTH_IN_BYTES);
+    rc = allocate_buffer((void **) &source_buffer, TRANSFER_LENGTH_IN_BYTES,
+                         buffer_mode, numa_node);
+    assert(rc == 0);
 
     /*
      * Register the memory associated for the source buffer with the NIC.
@@ -507,10 +610,12 @@ main(int argc, char **argv)
      *     source_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) source_buffer,
-                             TRANSFER_LENGTH_IN_BYTES,
-                             destination_cq_handle, GNI_MEM_READWRITE, -1,
-                             &source_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) source_buffer,
+                                TRANSFER_LENGTH_IN_BYTES,
+                                destination_cq_handle, GNI_MEM_READWRITE, -1,
+                                &source_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   source_buffer ERROR status: %s (%d)\n",
@@ -529,26 +634,27 @@ main(int argc, char **argv)
     /*
      * Allocate the buffer that will receive the data.  This allocation is
      * creating a buffer large enough to hold all of the received data for
-     * all of the transfers.
+     * all of the transfers.  The buffer is placed on the requested NUMA
+     * node and initialized to all zeros.
      */
 
-    rc = posix_memalign((void **) &target_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &target_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         numa_node);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(target_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
+    if (v_option > 1) {
+        fprintf(stdout,
+                "[%s] Rank: %4i NUMA placement    source_buffer node: %i target_buffer node: %i NIC node: %i\n",
+                uts_info.nodename, rank_id, get_buffer_numa_node(source_buffer),
+                get_buffer_numa_node(target_buffer), get_nic_numa_node());
+    }
 
     /*
      * Initialize the receive buffer.
      */
 
-    for (i = 0; i < TRANSFER_LENGTH * transfers; i++) {
-        target_buffer[i] = -1L;
-    }
+    fill_pattern(target_buffer, TRANSFER_LENGTH * transfers, -1L);
 
     /*
      * Register the memory associated for the receive buffer with the NIC.
@@ -565,11 +671,13 @@ main(int argc, char **argv)
      *     target_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) target_buffer,
-                             TRANSFER_LENGTH_IN_BYTES *
-                             transfers, NULL,
-                             GNI_MEM_READWRITE,
-                             -1, &target_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) target_buffer,
+                                TRANSFER_LENGTH_IN_BYTES *
+                                transfers, NULL,
+                                GNI_MEM_READWRITE,
+                                -1, &target_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   target_buffer ERROR status: %s (%d)\n",
@@ -602,8 +710,12 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&my_memory_handle, remote_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -660,9 +772,7 @@ main(int argc, char **argv)
 
         data = SEND_DATA + my_id + i + 1;
 
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
-            source_buffer[j] = data;
-        }
+        fill_pattern(source_buffer, TRANSFER_LENGTH, data);
 
         /*
          * Detemine what the received data will look like.
@@ -730,6 +840,8 @@ main(int argc, char **argv)
          * Get the data.
          */
 
+        get_start_time = get_timestamp();
+
         status =
             GNI_PostRdma(endpoint_handles_array[get_from],
                          &rdma_data_desc[i]);
@@ -769,6 +881,13 @@ main(int argc, char **argv)
         rc = get_cq_event(cq_handle, uts_info, rank_id, 1, 1, &current_event);
         if (rc == 0) {
 
+            /*
+             * The local completion of the get marks the arrival of the data.
+             */
+
+            get_time += get_timestamp() - get_start_time;
+            gets_completed++;
+
             /*
              * An event was received.
              *
@@ -877,7 +996,25 @@ main(int argc, char **argv)
 
         compare_data_failed = 0;
 
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
+        j = 0;
+
+        if (v_option > 1) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Received          data element: %d contains: 0x%016lx\n",
+                    uts_info.nodename, rank_id,
+                    j + (TRANSFER_LENGTH * i),
+                    target_buffer[j + (TRANSFER_LENGTH * i)]);
+        }
+
+        /*
+         * Skip the elements that match using the vector compare, the loop
+         * below only reports the elements that do not.
+         */
+
+        j += verify_pattern(&target_buffer[TRANSFER_LENGTH * i],
+                            TRANSFER_LENGTH, target_data);
+
+        for (; j < TRANSFER_LENGTH; j++) {
             if (target_buffer[j + (TRANSFER_LENGTH * i)] != target_data) {
 
                 /*
@@ -893,14 +1030,6 @@ main(int argc, char **argv)
                         &(target_buffer[j + (TRANSFER_LENGTH * i)]),
                         target_buffer[j + (TRANSFER_LENGTH * i)],
                         target_data);
-            } else if (j == 0) {
-                if (v_option > 1) {
-                    fprintf(stdout,
-                            "[%s] Rank: %4i Received          data element: %d contains: 0x%016lx\n",
-                            uts_info.nodename, rank_id,
-                            j + (TRANSFER_LENGTH * i),
-                            target_buffer[j + (TRANSFER_LENGTH * i)]);
-                }
             }
 
             /*
@@ -949,6 +1078,20 @@ main(int argc, char **argv)
         assert(rc == PMI_SUCCESS);
     }   /* end loop over transfers */
 
+    /*
+     * Report the average time from posting a get until its local
+     * completion, this includes the effect of the buffer placement.
+     */
+
+    print_rank_statistic("RDMA Get latency",
+                         (gets_completed > 0) ?
+                         (get_time * 1.0e6) / gets_completed : 0.0, "usec",
+                         RESULT_LOWER_IS_BETTER);
+    print_rank_statistic("RDMA Get bandwidth",
+                         (get_time > 0.0) ? ((double) gets_completed *
+                          TRANSFER_LENGTH_IN_BYTES) / get_time / 1.0e6 : 0.0,
+                         "MB/s", RESULT_HIGHER_IS_BETTER);
+
     /*
      * Wait for all the processes to finish before we clean up and exit.
      */
@@ -985,7 +1128,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(target_buffer);
+        free_buffer(target_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_SOURCE:
@@ -1013,7 +1157,7 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(source_buffer);
+        free_buffer(source_buffer, TRANSFER_LENGTH_IN_BYTES, buffer_mode);
     }
 
   EXIT_ENDPOINT:
@@ -1149,6 +1293,12 @@ main(int argc, char **argv)
 
     free(rdma_data_desc);
 
+    /*
+     * Display the time spent registering the data buffers.
+     */
+
+    print_buffer_statistics();
+
     /*
      * Display the results from this test.
      */
@@ -28,14 +28,24 @@
 #define BIND_ID_MULTIPLIER       100
 #define CACHELINE_MASK           0x3F   /* 64 byte cacheline */
 #define CDM_ID_MULTIPLIER        1000
+#define CREDIT_INDEX             -2
+#define CREDIT_POST_ID           0x4000000000000000
 #define FLAG_DATA                0xffff000000000000
+#define FLAG_INDEX(transfer)     (-3 - (transfer))
+#define FLAG_POST_ID             0x8000000000000000
 #define LOCAL_EVENT_ID_BASE      10000000
 #define NUMBER_OF_TRANSFERS      10
 #define POST_ID_MULTIPLIER       1000
 #define REMOTE_EVENT_ID_BASE     11000000
 #define SEND_DATA                0xdddd000000000000
+#define SLOT_FREE                0
+#define SLOT_DATA                1
+#define SLOT_FLAG                2
 #define TRANSFER_LENGTH          1024
 #define TRANSFER_LENGTH_IN_BYTES ((TRANSFER_LENGTH)*sizeof(uint64_t))
+#define TRANSFER_TAG(transfer)   (((transfer) + 1) & 0xffffff)
+#define WINDOW                   64
+#define WINDOW_MAXIMUM           0xffff /* CHECKSUM_FLAG keeps 16 bits */
 
 typedef struct {
     gni_mem_handle_t mdh;
@@ -48,6 +58,11 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "buffer_functions.h"
+#include "pattern_functions.h"
+#include "verify_functions.h"
+#include "completion_functions.h"
+#include "trace_functions.h"
 
 void print_help(void)
 {
@@ -65,25 +80,48 @@ void print_help(void)
 "\n"
 "  Parameters:\n"
 "    Additional parameters for this example are:\n"
-"      1.  '-D' specifies that the destination completion queue will not be\n"
+"      1.  '-C' specifies that the data will be pseudo random and verified\n"
+"          by a CRC32C checksum that is sent in the flag word, instead of\n"
+"          comparing every element with a known value.\n"
+"          The default value is to compare every element.\n"
+"      2.  '-D' specifies that the destination completion queue will not be\n"
 "          created.\n"
 "          The default value is that the destination completion queue will\n"
 "          be created.\n"
-"      2.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
-"      3.  '-h' prints the help information for this example.\n"
-"      4.  '-n' specifies the number of data transactions that will be sent.\n"
+"      3.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
+"      4.  '-h' prints the help information for this example.\n"
+"      5.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      6.  '-n' specifies the number of data transactions that will be sent.\n"
 "          The default value is 10 data transactions to be sent.\n"
-"      5.  '-O' specifies that the destination completion queue will\n"
+"      7.  '-O' specifies that the destination completion queue will\n"
 "          be created with a very small number of entries.  This will\n"
-"      6   cause an overrun condition on the destination complete queue.\n"
+"          cause an overrun condition on the destination complete queue.\n"
 "          The default value is that the destination completion queue will\n"
 "          be created with a sufficient number of entries to not cause\n"
 "          the overrun condition to occur.  This implies that '-D' is ignored.\n"
-"      7.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
+"      8.  '-P' specifies that each element will hold the value of the\n"
+"          transfer plus its position in the transfer, so that data that\n"
+"          lands at the wrong offset of a slot is found.  It is ignored\n"
+"          with '-C'.\n"
+"          The default value is the same value in every element.\n"
+"      9.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
 "          messages to be displayed.  With each additional 'v' more\n"
 "          information will be displayed.\n"
 "          The default value is no output or debug messages will be\n"
 "          displayed.\n"
+"     10.  '-V' specifies that the received data will be verified by a\n"
+"          background thread as each transfer arrives, instead of after all\n"
+"          of the transfers have arrived.\n"
+"          The default value is to verify the data after the transfers.\n"
+"     11.  '-w' specifies the number of transfers that may be in flight.\n"
+"          The buffers, descriptors and completion queues are sized for\n"
+"          the window, the slots are reused once the receiver has verified\n"
+"          the data and returned a credit.\n"
+"          The default value is 64, or the number of transfers if less.\n"
 "\n"
 "  Execution:\n"
 "    The following is a list of suggested example executions with various\n"
@@ -104,30 +142,46 @@ main(int argc, char **argv)
     uint32_t        bind_id;
     gni_cdm_handle_t cdm_handle;
     uint32_t        cdm_id;
+    int             consumed;
     int             cookie;
     gni_cq_handle_t cq_handle;
+    int             completed_transfers[CQ_DRAIN_BATCH];
+    gni_cq_entry_t  completed_events[CQ_DRAIN_BATCH];
+    int             completions;
     int             create_destination_cq = 1;
+    gni_post_descriptor_t credit_desc;
+    int             credit_interval;
+    int             credit_outstanding = 0;
+    volatile uint64_t *credit_ptr;
+    int             credit_sent = 0;
     int             create_destination_overrun = 0;
     gni_cq_entry_t  current_event;
     uint64_t        data = SEND_DATA;
+    int             data_pattern;
+    post_id_table_t data_post_ids;
+    int             data_events = 0;
     int             data_transfers_sent = 0;
     gni_cq_handle_t destination_cq_handle = NULL;
+    int             destination_events = 0;
     int             device_id = 0;
     gni_ep_handle_t *endpoint_handles_array;
     uint32_t        event_inst_id;
-    gni_post_descriptor_t *event_post_desc_ptr;
     uint32_t        expected_local_event_id;
     uint32_t        expected_remote_event_id;
     int             first_spawned;
     uint64_t        *flag;
+    int             flag_from;
+    uint64_t        flag_mask;
+    int             flag_events = 0;
     volatile uint64_t *flag_ptr;
-    int             flag_transfers_sent = 0;
     int             i;
     int             j;
     unsigned int    local_address;
     uint32_t        local_event_id;
+    int             max_outstanding;
     int             modes = GNI_CDM_MODE_BTE_SINGLE_CHANNEL;
     gni_mem_handle_t my_flag_memory_handle;
+    mdh_addr_t      my_flag_region;
     int             my_id;
     mdh_addr_t      my_memory_handle;
     int             my_receive_from;
@@ -136,6 +190,7 @@ main(int argc, char **argv)
     int             number_of_dest_cq_entries;
     int             number_of_ranks;
     char            opt;
+    int             progress;
     extern char    *optarg;
     extern int      optopt;
     uint8_t         ptag;
@@ -145,19 +200,29 @@ main(int argc, char **argv)
     uint64_t       *receive_buffer;
     uint64_t        receive_data = SEND_DATA;
     uint64_t        receive_flag = FLAG_DATA;
+    int             received = 0;
     int             receive_from;
     gni_mem_handle_t receive_memory_handle;
     unsigned int    remote_address;
     uint32_t        remote_event_id;
+    mdh_addr_t     *remote_flag_handle_array;
     mdh_addr_t     *remote_memory_handle_array;
     uint64_t       *send_buffer;
     uint64_t        send_post_id;
+    int            *send_state;
     int             send_to;
+    int             slot;
     gni_mem_handle_t source_memory_handle;
     gni_return_t    status = GNI_RC_SUCCESS;
     char           *text_pointer;
     uint32_t        transfers = NUMBER_OF_TRANSFERS;
+    int             use_checksum = 0;
     int             use_event_id = 0;
+    int             use_position = 0;
+    int             use_verify_thread = 0;
+    verify_request_t verify_inline;
+    verify_queue_t *verify_queue = NULL;
+    uint32_t        window = 0;
 
     command_name = ((text_pointer = rindex(argv[0], '/')) != NULL) ?
         strdup(++text_pointer) : strdup(argv[0]);
@@ -171,8 +236,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -182,8 +249,18 @@ main(int argc, char **argv)
 
     local_event_id = rank_id;
 
-    while ((opt = getopt(argc, argv, "hn:l:")) != -1) {
+    rc = trace_init(rank_id, uts_info.nodename, command_name);
+    if (rc != 0) {
+        fprintf(stdout, "[%s] Rank: %4i trace_init WARNING failed, running with tracing disabled\n",
+                uts_info.nodename, rank_id);
+    }
+
+    while ((opt = getopt(argc, argv, "ChH:n:l:PVw:")) != -1) {
         switch (opt) {
+        case 'C':
+            use_checksum = 1;
+            break;
+
         case 'h':
             if (rank_id == 0) {
                 print_help();
@@ -197,6 +274,26 @@ main(int argc, char **argv)
 
             exit(0);
 
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
         case 'n':
 
             /*
@@ -211,10 +308,31 @@ main(int argc, char **argv)
 
             break;
 
+        case 'P':
+            use_position = 1;
+            break;
+
         case 'v':
             v_option++;
             break;
 
+        case 'V':
+            use_verify_thread = 1;
+            break;
+
+        case 'w':
+
+            /*
+             * Set the number of transfers that may be in flight.
+             */
+
+            window = atoi(optarg);
+            if ((window < 1) || (window > WINDOW_MAXIMUM)) {
+                window = 0;
+            }
+
+            break;
+
         case '?':
             break;
         }
@@ -224,8 +342,20 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
+
+    if (window == 0) {
+        window = WINDOW;
+    }
+
+    if (window > transfers) {
+        window = transfers;
+    }
+
+    max_outstanding = (2 * window) + 1;
 
     /*
      * Determine the number of passes required for this test to be successful.
@@ -238,28 +368,56 @@ main(int argc, char **argv)
     }
 
     /*
-     * Allocate the flag array.
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%i", transfers);
+    add_result_metadata("window", "%i", window);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) TRANSFER_LENGTH_IN_BYTES);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("dlvr_mode", "PERFORMANCE");
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
+    /*
+     * Allocate the flag array, one flag for each slot of the window, the
+     * credit returned by the receiver and the credit sent to the sender.
      */
 
-    flag = (uint64_t *) calloc(transfers, sizeof(uint64_t));
+    flag = (uint64_t *) calloc(window + 2, sizeof(uint64_t));
     assert(flag != NULL);
 
     /*
      * Allocate the rdma_data_desc array.
      */
 
-    rdma_data_desc = (gni_post_descriptor_t *) calloc(transfers,
+    rdma_data_desc = (gni_post_descriptor_t *) calloc(window,
                                                 sizeof(gni_post_descriptor_t));
     assert(rdma_data_desc != NULL);
 
+    /*
+     * The data, the flag and the credit posts are outstanding at the
+     * same time.
+     */
+
+    post_id_table_init(&data_post_ids, max_outstanding);
+
     /*
      * Allocate the rdma_flag_desc array.
      */
 
-    rdma_flag_desc = (gni_post_descriptor_t *) calloc(transfers,
+    rdma_flag_desc = (gni_post_descriptor_t *) calloc(window,
                                                 sizeof(gni_post_descriptor_t));
     assert(rdma_flag_desc != NULL);
 
+    /*
+     * Allocate the state of each slot of the window.
+     */
+
+    send_state = (int *) calloc(window, sizeof(int));
+    assert(send_state != NULL);
+
+
     cdm_id = rank_id * CDM_ID_MULTIPLIER;
 
     /*
@@ -274,7 +432,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
 
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
@@ -299,8 +459,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status =
         GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -317,11 +479,11 @@ main(int argc, char **argv)
     /*
      * Determine the minimum number of completion queue entries, which
      * is the number of outstanding transactions at one time.  For this
-     * test, it will be up to transfers transactions outstanding
-     * at one time.
+     * test, it will be up to window data and window flag transactions
+     * and one credit transaction outstanding at one time.
      */
 
-    number_of_cq_entries = transfers;
+    number_of_cq_entries = max_outstanding;
 
     /*
      * Create the completion queue.
@@ -338,9 +500,11 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      source ERROR status: %s (%d)\n",
@@ -360,14 +524,15 @@ main(int argc, char **argv)
             /*
              * Determine the minimum number of completion queue entries, which
              * is the number of transactions outstanding at one time.  For this
-             * test, since there are no barriers between transfers, the number
-             * of outstanding transfers could be up to transfers.
-             * Also, we need to multiple the number of outstanding transfers by
-             * 2 because the data and flag transfers are done on separate
-             * requests and each request will create an event.
+             * test, the sender may be up to window transfers ahead of the
+             * receiver, and the events of a transfer may still be in the
+             * queue after its flag has been seen.  Also, we need to multiple
+             * the number of outstanding transfers by 2 because the data and
+             * flag transfers are done on separate requests and each request
+             * will create an event.
              */
 
-            number_of_dest_cq_entries = transfers * 2;
+            number_of_dest_cq_entries = window * 4;
         } else {
 
             /*
@@ -394,10 +559,12 @@ main(int argc, char **argv)
          *          this newly created completion queue.
          */
 
+        startup_phase_begin(STARTUP_CQ_CREATE);
         status =
             GNI_CqCreate(nic_handle, number_of_dest_cq_entries, 0,
                          GNI_CQ_NOBLOCK, NULL, NULL,
                          &destination_cq_handle);
+        startup_phase_end(STARTUP_CQ_CREATE);
         if (status != GNI_RC_SUCCESS) {
             fprintf(stdout,
                     "[%s] Rank: %4i GNI_CqCreate      destination ERROR status: %s (%d)\n",
@@ -426,7 +593,11 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
+
+    startup_phase_begin(STARTUP_EP_SETUP);
 
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
@@ -519,11 +690,13 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * Register the memory associated for the flag with the NIC.
      *     nic_handle is our NIC handle.
      *     flag is the memory location of the flag.
-     *     (transfers * sizeof(uint64_t)) is the size of the memory
+     *     ((window + 2) * sizeof(uint64_t)) is the size of the memory
      *         allocated to the flag.
      *     NULL means that no completion queue handle is specified.
      *     GNI_MEM_READWRITE is the read/write attribute for the flag's
@@ -533,10 +706,12 @@ main(int argc, char **argv)
      *     my_flag_memory_handle is the handle for this memory region.
      */
 
+    startup_phase_begin(STARTUP_MEM_REGISTER);
     status = GNI_MemRegister(nic_handle, (uint64_t) flag,
-                             (transfers * sizeof(uint64_t)),
+                             ((window + 2) * sizeof(uint64_t)),
                              NULL, GNI_MEM_READWRITE, -1,
                              &my_flag_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   flag ERROR status: %s (%d)\n",
@@ -549,25 +724,20 @@ main(int argc, char **argv)
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   flag  size: %lu address: %p\n",
                 uts_info.nodename, rank_id,
-                (transfers * sizeof(uint64_t)), flag);
+                ((window + 2) * sizeof(uint64_t)), flag);
     }
 
     /*
      * Allocate the buffer that will contain the data to be sent.  This
-     * allocation is creating a buffer large enough to hold all of the
-     * sending data for all of the transfers.
+     * allocation is creating a buffer large enough to hold the sending
+     * data for the transfers in the window.
      */
 
-    rc = posix_memalign((void **) &send_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &send_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * window), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(send_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
-
     /*
      * Register the memory associated for the send buffer with the NIC.
      * We are sending the data from this buffer not receiving into it.
@@ -583,11 +753,13 @@ main(int argc, char **argv)
      *     source_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) send_buffer,
-                             (TRANSFER_LENGTH_IN_BYTES *
-                              transfers), NULL,
-                             GNI_MEM_READWRITE, -1,
-                             &source_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) send_buffer,
+                                (TRANSFER_LENGTH_IN_BYTES *
+                                 window), NULL,
+                                GNI_MEM_READWRITE, -1,
+                                &source_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister  send_buffer ERROR status: %s (%d)\n",
@@ -601,31 +773,26 @@ main(int argc, char **argv)
                 "[%s] Rank: %4i GNI_MemRegister   send_buffer  size: %u address: %p\n",
                 uts_info.nodename, rank_id,
                 (unsigned int) (TRANSFER_LENGTH_IN_BYTES *
-                                transfers), send_buffer);
+                                window), send_buffer);
     }
 
     /*
      * Allocate the buffer that will receive the data.  This allocation is
-     * creating a buffer large enough to hold all of the received data for
-     * all of the transfers.
+     * creating a buffer large enough to hold the received data for the
+     * transfers in the window.
      */
 
-    rc = posix_memalign((void **) &receive_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &receive_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * window), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(receive_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
-
     /*
      * Register the memory associated for the receive buffer with the NIC.
      * We are receiving the data into this buffer.
      *     nic_handle is our NIC handle.
      *     receive_buffer is the memory location of the receive buffer.
-     *     (TRANSFER_LENGTH_IN_BYTES * transfers) is the size of the
+     *     (TRANSFER_LENGTH_IN_BYTES * window) is the size of the
      *         memory allocated to the receive buffer.
      *     destination_cq_handle is the destination completion queue handle.
      *     GNI_MEM_READWRITE is the read/write attribute for the receive buffer's
@@ -635,11 +802,13 @@ main(int argc, char **argv)
      *     receive_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) receive_buffer,
-                             TRANSFER_LENGTH_IN_BYTES *
-                             transfers, destination_cq_handle,
-                             GNI_MEM_READWRITE,
-                             -1, &receive_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) receive_buffer,
+                                TRANSFER_LENGTH_IN_BYTES *
+                                window, destination_cq_handle,
+                                GNI_MEM_READWRITE,
+                                -1, &receive_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   receive_buffer ERROR status: %s (%d)\n",
@@ -652,7 +821,7 @@ main(int argc, char **argv)
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   receive_buffer  size: %u address: %p\n",
                 uts_info.nodename, rank_id,
-                (unsigned int) (((TRANSFER_LENGTH * transfers)
+                (unsigned int) (((TRANSFER_LENGTH * window)
                                  + CACHELINE_MASK + 1) * sizeof(uint64_t)),
                 receive_buffer);
     }
@@ -673,8 +842,29 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&my_memory_handle, remote_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    /*
+     * Gather up all of the flag memory handle's, the credits are put into
+     * the flag array of the sender.
+     */
+
+    remote_flag_handle_array =
+        (mdh_addr_t *) calloc(number_of_ranks, sizeof(mdh_addr_t));
+    assert(remote_flag_handle_array);
+
+    my_flag_region.addr = (uint64_t) flag;
+    my_flag_region.mdh = my_flag_memory_handle;
+
+    startup_phase_begin(STARTUP_ALLGATHER);
+    allgather(&my_flag_region, remote_flag_handle_array,
+              sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -698,6 +888,17 @@ main(int argc, char **argv)
         fflush(stdout);
     }
 
+    /*
+     * Line up the ranks before the transfers start.  With tracing on,
+     * trace_merge uses this barrier and the one at the exit to line up
+     * the clocks of the ranks.
+     */
+
+    trace_mark(TRACE_BARRIER_ENTER);
+    rc = PMI_Barrier();
+    assert(rc == PMI_SUCCESS);
+    trace_mark(TRACE_BARRIER_EXIT);
+
     /*
      * Determine who we are going to send our data to and
      * who we are going to receive data from.
@@ -721,496 +922,348 @@ main(int argc, char **argv)
         expected_remote_event_id = CDM_ID_MULTIPLIER * receive_from;
     }
 
-    for (i = 0; i < transfers; i++) {
-        send_post_id = ((uint64_t) expected_local_event_id * POST_ID_MULTIPLIER) + i + 1;
-
-        /*
-         * Initialize the data to be sent.
-         * The source data will look like: 0xddddlllllltttttt
-         *     where: dddd is the actual value
-         *            llllll is the rank for this process
-         *            tttttt is the transfer number
-         */
-
-        data = SEND_DATA + my_id + i + 1;
-
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
-            send_buffer[j + (i * TRANSFER_LENGTH)] = data;
-        }
-
-        /*
-         * Setup the data request.
-         *    type is RDMA_PUT.
-         *    cq_mode states what type of events should be sent.
-         *         GNI_CQMODE_GLOBAL_EVENT allows for the sending of an event
-         *             to the local node after the receipt of the data.
-         *         GNI_CQMODE_REMOTE_EVENT allows for the sending of an event
-         *             to the remote node after the receipt of the data.
-         *    dlvr_mode states the delivery mode.
-         *    local_addr is the address of the sending buffer.
-         *    local_mem_hndl is the memory handle of the sending buffer.
-         *    remote_addr is the the address of the receiving buffer.
-         *    remote_mem_hndl is the memory handle of the receiving buffer.
-         *    length is the amount of data to transfer.
-         *    rdma_mode states how the request will be handled.
-         *    src_cq_hndl is the source complete queue handle.
-         */
-
-        rdma_data_desc[i].type = GNI_POST_RDMA_PUT;
-        if (create_destination_cq != 0) {
-            rdma_data_desc[i].cq_mode = GNI_CQMODE_GLOBAL_EVENT |
-                GNI_CQMODE_REMOTE_EVENT;
-        } else {
-            rdma_data_desc[i].cq_mode = GNI_CQMODE_GLOBAL_EVENT;
-        }
-        rdma_data_desc[i].dlvr_mode = GNI_DLVMODE_PERFORMANCE;
-        rdma_data_desc[i].local_addr = (uint64_t) send_buffer;
-        rdma_data_desc[i].local_addr += i * TRANSFER_LENGTH_IN_BYTES;
-        rdma_data_desc[i].local_mem_hndl = source_memory_handle;
-        rdma_data_desc[i].remote_addr =
-            remote_memory_handle_array[send_to].addr + sizeof(uint64_t);
-        rdma_data_desc[i].remote_addr += i * TRANSFER_LENGTH_IN_BYTES;
-        rdma_data_desc[i].remote_mem_hndl =
-            remote_memory_handle_array[send_to].mdh;
-        rdma_data_desc[i].length =
-            TRANSFER_LENGTH_IN_BYTES - sizeof(uint64_t);
-        rdma_data_desc[i].rdma_mode = GNI_RDMAMODE_FENCE;
-        rdma_data_desc[i].src_cq_hndl = cq_handle;
-        rdma_data_desc[i].post_id = send_post_id;
-
-        if (v_option) {
-            fprintf(stdout,
-                    "[%s] Rank: %4i GNI_PostRdma      data transfer: %4i send to:   %4i local addr:  0x%lx remote addr: 0x%lx data: 0x%16lx data length: %4i post_id: %lu\n",
-                    uts_info.nodename, rank_id, (i + 1), send_to,
-                    rdma_data_desc[i].local_addr,
-                    rdma_data_desc[i].remote_addr, data,
-                    (int) (TRANSFER_LENGTH_IN_BYTES - sizeof(uint64_t)),
-                    rdma_data_desc[i].post_id);
-        }
-
-        /*
-         * Send the data.
-         */
-
-        status =
-            GNI_PostRdma(endpoint_handles_array[send_to],
-                         &rdma_data_desc[i]);
-        if (status != GNI_RC_SUCCESS) {
-            fprintf(stdout,
-                    "[%s] Rank: %4i GNI_PostRdma      data ERROR status: %s (%d)\n",
-                    uts_info.nodename, rank_id, gni_err_str[status], status);
-            INCREMENT_FAILED;
-            continue;
-        }
-
-        INCREMENT_PASSED;
-
-        if (v_option > 2) {
-            fprintf(stdout, "[%s] Rank: %4i GNI_PostRdma      data successful\n",
-                    uts_info.nodename, rank_id);
-        }
+    /*
+     * The transfers go through a ring of window slots.  Transfer i uses
+     * slot i % window of the send buffer, the receive buffer and the
+     * descriptors, so the memory used depends on the window and not on
+     * the number of transfers.
+     *
+     * A send slot is reused once the flag of its last transfer has
+     * completed, and once the receiver has returned a credit for it.  The
+     * receiver puts the number of transfers it has consumed into
+     * flag[window] of the sender, the sender may be up to window
+     * transfers ahead of it.  The flags carry the transfer number, so
+     * the receiver can tell the flag of a new transfer from the flag the
+     * last transfer through the slot left behind.
+     */
 
-        data_transfers_sent++;
-    }   /* end of for loop for transfers */
+    credit_ptr = &flag[window];
+    credit_interval = (window + 1) / 2;
 
-    if (v_option) {
-
-        /*
-         * Write out all of the output messages.
-         */
-
-        fflush(stdout);
+    if (use_verify_thread == 1) {
+        verify_queue = start_verify_thread();
     }
 
-    /*
-     * Get all of the data completion queue events.
-     */
-
-    if (v_option > 2) {
-        fprintf(stdout,
-                "[%s] Rank: %4i data transfers complete, checking CQ events\n",
-                uts_info.nodename, rank_id);
+    if (TRACE_ENABLED) {
+        trace_record(TRACE_FLAG_WAIT, -1, 1, 0, 0, 0,
+                     (uint64_t) receive_buffer, 0, 0);
     }
 
-    for (i = 0; i < data_transfers_sent; i++) {
-        send_post_id = ((uint64_t) expected_local_event_id * POST_ID_MULTIPLIER) + i + 1;
+    while ((data_events < transfers) || (flag_events < transfers) ||
+           (received < transfers) || (credit_outstanding != 0)) {
+        progress = 0;
 
         /*
-         * Check the completion queue to verify that the message request has
-         * been sent.  The source completion queue needs to be checked and
-         * events to be removed so that it does not become full and cause
-         * succeeding calls to PostRdma to fail.
+         * Post the data of as many transfers as the credits and the free
+         * slots allow.
          */
 
-        rc = get_cq_event(cq_handle, uts_info, rank_id, 1, 1, &current_event);
-        if (rc == 0) {
+        while ((data_transfers_sent < transfers) &&
+               ((data_transfers_sent - *credit_ptr) < window) &&
+               (send_state[data_transfers_sent % window] == SLOT_FREE)) {
+            i = data_transfers_sent;
+            slot = i % window;
+            send_post_id = ((uint64_t) expected_local_event_id * POST_ID_MULTIPLIER) + i + 1;
 
             /*
-             * An event was received.
-             *
-             * Complete the event, which removes the current event's post
-             * descriptor from the event queue.
+             * Initialize the data to be sent.
+             * The source data will look like: 0xddddlllllltttttt
+             *     where: dddd is the actual value
+             *            llllll is the rank for this process
+             *            tttttt is the transfer number
              */
 
-            status = GNI_GetCompleted(cq_handle, current_event, &event_post_desc_ptr);
-            if (status != GNI_RC_SUCCESS) {
-                fprintf(stdout,
-                        "[%s] Rank: %4i GNI_GetCompleted  data ERROR status: %s (%d)\n",
-                        uts_info.nodename, rank_id, gni_err_str[status], status);
-
-                INCREMENT_FAILED;
-            } else {
-
-                /*
-                 * Validate the completed request's post id with the expected id.
-                 */
-
-                if (send_post_id != event_post_desc_ptr->post_id) {
+            data = SEND_DATA + my_id + TRANSFER_TAG(i);
 
-                    /*
-                     * The event's inst_id was not the expected inst_id
-                     * value.
-                     */
-
-                    fprintf(stdout,
-                            "[%s] Rank: %4i Completed data ERROR received post_id: %lu, expected post_id: %lu\n",
-                            uts_info.nodename, rank_id, event_post_desc_ptr->post_id,
-                            send_post_id);
-
-                    INCREMENT_FAILED;
-                } else {
-
-                    if (v_option) {
-                        fprintf(stdout,
-                                "[%s] Rank: %4i GNI_GetCompleted  data transfer: %4i send to:   %4i remote addr: 0x%lx post_id: %lu\n",
-                                uts_info.nodename, rank_id, (i + 1), send_to,
-                                event_post_desc_ptr->remote_addr,
-                                event_post_desc_ptr->post_id);
-                    }
-
-                    INCREMENT_PASSED;
-                }
+            if (use_checksum == 1) {
 
                 /*
-                 * Validate the current event's instance id with the expected id.
+                 * Only the data after the flag element is sent.
                  */
 
-                event_inst_id = GNI_CQ_GET_INST_ID(current_event);
-                if (event_inst_id != expected_local_event_id) {
-
-                    /*
-                     * The event's inst_id was not the expected inst_id
-                     * value.
-                     */
-
-                    fprintf(stdout,
-                            "[%s] Rank: %4i CQ Event data ERROR received inst_id: %u, expected inst_id: %u in event_data\n",
-                            uts_info.nodename, rank_id, event_inst_id, expected_local_event_id);
-
-                    INCREMENT_FAILED;
-                } else {
-
-                    INCREMENT_PASSED;
-                }
+                fill_random_pattern(&send_buffer[slot * TRANSFER_LENGTH],
+                                    TRANSFER_LENGTH - 1, data);
+            } else if (use_position == 1) {
+                fill_position_pattern(&send_buffer[slot * TRANSFER_LENGTH],
+                                      TRANSFER_LENGTH, data);
+            } else {
+                fill_pattern(&send_buffer[slot * TRANSFER_LENGTH],
+                             TRANSFER_LENGTH, data);
             }
-        } else if (rc == 2) {
 
             /*
-             * An overrun error occurred while receiving the event.
+             * Setup the data request.
+             *    type is RDMA_PUT.
+             *    cq_mode states what type of events should be sent.
+             *         GNI_CQMODE_GLOBAL_EVENT allows for the sending of an event
+             *             to the local node after the receipt of the data.
+             *         GNI_CQMODE_REMOTE_EVENT allows for the sending of an event
+             *             to the remote node after the receipt of the data.
+             *    dlvr_mode states the delivery mode.
+             *    local_addr is the address of the sending buffer.
+             *    local_mem_hndl is the memory handle of the sending buffer.
+             *    remote_addr is the the address of the receiving buffer.
+             *    remote_mem_hndl is the memory handle of the receiving buffer.
+             *    length is the amount of data to transfer.
+             *    rdma_mode states how the request will be handled.
+             *    src_cq_hndl is the source complete queue handle.
              */
 
-            if (create_destination_overrun == 1) {
-                expected_passed = 1;
-                passed = 1;
-                failed = 0;
+            rdma_data_desc[slot].type = GNI_POST_RDMA_PUT;
+            if (create_destination_cq != 0) {
+                rdma_data_desc[slot].cq_mode = GNI_CQMODE_GLOBAL_EVENT |
+                    GNI_CQMODE_REMOTE_EVENT;
             } else {
-                INCREMENT_FAILED;
-
-                if (v_option > 2) {
-                    fprintf(stdout,
-                            "[%s] Rank: %4i get_cq_event        data ERROR status: OVERRUN\n",
-                            uts_info.nodename, rank_id);
-                }
+                rdma_data_desc[slot].cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+            }
+            rdma_data_desc[slot].dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+            rdma_data_desc[slot].local_addr = (uint64_t) send_buffer;
+            rdma_data_desc[slot].local_addr += slot * TRANSFER_LENGTH_IN_BYTES;
+            rdma_data_desc[slot].local_mem_hndl = source_memory_handle;
+            rdma_data_desc[slot].remote_addr =
+                remote_memory_handle_array[send_to].addr + sizeof(uint64_t);
+            rdma_data_desc[slot].remote_addr += slot * TRANSFER_LENGTH_IN_BYTES;
+            rdma_data_desc[slot].remote_mem_hndl =
+                remote_memory_handle_array[send_to].mdh;
+            rdma_data_desc[slot].length =
+                TRANSFER_LENGTH_IN_BYTES - sizeof(uint64_t);
+            rdma_data_desc[slot].rdma_mode = GNI_RDMAMODE_FENCE;
+            rdma_data_desc[slot].src_cq_hndl = cq_handle;
+            rdma_data_desc[slot].post_id = send_post_id;
+
+            if (TRACE_ENABLED) {
+                trace_record(TRACE_POST_DATA, send_to, i + 1,
+                             rdma_data_desc[slot].post_id,
+                             TRANSFER_LENGTH_IN_BYTES - sizeof(uint64_t),
+                             rdma_data_desc[slot].local_addr,
+                             rdma_data_desc[slot].remote_addr, data, 0);
+            } else if (v_option) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i GNI_PostRdma      data transfer: %4i send to:   %4i local addr:  0x%lx remote addr: 0x%lx data: 0x%16lx data length: %4i post_id: %lu\n",
+                        uts_info.nodename, rank_id, (i + 1), send_to,
+                        rdma_data_desc[slot].local_addr,
+                        rdma_data_desc[slot].remote_addr, data,
+                        (int) (TRANSFER_LENGTH_IN_BYTES - sizeof(uint64_t)),
+                        rdma_data_desc[slot].post_id);
             }
-                        
-            continue;
-        } else {
 
             /*
-             * An error occurred while receiving the event.
+             * Send the data.
              */
 
-            INCREMENT_FAILED;
-            continue;
-        }
-    }
-
-    if (v_option) {
-
-        /*
-         * Write out all of the output messages.
-         */
-
-        fflush(stdout);
-    }
+            status =
+                GNI_PostRdma(endpoint_handles_array[send_to],
+                             &rdma_data_desc[slot]);
+            if (status != GNI_RC_SUCCESS) {
 
-    for (i = 0; i < transfers; i++) {
+                /*
+                 * The receiver would wait for this transfer forever.
+                 */
 
-        /*
-         * Initialize the flag to be sent.
-         * The source flag will look like: 0xfffflllllltttttt
-         *     where: ffff is the actual value
-         *            llllll is the rank for this process
-         *            tttttt is the transfer number
-         */
+                fprintf(stdout,
+                        "[%s] Rank: %4i GNI_PostRdma      data ERROR status: %s (%d)\n",
+                        uts_info.nodename, rank_id, gni_err_str[status], status);
+                INCREMENT_FAILED;
+                goto EXIT_WAIT_BARRIER;
+            }
 
-        flag[i] = FLAG_DATA + my_id + i + 1;
+            INCREMENT_PASSED;
 
-        /*
-         * Setup the flag request.
-         *    type is RDMA_PUT.
-         *    cq_mode states what type of events should be sent.
-         *         GNI_CQMODE_GLOBAL_EVENT allows for the sending of an event
-         *             to the local node after the receipt of the data.
-         *         GNI_CQMODE_REMOTE_EVENT allows for the sending of an event
-         *             to the remote node after the receipt of the data.
-         *    dlvr_mode states the delivery mode.
-         *    local_addr is the address of the sending flag.
-         *    local_mem_hndl is the memory handle of the sending flag.
-         *    remote_addr is the the address of the receiving flag.
-         *    remote_mem_hndl is the memory handle of the receiving flag.
-         *    length is the amount of data to transfer.
-         *    rdma_mode states how the request will be handled.
-         *    src_cq_hndl is the source complete queue handle.
-         */
+            if (v_option > 2) {
+                fprintf(stdout, "[%s] Rank: %4i GNI_PostRdma      data successful\n",
+                        uts_info.nodename, rank_id);
+            }
 
-        rdma_flag_desc[i].type = GNI_POST_RDMA_PUT;
-        if (create_destination_cq != 0) {
-            rdma_flag_desc[i].cq_mode = GNI_CQMODE_GLOBAL_EVENT |
-                GNI_CQMODE_REMOTE_EVENT;
-        } else {
-            rdma_flag_desc[i].cq_mode = GNI_CQMODE_GLOBAL_EVENT;
-        }
-        rdma_flag_desc[i].dlvr_mode = GNI_DLVMODE_PERFORMANCE;
-        rdma_flag_desc[i].local_addr = (uint64_t) & flag[i];
-        rdma_flag_desc[i].local_mem_hndl = my_flag_memory_handle;
-        rdma_flag_desc[i].remote_addr =
-            remote_memory_handle_array[send_to].addr;
-        rdma_flag_desc[i].remote_addr += i * TRANSFER_LENGTH_IN_BYTES;
-        rdma_flag_desc[i].remote_mem_hndl =
-            remote_memory_handle_array[send_to].mdh;
-        rdma_flag_desc[i].length = sizeof(uint64_t);
-        rdma_flag_desc[i].rdma_mode = 0;
-        rdma_flag_desc[i].src_cq_hndl = cq_handle;
-
-        if (v_option) {
-            fprintf(stdout,
-                    "[%s] Rank: %4i GNI_PostRdma      flag transfer: %4i send to:   %4i local addr:  0x%lx remote addr: 0x%lx flag: 0x%16lx data length: %4i\n",
-                    uts_info.nodename, rank_id, (i + 1), send_to,
-                    rdma_flag_desc[i].local_addr,
-                    rdma_flag_desc[i].remote_addr, flag[i],
-                    (int) (sizeof(uint64_t)));
+            post_id_table_insert(&data_post_ids, send_post_id, i);
+            send_state[slot] = SLOT_DATA;
+            data_transfers_sent++;
+            progress = 1;
         }
 
         /*
-         * Send the flag.
+         * Take the completed transfers from the source completion queue.
+         * The source completion queue needs to be checked and events to
+         * be removed so that it does not become full and cause
+         * succeeding calls to PostRdma to fail.  The transfers may
+         * complete in any order, each completed descriptor is found by
+         * its post_id.
          */
 
-        status =
-            GNI_PostRdma(endpoint_handles_array[send_to],
-                         &rdma_flag_desc[i]);
-        if (status != GNI_RC_SUCCESS) {
-            fprintf(stdout,
-                    "[%s] Rank: %4i GNI_PostRdma      flag ERROR status: %s (%d)\n",
-                    uts_info.nodename, rank_id, gni_err_str[status], status);
+        completions = poll_cq_events(cq_handle, &data_post_ids, "data",
+                                     CQ_DRAIN_BATCH, completed_transfers,
+                                     completed_events, &rc);
+        if (rc != 0) {
             INCREMENT_FAILED;
-            continue;
-        }
-
-        INCREMENT_PASSED;
-
-        if (v_option > 2) {
-            fprintf(stdout, "[%s] Rank: %4i GNI_PostRdma      flag successful\n",
-                    uts_info.nodename, rank_id);
+            goto EXIT_WAIT_BARRIER;
         }
 
-        flag_transfers_sent++;
-    }
-
-    if (v_option) {
-
-        /*
-         * Write out all of the output messages.
-         */
-
-        fflush(stdout);
-    }
-
-    /*
-     * Get all of the flag completion queue events.
-     */
-
-    if (v_option > 2) {
-        fprintf(stdout,
-                "[%s] Rank: %4i flag transfers complete, checking CQ events\n",
-                uts_info.nodename, rank_id);
-    }
+        for (j = 0; j < completions; j++) {
+            progress = 1;
 
-    for (i = 0; i < flag_transfers_sent; i++) {
+            if (completed_transfers[j] == CREDIT_INDEX) {
+                credit_outstanding = 0;
+                continue;
+            }
 
-        /*
-         * Check the completion queue to verify that the message request has
-         * been sent.  The source completion queue needs to be checked and
-         * events to be removed so that it does not become full and cause
-         * succeeding calls to PostRdma to fail.
-         */
+            /*
+             * A data post is entered with its transfer number, a flag
+             * post with FLAG_INDEX of it, which FLAG_INDEX turns back
+             * into the transfer number.
+             */
 
-        rc = get_cq_event(cq_handle, uts_info, rank_id, 1, 1, &current_event);
-        if (rc == 0) {
+            if (completed_transfers[j] < 0) {
+                i = FLAG_INDEX(completed_transfers[j]);
+            } else {
+                i = completed_transfers[j];
+            }
+            slot = i % window;
 
             /*
-             * An event was received.
-             *
-             * Complete the event, which removes the current event's post
-             * descriptor from the event queue.
+             * Validate the current event's instance id with the expected id.
              */
 
-            status = GNI_GetCompleted(cq_handle, current_event, &event_post_desc_ptr);
-            if (status != GNI_RC_SUCCESS) {
+            event_inst_id = GNI_CQ_GET_INST_ID(completed_events[j]);
+            if (event_inst_id != expected_local_event_id) {
+
+                /*
+                 * The event's inst_id was not the expected inst_id
+                 * value.
+                 */
+
                 fprintf(stdout,
-                        "[%s] Rank: %4i GNI_GetCompleted  flag ERROR status: %s (%d)\n",
-                        uts_info.nodename, rank_id, gni_err_str[status], status);
+                        "[%s] Rank: %4i CQ Event %s ERROR received inst_id: %u, expected inst_id: %u in event_data\n",
+                        uts_info.nodename, rank_id,
+                        (completed_transfers[j] >= 0) ? "data" : "flag",
+                        event_inst_id, expected_local_event_id);
 
                 INCREMENT_FAILED;
             } else {
 
-                /*
-                 * Validate the current event's instance id with the expected id.
-                 */
+                INCREMENT_PASSED;
+            }
 
-                event_inst_id = GNI_CQ_GET_INST_ID(current_event);
-                if (event_inst_id != expected_local_event_id) {
+            if (completed_transfers[j] < 0) {
 
-                    /*
-                     * The event's inst_id was not the expected inst_id
-                     * value.
-                     */
+                /*
+                 * The flag arrived, the slot may be reused.
+                 */
 
-                    fprintf(stdout,
-                            "[%s] Rank: %4i CQ Event flag ERROR received inst_id: %u, expected inst_id: %u in event_data\n",
-                            uts_info.nodename, rank_id, event_inst_id, expected_local_event_id);
+                if (TRACE_ENABLED) {
+                    trace_record(TRACE_COMPLETED_FLAG, -1, i + 1, 0, 0, 0, 0,
+                                 0, 0);
+                }
 
-                    INCREMENT_FAILED;
-                } else {
+                send_state[slot] = SLOT_FREE;
+                flag_events++;
+                continue;
+            }
 
-                    INCREMENT_PASSED;
-                }
+            if (TRACE_ENABLED) {
+                trace_record(TRACE_COMPLETED_DATA, send_to, i + 1,
+                             rdma_data_desc[slot].post_id, 0, 0,
+                             rdma_data_desc[slot].remote_addr, 0, 0);
+            } else if (v_option) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i GNI_GetCompleted  data transfer: %4i send to:   %4i remote addr: 0x%lx post_id: %lu\n",
+                        uts_info.nodename, rank_id, (i + 1), send_to,
+                        rdma_data_desc[slot].remote_addr,
+                        rdma_data_desc[slot].post_id);
             }
-        } else if (rc == 2) {
+
+            INCREMENT_PASSED;
+            data_events++;
 
             /*
-             * An overrun error occurred while receiving the event.
+             * The data is in the receiver's memory, send the flag.
+             * The source flag will look like: 0xfffflllllltttttt
+             *     where: ffff is the actual value
+             *            llllll is the rank for this process
+             *            tttttt is the transfer number
              */
 
-            if (create_destination_overrun == 1) {
-                expected_passed = 1;
-                passed = 1;
-                failed = 0;
+            if (use_checksum == 1) {
+                flag[slot] = CHECKSUM_FLAG(i + 1,
+                                           crc32c(0, &send_buffer[slot * TRANSFER_LENGTH],
+                                                  TRANSFER_LENGTH_IN_BYTES -
+                                                  sizeof(uint64_t)));
             } else {
-                INCREMENT_FAILED;
-
-                if (v_option > 2) {
-                    fprintf(stdout,
-                            "[%s] Rank: %4i get_cq_event        flag ERROR status: OVERRUN\n",
-                            uts_info.nodename, rank_id);
-                }
+                flag[slot] = FLAG_DATA + my_id + TRANSFER_TAG(i);
             }
-                        
-            continue;
-        } else {
+
             /*
-             * An error occurred while receiving the event.
+             * Setup the flag request, as the data request but from the
+             * flag to the first element of the receiving slot.
              */
 
-            INCREMENT_FAILED;
-            continue;
-        }
-    }
+            rdma_flag_desc[slot].type = GNI_POST_RDMA_PUT;
+            rdma_flag_desc[slot].cq_mode = rdma_data_desc[slot].cq_mode;
+            rdma_flag_desc[slot].dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+            rdma_flag_desc[slot].local_addr = (uint64_t) & flag[slot];
+            rdma_flag_desc[slot].local_mem_hndl = my_flag_memory_handle;
+            rdma_flag_desc[slot].remote_addr =
+                remote_memory_handle_array[send_to].addr;
+            rdma_flag_desc[slot].remote_addr += slot * TRANSFER_LENGTH_IN_BYTES;
+            rdma_flag_desc[slot].remote_mem_hndl =
+                remote_memory_handle_array[send_to].mdh;
+            rdma_flag_desc[slot].length = sizeof(uint64_t);
+            rdma_flag_desc[slot].rdma_mode = 0;
+            rdma_flag_desc[slot].src_cq_hndl = cq_handle;
+            rdma_flag_desc[slot].post_id =
+                rdma_data_desc[slot].post_id | FLAG_POST_ID;
+
+            if (TRACE_ENABLED) {
+                trace_record(TRACE_POST_FLAG, send_to, i + 1, 0,
+                             sizeof(uint64_t), rdma_flag_desc[slot].local_addr,
+                             rdma_flag_desc[slot].remote_addr, flag[slot], 0);
+            } else if (v_option) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i GNI_PostRdma      flag transfer: %4i send to:   %4i local addr:  0x%lx remote addr: 0x%lx flag: 0x%16lx data length: %4i\n",
+                        uts_info.nodename, rank_id, (i + 1), send_to,
+                        rdma_flag_desc[slot].local_addr,
+                        rdma_flag_desc[slot].remote_addr, flag[slot],
+                        (int) (sizeof(uint64_t)));
+            }
 
-    if (v_option) {
+            /*
+             * Send the flag.
+             */
 
-        /*
-         * Write out all of the output messages.
-         */
+            status =
+                GNI_PostRdma(endpoint_handles_array[send_to],
+                             &rdma_flag_desc[slot]);
+            if (status != GNI_RC_SUCCESS) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i GNI_PostRdma      flag ERROR status: %s (%d)\n",
+                        uts_info.nodename, rank_id, gni_err_str[status], status);
+                INCREMENT_FAILED;
+                goto EXIT_WAIT_BARRIER;
+            }
 
-        fflush(stdout);
-    }
+            INCREMENT_PASSED;
 
-    if (create_destination_cq != 0) {
+            if (v_option > 2) {
+                fprintf(stdout, "[%s] Rank: %4i GNI_PostRdma      flag successful\n",
+                        uts_info.nodename, rank_id);
+            }
 
-        if (v_option > 2) {
-            fprintf(stdout,
-                    "[%s] Rank: %4i Wait for destination completion queue events recv from: %4i\n",
-                    uts_info.nodename, rank_id, receive_from);
+            post_id_table_insert(&data_post_ids, rdma_flag_desc[slot].post_id,
+                                 FLAG_INDEX(i));
+            send_state[slot] = SLOT_FLAG;
         }
 
         /*
-         * Check the completion queue to verify that the data and flag has
-         * been received.  The destination completion queue needs to be
-         * checked and events to be removed so that it does not become full
-         * and cause succeeding events to be lost.
+         * Take the data and flag events from the destination completion
+         * queue, so that it does not become full and cause succeeding
+         * events to be lost.
          */
 
-        for (i = 0; i < transfers * 2; i++) {
+        while ((create_destination_cq != 0) &&
+               (destination_events < transfers * 2)) {
             rc = get_cq_event(destination_cq_handle, uts_info,
-                                         rank_id, 0, 1, &current_event);
-            if (rc == 0) {
-
-                /*
-                 * An event was received.
-                 *
-                 * Validate the current event's instance id with the expected id.
-                 */
-
-                event_inst_id = GNI_CQ_GET_INST_ID(current_event);
-                if (event_inst_id != expected_remote_event_id) {
-
-                    /*
-                     * The event's inst_id was not the expected inst_id
-                     * value.
-                     */
-
-                    fprintf(stdout,
-                            "[%s] Rank: %4i CQ Event destination ERROR received inst_id: %u, expected inst_id: %u in event_data\n",
-                            uts_info.nodename, rank_id, event_inst_id, expected_remote_event_id);
-
-                    INCREMENT_FAILED;
-                } else {
-
-                    INCREMENT_PASSED;
-                }
-            } else if (rc == 2) {
-
-                /*
-                 * An overrun error occurred while receiving the event.
-                 */
-
-                if (create_destination_overrun == 1) {
-                    expected_passed = 1;
-                    passed = 1;
-                    failed = 0;
-                } else {
-                    INCREMENT_FAILED;
-
-                    if (v_option > 2) {
-                        fprintf(stdout,
-                                "[%s] Rank: %4i get_cq_event         destination CQ ERROR status: OVERRUN\n",
-                                uts_info.nodename, rank_id);
-                    }
-                }
-
-                goto EXIT_WAIT_BARRIER;
-            } else {
+                              rank_id, 0, 0, &current_event);
+            if (rc == 3) {
+                break;
+            } else if (rc != 0) {
 
                 /*
                  * An error occurred while receiving the event.
@@ -1224,136 +1277,259 @@ main(int argc, char **argv)
                 INCREMENT_FAILED;
                 goto EXIT_WAIT_BARRIER;
             }
-        }
 
-        if (v_option) {
+            destination_events++;
+            progress = 1;
+
+            if (TRACE_ENABLED) {
+                trace_record(TRACE_REMOTE_CQ_EVENT, -1, destination_events,
+                             0, 0, 0, 0, current_event, 0);
+            }
 
             /*
-             * Write out all of the output messages.
+             * Validate the current event's instance id with the expected id.
              */
 
-            fflush(stdout);
-        }
-    }
+            event_inst_id = GNI_CQ_GET_INST_ID(current_event);
+            if (event_inst_id != expected_remote_event_id) {
 
-    for (i = 0; i < transfers; i++) {
+                /*
+                 * The event's inst_id was not the expected inst_id
+                 * value.
+                 */
 
-        /*
-         * Detemine what the received flag will look like.
-         * The received flag will look like: 0xffffrrrrrrtttttt
-         *     where: ffff is the actual value
-         *            rrrrrr is the rank of the remote process,
-         *                   that is sending to this process
-         *            tttttt is the transfer number
-         */
+                fprintf(stdout,
+                        "[%s] Rank: %4i CQ Event destination ERROR received inst_id: %u, expected inst_id: %u in event_data\n",
+                        uts_info.nodename, rank_id, event_inst_id, expected_remote_event_id);
 
-        receive_flag = FLAG_DATA + my_receive_from + i + 1;
+                INCREMENT_FAILED;
+            } else {
+
+                INCREMENT_PASSED;
+            }
+        }
 
         /*
-         * Wait for arrival of the flag from the remote node
+         * Receive the transfers whose flags have arrived, in order.
          */
 
-        flag_ptr = (uint64_t *) & receive_buffer[TRANSFER_LENGTH * i];
+        while (received < transfers) {
+            i = received;
+            slot = i % window;
 
-        while (*flag_ptr != receive_flag) {
-            sched_yield();
-        };
+            /*
+             * Detemine what the received flag will look like.
+             * The received flag will look like: 0xffffrrrrrrtttttt
+             *     where: ffff is the actual value
+             *            rrrrrr is the rank of the remote process,
+             *                   that is sending to this process
+             *            tttttt is the transfer number
+             */
 
-        if (v_option) {
-            fprintf(stdout,
-                    "[%s] Rank: %4i Received          flag transfer: %4i recv from: %4i remote addr: %p flag: 0x%16lx\n",
-                    uts_info.nodename, rank_id, (i + 1),
-                    (int) ((*flag_ptr >> 24) & 0xffffff), flag_ptr,
-                    *flag_ptr);
-        }
-    }
+            receive_flag = FLAG_DATA + my_receive_from + TRANSFER_TAG(i);
+            flag_mask = ~0UL;
 
-    if (v_option) {
+            if (use_checksum == 1) {
 
-        /*
-         * Write out all of the output messages.
-         */
+                /*
+                 * The checksum part of the flag is not known in advance.
+                 */
 
-        fflush(stdout);
-    }
+                receive_flag = CHECKSUM_FLAG(i + 1, 0);
+                flag_mask = CHECKSUM_FLAG_MASK;
+            }
 
-    for (i = 0; i < transfers; i++) {
+            flag_ptr = (uint64_t *) & receive_buffer[TRANSFER_LENGTH * slot];
+            if ((*flag_ptr & flag_mask) != receive_flag) {
+                break;
+            }
 
-        /*
-         * Detemine what the received data will look like.
-         * The received data will look like: 0xddddrrrrrrtttttt
-         *     where: dddd is the actual value
-         *            rrrrrr is the rank of the remote process,
-         *                   that is sending to this process
-         *            tttttt is the transfer number
-         */
+            /*
+             * The checksum flag has no room for the sender's rank, but it can
+             * only have come from the rank that this rank receives from.
+             */
 
-        receive_data = SEND_DATA + my_receive_from + i + 1;
+            if (use_checksum == 1) {
+                flag_from = receive_from;
+            } else {
+                flag_from = (int) ((*flag_ptr >> 24) & 0xffffff);
+            }
 
-        /*
-         * Verify the received data.
-         * The first element in the buffer is the flag.
-         */
+            if (TRACE_ENABLED) {
+                trace_record(TRACE_RECEIVED_FLAG, flag_from,
+                             i + 1, 0, 0, 0, (uint64_t) flag_ptr, *flag_ptr, 0);
+            } else if (v_option) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i Received          flag transfer: %4i recv from: %4i remote addr: %p flag: 0x%16lx\n",
+                        uts_info.nodename, rank_id, (i + 1),
+                        flag_from, flag_ptr,
+                        *flag_ptr);
+            }
 
-        compare_data_failed = 0;
+            /*
+             * Verify the data after the flag, either against the checksum
+             * in the flag or against the value of every element.  The slot
+             * is not credited back to the sender until it has been checked.
+             * A position pattern starts at the element after the flag.
+             */
+
+            if (use_checksum == 1) {
+                receive_data = *flag_ptr;
+                data_pattern = PATTERN_RANDOM;
+            } else if (use_position == 1) {
+                receive_data = SEND_DATA + my_receive_from +
+                    TRANSFER_TAG(i) + 1;
+                data_pattern = PATTERN_POSITION;
+            } else {
+                receive_data = SEND_DATA + my_receive_from + TRANSFER_TAG(i);
+                data_pattern = PATTERN_CONSTANT;
+            }
 
-        for (j = 1; j < TRANSFER_LENGTH; j++) {
-            if (receive_buffer[j + (TRANSFER_LENGTH * i)] != receive_data) {
+            if (use_verify_thread == 1) {
 
                 /*
-                 * The data was not what was expected.
+                 * Hand the data to the verification thread.
                  */
 
-                compare_data_failed++;
-                fprintf(stdout,
-                        "[%s] Rank: %4i Received data ERROR in transfer: %4i element: %4i (address %p)"
-                        " received data: 0x%016lx expected data: 0x%016lx\n",
-                        uts_info.nodename, rank_id, (i + 1),
-                        j + (TRANSFER_LENGTH * i),
-                        &(receive_buffer[j + (TRANSFER_LENGTH * i)]),
-                        receive_buffer[j + (TRANSFER_LENGTH * i)],
-                        receive_data);
-            } else if (j == 1) {
-                if (v_option) {
-                    fprintf(stdout,
-                            "[%s] Rank: %4i Received          data transfer: %4i recv from: %4i remote addr: %p data: 0x%016lx\n",
-                            uts_info.nodename, rank_id, (i + 1),
-                            (int) ((receive_buffer
-                                    [j + (TRANSFER_LENGTH * i)] >> 24)
-                                   & 0xffffff),
-                            &receive_buffer[j + (TRANSFER_LENGTH * i)],
-                            receive_buffer[j + (TRANSFER_LENGTH * i)]);
+                queue_verify_request(verify_queue,
+                                     &receive_buffer[1 + (TRANSFER_LENGTH * slot)],
+                                     TRANSFER_LENGTH - 1, receive_data, i + 1,
+                                     data_pattern);
+            } else {
+                verify_inline.data = &receive_buffer[1 + (TRANSFER_LENGTH * slot)];
+                verify_inline.count = TRANSFER_LENGTH - 1;
+                verify_inline.expected = receive_data;
+                verify_inline.transfer = i + 1;
+                verify_inline.pattern = data_pattern;
+
+                if (verify_request(&verify_inline) == 0) {
+                    INCREMENT_PASSED;
+                } else {
+                    INCREMENT_FAILED;
                 }
             }
 
-            /*
-             * Only print the first 10 data compare errors.
-             */
+            received++;
+            progress = 1;
 
-            if (compare_data_failed > 9) {
-                break;
+            if (TRACE_ENABLED && (received < transfers)) {
+                trace_record(TRACE_FLAG_WAIT, -1, received + 1, 0, 0, 0,
+                             (uint64_t) &receive_buffer[TRANSFER_LENGTH * (received % window)],
+                             0, 0);
             }
         }
 
-        if (compare_data_failed != 0) {
+        /*
+         * Return the credits for the consumed slots to the sender.  There
+         * is only one credit put outstanding, it carries the latest count.
+         */
 
-            /*
-             * The data did not compare correctly.
-             * Increment the failed test count.
-             */
+        consumed = (use_verify_thread == 1) ?
+            verified_requests(verify_queue) : received;
+
+        if ((credit_outstanding == 0) && (consumed < transfers) &&
+            ((consumed - credit_sent) >= credit_interval)) {
+            flag[window + 1] = consumed;
+
+            credit_desc.type = GNI_POST_RDMA_PUT;
+            credit_desc.cq_mode = GNI_CQMODE_GLOBAL_EVENT;
+            credit_desc.dlvr_mode = GNI_DLVMODE_PERFORMANCE;
+            credit_desc.local_addr = (uint64_t) & flag[window + 1];
+            credit_desc.local_mem_hndl = my_flag_memory_handle;
+            credit_desc.remote_addr =
+                remote_flag_handle_array[receive_from].addr +
+                window * sizeof(uint64_t);
+            credit_desc.remote_mem_hndl =
+                remote_flag_handle_array[receive_from].mdh;
+            credit_desc.length = sizeof(uint64_t);
+            credit_desc.rdma_mode = 0;
+            credit_desc.src_cq_hndl = cq_handle;
+            credit_desc.post_id = CREDIT_POST_ID;
+
+            status = GNI_PostRdma(endpoint_handles_array[receive_from],
+                                  &credit_desc);
+            if (status != GNI_RC_SUCCESS) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i GNI_PostRdma      credit ERROR status: %s (%d)\n",
+                        uts_info.nodename, rank_id, gni_err_str[status], status);
+                INCREMENT_FAILED;
+                goto EXIT_WAIT_BARRIER;
+            }
+
+            if (v_option > 2) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i GNI_PostRdma      credit: %4i send to:   %4i\n",
+                        uts_info.nodename, rank_id, consumed, receive_from);
+            }
+
+            post_id_table_insert(&data_post_ids, CREDIT_POST_ID, CREDIT_INDEX);
+            credit_outstanding = 1;
+            credit_sent = consumed;
+            progress = 1;
+        }
+
+        if (progress == 0) {
+            sched_yield();
+        }
+    }
+
+    if (v_option > 1) {
+        fprintf(stdout,
+                "[%s] Rank: %4i completions drained: %lu in %lu batches out of order: %lu\n",
+                uts_info.nodename, rank_id, data_post_ids.events,
+                data_post_ids.drains, data_post_ids.out_of_order);
+    }
+
+    /*
+     * Wait for the rest of the destination completion queue events, an
+     * event may arrive after the flag of its transfer.
+     */
+
+    while ((create_destination_cq != 0) &&
+           (destination_events < transfers * 2)) {
+        rc = get_cq_event(destination_cq_handle, uts_info,
+                          rank_id, 0, 1, &current_event);
+        if (rc != 0) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i CQ Event ERROR destination queue did not receieve"
+                    " flag or data event\n",
+                    uts_info.nodename, rank_id);
 
             INCREMENT_FAILED;
-        } else {
+            break;
+        }
 
-            /*
-             * The data compared correctly.
-             * Increment the passed test count.
-             */
+        destination_events++;
+
+        if (TRACE_ENABLED) {
+            trace_record(TRACE_REMOTE_CQ_EVENT, -1, destination_events,
+                         0, 0, 0, 0, current_event, 0);
+        }
+
+        event_inst_id = GNI_CQ_GET_INST_ID(current_event);
+        if (event_inst_id != expected_remote_event_id) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i CQ Event destination ERROR received inst_id: %u, expected inst_id: %u in event_data\n",
+                    uts_info.nodename, rank_id, event_inst_id, expected_remote_event_id);
+
+            INCREMENT_FAILED;
+        } else {
 
             INCREMENT_PASSED;
         }
     }
 
+    if (use_verify_thread == 1) {
+
+        /*
+         * Wait for the verification thread to check the remaining
+         * transfers, it adds its results to the passed and failed counts.
+         */
+
+        stop_verify_thread(verify_queue);
+        verify_queue = NULL;
+    }
+
     if (v_option) {
 
         /*
@@ -1368,13 +1544,16 @@ main(int argc, char **argv)
      * Wait for all the processes to finish before we clean up and exit.
      */
 
+    trace_mark(TRACE_BARRIER_ENTER);
     rc = PMI_Barrier();
     assert(rc == PMI_SUCCESS);
+    trace_mark(TRACE_BARRIER_EXIT);
 
     /*
      * Free allocated memory.
      */
 
+    free(remote_flag_handle_array);
     free(remote_memory_handle_array);
 
     /*
@@ -1400,7 +1579,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(receive_buffer);
+        free_buffer(receive_buffer, (TRANSFER_LENGTH_IN_BYTES * window),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_SOURCE:
@@ -1428,7 +1608,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(send_buffer);
+        free_buffer(send_buffer, (TRANSFER_LENGTH_IN_BYTES * window),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_FLAG:
@@ -1588,6 +1769,8 @@ main(int argc, char **argv)
      */
 
     free(rdma_data_desc);
+    post_id_table_free(&data_post_ids);
+    free(send_state);
 
     /*
      * Free allocated memory.
@@ -1595,10 +1778,18 @@ main(int argc, char **argv)
 
     free(flag);
 
+    /*
+     * Display the time spent registering the data buffers.
+     */
+
+    print_buffer_statistics();
+
     /*
      * Display the results from this test.
      */
 
+    trace_finish();
+
     rc = print_results();
 
     /*
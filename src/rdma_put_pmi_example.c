@@ -48,6 +48,12 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "affinity_functions.h"
+#include "buffer_functions.h"
+#include "pattern_functions.h"
+#include "verify_functions.h"
+#include "completion_functions.h"
+#include "trace_functions.h"
 
 void print_help(void)
 {
@@ -65,25 +71,45 @@ void print_help(void)
 "\n"
 "  Parameters:\n"
 "    Additional parameters for this example are:\n"
-"      1.  '-D' specifies that the destination completion queue will not be\n"
+"      1.  '-c' specifies a list of cores, e.g. '0-7,16', that the ranks on\n"
+"          a node will be pinned to in order.\n"
+"          The default value is that the ranks are not pinned.\n"
+"      2.  '-C' specifies that the data will be pseudo random and verified\n"
+"          by a CRC32C checksum that is sent in the flag word, instead of\n"
+"          comparing every element with a known value.\n"
+"          The default value is to compare every element.\n"
+"      3.  '-D' specifies that the destination completion queue will not be\n"
 "          created.\n"
 "          The default value is that the destination completion queue will\n"
 "          be created.\n"
-"      2.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
-"      3.  '-h' prints the help information for this example.\n"
-"      4.  '-n' specifies the number of data transactions that will be sent.\n"
+"      4.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
+"      5.  '-h' prints the help information for this example.\n"
+"      6.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      7.  '-N' specifies the NUMA node that the send and receive buffers\n"
+"          will be allocated and first touched on.  This is either a node\n"
+"          number, 'local' for the node of the NIC or 'remote'.\n"
+"          The default value is the node of the first touch.\n"
+"      8.  '-n' specifies the number of data transactions that will be sent.\n"
 "          The default value is 10 data transactions to be sent.\n"
-"      5.  '-O' specifies that the destination completion queue will\n"
+"      9.  '-O' specifies that the destination completion queue will\n"
 "          be created with a very small number of entries.  This will\n"
-"      6   cause an overrun condition on the destination complete queue.\n"
+"          cause an overrun condition on the destination complete queue.\n"
 "          The default value is that the destination completion queue will\n"
 "          be created with a sufficient number of entries to not cause\n"
 "          the overrun condition to occur.  This implies that '-D' is ignored.\n"
-"      7.  '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
+"      10. '-v', '-vv' or '-vvv' allows various levels of output or debug\n"
 "          messages to be displayed.  With each additional 'v' more\n"
 "          information will be displayed.\n"
 "          The default value is no output or debug messages will be\n"
 "          displayed.\n"
+"      11. '-V' specifies that the received data will be verified by a\n"
+"          background thread as each transfer arrives, instead of after all\n"
+"          of the transfers have arrived.\n"
+"          The default value is to verify the data after the transfers.\n"
 "\n"
 "  Execution:\n"
 "    The following is a list of suggested example executions with various\n"
@@ -93,6 +119,9 @@ void print_help(void)
 "      - rdma_put_pmi_example -D\n"
 "      - rdma_put_pmi_example -D -e\n"
 "      - rdma_put_pmi_example -O\n"
+"      - rdma_put_pmi_example -c 0-15 -N local -n 1000\n"
+"      - rdma_put_pmi_example -c 0-15 -N remote -n 1000\n"
+"      - rdma_put_pmi_example -C -H 2m -n 1000\n"
 "\n"
     );
 }
@@ -104,12 +133,22 @@ main(int argc, char **argv)
     uint32_t        bind_id;
     gni_cdm_handle_t cdm_handle;
     uint32_t        cdm_id;
+    uint32_t        checksum;
     int             cookie;
+    char           *core_list = NULL;
+    int            *cores;
     gni_cq_handle_t cq_handle;
+    int             completed_transfers[CQ_DRAIN_BATCH];
+    gni_cq_entry_t  completed_events[CQ_DRAIN_BATCH];
+    int             completions;
     int             create_destination_cq = 1;
     int             create_destination_overrun = 0;
     gni_cq_entry_t  current_event;
     uint64_t        data = SEND_DATA;
+    double          data_start_time = 0.0;
+    double          data_time;
+    post_id_table_t data_post_ids;
+    int             data_events;
     int             data_transfers_sent = 0;
     gni_cq_handle_t destination_cq_handle = NULL;
     int             device_id = 0;
@@ -120,9 +159,12 @@ main(int argc, char **argv)
     uint32_t        expected_remote_event_id;
     int             first_spawned;
     uint64_t        *flag;
+    int             flag_from;
+    uint64_t        flag_mask;
     volatile uint64_t *flag_ptr;
     int             flag_transfers_sent = 0;
     int             i;
+    int             inline_transfers;
     int             j;
     unsigned int    local_address;
     uint32_t        local_event_id;
@@ -132,9 +174,11 @@ main(int argc, char **argv)
     mdh_addr_t      my_memory_handle;
     int             my_receive_from;
     gni_nic_handle_t nic_handle;
+    int             number_of_cores;
     int             number_of_cq_entries;
     int             number_of_dest_cq_entries;
     int             number_of_ranks;
+    int             numa_node = NUMA_NODE_UNSPECIFIED;
     char            opt;
     extern char    *optarg;
     extern int      optopt;
@@ -157,7 +201,10 @@ main(int argc, char **argv)
     gni_return_t    status = GNI_RC_SUCCESS;
     char           *text_pointer;
     uint32_t        transfers = NUMBER_OF_TRANSFERS;
+    int             use_checksum = 0;
     int             use_event_id = 0;
+    int             use_verify_thread = 0;
+    verify_queue_t *verify_queue = NULL;
 
     command_name = ((text_pointer = rindex(argv[0], '/')) != NULL) ?
         strdup(++text_pointer) : strdup(argv[0]);
@@ -171,8 +218,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -182,8 +231,22 @@ main(int argc, char **argv)
 
     local_event_id = rank_id;
 
-    while ((opt = getopt(argc, argv, "Dehn:Ov")) != -1) {
+    rc = trace_init(rank_id, uts_info.nodename, command_name);
+    if (rc != 0) {
+        fprintf(stdout, "[%s] Rank: %4i trace_init WARNING failed, running with tracing disabled\n",
+                uts_info.nodename, rank_id);
+    }
+
+    while ((opt = getopt(argc, argv, "c:CDehH:N:n:OvV")) != -1) {
         switch (opt) {
+        case 'c':
+            core_list = optarg;
+            break;
+
+        case 'C':
+            use_checksum = 1;
+            break;
+
         case 'D':
             /* Do not create a destination completion queue. */
 
@@ -209,6 +272,30 @@ main(int argc, char **argv)
 
             exit(0);
 
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
+        case 'N':
+            numa_node = parse_numa_node(optarg);
+            break;
+
         case 'n':
 
             /*
@@ -237,6 +324,10 @@ main(int argc, char **argv)
             v_option++;
             break;
 
+        case 'V':
+            use_verify_thread = 1;
+            break;
+
         case '?':
             break;
         }
@@ -246,8 +337,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     /*
      * Determine the number of passes required for this test to be successful.
@@ -259,6 +352,17 @@ main(int argc, char **argv)
         expected_passed = transfers * 6;
     }
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%i", transfers);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) TRANSFER_LENGTH_IN_BYTES);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("dlvr_mode", "PERFORMANCE");
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
     /*
      * Allocate the flag array.
      */
@@ -274,6 +378,8 @@ main(int argc, char **argv)
                                                 sizeof(gni_post_descriptor_t));
     assert(rdma_data_desc != NULL);
 
+    post_id_table_init(&data_post_ids, transfers);
+
     /*
      * Allocate the rdma_flag_desc array.
      */
@@ -296,7 +402,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
 
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
@@ -321,8 +429,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status =
         GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -360,9 +470,11 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      source ERROR status: %s (%d)\n",
@@ -416,10 +528,12 @@ main(int argc, char **argv)
          *          this newly created completion queue.
          */
 
+        startup_phase_begin(STARTUP_CQ_CREATE);
         status =
             GNI_CqCreate(nic_handle, number_of_dest_cq_entries, 0,
                          GNI_CQ_NOBLOCK, NULL, NULL,
                          &destination_cq_handle);
+        startup_phase_end(STARTUP_CQ_CREATE);
         if (status != GNI_RC_SUCCESS) {
             fprintf(stdout,
                     "[%s] Rank: %4i GNI_CqCreate      destination ERROR status: %s (%d)\n",
@@ -448,7 +562,36 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
+
+    if (core_list != NULL) {
+
+        /*
+         * Pin this rank to the next core in the list for its node.
+         */
+
+        number_of_cores = parse_core_list(core_list, &cores);
+        if (number_of_cores > 0) {
+            i = cores[get_node_local_rank(all_nic_addresses, number_of_ranks,
+                                          rank_id) % number_of_cores];
+
+            if (bind_to_core(i) != 0) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i bind_to_core      ERROR core: %i\n",
+                        uts_info.nodename, rank_id, i);
+            } else if (v_option > 1) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i bind_to_core      core: %i\n",
+                        uts_info.nodename, rank_id, i);
+            }
+        }
+
+        free(cores);
+    }
+
+    startup_phase_begin(STARTUP_EP_SETUP);
 
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
@@ -541,6 +684,8 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * Register the memory associated for the flag with the NIC.
      *     nic_handle is our NIC handle.
@@ -555,10 +700,12 @@ main(int argc, char **argv)
      *     my_flag_memory_handle is the handle for this memory region.
      */
 
+    startup_phase_begin(STARTUP_MEM_REGISTER);
     status = GNI_MemRegister(nic_handle, (uint64_t) flag,
                              (transfers * sizeof(uint64_t)),
                              NULL, GNI_MEM_READWRITE, -1,
                              &my_flag_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   flag ERROR status: %s (%d)\n",
@@ -577,19 +724,15 @@ main(int argc, char **argv)
     /*
      * Allocate the buffer that will contain the data to be sent.  This
      * allocation is creating a buffer large enough to hold all of the
-     * sending data for all of the transfers.
+     * sending data for all of the transfers.  The buffer is placed on the
+     * requested NUMA node and initialized to all zeros.
      */
 
-    rc = posix_memalign((void **) &send_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &send_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         numa_node);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(send_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
-
     /*
      * Register the memory associated for the send buffer with the NIC.
      * We are sending the data from this buffer not receiving into it.
@@ -605,11 +748,13 @@ main(int argc, char **argv)
      *     source_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) send_buffer,
-                             (TRANSFER_LENGTH_IN_BYTES *
-                              transfers), NULL,
-                             GNI_MEM_READWRITE, -1,
-                             &source_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) send_buffer,
+                                (TRANSFER_LENGTH_IN_BYTES *
+                                 transfers), NULL,
+                                GNI_MEM_READWRITE, -1,
+                                &source_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister  send_buffer ERROR status: %s (%d)\n",
@@ -629,18 +774,21 @@ main(int argc, char **argv)
     /*
      * Allocate the buffer that will receive the data.  This allocation is
      * creating a buffer large enough to hold all of the received data for
-     * all of the transfers.
+     * all of the transfers.  The buffer is placed on the requested NUMA
+     * node and initialized to all zeros.
      */
 
-    rc = posix_memalign((void **) &receive_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &receive_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         numa_node);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(receive_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
+    if (v_option > 1) {
+        fprintf(stdout,
+                "[%s] Rank: %4i NUMA placement    send_buffer node: %i receive_buffer node: %i NIC node: %i\n",
+                uts_info.nodename, rank_id, get_buffer_numa_node(send_buffer),
+                get_buffer_numa_node(receive_buffer), get_nic_numa_node());
+    }
 
     /*
      * Register the memory associated for the receive buffer with the NIC.
@@ -657,11 +805,13 @@ main(int argc, char **argv)
      *     receive_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) receive_buffer,
-                             TRANSFER_LENGTH_IN_BYTES *
-                             transfers, destination_cq_handle,
-                             GNI_MEM_READWRITE,
-                             -1, &receive_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) receive_buffer,
+                                TRANSFER_LENGTH_IN_BYTES *
+                                transfers, destination_cq_handle,
+                                GNI_MEM_READWRITE,
+                                -1, &receive_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   receive_buffer ERROR status: %s (%d)\n",
@@ -695,8 +845,12 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&my_memory_handle, remote_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -720,6 +874,17 @@ main(int argc, char **argv)
         fflush(stdout);
     }
 
+    /*
+     * Line up the ranks before the transfers start.  With tracing on,
+     * trace_merge uses this barrier and the one at the exit to line up
+     * the clocks of the ranks.
+     */
+
+    trace_mark(TRACE_BARRIER_ENTER);
+    rc = PMI_Barrier();
+    assert(rc == PMI_SUCCESS);
+    trace_mark(TRACE_BARRIER_EXIT);
+
     /*
      * Determine who we are going to send our data to and
      * who we are going to receive data from.
@@ -756,8 +921,17 @@ main(int argc, char **argv)
 
         data = SEND_DATA + my_id + i + 1;
 
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
-            send_buffer[j + (i * TRANSFER_LENGTH)] = data;
+        if (use_checksum == 1) {
+
+            /*
+             * Only the data after the flag element is sent.
+             */
+
+            fill_random_pattern(&send_buffer[i * TRANSFER_LENGTH],
+                                TRANSFER_LENGTH - 1, data);
+        } else {
+            fill_pattern(&send_buffer[i * TRANSFER_LENGTH], TRANSFER_LENGTH,
+                         data);
         }
 
         /*
@@ -800,7 +974,13 @@ main(int argc, char **argv)
         rdma_data_desc[i].src_cq_hndl = cq_handle;
         rdma_data_desc[i].post_id = send_post_id;
 
-        if (v_option) {
+        if (TRACE_ENABLED) {
+            trace_record(TRACE_POST_DATA, send_to, i + 1,
+                         rdma_data_desc[i].post_id,
+                         TRANSFER_LENGTH_IN_BYTES - sizeof(uint64_t),
+                         rdma_data_desc[i].local_addr,
+                         rdma_data_desc[i].remote_addr, data, 0);
+        } else if (v_option) {
             fprintf(stdout,
                     "[%s] Rank: %4i GNI_PostRdma      data transfer: %4i send to:   %4i local addr:  0x%lx remote addr: 0x%lx data: 0x%16lx data length: %4i post_id: %lu\n",
                     uts_info.nodename, rank_id, (i + 1), send_to,
@@ -814,6 +994,10 @@ main(int argc, char **argv)
          * Send the data.
          */
 
+        if (data_start_time == 0.0) {
+            data_start_time = get_timestamp();
+        }
+
         status =
             GNI_PostRdma(endpoint_handles_array[send_to],
                          &rdma_data_desc[i]);
@@ -832,6 +1016,7 @@ main(int argc, char **argv)
                     uts_info.nodename, rank_id);
         }
 
+        post_id_table_insert(&data_post_ids, send_post_id, i);
         data_transfers_sent++;
     }   /* end of for loop for transfers */
 
@@ -854,88 +1039,75 @@ main(int argc, char **argv)
                 uts_info.nodename, rank_id);
     }
 
-    for (i = 0; i < data_transfers_sent; i++) {
-        send_post_id = ((uint64_t) expected_local_event_id * POST_ID_MULTIPLIER) + i + 1;
+    data_events = 0;
+    while (data_events < data_transfers_sent) {
 
         /*
-         * Check the completion queue to verify that the message request has
-         * been sent.  The source completion queue needs to be checked and
-         * events to be removed so that it does not become full and cause
-         * succeeding calls to PostRdma to fail.
+         * Check the completion queue to verify that the message requests
+         * have been sent.  The source completion queue needs to be checked
+         * and events to be removed so that it does not become full and
+         * cause succeeding calls to PostRdma to fail.  The transfers may
+         * complete in any order, each completed descriptor is found by
+         * its post_id.
          */
 
-        rc = get_cq_event(cq_handle, uts_info, rank_id, 1, 1, &current_event);
-        if (rc == 0) {
+        completions = drain_cq_events(cq_handle, &data_post_ids, "data",
+                                      CQ_DRAIN_BATCH, completed_transfers,
+                                      completed_events, &rc);
+        data_events += completions;
+
+        for (j = 0; j < completions; j++) {
+            if (TRACE_ENABLED) {
+                trace_record(TRACE_COMPLETED_DATA, send_to,
+                             completed_transfers[j] + 1,
+                             rdma_data_desc[completed_transfers[j]].post_id, 0, 0,
+                             rdma_data_desc[completed_transfers[j]].remote_addr,
+                             0, 0);
+            } else if (v_option) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i GNI_GetCompleted  data transfer: %4i send to:   %4i remote addr: 0x%lx post_id: %lu\n",
+                        uts_info.nodename, rank_id, (completed_transfers[j] + 1), send_to,
+                        rdma_data_desc[completed_transfers[j]].remote_addr,
+                        rdma_data_desc[completed_transfers[j]].post_id);
+            }
+
+            INCREMENT_PASSED;
 
             /*
-             * An event was received.
-             *
-             * Complete the event, which removes the current event's post
-             * descriptor from the event queue.
+             * Validate the current event's instance id with the expected id.
              */
 
-            status = GNI_GetCompleted(cq_handle, current_event, &event_post_desc_ptr);
-            if (status != GNI_RC_SUCCESS) {
-                fprintf(stdout,
-                        "[%s] Rank: %4i GNI_GetCompleted  data ERROR status: %s (%d)\n",
-                        uts_info.nodename, rank_id, gni_err_str[status], status);
-
-                INCREMENT_FAILED;
-            } else {
+            event_inst_id = GNI_CQ_GET_INST_ID(completed_events[j]);
+            if (event_inst_id != expected_local_event_id) {
 
                 /*
-                 * Validate the completed request's post id with the expected id.
+                 * The event's inst_id was not the expected inst_id
+                 * value.
                  */
 
-                if (send_post_id != event_post_desc_ptr->post_id) {
-
-                    /*
-                     * The event's inst_id was not the expected inst_id
-                     * value.
-                     */
-
-                    fprintf(stdout,
-                            "[%s] Rank: %4i Completed data ERROR received post_id: %lu, expected post_id: %lu\n",
-                            uts_info.nodename, rank_id, event_post_desc_ptr->post_id,
-                            send_post_id);
-
-                    INCREMENT_FAILED;
-                } else {
-
-                    if (v_option) {
-                        fprintf(stdout,
-                                "[%s] Rank: %4i GNI_GetCompleted  data transfer: %4i send to:   %4i remote addr: 0x%lx post_id: %lu\n",
-                                uts_info.nodename, rank_id, (i + 1), send_to,
-                                event_post_desc_ptr->remote_addr,
-                                event_post_desc_ptr->post_id);
-                    }
-
-                    INCREMENT_PASSED;
-                }
+                fprintf(stdout,
+                        "[%s] Rank: %4i CQ Event data ERROR received inst_id: %u, expected inst_id: %u in event_data\n",
+                        uts_info.nodename, rank_id, event_inst_id, expected_local_event_id);
 
-                /*
-                 * Validate the current event's instance id with the expected id.
-                 */
+                INCREMENT_FAILED;
+            } else {
 
-                event_inst_id = GNI_CQ_GET_INST_ID(current_event);
-                if (event_inst_id != expected_local_event_id) {
+                INCREMENT_PASSED;
+            }
+        }
 
-                    /*
-                     * The event's inst_id was not the expected inst_id
-                     * value.
-                     */
+        if (rc == 0) {
+            continue;
+        }
 
-                    fprintf(stdout,
-                            "[%s] Rank: %4i CQ Event data ERROR received inst_id: %u, expected inst_id: %u in event_data\n",
-                            uts_info.nodename, rank_id, event_inst_id, expected_local_event_id);
+        /*
+         * The event that stopped the drain is counted as one of the
+         * expected events.
+         */
 
-                    INCREMENT_FAILED;
-                } else {
+        data_events++;
 
-                    INCREMENT_PASSED;
-                }
-            }
-        } else if (rc == 2) {
+        if (rc == 2) {
 
             /*
              * An overrun error occurred while receiving the event.
@@ -954,8 +1126,6 @@ main(int argc, char **argv)
                             uts_info.nodename, rank_id);
                 }
             }
-                        
-            continue;
         } else {
 
             /*
@@ -963,10 +1133,33 @@ main(int argc, char **argv)
              */
 
             INCREMENT_FAILED;
-            continue;
         }
     }
 
+    if (v_option > 1) {
+        fprintf(stdout,
+                "[%s] Rank: %4i data completions drained: %lu in %lu batches out of order: %lu\n",
+                uts_info.nodename, rank_id, data_post_ids.events,
+                data_post_ids.drains, data_post_ids.out_of_order);
+    }
+
+    /*
+     * Report the time from the first data post until the last data
+     * completion, this includes the effect of the buffer placement.
+     */
+
+    data_time = get_timestamp() - data_start_time;
+
+    print_rank_statistic("RDMA Put bandwidth",
+                         (data_time > 0.0) ? ((double) data_transfers_sent *
+                          (TRANSFER_LENGTH_IN_BYTES - sizeof(uint64_t))) /
+                         data_time / 1.0e6 : 0.0, "MB/s",
+                         RESULT_HIGHER_IS_BETTER);
+    print_rank_statistic("RDMA Put time per transfer",
+                         (data_transfers_sent > 0) ?
+                         (data_time * 1.0e6) / data_transfers_sent : 0.0,
+                         "usec", RESULT_LOWER_IS_BETTER);
+
     if (v_option) {
 
         /*
@@ -986,7 +1179,14 @@ main(int argc, char **argv)
          *            tttttt is the transfer number
          */
 
-        flag[i] = FLAG_DATA + my_id + i + 1;
+        if (use_checksum == 1) {
+            flag[i] = CHECKSUM_FLAG(i + 1,
+                                    crc32c(0, &send_buffer[i * TRANSFER_LENGTH],
+                                           TRANSFER_LENGTH_IN_BYTES -
+                                           sizeof(uint64_t)));
+        } else {
+            flag[i] = FLAG_DATA + my_id + i + 1;
+        }
 
         /*
          * Setup the flag request.
@@ -1025,7 +1225,11 @@ main(int argc, char **argv)
         rdma_flag_desc[i].rdma_mode = 0;
         rdma_flag_desc[i].src_cq_hndl = cq_handle;
 
-        if (v_option) {
+        if (TRACE_ENABLED) {
+            trace_record(TRACE_POST_FLAG, send_to, i + 1, 0,
+                         sizeof(uint64_t), rdma_flag_desc[i].local_addr,
+                         rdma_flag_desc[i].remote_addr, flag[i], 0);
+        } else if (v_option) {
             fprintf(stdout,
                     "[%s] Rank: %4i GNI_PostRdma      flag transfer: %4i send to:   %4i local addr:  0x%lx remote addr: 0x%lx flag: 0x%16lx data length: %4i\n",
                     uts_info.nodename, rank_id, (i + 1), send_to,
@@ -1106,6 +1310,11 @@ main(int argc, char **argv)
                 INCREMENT_FAILED;
             } else {
 
+                if (TRACE_ENABLED) {
+                    trace_record(TRACE_COMPLETED_FLAG, -1, i + 1, 0, 0, 0, 0,
+                                 0, 0);
+                }
+
                 /*
                  * Validate the current event's instance id with the expected id.
                  */
@@ -1188,6 +1397,11 @@ main(int argc, char **argv)
                                          rank_id, 0, 1, &current_event);
             if (rc == 0) {
 
+                if (TRACE_ENABLED) {
+                    trace_record(TRACE_REMOTE_CQ_EVENT, -1, i + 1, 0, 0, 0, 0,
+                                 current_event, 0);
+                }
+
                 /*
                  * An event was received.
                  *
@@ -1258,6 +1472,10 @@ main(int argc, char **argv)
         }
     }
 
+    if (use_verify_thread == 1) {
+        verify_queue = start_verify_thread();
+    }
+
     for (i = 0; i < transfers; i++) {
 
         /*
@@ -1270,6 +1488,17 @@ main(int argc, char **argv)
          */
 
         receive_flag = FLAG_DATA + my_receive_from + i + 1;
+        flag_mask = ~0UL;
+
+        if (use_checksum == 1) {
+
+            /*
+             * The checksum part of the flag is not known in advance.
+             */
+
+            receive_flag = CHECKSUM_FLAG(i + 1, 0);
+            flag_mask = CHECKSUM_FLAG_MASK;
+        }
 
         /*
          * Wait for arrival of the flag from the remote node
@@ -1277,17 +1506,56 @@ main(int argc, char **argv)
 
         flag_ptr = (uint64_t *) & receive_buffer[TRANSFER_LENGTH * i];
 
-        while (*flag_ptr != receive_flag) {
+        if (TRACE_ENABLED) {
+            trace_record(TRACE_FLAG_WAIT, -1, i + 1, 0, 0, 0,
+                         (uint64_t) flag_ptr, 0, 0);
+        }
+
+        while ((*flag_ptr & flag_mask) != receive_flag) {
             sched_yield();
         };
 
-        if (v_option) {
+        /*
+         * The checksum flag has no room for the sender's rank, but it can
+         * only have come from the rank that this rank receives from.
+         */
+
+        if (use_checksum == 1) {
+            flag_from = receive_from;
+        } else {
+            flag_from = (int) ((*flag_ptr >> 24) & 0xffffff);
+        }
+
+        if (TRACE_ENABLED) {
+            trace_record(TRACE_RECEIVED_FLAG, flag_from,
+                         i + 1, 0, 0, 0, (uint64_t) flag_ptr, *flag_ptr, 0);
+        } else if (v_option) {
             fprintf(stdout,
                     "[%s] Rank: %4i Received          flag transfer: %4i recv from: %4i remote addr: %p flag: 0x%16lx\n",
                     uts_info.nodename, rank_id, (i + 1),
-                    (int) ((*flag_ptr >> 24) & 0xffffff), flag_ptr,
+                    flag_from, flag_ptr,
                     *flag_ptr);
         }
+
+        if (use_verify_thread == 1) {
+
+            /*
+             * Hand the data after the flag to the verification thread.
+             */
+
+            if (use_checksum == 1) {
+                queue_verify_request(verify_queue,
+                                     &receive_buffer[1 + (TRANSFER_LENGTH * i)],
+                                     TRANSFER_LENGTH - 1, *flag_ptr, i + 1,
+                                     PATTERN_RANDOM);
+            } else {
+                queue_verify_request(verify_queue,
+                                     &receive_buffer[1 + (TRANSFER_LENGTH * i)],
+                                     TRANSFER_LENGTH - 1,
+                                     SEND_DATA + my_receive_from + i + 1,
+                                     i + 1, PATTERN_CONSTANT);
+            }
+        }
     }
 
     if (v_option) {
@@ -1299,7 +1567,20 @@ main(int argc, char **argv)
         fflush(stdout);
     }
 
-    for (i = 0; i < transfers; i++) {
+    inline_transfers = transfers;
+
+    if (use_verify_thread == 1) {
+
+        /*
+         * Wait for the verification thread to check the remaining
+         * transfers, it adds its results to the passed and failed counts.
+         */
+
+        stop_verify_thread(verify_queue);
+        inline_transfers = 0;
+    }
+
+    for (i = 0; i < inline_transfers; i++) {
 
         /*
          * Detemine what the received data will look like.
@@ -1319,7 +1600,49 @@ main(int argc, char **argv)
 
         compare_data_failed = 0;
 
-        for (j = 1; j < TRANSFER_LENGTH; j++) {
+        if (use_checksum == 1) {
+
+            /*
+             * A single checksum of the received data replaces the compare
+             * of every element.
+             */
+
+            checksum = crc32c(0, &receive_buffer[1 + (TRANSFER_LENGTH * i)],
+                              TRANSFER_LENGTH_IN_BYTES - sizeof(uint64_t));
+
+            if (checksum != (uint32_t) receive_buffer[TRANSFER_LENGTH * i]) {
+                compare_data_failed++;
+                fprintf(stdout,
+                        "[%s] Rank: %4i Received data ERROR in transfer: %4i checksum: 0x%08x expected checksum: 0x%08x\n",
+                        uts_info.nodename, rank_id, (i + 1), checksum,
+                        (uint32_t) receive_buffer[TRANSFER_LENGTH * i]);
+            }
+
+            j = TRANSFER_LENGTH;
+        } else {
+            j = 1;
+
+            if (v_option) {
+                fprintf(stdout,
+                        "[%s] Rank: %4i Received          data transfer: %4i recv from: %4i remote addr: %p data: 0x%016lx\n",
+                        uts_info.nodename, rank_id, (i + 1),
+                        (int) ((receive_buffer
+                                [j + (TRANSFER_LENGTH * i)] >> 24)
+                               & 0xffffff),
+                        &receive_buffer[j + (TRANSFER_LENGTH * i)],
+                        receive_buffer[j + (TRANSFER_LENGTH * i)]);
+            }
+
+            /*
+             * Skip the elements that match using the vector compare, the loop
+             * below only reports the elements that do not.
+             */
+
+            j += verify_pattern(&receive_buffer[1 + (TRANSFER_LENGTH * i)],
+                                TRANSFER_LENGTH - 1, receive_data);
+        }
+
+        for (; j < TRANSFER_LENGTH; j++) {
             if (receive_buffer[j + (TRANSFER_LENGTH * i)] != receive_data) {
 
                 /*
@@ -1335,17 +1658,6 @@ main(int argc, char **argv)
                         &(receive_buffer[j + (TRANSFER_LENGTH * i)]),
                         receive_buffer[j + (TRANSFER_LENGTH * i)],
                         receive_data);
-            } else if (j == 1) {
-                if (v_option) {
-                    fprintf(stdout,
-                            "[%s] Rank: %4i Received          data transfer: %4i recv from: %4i remote addr: %p data: 0x%016lx\n",
-                            uts_info.nodename, rank_id, (i + 1),
-                            (int) ((receive_buffer
-                                    [j + (TRANSFER_LENGTH * i)] >> 24)
-                                   & 0xffffff),
-                            &receive_buffer[j + (TRANSFER_LENGTH * i)],
-                            receive_buffer[j + (TRANSFER_LENGTH * i)]);
-                }
             }
 
             /*
@@ -1390,8 +1702,10 @@ main(int argc, char **argv)
      * Wait for all the processes to finish before we clean up and exit.
      */
 
+    trace_mark(TRACE_BARRIER_ENTER);
     rc = PMI_Barrier();
     assert(rc == PMI_SUCCESS);
+    trace_mark(TRACE_BARRIER_EXIT);
 
     /*
      * Free allocated memory.
@@ -1422,7 +1736,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(receive_buffer);
+        free_buffer(receive_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_SOURCE:
@@ -1450,7 +1765,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(send_buffer);
+        free_buffer(send_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_FLAG:
@@ -1610,6 +1926,7 @@ main(int argc, char **argv)
      */
 
     free(rdma_data_desc);
+    post_id_table_free(&data_post_ids);
 
     /*
      * Free allocated memory.
@@ -1617,10 +1934,18 @@ main(int argc, char **argv)
 
     free(flag);
 
+    /*
+     * Display the time spent registering the data buffers.
+     */
+
+    print_buffer_statistics();
+
     /*
      * Display the results from this test.
      */
 
+    trace_finish();
+
     rc = print_results();
 
     /*
@@ -48,6 +48,8 @@ struct utsname  uts_info;
 int             v_option = 0;
 
 #include "utility_functions.h"
+#include "buffer_functions.h"
+#include "pattern_functions.h"
 
 void print_help(void)
 {
@@ -71,11 +73,16 @@ void print_help(void)
 "          be created.\n"
 "      2.  '-e' specifies that the GNI_EpSetEventId API will be used.\n"
 "      3.  '-h' prints the help information for this example.\n"
-"      4.  '-n' specifies the number of data transactions that will be sent.\n"
+"      4.  '-H' specifies the buffer mode used to allocate the data buffers,\n"
+"          a comma separated list of the page size, '4k', 'thp', '2m' or\n"
+"          '1g', and 'populate', 'nopopulate' or 'mlock'.  The\n"
+"          registration time for the mode is displayed at the end.\n"
+"          The default value is '4k,populate'.\n"
+"      5.  '-n' specifies the number of data transactions that will be sent.\n"
 "          The default value is 10 data transactions to be sent.\n"
-"      5.  '-O' specifies that the destination completion queue will\n"
+"      6.  '-O' specifies that the destination completion queue will\n"
 "          be created with a very small number of entries.  This will\n"
-"      6   cause an overrun condition on the destination complete queue.\n"
+"          cause an overrun condition on the destination complete queue.\n"
 "          The default value is that the destination completion queue will\n"
 "          be created with a sufficient number of entries to not cause\n"
 "          the overrun condition to occur.  This implies that '-D' is ignored.\n"
@@ -115,7 +122,6 @@ main(int argc, char **argv)
     gni_post_descriptor_t *event_post_desc_ptr;
     int             first_spawned;
     int             i;
-    int             j;
     unsigned int    local_address;
     int             modes = GNI_CDM_MODE_BTE_SINGLE_CHANNEL;
     int             my_id;
@@ -158,8 +164,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_PMI_INIT);
     rc = PMI_Init(&first_spawned);
     assert(rc == PMI_SUCCESS);
+    startup_phase_end(STARTUP_PMI_INIT);
 
     rc = PMI_Get_size(&number_of_ranks);
     assert(rc == PMI_SUCCESS);
@@ -167,7 +175,7 @@ main(int argc, char **argv)
     rc = PMI_Get_rank(&rank_id);
     assert(rc == PMI_SUCCESS);
 
-    while ((opt = getopt(argc, argv, "hn:v")) != -1) {
+    while ((opt = getopt(argc, argv, "hH:n:v")) != -1) {
         switch (opt) {
         case 'h':
             if (rank_id == 0) {
@@ -182,6 +190,26 @@ main(int argc, char **argv)
 
             exit(0);
 
+        case 'H':
+
+            /*
+             * Set the page size and pre-faulting of the data buffers.
+             */
+
+            buffer_mode = parse_buffer_mode(optarg);
+            if (buffer_mode == -1) {
+                if (rank_id == 0) {
+                    fprintf(stdout, "Unknown -H buffer mode: %s\n", optarg);
+                    print_help();
+                }
+
+                PMI_Finalize();
+
+                exit(1);
+            }
+
+            break;
+
         case 'n':
 
             /*
@@ -209,8 +237,10 @@ main(int argc, char **argv)
      * Get job attributes from PMI.
      */
 
+    startup_phase_begin(STARTUP_CREDENTIALS);
     ptag = get_ptag();
     cookie = get_cookie();
+    startup_phase_end(STARTUP_CREDENTIALS);
 
     /*
      * Allocate the rdma_data_desc array.
@@ -222,6 +252,16 @@ main(int argc, char **argv)
 
     cdm_id = rank_id;
 
+    /*
+     * Describe this run for the structured results.
+     */
+
+    add_result_metadata("transfers", "%u", transfers);
+    add_result_metadata("transfer_length", "%lu",
+                        (unsigned long) TRANSFER_LENGTH_IN_BYTES);
+    add_result_metadata("cdm_modes", "0x%x", modes);
+    add_result_metadata("buffer_mode", "%s", buffer_mode_string(buffer_mode));
+
     /*
      * Create a handle to the communication domain.
      *    cdm_id is the rank of this instance of the job.
@@ -234,7 +274,9 @@ main(int argc, char **argv)
      *        communication domain.
      */
 
+    startup_phase_begin(STARTUP_CDM_CREATE);
     status = GNI_CdmCreate(cdm_id, ptag, cookie, modes, &cdm_handle);
+    startup_phase_end(STARTUP_CDM_CREATE);
 
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
@@ -258,8 +300,10 @@ main(int argc, char **argv)
      *    nic_handle is the handle that is returned pointing to the NIC.
      */
 
+    startup_phase_begin(STARTUP_CDM_ATTACH);
     status =
         GNI_CdmAttach(cdm_handle, device_id, &local_address, &nic_handle);
+    startup_phase_end(STARTUP_CDM_ATTACH);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CdmAttach     ERROR status: %s (%d)\n",
@@ -296,9 +340,11 @@ main(int argc, char **argv)
      *          created completion queue.
      */
 
+    startup_phase_begin(STARTUP_CQ_CREATE);
     status =
         GNI_CqCreate(nic_handle, number_of_cq_entries, 0, GNI_CQ_NOBLOCK,
                      NULL, NULL, &cq_handle);
+    startup_phase_end(STARTUP_CQ_CREATE);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_CqCreate      source ERROR status: %s (%d)\n",
@@ -325,7 +371,11 @@ main(int argc, char **argv)
      * Get all of the NIC address for all of the ranks.
      */
 
+    startup_phase_begin(STARTUP_NIC_ADDRESSES);
     all_nic_addresses = (unsigned int *) gather_nic_addresses();
+    startup_phase_end(STARTUP_NIC_ADDRESSES);
+
+    startup_phase_begin(STARTUP_EP_SETUP);
 
     for (i = 0; i < number_of_ranks; i++) {
         if (i == rank_id) {
@@ -395,22 +445,19 @@ main(int argc, char **argv)
         }
     }
 
+    startup_phase_end(STARTUP_EP_SETUP);
+
     /*
      * Allocate the buffer that will contain the data to be sent.  This
      * allocation is creating a buffer large enough to hold all of the
      * sending data for all of the transfers.
      */
 
-    rc = posix_memalign((void **) &send_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &send_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(send_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
-
     /*
      * Register the memory associated for the send buffer with the NIC.
      * We are sending the data from this buffer not receiving into it.
@@ -426,11 +473,13 @@ main(int argc, char **argv)
      *     source_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) send_buffer,
-                             (TRANSFER_LENGTH_IN_BYTES *
-                              transfers), NULL,
-                             GNI_MEM_READWRITE, -1,
-                             &source_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) send_buffer,
+                                (TRANSFER_LENGTH_IN_BYTES *
+                                 transfers), NULL,
+                                GNI_MEM_READWRITE, -1,
+                                &source_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister  send_buffer ERROR status: %s (%d)\n",
@@ -452,16 +501,11 @@ main(int argc, char **argv)
      * all of the transfers.
      */
 
-    rc = posix_memalign((void **) &receive_buffer, 64,
-                        (TRANSFER_LENGTH_IN_BYTES * transfers));
+    rc = allocate_buffer((void **) &receive_buffer,
+                         (TRANSFER_LENGTH_IN_BYTES * transfers), buffer_mode,
+                         NUMA_NODE_UNSPECIFIED);
     assert(rc == 0);
 
-    /*
-     * Initialize the buffer to all zeros.
-     */
-
-    memset(receive_buffer, 0, (TRANSFER_LENGTH_IN_BYTES * transfers));
-
     /*
      * Register the memory associated for the receive buffer with the NIC.
      * We are receiving the data into this buffer.
@@ -477,11 +521,13 @@ main(int argc, char **argv)
      *     receive_memory_handle is the handle for this memory region.
      */
 
-    status = GNI_MemRegister(nic_handle, (uint64_t) receive_buffer,
-                             TRANSFER_LENGTH_IN_BYTES *
-                             transfers, NULL,
-                             GNI_MEM_READWRITE,
-                             -1, &receive_memory_handle);
+    startup_phase_begin(STARTUP_MEM_REGISTER);
+    status = timed_mem_register(nic_handle, (uint64_t) receive_buffer,
+                                TRANSFER_LENGTH_IN_BYTES *
+                                transfers, NULL,
+                                GNI_MEM_READWRITE,
+                                -1, &receive_memory_handle);
+    startup_phase_end(STARTUP_MEM_REGISTER);
     if (status != GNI_RC_SUCCESS) {
         fprintf(stdout,
                 "[%s] Rank: %4i GNI_MemRegister   receive_buffer ERROR status: %s (%d)\n",
@@ -514,8 +560,12 @@ main(int argc, char **argv)
      * This also acts as a barrier to get all of the ranks to sync up.
      */
 
+    startup_phase_begin(STARTUP_ALLGATHER);
     allgather(&my_memory_handle, remote_memory_handle_array,
               sizeof(mdh_addr_t));
+    startup_phase_end(STARTUP_ALLGATHER);
+
+    print_startup_profile();
 
     if ((v_option > 1) && (rank_id == 0)) {
         fprintf(stdout,
@@ -559,9 +609,7 @@ main(int argc, char **argv)
 
         data = SEND_DATA + my_id + i + 1;
 
-        for (j = 0; j < TRANSFER_LENGTH; j++) {
-            send_buffer[j + (i * TRANSFER_LENGTH)] = data;
-        }
+        fill_pattern(&send_buffer[i * TRANSFER_LENGTH], TRANSFER_LENGTH, data);
 
         /*
          * Setup the data request.
@@ -751,7 +799,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(receive_buffer);
+        free_buffer(receive_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
   EXIT_MEMORY_SOURCE:
@@ -778,7 +827,8 @@ main(int argc, char **argv)
          * Free allocated memory.
          */
 
-        free(send_buffer);
+        free_buffer(send_buffer, (TRANSFER_LENGTH_IN_BYTES * transfers),
+                    buffer_mode);
     }
 
 
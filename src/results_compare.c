@@ -0,0 +1,841 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * results comparator - checks the runs recorded in a results store, see
+ * RESULTS_STORE in utility_functions.h, for performance regressions.
+ *
+ * Usage: results_compare [-a alpha] [-t threshold] [-w runs] [-v]
+ *                        store [candidate_store]
+ *
+ *   -a is the significance level of the test, 0.05 by default.
+ *   -t is the smallest change, in percent, that is reported as a
+ *      regression, 5 by default.
+ *   -w limits the baseline to the last runs of each configuration.
+ *   -v also prints the configurations that did not change.
+ *
+ * The runs are matched by system, test, rank count and metadata, which
+ * includes the transfer size, the buffer mode and the CDM modes, and
+ * then each statistic is compared.  With one store, the latest run of
+ * each configuration is compared with the earlier runs.  With two, all of
+ * the runs in the candidate store are compared with all of the runs in
+ * the baseline store.  Only the runs that passed are compared, a latest
+ * or candidate run that did not pass is reported as a failed run.
+ *
+ * The ranks of a run share the node placement, the fabric load and the
+ * software of that run, so their values are not independent samples.
+ * Each run is one sample, the average over its ranks.  Welch's t test of
+ * the run averages gives a confidence interval for the change in the
+ * mean.  A single candidate run is taken to vary from run to run as much
+ * as the baseline runs do, so it is compared with the baseline's spread.
+ * The store records which way each statistic improves, a bandwidth
+ * regressed when it decreased and a latency when it increased.  The
+ * change is a regression when its confidence interval excludes 0 and the
+ * change is at least the threshold.  A statistic without a direction,
+ * such as a counter, is only reported as changed.
+ *
+ * Returns: 0 when nothing regressed and no run failed, 1 when something
+ * did, 2 on an error.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KEY_LENGTH     2048
+#define LINE_LENGTH    65536
+
+typedef enum {
+    JSON_NULL = 0,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+} json_type_t;
+
+typedef struct json_value {
+    json_type_t     type;
+    double          number;
+    char           *string;
+    int             count;
+    char          **keys;               /* the member names of an object */
+    struct json_value *items;
+} json_value_t;
+
+/*
+ * A run, kept whether or not it passed.
+ */
+
+typedef struct {
+    char            key[KEY_LENGTH];    /* system, test, ranks and metadata */
+    char            status[32];
+} run_t;
+
+/*
+ * A statistic of one run.
+ */
+
+typedef struct {
+    char            key[KEY_LENGTH];
+    char            label[128];
+    char            units[128];
+    long            time;
+    int             run;
+    int             better;             /* 1 higher, -1 lower, 0 neither */
+    double          mean;               /* the average over the ranks */
+} sample_t;
+
+/*
+ * The run averages of one side of a comparison.
+ */
+
+typedef struct {
+    int             runs;
+    double          mean;
+    double          m2;                 /* sum of squared deviations */
+} pool_t;
+
+static double   a_option = 0.05;
+static double   t_option = 5.0;
+static int      w_option = 0;
+static int      v_option = 0;
+
+static sample_t *samples = NULL;
+static int      sample_count = 0;
+static int      sample_size = 0;
+static run_t   *all_runs = NULL;
+static int      run_count = 0;
+static int      run_size = 0;
+
+/*
+ * A small JSON parser, just enough to read the lines of the store.
+ */
+
+static void
+skip_space(char **p)
+{
+    while (isspace((unsigned char) **p)) {
+        (*p)++;
+    }
+}
+
+static int      parse_value(char **p, json_value_t *value);
+
+static int
+parse_string(char **p, char **string)
+{
+    char           *end;
+    char           *out;
+
+    if (**p != '"') {
+        return -1;
+    }
+    (*p)++;
+
+    /*
+     * The string is no longer than its escaped form.
+     */
+
+    for (end = *p; (*end != '"') && (*end != '\0'); end++) {
+        if ((end[0] == '\\') && (end[1] != '\0')) {
+            end++;
+        }
+    }
+
+    *string = out = (char *) malloc(end - *p + 1);
+    assert(out != NULL);
+
+    while (**p != '"') {
+        if (**p == '\0') {
+            return -1;
+        }
+
+        if (**p == '\\') {
+            (*p)++;
+            switch (**p) {
+            case 'n':
+                *out++ = '\n';
+                break;
+            case 't':
+                *out++ = '\t';
+                break;
+            case '\0':
+                return -1;
+            default:
+                *out++ = **p;
+                break;
+            }
+        } else {
+            *out++ = **p;
+        }
+        (*p)++;
+    }
+    (*p)++;
+    *out = '\0';
+
+    return 0;
+}
+
+static int
+parse_members(char **p, json_value_t *value, char close)
+{
+    int             size = 0;
+
+    (*p)++;
+    skip_space(p);
+    if (**p == close) {
+        (*p)++;
+        return 0;
+    }
+
+    for (;;) {
+        if (value->count == size) {
+            size = (size == 0) ? 8 : size * 2;
+            value->items = (json_value_t *) realloc(value->items,
+                                                    size * sizeof(json_value_t));
+            value->keys = (char **) realloc(value->keys, size * sizeof(char *));
+            assert((value->items != NULL) && (value->keys != NULL));
+        }
+
+        value->keys[value->count] = NULL;
+        memset(&value->items[value->count], 0, sizeof(json_value_t));
+        value->count++;
+
+        skip_space(p);
+        if (close == '}') {
+            if (parse_string(p, &value->keys[value->count - 1]) != 0) {
+                return -1;
+            }
+            skip_space(p);
+            if (**p != ':') {
+                return -1;
+            }
+            (*p)++;
+        }
+
+        if (parse_value(p, &value->items[value->count - 1]) != 0) {
+            return -1;
+        }
+
+        skip_space(p);
+        if (**p == close) {
+            (*p)++;
+            return 0;
+        } else if (**p != ',') {
+            return -1;
+        }
+        (*p)++;
+    }
+}
+
+static int
+parse_value(char **p, json_value_t *value)
+{
+    char           *end;
+
+    skip_space(p);
+
+    switch (**p) {
+    case '{':
+        value->type = JSON_OBJECT;
+        return parse_members(p, value, '}');
+
+    case '[':
+        value->type = JSON_ARRAY;
+        return parse_members(p, value, ']');
+
+    case '"':
+        value->type = JSON_STRING;
+        return parse_string(p, &value->string);
+
+    case 'n':
+        if (strncmp(*p, "null", 4) != 0) {
+            return -1;
+        }
+        *p += 4;
+        value->type = JSON_NULL;
+        return 0;
+
+    default:
+        value->number = strtod(*p, &end);
+        if (end == *p) {
+            return -1;
+        }
+        *p = end;
+        value->type = JSON_NUMBER;
+        return 0;
+    }
+}
+
+static void
+free_value(json_value_t *value)
+{
+    int             i;
+
+    for (i = 0; i < value->count; i++) {
+        free(value->keys[i]);
+        free_value(&value->items[i]);
+    }
+
+    free(value->keys);
+    free(value->items);
+    free(value->string);
+}
+
+static json_value_t *
+find_member(json_value_t *object, char *key)
+{
+    int             i;
+
+    if (object->type != JSON_OBJECT) {
+        return NULL;
+    }
+
+    for (i = 0; i < object->count; i++) {
+        if (strcmp(object->keys[i], key) == 0) {
+            return &object->items[i];
+        }
+    }
+
+    return NULL;
+}
+
+static char    *
+member_string(json_value_t *object, char *key)
+{
+    json_value_t   *member = find_member(object, key);
+
+    return ((member != NULL) && (member->type == JSON_STRING)) ?
+        member->string : "";
+}
+
+static double
+member_number(json_value_t *object, char *key)
+{
+    json_value_t   *member = find_member(object, key);
+
+    return ((member != NULL) && (member->type == JSON_NUMBER)) ?
+        member->number : 0.0;
+}
+
+static int
+compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char **) a, *(char **) b);
+}
+
+/*
+ * add_run records a run and, if it passed, adds its statistics to the
+ * samples.  The metadata is sorted, so the order the test added it in
+ * does not matter.
+ */
+
+static void
+add_run(json_value_t *run)
+{
+    char           *better;
+    int             i;
+    char            key[KEY_LENGTH];
+    json_value_t   *metadata;
+    char          **pairs;
+    sample_t       *sample;
+    json_value_t   *statistic;
+    json_value_t   *statistics;
+    size_t          offset;
+
+    offset = snprintf(key, sizeof(key), "%s %s ranks=%.0f",
+                      member_string(run, "system"), member_string(run, "test"),
+                      member_number(run, "ranks"));
+
+    metadata = find_member(run, "metadata");
+    if ((metadata != NULL) && (metadata->type == JSON_OBJECT) &&
+        (metadata->count > 0)) {
+        pairs = (char **) malloc(metadata->count * sizeof(char *));
+        assert(pairs != NULL);
+
+        for (i = 0; i < metadata->count; i++) {
+            pairs[i] = (char *) malloc(strlen(metadata->keys[i]) +
+                                       strlen(member_string(metadata,
+                                                            metadata->keys[i])) + 2);
+            assert(pairs[i] != NULL);
+            sprintf(pairs[i], "%s=%s", metadata->keys[i],
+                    member_string(metadata, metadata->keys[i]));
+        }
+
+        qsort(pairs, metadata->count, sizeof(char *), compare_strings);
+        for (i = 0; i < metadata->count; i++) {
+            if (offset < sizeof(key)) {
+                offset += snprintf(&key[offset], sizeof(key) - offset, " %s",
+                                   pairs[i]);
+            }
+            free(pairs[i]);
+        }
+        free(pairs);
+    }
+
+    if (run_count == run_size) {
+        run_size = (run_size == 0) ? 64 : run_size * 2;
+        all_runs = (run_t *) realloc(all_runs, run_size * sizeof(run_t));
+        assert(all_runs != NULL);
+    }
+
+    snprintf(all_runs[run_count].key, sizeof(all_runs[run_count].key), "%s", key);
+    snprintf(all_runs[run_count].status, sizeof(all_runs[run_count].status), "%s",
+             member_string(run, "status"));
+    run_count++;
+
+    if (strcmp(member_string(run, "status"), "Passed") != 0) {
+        return;
+    }
+
+    statistics = find_member(run, "statistics");
+    if ((statistics == NULL) || (statistics->type != JSON_ARRAY)) {
+        return;
+    }
+
+    for (i = 0; i < statistics->count; i++) {
+        statistic = &statistics->items[i];
+
+        if (sample_count == sample_size) {
+            sample_size = (sample_size == 0) ? 256 : sample_size * 2;
+            samples = (sample_t *) realloc(samples,
+                                           sample_size * sizeof(sample_t));
+            assert(samples != NULL);
+        }
+
+        sample = &samples[sample_count++];
+        snprintf(sample->key, sizeof(sample->key), "%s", key);
+        snprintf(sample->label, sizeof(sample->label), "%s",
+                 member_string(statistic, "label"));
+        snprintf(sample->units, sizeof(sample->units), "%s",
+                 member_string(statistic, "units"));
+        sample->time = (long) member_number(run, "time");
+        sample->run = run_count - 1;
+        sample->mean = member_number(statistic, "avg");
+
+        better = member_string(statistic, "better");
+        if (strcmp(better, "higher") == 0) {
+            sample->better = 1;
+        } else if (strcmp(better, "lower") == 0) {
+            sample->better = -1;
+        } else {
+            sample->better = 0;
+        }
+    }
+}
+
+/*
+ * load_store reads the runs in a results store.
+ *
+ *   Returns: the number of runs read, or -1 on an error.
+ */
+
+static int
+load_store(char *file_name)
+{
+    FILE           *file;
+    char           *line;
+    int             line_number = 0;
+    char           *p_ptr;
+    int             runs = 0;
+    json_value_t    run;
+
+    file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "unable to open %s\n", file_name);
+        return -1;
+    }
+
+    line = (char *) malloc(LINE_LENGTH);
+    assert(line != NULL);
+
+    while (fgets(line, LINE_LENGTH, file) != NULL) {
+        line_number++;
+
+        p_ptr = line;
+        skip_space(&p_ptr);
+        if (*p_ptr == '\0') {
+            continue;
+        }
+
+        memset(&run, 0, sizeof(run));
+        if ((parse_value(&p_ptr, &run) != 0) || (run.type != JSON_OBJECT)) {
+            fprintf(stderr, "%s:%d is not a results line, skipped\n",
+                    file_name, line_number);
+        } else {
+            add_run(&run);
+            runs++;
+        }
+        free_value(&run);
+    }
+
+    free(line);
+    fclose(file);
+
+    return runs;
+}
+
+/*
+ * pool_add adds a run's average to one side of a comparison.
+ */
+
+static void
+pool_add(pool_t *pool, sample_t *sample)
+{
+    double          delta = sample->mean - pool->mean;
+
+    pool->runs++;
+    pool->mean += delta / pool->runs;
+    pool->m2 += delta * (sample->mean - pool->mean);
+}
+
+/*
+ * incomplete_beta is the regularized incomplete beta function, evaluated
+ * with its continued fraction.
+ */
+
+static double
+incomplete_beta(double a, double b, double x)
+{
+    double          c;
+    double          d;
+    double          delta;
+    double          f;
+    int             i;
+    double          m;
+    double          numerator;
+
+    if (x <= 0.0) {
+        return 0.0;
+    } else if (x >= 1.0) {
+        return 1.0;
+    }
+
+    /*
+     * The continued fraction converges quickly below this point, use the
+     * symmetry relation above it.
+     */
+
+    if (x > (a + 1.0) / (a + b + 2.0)) {
+        return 1.0 - incomplete_beta(b, a, 1.0 - x);
+    }
+
+    f = 1.0;
+    c = 1.0;
+    d = 0.0;
+    for (i = 0; i <= 400; i++) {
+        m = i / 2;
+        if (i == 0) {
+            numerator = 1.0;
+        } else if (i % 2 == 0) {
+            numerator = (m * (b - m) * x) / ((a + 2.0 * m - 1.0) * (a + 2.0 * m));
+        } else {
+            numerator = -((a + m) * (a + b + m) * x) /
+                ((a + 2.0 * m) * (a + 2.0 * m + 1.0));
+        }
+
+        d = 1.0 + numerator * d;
+        if (fabs(d) < 1.0e-30) {
+            d = 1.0e-30;
+        }
+        d = 1.0 / d;
+
+        c = 1.0 + numerator / c;
+        if (fabs(c) < 1.0e-30) {
+            c = 1.0e-30;
+        }
+
+        delta = c * d;
+        f *= delta;
+        if (fabs(1.0 - delta) < 1.0e-12) {
+            break;
+        }
+    }
+
+    return exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) +
+               b * log(1.0 - x)) / a * (f - 1.0);
+}
+
+/*
+ * t_critical returns the value that Student's t with df degrees of
+ * freedom exceeds in absolute value with probability alpha.
+ */
+
+static double
+t_critical(double alpha, double df)
+{
+    double          high = 1.0e6;
+    int             i;
+    double          low = 0.0;
+    double          t;
+
+    for (i = 0; i < 200; i++) {
+        t = (low + high) / 2.0;
+        if (incomplete_beta(df / 2.0, 0.5, df / (df + t * t)) > alpha) {
+            low = t;
+        } else {
+            high = t;
+        }
+    }
+
+    return (low + high) / 2.0;
+}
+
+/*
+ * compare prints the change in a statistic between the baseline and
+ * candidate run averages.
+ *
+ *   better is 1 if a higher value is better, -1 if a lower one is, and 0
+ *       if the statistic has no direction.
+ *
+ *   Returns: 1 if the change is a regression, 0 if not.
+ */
+
+static int
+compare(sample_t *sample, int better, pool_t *baseline, pool_t *candidate)
+{
+    double          change;
+    double          df;
+    double          half_width;
+    double          high;
+    double          low;
+    double          se;
+    double          vb;
+    double          vc;
+    char           *verdict;
+
+    if ((baseline->runs < 2) || (baseline->mean == 0.0)) {
+        if (v_option) {
+            fprintf(stdout, "%s %s: too few baseline runs to compare\n",
+                    sample->key, sample->label);
+        }
+        return 0;
+    }
+
+    /*
+     * Welch's t test, the variances of the two sides are not assumed to
+     * be equal.  A single candidate run has no variance of its own, it is
+     * given the baseline's run to run variance and the test becomes the
+     * prediction interval of one more baseline run.
+     */
+
+    vb = baseline->m2 / (baseline->runs - 1);
+    if (candidate->runs > 1) {
+        vc = candidate->m2 / (candidate->runs - 1) / candidate->runs;
+    } else {
+        vc = vb;
+    }
+    vb /= baseline->runs;
+    se = sqrt(vb + vc);
+    change = candidate->mean - baseline->mean;
+
+    if (se > 0.0) {
+        if (candidate->runs > 1) {
+            df = (vb + vc) * (vb + vc) /
+                (vb * vb / (baseline->runs - 1) +
+                 vc * vc / (candidate->runs - 1));
+        } else {
+            df = baseline->runs - 1;
+        }
+        half_width = t_critical(a_option, df) * se;
+    } else {
+        half_width = 0.0;
+    }
+
+    low = (change - half_width) / baseline->mean * 100.0;
+    high = (change + half_width) / baseline->mean * 100.0;
+    change = change / baseline->mean * 100.0;
+
+    if ((low > 0.0) || (high < 0.0)) {
+        if (better == 0) {
+            verdict = "changed";
+        } else if ((change < 0.0) == (better > 0)) {
+            verdict = (fabs(change) >= t_option) ? "REGRESSION" : "worse";
+        } else {
+            verdict = "improved";
+        }
+    } else {
+        verdict = "unchanged";
+    }
+
+    if (v_option || (strcmp(verdict, "unchanged") != 0)) {
+        fprintf(stdout,
+                "%s %s: %s baseline: %.3f %s (%i runs) candidate: %.3f %s (%i runs) change: %+.2f%% [%+.2f%%, %+.2f%%]\n",
+                sample->key, sample->label, verdict, baseline->mean,
+                sample->units, baseline->runs, candidate->mean, sample->units,
+                candidate->runs, change, low, high);
+    }
+
+    return (strcmp(verdict, "REGRESSION") == 0);
+}
+
+static void
+usage(char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-a alpha] [-t threshold] [-w runs] [-v] store [candidate_store]\n",
+            name);
+}
+
+int
+main(int argc, char **argv)
+{
+    pool_t          baseline;
+    int             baseline_runs;
+    int             better;
+    pool_t          candidate;
+    int             candidate_run;
+    int            *done;
+    int             failures = 0;
+    int             i;
+    int             j;
+    int             opt;
+    int             regressions = 0;
+    int             comparisons = 0;
+
+    while ((opt = getopt(argc, argv, "a:t:w:v")) != -1) {
+        switch (opt) {
+        case 'a':
+            a_option = atof(optarg);
+            if ((a_option <= 0.0) || (a_option >= 1.0)) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+
+        case 't':
+            t_option = atof(optarg);
+            break;
+
+        case 'w':
+            w_option = atoi(optarg);
+            break;
+
+        case 'v':
+            v_option = 1;
+            break;
+
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if ((argc - optind < 1) || (argc - optind > 2)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    baseline_runs = load_store(argv[optind]);
+    if (baseline_runs < 0) {
+        return 2;
+    }
+
+    if (argc - optind == 2) {
+        if (load_store(argv[optind + 1]) < 0) {
+            return 2;
+        }
+    }
+
+    /*
+     * Report the candidate runs that did not pass, with one store that is
+     * the latest run of each configuration.
+     */
+
+    for (i = 0; i < run_count; i++) {
+        if (strcmp(all_runs[i].status, "Passed") == 0) {
+            continue;
+        }
+
+        if (argc - optind == 1) {
+            for (j = i + 1; j < run_count; j++) {
+                if (strcmp(all_runs[j].key, all_runs[i].key) == 0) {
+                    break;
+                }
+            }
+            if (j < run_count) {
+                continue;
+            }
+        } else if (i < baseline_runs) {
+            continue;
+        }
+
+        fprintf(stdout, "%s: FAILED run, status %s, not compared\n",
+                all_runs[i].key, (all_runs[i].status[0] != '\0') ?
+                all_runs[i].status : "unknown");
+        failures++;
+    }
+
+    done = (int *) calloc(sample_count + 1, sizeof(int));
+    assert(done != NULL);
+
+    for (i = 0; i < sample_count; i++) {
+        if (done[i]) {
+            continue;
+        }
+
+        /*
+         * With one store, the candidate is the latest run of this
+         * configuration, the runs are in the order they were appended.
+         * If it did not pass, it has no samples and nothing is compared.
+         */
+
+        candidate_run = baseline_runs;
+        if (argc - optind == 1) {
+            for (j = samples[i].run; j < run_count; j++) {
+                if (strcmp(all_runs[j].key, samples[i].key) == 0) {
+                    candidate_run = j;
+                }
+            }
+        }
+
+        memset(&baseline, 0, sizeof(baseline));
+        memset(&candidate, 0, sizeof(candidate));
+        better = 0;
+
+        /*
+         * Pool the baseline from the latest runs backwards, so that -w
+         * keeps the most recent ones.  The direction is taken from the
+         * latest run that recorded one.
+         */
+
+        for (j = sample_count - 1; j >= i; j--) {
+            if ((strcmp(samples[j].key, samples[i].key) != 0) ||
+                (strcmp(samples[j].label, samples[i].label) != 0)) {
+                continue;
+            }
+
+            done[j] = 1;
+            if (better == 0) {
+                better = samples[j].better;
+            }
+
+            if (samples[j].run >= candidate_run) {
+                pool_add(&candidate, &samples[j]);
+            } else if ((w_option == 0) || (baseline.runs < w_option)) {
+                pool_add(&baseline, &samples[j]);
+            }
+        }
+
+        if ((baseline.runs == 0) || (candidate.runs == 0)) {
+            continue;
+        }
+
+        comparisons++;
+        regressions += compare(&samples[i], better, &baseline, &candidate);
+    }
+
+    fprintf(stdout, "%d statistics compared, %d regressions, %d failed runs\n",
+            comparisons, regressions, failures);
+
+    free(done);
+    free(samples);
+    free(all_runs);
+
+    return ((regressions > 0) || (failures > 0)) ? 1 : 0;
+}
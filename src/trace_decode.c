@@ -0,0 +1,210 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * trace decoder - prints the events recorded in the trace files written
+ * with TRACE_FILE=prefix, see trace_functions.h, as the verbose lines the
+ * tests print with -v.
+ *
+ * Usage: trace_decode [-t] trace_file ...
+ *
+ *   -t prefixes each line with the time of the event in microseconds
+ *      since the rank started tracing.
+ *
+ * When the ring wrapped, only the last events are in the file, and the
+ * number of events that were overwritten is reported.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "trace_functions.h"
+
+static int      t_option = 0;
+
+static void
+print_event(trace_header_t *header, trace_event_t *event)
+{
+    if (t_option) {
+        fprintf(stdout, "%14.3f ", event->timestamp / 1000.0);
+    }
+
+    switch (event->type) {
+    case TRACE_POST_DATA:
+        fprintf(stdout,
+                "[%s] Rank: %4i GNI_PostRdma      data transfer: %4i send to:   %4i local addr:  0x%lx remote addr: 0x%lx data: 0x%16lx data length: %4i post_id: %lu\n",
+                header->nodename, header->rank, event->transfer,
+                event->peer, event->local_addr, event->remote_addr,
+                event->data, (int) event->length, event->post_id);
+        break;
+
+    case TRACE_POST_FLAG:
+        fprintf(stdout,
+                "[%s] Rank: %4i GNI_PostRdma      flag transfer: %4i send to:   %4i local addr:  0x%lx remote addr: 0x%lx flag: 0x%16lx data length: %4i\n",
+                header->nodename, header->rank, event->transfer,
+                event->peer, event->local_addr, event->remote_addr,
+                event->data, (int) event->length);
+        break;
+
+    case TRACE_COMPLETED_DATA:
+        fprintf(stdout,
+                "[%s] Rank: %4i GNI_GetCompleted  data transfer: %4i send to:   %4i remote addr: 0x%lx post_id: %lu\n",
+                header->nodename, header->rank, event->transfer,
+                event->peer, event->remote_addr, event->post_id);
+        break;
+
+    case TRACE_RECEIVED_FLAG:
+        fprintf(stdout,
+                "[%s] Rank: %4i Received          flag transfer: %4i recv from: %4i remote addr: %p flag: 0x%16lx\n",
+                header->nodename, header->rank, event->transfer,
+                event->peer, (void *) event->remote_addr, event->data);
+        break;
+
+    case TRACE_COMPLETED_FLAG:
+        fprintf(stdout,
+                "[%s] Rank: %4i GNI_GetCompleted  flag transfer: %4i\n",
+                header->nodename, header->rank, event->transfer);
+        break;
+
+    case TRACE_FLAG_WAIT:
+        fprintf(stdout,
+                "[%s] Rank: %4i Waiting for       flag transfer: %4i\n",
+                header->nodename, header->rank, event->transfer);
+        break;
+
+    case TRACE_REMOTE_CQ_EVENT:
+        fprintf(stdout,
+                "[%s] Rank: %4i GNI_CqGetEvent    destination event: %4i event: 0x%16.16lx\n",
+                header->nodename, header->rank, event->transfer,
+                event->data);
+        break;
+
+    case TRACE_BARRIER_ENTER:
+    case TRACE_BARRIER_EXIT:
+        fprintf(stdout,
+                "[%s] Rank: %4i PMI_Barrier       %s barrier: %4i\n",
+                header->nodename, header->rank,
+                (event->type == TRACE_BARRIER_ENTER) ? "enter" : "exit",
+                event->transfer);
+        break;
+
+    case TRACE_POST_CE:
+        fprintf(stdout,
+                "[%s] Rank: %4i GNI_PostFma       ce request cmd: 0x%04x\n",
+                header->nodename, header->rank, (unsigned int) event->data);
+        break;
+
+    case TRACE_COMPLETED_CE:
+        fprintf(stdout,
+                "[%s] Rank: %4i GNI_GetCompleted  cmd: 0x%04x, event: 0x%016lx\n",
+                header->nodename, header->rank, (unsigned int) event->post_id,
+                event->data);
+        break;
+
+    case TRACE_CE_RESULT:
+        fprintf(stdout,
+                "[%s] Rank: %4i GNI_CeCheckResult status: %u\n",
+                header->nodename, header->rank, event->status);
+        break;
+
+    default:
+        fprintf(stdout,
+                "[%s] Rank: %4i unknown trace event type: %u\n",
+                header->nodename, header->rank, event->type);
+        break;
+    }
+}
+
+static int
+decode_file(char *file_name)
+{
+    uint64_t        events;
+    int             fd;
+    uint64_t        first;
+    trace_header_t *header;
+    uint64_t        i;
+    void           *map;
+    struct stat     st;
+    trace_event_t  *ring;
+
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed, errno=%d\n", file_name, errno);
+        return 1;
+    }
+
+    if ((fstat(fd, &st) != 0) || (st.st_size < TRACE_HEADER_SIZE)) {
+        fprintf(stderr, "%s is not a trace file\n", file_name);
+        close(fd);
+        return 1;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "mmap %s failed, errno=%d\n", file_name, errno);
+        return 1;
+    }
+
+    header = (trace_header_t *) map;
+    events = (uint64_t) header->mask + 1;
+    if ((header->magic != TRACE_MAGIC) ||
+        (header->version != TRACE_VERSION) ||
+        (st.st_size < TRACE_HEADER_SIZE + events * sizeof(trace_event_t))) {
+        fprintf(stderr, "%s is not a version %d trace file\n",
+                file_name, TRACE_VERSION);
+        munmap(map, st.st_size);
+        return 1;
+    }
+
+    ring = (trace_event_t *) ((char *) map + TRACE_HEADER_SIZE);
+
+    first = 0;
+    if (header->head > events) {
+        first = header->head - events;
+        fprintf(stdout,
+                "[%s] Rank: %4i %s trace wrapped, %lu earlier events were overwritten\n",
+                header->nodename, header->rank, header->command, first);
+    }
+
+    for (i = first; i < header->head; i++) {
+        print_event(header, &ring[i & header->mask]);
+    }
+
+    munmap(map, st.st_size);
+
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int             opt;
+    int             rc = 0;
+
+    while ((opt = getopt(argc, argv, "t")) != -1) {
+        switch (opt) {
+        case 't':
+            t_option = 1;
+            break;
+
+        default:
+            fprintf(stderr, "Usage: %s [-t] trace_file ...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind == argc) {
+        fprintf(stderr, "Usage: %s [-t] trace_file ...\n", argv[0]);
+        return 1;
+    }
+
+    for (; optind < argc; optind++) {
+        rc |= decode_file(argv[optind]);
+    }
+
+    return rc;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * This header file contains the functions used to trace the posts and
+ * completions in the timed loops.
+ *
+ * Printing a verbose line for every transfer changes the timing of the
+ * loop it describes.  With TRACE_FILE=prefix set, each rank records a
+ * fixed size binary event instead, in a ring that is mapped from the
+ * file prefix.<rank>.  Recording an event is a clock read, an atomic
+ * increment and a 64 byte store.  The ring keeps the last TRACE_EVENTS
+ * events, 65536 by default, and because it is the file, the events are
+ * there even if the rank does not exit cleanly.
+ *
+ * trace_decode reads the files and prints the verbose lines.  trace_merge
+ * merges the files of all of the ranks into one Chrome trace, the
+ * barrier exits are used to line up the clocks of the ranks.  Each
+ * barrier event carries the barrier's sequence number in its transfer
+ * field, so the exits can be matched across ranks after a ring wraps.
+ *
+ * This header is also used by trace_decode, so it only depends on the
+ * C library.
+ */
+
+#ifndef TRACE_FUNCTIONS_H
+#define TRACE_FUNCTIONS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define TRACE_MAGIC              0x47545243     /* "GTRC" */
+#define TRACE_VERSION            2
+#define TRACE_EVENTS_DEFAULT     65536          /* must be a power of 2 */
+#define TRACE_HEADER_SIZE        256
+#define TRACE_NAME_LENGTH        64
+
+/*
+ * The event types, each one is printed as one of the verbose lines.
+ */
+
+typedef enum {
+    TRACE_POST_DATA = 1,        /* GNI_PostRdma data transfer */
+    TRACE_POST_FLAG,            /* GNI_PostRdma flag transfer */
+    TRACE_COMPLETED_DATA,       /* GNI_GetCompleted data transfer */
+    TRACE_RECEIVED_FLAG,        /* Received flag transfer */
+    TRACE_COMPLETED_FLAG,       /* GNI_GetCompleted flag transfer */
+    TRACE_FLAG_WAIT,            /* started waiting for a flag */
+    TRACE_REMOTE_CQ_EVENT,      /* destination CQ event */
+    TRACE_BARRIER_ENTER,
+    TRACE_BARRIER_EXIT,
+    TRACE_POST_CE,              /* GNI_PostFma ce request */
+    TRACE_COMPLETED_CE,         /* GNI_GetCompleted ce request */
+    TRACE_CE_RESULT,            /* GNI_CeCheckResult result ready */
+    TRACE_EVENT_TYPES
+} trace_event_type_t;
+
+static const char *const trace_event_names[TRACE_EVENT_TYPES] = {
+    "unknown",
+    "post data",
+    "post flag",
+    "completed data",
+    "received flag",
+    "completed flag",
+    "flag wait",
+    "destination CQ event",
+    "barrier enter",
+    "barrier exit",
+    "post ce",
+    "completed ce",
+    "ce result"
+};
+
+typedef struct {
+    uint64_t        timestamp;          /* nanoseconds since trace_init */
+    uint16_t        type;
+    uint16_t        status;
+    int32_t         peer;
+    int32_t         transfer;
+    uint32_t        length;
+    uint64_t        post_id;
+    uint64_t        local_addr;
+    uint64_t        remote_addr;
+    uint64_t        data;
+    uint64_t        reserved;
+} trace_event_t;
+
+typedef struct {
+    uint32_t        magic;
+    uint32_t        version;
+    int32_t         rank;
+    uint32_t        mask;               /* number of events - 1 */
+    volatile uint64_t head;             /* events recorded */
+    uint64_t        start_sec;          /* CLOCK_MONOTONIC at trace_init */
+    uint64_t        start_nsec;
+    char            nodename[TRACE_NAME_LENGTH];
+    char            command[TRACE_NAME_LENGTH];
+} trace_header_t;
+
+static trace_header_t *trace_header;
+static trace_event_t *trace_events;
+static size_t   trace_map_size;
+static struct timespec trace_start;
+static int32_t  trace_barrier_seq;
+
+#define TRACE_ENABLED (trace_header != NULL)
+
+/*
+ * trace_init maps the trace file when TRACE_FILE is set.
+ *
+ *   Returns: 0 on success or when tracing is not enabled, -1 on an error.
+ */
+
+static inline int
+trace_init(int rank, char *nodename, char *command)
+{
+    uint64_t        events = TRACE_EVENTS_DEFAULT;
+    int             fd;
+    char            file_name[1024];
+    void           *map;
+    char           *p_ptr;
+    char           *prefix;
+    size_t          offset;
+    long            page_size;
+
+    prefix = getenv("TRACE_FILE");
+    if (prefix == NULL) {
+        return 0;
+    }
+
+    p_ptr = getenv("TRACE_EVENTS");
+    if (p_ptr != NULL) {
+        events = strtoul(p_ptr, NULL, 0);
+        if ((events == 0) || ((events & (events - 1)) != 0)) {
+            fprintf(stderr,
+                    "TRACE_EVENTS=%s is not a power of 2, using %d\n",
+                    p_ptr, TRACE_EVENTS_DEFAULT);
+            events = TRACE_EVENTS_DEFAULT;
+        }
+    }
+
+    snprintf(file_name, sizeof(file_name), "%s.%d", prefix, rank);
+    trace_map_size = TRACE_HEADER_SIZE + events * sizeof(trace_event_t);
+
+    fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "trace_init open %s failed, errno=%d\n",
+                file_name, errno);
+        return -1;
+    }
+
+    if (ftruncate(fd, trace_map_size) != 0) {
+        fprintf(stderr, "trace_init ftruncate %s failed, errno=%d\n",
+                file_name, errno);
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, trace_map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "trace_init mmap %s failed, errno=%d\n",
+                file_name, errno);
+        return -1;
+    }
+
+    /*
+     * Store to every page of the ring now, so that the page faults and
+     * the file system's page_mkwrite calls are taken here rather than by
+     * trace_record in the timed loops.  MAP_POPULATE is not enough, it
+     * only read faults a shared mapping.
+     */
+
+    page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) {
+        page_size = 4096;
+    }
+    for (offset = 0; offset < trace_map_size; offset += page_size) {
+        ((volatile char *) map)[offset] = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &trace_start);
+
+    trace_header = (trace_header_t *) map;
+    trace_header->magic = TRACE_MAGIC;
+    trace_header->version = TRACE_VERSION;
+    trace_header->rank = rank;
+    trace_header->mask = events - 1;
+    trace_header->head = 0;
+    trace_header->start_sec = trace_start.tv_sec;
+    trace_header->start_nsec = trace_start.tv_nsec;
+    strncpy(trace_header->nodename, nodename, TRACE_NAME_LENGTH - 1);
+    strncpy(trace_header->command, command, TRACE_NAME_LENGTH - 1);
+    trace_events = (trace_event_t *) ((char *) map + TRACE_HEADER_SIZE);
+
+    return 0;
+}
+
+/*
+ * trace_record adds an event to the ring, overwriting the oldest event
+ * when the ring is full.  It may be called from several threads.
+ */
+
+static inline void
+trace_record(trace_event_type_t type, int peer, int transfer,
+             uint64_t post_id, uint32_t length, uint64_t local_addr,
+             uint64_t remote_addr, uint64_t data, uint16_t status)
+{
+    trace_event_t  *event;
+    struct timespec ts;
+    uint64_t        index;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    index = __sync_fetch_and_add(&trace_header->head, 1);
+    event = &trace_events[index & trace_header->mask];
+
+    event->timestamp = (uint64_t) (ts.tv_sec - trace_start.tv_sec) * 1000000000UL +
+        ts.tv_nsec - trace_start.tv_nsec;
+    event->type = type;
+    event->status = status;
+    event->peer = peer;
+    event->transfer = transfer;
+    event->length = length;
+    event->post_id = post_id;
+    event->local_addr = local_addr;
+    event->remote_addr = remote_addr;
+    event->data = data;
+}
+
+/*
+ * trace_mark records an event that has no fields, such as entering or
+ * leaving a barrier.  Barrier events record the barrier's sequence
+ * number, every rank passes the same barriers so the numbers agree.
+ */
+
+static inline void
+trace_mark(trace_event_type_t type)
+{
+    int32_t         seq = 0;
+
+    if (TRACE_ENABLED) {
+        if (type == TRACE_BARRIER_ENTER) {
+            seq = trace_barrier_seq;
+        } else if (type == TRACE_BARRIER_EXIT) {
+            seq = trace_barrier_seq++;
+        }
+        trace_record(type, -1, seq, 0, 0, 0, 0, 0, 0);
+    }
+}
+
+/*
+ * trace_finish writes the ring back to the file and unmaps it.
+ */
+
+static inline void
+trace_finish(void)
+{
+    if (trace_header == NULL) {
+        return;
+    }
+
+    msync(trace_header, trace_map_size, MS_SYNC);
+    munmap(trace_header, trace_map_size);
+    trace_header = NULL;
+    trace_events = NULL;
+}
+
+#endif /* TRACE_FUNCTIONS_H */
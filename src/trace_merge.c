@@ -0,0 +1,461 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * trace merger - merges the trace files written by each rank with
+ * TRACE_FILE=prefix, see trace_functions.h, into one timeline in the
+ * Chrome trace event JSON format.  The output can be loaded in
+ * chrome://tracing or in the Perfetto UI.
+ *
+ * Usage: trace_merge [-n] trace_file ... > timeline.json
+ *
+ *   -n leaves the clocks of the ranks as they were recorded.
+ *
+ * Each rank is a process in the timeline, with a thread for its posts,
+ * one for its receives and one for its barriers.  A data post and its
+ * completion are shown as one slice, as are the wait for a flag, a
+ * barrier and a CE request up to its result.
+ *
+ * The ranks' clocks are not synchronized across nodes.  All of the ranks
+ * leave a barrier at about the same time, so each barrier exit of a rank
+ * is lined up with the exit of the same barrier, by its sequence number,
+ * in the first file.  A ring that wrapped only loses its oldest
+ * barriers.  With one barrier in common the clock is shifted, with more
+ * the first and last barriers in common also correct the drift between
+ * the clocks.  The error is the skew in leaving the barrier.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "trace_functions.h"
+
+#define TID_POSTS      0
+#define TID_RECEIVES   1
+#define TID_BARRIERS   2
+
+typedef struct {
+    trace_header_t  header;
+    trace_event_t  *events;
+    uint64_t        count;
+    double         *exits;              /* absolute barrier exit times */
+    int32_t        *exit_seqs;          /* their barrier sequence numbers */
+    uint64_t        exit_count;
+    double          offset;             /* aligned = offset + scale * t */
+    double          scale;
+} rank_trace_t;
+
+static int      n_option = 0;
+static int      first_event = 1;
+static double   time_zero;
+
+static int
+load_file(char *file_name, rank_trace_t *trace)
+{
+    uint64_t        events;
+    int             fd;
+    uint64_t        first;
+    uint64_t        i;
+    void           *map;
+    trace_event_t  *ring;
+    struct stat     st;
+
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed, errno=%d\n", file_name, errno);
+        return 1;
+    }
+
+    if ((fstat(fd, &st) != 0) || (st.st_size < TRACE_HEADER_SIZE)) {
+        fprintf(stderr, "%s is not a trace file\n", file_name);
+        close(fd);
+        return 1;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "mmap %s failed, errno=%d\n", file_name, errno);
+        return 1;
+    }
+
+    memcpy(&trace->header, map, sizeof(trace_header_t));
+    events = (uint64_t) trace->header.mask + 1;
+    if ((trace->header.magic != TRACE_MAGIC) ||
+        (trace->header.version != TRACE_VERSION) ||
+        (st.st_size < TRACE_HEADER_SIZE + events * sizeof(trace_event_t))) {
+        fprintf(stderr, "%s is not a version %d trace file\n",
+                file_name, TRACE_VERSION);
+        munmap(map, st.st_size);
+        return 1;
+    }
+
+    /*
+     * Copy the ring out oldest event first.
+     */
+
+    ring = (trace_event_t *) ((char *) map + TRACE_HEADER_SIZE);
+    first = (trace->header.head > events) ? trace->header.head - events : 0;
+    trace->count = trace->header.head - first;
+    trace->events = (trace_event_t *) malloc(trace->count * sizeof(trace_event_t) + 1);
+    trace->exits = (double *) malloc(trace->count * sizeof(double) + 1);
+    trace->exit_seqs = (int32_t *) malloc(trace->count * sizeof(int32_t) + 1);
+    assert((trace->events != NULL) && (trace->exits != NULL) &&
+           (trace->exit_seqs != NULL));
+
+    trace->exit_count = 0;
+    for (i = 0; i < trace->count; i++) {
+        trace->events[i] = ring[(first + i) & trace->header.mask];
+        if (trace->events[i].type == TRACE_BARRIER_EXIT) {
+            trace->exit_seqs[trace->exit_count] = trace->events[i].transfer;
+            trace->exits[trace->exit_count++] =
+                (double) trace->header.start_sec * 1.0e9 +
+                trace->header.start_nsec + trace->events[i].timestamp;
+        }
+    }
+
+    if (first != 0) {
+        fprintf(stderr, "rank %d: the trace wrapped, %lu events were lost\n",
+                trace->header.rank, first);
+    }
+
+    munmap(map, st.st_size);
+
+    return 0;
+}
+
+/*
+ * align_clock maps this rank's absolute times onto the reference rank's
+ * clock through the barrier exits they have in common.  The exits are in
+ * sequence order in both ranks, the first and last common barriers are
+ * found by walking them in from each end.
+ */
+
+static void
+align_clock(rank_trace_t *trace, rank_trace_t *reference)
+{
+    int64_t         i;
+    int64_t         j;
+    uint64_t        first[2];
+    uint64_t        last[2];
+    uint64_t        n = 0;
+
+    trace->scale = 1.0;
+    trace->offset = 0.0;
+
+    if ((n_option == 0) && (trace != reference)) {
+        i = 0;
+        j = 0;
+        while ((i < (int64_t) trace->exit_count) &&
+               (j < (int64_t) reference->exit_count)) {
+            if (trace->exit_seqs[i] < reference->exit_seqs[j]) {
+                i++;
+            } else if (trace->exit_seqs[i] > reference->exit_seqs[j]) {
+                j++;
+            } else {
+                if (n == 0) {
+                    first[0] = i;
+                    first[1] = j;
+                }
+                last[0] = i;
+                last[1] = j;
+                n++;
+                i++;
+                j++;
+            }
+        }
+    }
+
+    if ((n_option == 1) || (n == 0) || (trace == reference)) {
+        if ((n_option == 0) && (trace != reference) &&
+            (strcmp(trace->header.nodename, reference->header.nodename) != 0)) {
+            fprintf(stderr,
+                    "rank %d: no barriers to line up the clock with rank %d\n",
+                    trace->header.rank, reference->header.rank);
+        }
+        return;
+    }
+
+    if ((n != trace->exit_count) || (n != reference->exit_count)) {
+        fprintf(stderr,
+                "rank %d: %lu barrier exits, rank %d has %lu, using the %lu in common\n",
+                trace->header.rank, trace->exit_count,
+                reference->header.rank, reference->exit_count, n);
+    }
+
+    if ((n > 1) && (trace->exits[last[0]] > trace->exits[first[0]])) {
+        trace->scale = (reference->exits[last[1]] - reference->exits[first[1]]) /
+            (trace->exits[last[0]] - trace->exits[first[0]]);
+    }
+    trace->offset = reference->exits[first[1]] -
+        trace->scale * trace->exits[first[0]];
+}
+
+static double
+aligned_nsec(rank_trace_t *trace, trace_event_t *event)
+{
+    double          t;
+
+    t = (double) trace->header.start_sec * 1.0e9 +
+        trace->header.start_nsec + event->timestamp;
+
+    return trace->offset + trace->scale * t;
+}
+
+static double
+aligned_usec(rank_trace_t *trace, trace_event_t *event)
+{
+    return (aligned_nsec(trace, event) - time_zero) / 1000.0;
+}
+
+static void
+print_separator(void)
+{
+    if (first_event == 0) {
+        fprintf(stdout, ",\n");
+    }
+    first_event = 0;
+}
+
+static void
+print_slice(rank_trace_t *trace, int tid, const char *name, double start,
+            double end, trace_event_t *event)
+{
+    print_separator();
+    fprintf(stdout,
+            "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"transfer\":%d,\"peer\":%d,\"post_id\":%lu,\"length\":%u}}",
+            name, trace->header.rank, tid, start, end - start,
+            event->transfer, event->peer, event->post_id, event->length);
+}
+
+static void
+print_instant(rank_trace_t *trace, int tid, trace_event_t *event)
+{
+    print_separator();
+    fprintf(stdout,
+            "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+            "\"args\":{\"transfer\":%d,\"peer\":%d,\"data\":\"0x%lx\"}}",
+            trace_event_names[(event->type < TRACE_EVENT_TYPES) ? event->type : 0],
+            trace->header.rank, tid, aligned_usec(trace, event),
+            event->transfer, event->peer, event->data);
+}
+
+static void
+print_metadata(rank_trace_t *trace)
+{
+    static const char *const thread_names[] = { "posts", "receives", "barriers" };
+    int             tid;
+
+    print_separator();
+    fprintf(stdout,
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"rank %d %s %s\"}}",
+            trace->header.rank, trace->header.rank,
+            trace->header.nodename, trace->header.command);
+
+    for (tid = TID_POSTS; tid <= TID_BARRIERS; tid++) {
+        print_separator();
+        fprintf(stdout,
+                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}",
+                trace->header.rank, tid, thread_names[tid]);
+    }
+}
+
+/*
+ * print_rank writes the events of one rank.  The data posts waiting for
+ * their completion are found by post_id, the other slices are started
+ * and ended by consecutive events.
+ */
+
+static void
+print_rank(rank_trace_t *trace)
+{
+    double          barrier_start = -1.0;
+    double          ce_start = -1.0;
+    trace_event_t  *event;
+    double          flag_start = -1.0;
+    uint64_t        i;
+    uint64_t        j;
+    uint64_t        mask;
+    double          now;
+    trace_event_t **posts;
+    uint64_t        slot;
+    uint64_t        size = 2;
+
+    while (size < 2 * trace->count) {
+        size <<= 1;
+    }
+    mask = size - 1;
+    posts = (trace_event_t **) calloc(size, sizeof(trace_event_t *));
+    assert(posts != NULL);
+
+    print_metadata(trace);
+
+    for (i = 0; i < trace->count; i++) {
+        event = &trace->events[i];
+        now = aligned_usec(trace, event);
+
+        switch (event->type) {
+        case TRACE_POST_DATA:
+            slot = (event->post_id * 0x9e3779b97f4a7c15UL) & mask;
+            while (posts[slot] != NULL) {
+                slot = (slot + 1) & mask;
+            }
+            posts[slot] = event;
+            break;
+
+        case TRACE_COMPLETED_DATA:
+            slot = (event->post_id * 0x9e3779b97f4a7c15UL) & mask;
+            while ((posts[slot] != NULL) &&
+                   (posts[slot]->post_id != event->post_id)) {
+                slot = (slot + 1) & mask;
+            }
+
+            if (posts[slot] != NULL) {
+                print_slice(trace, TID_POSTS, "data put",
+                            aligned_usec(trace, posts[slot]), now, posts[slot]);
+
+                /*
+                 * Leave a marker so the probe sequence is not broken.
+                 */
+
+                posts[slot]->post_id = 0;
+            } else {
+                print_instant(trace, TID_POSTS, event);
+            }
+            break;
+
+        case TRACE_FLAG_WAIT:
+            flag_start = now;
+            break;
+
+        case TRACE_RECEIVED_FLAG:
+            if (flag_start >= 0.0) {
+                print_slice(trace, TID_RECEIVES, "wait for flag",
+                            flag_start, now, event);
+                flag_start = -1.0;
+            } else {
+                print_instant(trace, TID_RECEIVES, event);
+            }
+            break;
+
+        case TRACE_REMOTE_CQ_EVENT:
+            print_instant(trace, TID_RECEIVES, event);
+            break;
+
+        case TRACE_BARRIER_ENTER:
+            barrier_start = now;
+            break;
+
+        case TRACE_BARRIER_EXIT:
+            if (barrier_start >= 0.0) {
+                print_slice(trace, TID_BARRIERS, "PMI_Barrier",
+                            barrier_start, now, event);
+                barrier_start = -1.0;
+            }
+            break;
+
+        case TRACE_POST_CE:
+            ce_start = now;
+            print_instant(trace, TID_POSTS, event);
+            break;
+
+        case TRACE_CE_RESULT:
+            if (ce_start >= 0.0) {
+                print_slice(trace, TID_POSTS, "ce request", ce_start, now,
+                            event);
+                ce_start = -1.0;
+            }
+            break;
+
+        default:
+            print_instant(trace, TID_POSTS, event);
+            break;
+        }
+    }
+
+    /*
+     * Data posts that never completed.
+     */
+
+    for (j = 0; j < size; j++) {
+        if ((posts[j] != NULL) && (posts[j]->post_id != 0)) {
+            print_instant(trace, TID_POSTS, posts[j]);
+        }
+    }
+
+    free(posts);
+}
+
+int
+main(int argc, char **argv)
+{
+    int             have_time_zero = 0;
+    int             i;
+    int             nranks;
+    int             opt;
+    rank_trace_t   *traces;
+    double          t;
+
+    while ((opt = getopt(argc, argv, "n")) != -1) {
+        switch (opt) {
+        case 'n':
+            n_option = 1;
+            break;
+
+        default:
+            fprintf(stderr, "Usage: %s [-n] trace_file ...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    nranks = argc - optind;
+    if (nranks == 0) {
+        fprintf(stderr, "Usage: %s [-n] trace_file ...\n", argv[0]);
+        return 1;
+    }
+
+    traces = (rank_trace_t *) calloc(nranks, sizeof(rank_trace_t));
+    assert(traces != NULL);
+
+    for (i = 0; i < nranks; i++) {
+        if (load_file(argv[optind + i], &traces[i]) != 0) {
+            return 1;
+        }
+    }
+
+    /*
+     * Line up the clocks, then start the timeline at the earliest event.
+     */
+
+    for (i = 0; i < nranks; i++) {
+        align_clock(&traces[i], &traces[0]);
+
+        if (traces[i].count > 0) {
+            t = aligned_nsec(&traces[i], &traces[i].events[0]);
+            if ((have_time_zero == 0) || (t < time_zero)) {
+                time_zero = t;
+                have_time_zero = 1;
+            }
+        }
+    }
+
+    fprintf(stdout, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (i = 0; i < nranks; i++) {
+        print_rank(&traces[i]);
+        free(traces[i].events);
+        free(traces[i].exits);
+        free(traces[i].exit_seqs);
+    }
+    fprintf(stdout, "\n]}\n");
+
+    free(traces);
+
+    return 0;
+}
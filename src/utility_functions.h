@@ -6,7 +6,12 @@
  * This header file contains the common utility functions.
  */
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <sched.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/stat.h>
 #ifdef CRAY_CONFIG_GHAL_ARIES
 #include "aries/misc/exceptions.h"
 #endif
@@ -20,113 +25,22 @@ int             passed = 0;
 #define INCREMENT_ABORTED aborted++
 #define INCREMENT_FAILED  failed++
 #define INCREMENT_PASSED  passed++
-#define MAXIMUM_CQ_RETRY_COUNT 500
 
 /* For Apollo systems...
 #define SLURM_PMI
 */
 #ifdef SLURM_PMI
-/*
- * functions needed for an implementation of PMI_Allgather which is not
- * included with slurm pmi
- */
 #include <glib.h>
-
-static int gnitRank;
-static char *kvsName;
-static int amRoot = 0;
-static int debug = 0;
-
-void
-util_init(void)
-{
-    int rc,first_spawned;
-    int len,rank;
-
-    rc = PMI_Get_rank(&rank);
-    assert(rc == PMI_SUCCESS);
-    gnitRank = rank;
-    if (rank==0) amRoot = 1;
-    rc = PMI_KVS_Get_name_length_max( &len );
-    assert(rc == PMI_SUCCESS);
-    kvsName = (char *)calloc( len, sizeof(char) );
-    rc = PMI_KVS_Get_my_name( kvsName, len );
-    assert(rc == PMI_SUCCESS);
-    if (debug) fprintf(stdout, "kvsName %s\n", kvsName);
-
-    PMI_Barrier();
-}
-
-static void
-send_data(char *kvs, void *buffer, size_t len)
-{
-    gchar *data;
-    char key[64];
-    int rc;
-    size_t output_length;
-    char *b = buffer;
-
-    snprintf(key, 64, "%s_rank%d", kvs, gnitRank);
-    data = g_base64_encode(buffer, len);
-    if (debug) fprintf(stdout, "send key:%s\n", key);
-    rc = PMI_KVS_Put( kvsName, key, data );
-    if (debug) fprintf(stdout, "PMI_KVS_Put data %s, rc %d\n", data, rc);
-    assert(rc == PMI_SUCCESS);
-    rc = PMI_KVS_Commit( kvsName );
-    assert(rc == PMI_SUCCESS);
-    free(data);
-}
-
-static void
-receive_data(char *kvs, int rank, void *buffer, size_t len)
-{
-    gchar *data;
-    char key[64];
-    char *keyval = (char*) malloc( len*3 );
-    int rc;
-    size_t outlen, inlen;
-
-    snprintf(key, 64, "%s_rank%d", kvs, rank);
-    if (debug) fprintf(stdout, "recv key:%s\n", key);
-    rc = PMI_KVS_Get( kvsName, key, keyval, len*3 );
-    if (debug) fprintf(stdout, "PMI_KVS_Get keyval %s, rc %d\n", keyval, rc);
-    assert(rc == PMI_SUCCESS);
-    data = g_base64_decode(keyval, &outlen);
-    inlen = strlen(keyval);
-    assert(data != NULL);
-    if (debug) fprintf(stdout, "decode in %s\n", keyval);
-    memcpy(buffer, data, outlen < len ? outlen : len);
-    free(keyval);
-    free(data);
-}
-
-int 
-PMI_Allgather(void *src, void *targ, size_t len_per_rank)
-{
-    static int cnt=0;
-    int i,nranks;
-    char *ptr;
-    char idstr[64];
-    int  my_rank;
-
-    snprintf(idstr, 64, "allg%d", cnt++);
-    send_data(idstr, src, len_per_rank);
-    PMI_Barrier();
-    PMI_Get_size( &nranks );
-    if (debug) fprintf(stdout, "PMI_Allgather cnt %d ranks %d\n", cnt, nranks);
-
-    for( i=0; i< nranks; i++ )
-    {
-       ptr = ((char*)targ) + (i*len_per_rank);
-       if (debug) fprintf(stdout, "PMI_Allgather i %d\n", i);
-       receive_data(idstr, i, ptr, len_per_rank);
-    }
-    return PMI_SUCCESS;
-}
+#include "kvs_functions.h"
 #endif /* SLURM_PMI */
 
 /*
  * allgather gather the requested information from all of the ranks.
+ *
+ * PMI_Allgather does not return the entries in rank order, so the order
+ * is gathered on the first call and cached.  The staging buffer is kept
+ * and only grown, and when PMI does return the entries in rank order
+ * they are gathered directly into the output buffer.
  */
 
 static void
@@ -134,12 +48,14 @@ allgather(void *in, void *out, int len)
 {
     static int      already_called = 0;
     int             i;
+    static int      in_rank_order = 1;
     static int     *ivec_ptr = NULL;
     static int      job_size = 0;
     int             my_rank;
     char           *out_ptr;
     int             rc;
-    char           *tmp_buf;
+    static char    *tmp_buf = NULL;
+    static size_t   tmp_buf_size = 0;
 
     if (!already_called) {
         rc = PMI_Get_size(&job_size);
@@ -154,11 +70,28 @@ allgather(void *in, void *out, int len)
         rc = PMI_Allgather(&my_rank, ivec_ptr, sizeof(int));
         assert(rc == PMI_SUCCESS);
 
+        for (i = 0; i < job_size; i++) {
+            if (ivec_ptr[i] != i) {
+                in_rank_order = 0;
+                break;
+            }
+        }
+
         already_called = 1;
     }
 
-    tmp_buf = (char *) malloc(job_size * len);
-    assert(tmp_buf);
+    if (in_rank_order) {
+        rc = PMI_Allgather(in, out, len);
+        assert(rc == PMI_SUCCESS);
+        return;
+    }
+
+    if (tmp_buf_size < ((size_t) job_size * len)) {
+        free(tmp_buf);
+        tmp_buf_size = (size_t) job_size * len;
+        tmp_buf = (char *) malloc(tmp_buf_size);
+        assert(tmp_buf);
+    }
 
     rc = PMI_Allgather(in, tmp_buf, len);
     assert(rc == PMI_SUCCESS);
@@ -168,8 +101,331 @@ allgather(void *in, void *out, int len)
     for (i = 0; i < job_size; i++) {
         memcpy(&out_ptr[len * ivec_ptr[i]], &tmp_buf[i * len], len);
     }
+}
+
+/*
+ * get_timestamp gets the current value of the monotonic clock.
+ *
+ *   Returns: the time in seconds.
+ */
+
+static inline double
+get_timestamp(void)
+{
+    struct timespec ts;
 
-    free(tmp_buf);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + ((double) ts.tv_nsec * 1.0e-9);
+}
+
+/*
+ * The results of a test are gathered to rank 0 by print_results.  Rank 0
+ * also keeps the statistics reduced by print_rank_statistic and the run
+ * metadata added with add_result_metadata, so that the whole run can be
+ * written as structured output:
+ *
+ *   RESULTS_JSON=file writes the run as one JSON object.
+ *   RESULTS_CSV=file appends a row for each statistic, or one row when
+ *       there are none, and writes the header when the file is new.
+ *   RESULTS_RANKS=file writes the counts of each rank as CSV.
+ *   RESULTS_STORE=file appends the run as one line of JSON, with the time
+ *       and the system, so that the file is a history of the runs on a
+ *       system that results_compare can check for regressions.  The
+ *       system is RESULTS_SYSTEM, or rank 0's node name, and RESULTS_LABEL
+ *       may describe the run, such as the software or firmware version.
+ */
+
+#define MAX_RESULT_STATISTICS    64
+#define MAX_RESULT_METADATA      32
+#define RESULT_STRING_LENGTH     128
+
+/*
+ * Which way a statistic improves, results_compare only reports a
+ * regression for a statistic with a direction.  Counters, such as the
+ * CQ wait statistics, describe the run and have none.
+ */
+
+#define RESULT_LOWER_IS_BETTER   -1
+#define RESULT_NO_DIRECTION      0
+#define RESULT_HIGHER_IS_BETTER  1
+
+typedef struct {
+    char            label[RESULT_STRING_LENGTH];
+    char            units[RESULT_STRING_LENGTH];
+    double          min;
+    int             min_rank;
+    double          avg;
+    double          max;
+    int             max_rank;
+    int             count;
+    double          variance;       /* of the ranks' values */
+    int             better;         /* RESULT_LOWER_IS_BETTER, ... */
+} result_statistic_t;
+
+typedef struct {
+    char            key[RESULT_STRING_LENGTH];
+    char            value[RESULT_STRING_LENGTH];
+} result_metadata_t;
+
+static result_statistic_t result_statistics[MAX_RESULT_STATISTICS];
+static int      result_statistic_count = 0;
+static result_metadata_t result_metadata[MAX_RESULT_METADATA];
+static int      result_metadata_count = 0;
+
+/*
+ * add_result_metadata records a property of the run, such as a transfer
+ * size or the CDM modes, for the structured output.
+ *
+ *   key names the property.
+ *   format is a printf format for its value.
+ */
+
+static void
+add_result_metadata(char *key, char *format, ...)
+{
+    va_list         args;
+    result_metadata_t *metadata;
+
+    if (result_metadata_count == MAX_RESULT_METADATA) {
+        return;
+    }
+
+    metadata = &result_metadata[result_metadata_count++];
+    snprintf(metadata->key, RESULT_STRING_LENGTH, "%s", key);
+
+    va_start(args, format);
+    vsnprintf(metadata->value, RESULT_STRING_LENGTH, format, args);
+    va_end(args);
+}
+
+/*
+ * print_rank_statistic gathers a value from all of the ranks and then
+ * rank 0 prints the minimum, average and maximum of the values.
+ *
+ *   label describes the value.
+ *   value is this rank's value.
+ *   units describes the units of the value.
+ *   better is RESULT_HIGHER_IS_BETTER, RESULT_LOWER_IS_BETTER or
+ *       RESULT_NO_DIRECTION.
+ */
+
+static void
+print_rank_statistic(char *label, double value, char *units, int better)
+{
+    double         *all_values;
+    int             i;
+    int             max_rank = 0;
+    int             min_rank = 0;
+    int             rc;
+    int             size;
+    result_statistic_t *statistic;
+    double          sum = 0.0;
+    double          sum_squares = 0.0;
+
+    rc = PMI_Get_size(&size);
+    assert(rc == PMI_SUCCESS);
+
+    all_values = (double *) malloc(size * sizeof(double));
+    assert(all_values != NULL);
+
+    allgather(&value, all_values, sizeof(double));
+
+    if (rank_id == 0) {
+        for (i = 0; i < size; i++) {
+            sum += all_values[i];
+
+            if (all_values[i] < all_values[min_rank]) {
+                min_rank = i;
+            }
+
+            if (all_values[i] > all_values[max_rank]) {
+                max_rank = i;
+            }
+        }
+
+        fprintf(stdout,
+                "[%s] Rank: %4i %s %s min: %.3f (rank %i) avg: %.3f max: %.3f (rank %i) %s\n",
+                uts_info.nodename, rank_id, command_name, label,
+                all_values[min_rank], min_rank, sum / size,
+                all_values[max_rank], max_rank, units);
+
+        if (result_statistic_count < MAX_RESULT_STATISTICS) {
+            statistic = &result_statistics[result_statistic_count++];
+            snprintf(statistic->label, RESULT_STRING_LENGTH, "%s", label);
+            snprintf(statistic->units, RESULT_STRING_LENGTH, "%s", units);
+            statistic->min = all_values[min_rank];
+            statistic->min_rank = min_rank;
+            statistic->avg = sum / size;
+            statistic->max = all_values[max_rank];
+            statistic->max_rank = max_rank;
+            statistic->count = size;
+            statistic->better = better;
+
+            for (i = 0; i < size; i++) {
+                sum_squares += (all_values[i] - statistic->avg) *
+                    (all_values[i] - statistic->avg);
+            }
+            statistic->variance = (size > 1) ? sum_squares / (size - 1) : 0.0;
+        }
+    }
+
+    free(all_values);
+}
+
+/*
+ * The startup phase profile records where the time goes between PMI_Init
+ * and the start of the test.  Each phase may be timed more than once, the
+ * times are summed.  Setting STARTUP_PROFILE=1 prints a min/avg/max table
+ * from rank 0, and STARTUP_PROFILE_JSON=file also writes it as JSON.
+ */
+
+typedef enum {
+    STARTUP_PMI_INIT = 0,
+    STARTUP_CREDENTIALS,
+    STARTUP_CDM_CREATE,
+    STARTUP_CDM_ATTACH,
+    STARTUP_NIC_ADDRESSES,
+    STARTUP_CQ_CREATE,
+    STARTUP_EP_SETUP,
+    STARTUP_MEM_REGISTER,
+    STARTUP_ALLGATHER,
+    STARTUP_TOTAL,
+    STARTUP_PHASES
+} startup_phase_t;
+
+static char    *startup_phase_names[STARTUP_PHASES] = {
+    "PMI_Init",
+    "get_ptag/cookie",
+    "GNI_CdmCreate",
+    "GNI_CdmAttach",
+    "nic_addresses",
+    "GNI_CqCreate",
+    "EpCreate/EpBind",
+    "GNI_MemRegister",
+    "allgather",
+    "total"
+};
+
+double          startup_phase_seconds[STARTUP_PHASES];
+double          startup_phase_start[STARTUP_PHASES];
+
+static inline void
+startup_phase_begin(startup_phase_t phase)
+{
+    startup_phase_start[phase] = get_timestamp();
+}
+
+static inline void
+startup_phase_end(startup_phase_t phase)
+{
+    startup_phase_seconds[phase] += get_timestamp() -
+        startup_phase_start[phase];
+}
+
+/*
+ * print_startup_profile reduces the phase times to rank 0 and prints them.
+ * All of the ranks must call it.
+ */
+
+static void
+print_startup_profile(void)
+{
+    double         *all_values;
+    double          avg;
+    FILE           *file = NULL;
+    int             i;
+    char           *json_file;
+    int             max_rank;
+    int             min_rank;
+    int             phase;
+    char           *p_ptr;
+    int             rc;
+    int             size;
+    double          sum;
+
+    json_file = getenv("STARTUP_PROFILE_JSON");
+    p_ptr = getenv("STARTUP_PROFILE");
+    if ((json_file == NULL) && ((p_ptr == NULL) || (atoi(p_ptr) == 0))) {
+        return;
+    }
+
+    /*
+     * The total runs from the start of PMI_Init.
+     */
+
+    startup_phase_seconds[STARTUP_TOTAL] = get_timestamp() -
+        startup_phase_start[STARTUP_PMI_INIT];
+
+    rc = PMI_Get_size(&size);
+    assert(rc == PMI_SUCCESS);
+
+    all_values = (double *) malloc(size * sizeof(startup_phase_seconds));
+    assert(all_values != NULL);
+
+    allgather(startup_phase_seconds, all_values, sizeof(startup_phase_seconds));
+
+    if (rank_id == 0) {
+        if (json_file != NULL) {
+            file = fopen(json_file, "w");
+            if (file == NULL) {
+                fprintf(stdout, "[%s] Rank: %4i unable to open %s\n",
+                        uts_info.nodename, rank_id, json_file);
+            } else {
+                fprintf(file, "{\"test\": \"%s\", \"ranks\": %i, \"units\": \"usec\", \"phases\": [",
+                        command_name, size);
+            }
+        }
+
+        fprintf(stdout, "[%s] Rank: %4i %s startup phase        min usec      avg usec      max usec  max rank\n",
+                uts_info.nodename, rank_id, command_name);
+
+        for (phase = 0; phase < STARTUP_PHASES; phase++) {
+            max_rank = 0;
+            min_rank = 0;
+            sum = 0.0;
+
+            for (i = 0; i < size; i++) {
+                sum += all_values[i * STARTUP_PHASES + phase];
+
+                if (all_values[i * STARTUP_PHASES + phase] <
+                    all_values[min_rank * STARTUP_PHASES + phase]) {
+                    min_rank = i;
+                }
+
+                if (all_values[i * STARTUP_PHASES + phase] >
+                    all_values[max_rank * STARTUP_PHASES + phase]) {
+                    max_rank = i;
+                }
+            }
+
+            avg = sum / size;
+
+            fprintf(stdout, "[%s] Rank: %4i %s %-18s %13.3f %13.3f %13.3f %9i\n",
+                    uts_info.nodename, rank_id, command_name,
+                    startup_phase_names[phase],
+                    all_values[min_rank * STARTUP_PHASES + phase] * 1.0e6,
+                    avg * 1.0e6,
+                    all_values[max_rank * STARTUP_PHASES + phase] * 1.0e6,
+                    max_rank);
+
+            if (file != NULL) {
+                fprintf(file, "%s\n  {\"phase\": \"%s\", \"min\": %.3f, \"avg\": %.3f, \"max\": %.3f, \"max_rank\": %i}",
+                        (phase == 0) ? "" : ",", startup_phase_names[phase],
+                        all_values[min_rank * STARTUP_PHASES + phase] * 1.0e6,
+                        avg * 1.0e6,
+                        all_values[max_rank * STARTUP_PHASES + phase] * 1.0e6,
+                        max_rank);
+            }
+        }
+
+        if (file != NULL) {
+            fprintf(file, "\n]}\n");
+            fclose(file);
+        }
+    }
+
+    free(all_values);
 }
 
 /*
@@ -365,6 +621,250 @@ get_cookie(void)
     return cookie;
 }
 
+/*
+ * The completion wait spins on GNI_CqGetEvent for a short budget and then
+ * blocks in GNI_CqWaitEvent until an event arrives or a wall clock
+ * deadline passes.
+ *
+ *   CQ_SPIN_USEC sets the spin budget in microseconds, 20 by default.
+ *       The first wait that uses up the budget counts the polls that fit
+ *       in it, later waits spin for that many polls without reading
+ *       the clock.
+ *   CQ_WAIT_TIMEOUT sets the deadline in seconds, 10 by default.
+ *
+ * GNI_CqWaitEvent needs a CQ created with GNI_CQ_BLOCKING.  When it
+ * rejects a CQ, the CQ is remembered and the waiters on it sleep instead,
+ * backing off from one microsecond to one millisecond between polls.
+ *
+ * The threaded examples wait from several threads, so the statistics are
+ * updated atomically.
+ */
+
+#define CQ_SPIN_USEC_DEFAULT        20
+#define CQ_WAIT_TIMEOUT_DEFAULT     10
+#define CQ_WAIT_BLOCK_MSEC          10
+#define CQ_SPIN_CLOCK_INTERVAL      64
+#define CQ_SLEEP_NSEC_MAXIMUM       1000000
+#define CQ_NOBLOCK_MAXIMUM          64
+
+#define CQ_WAIT_STAT_ADD(field, count) \
+    __sync_fetch_and_add(&cq_wait_stats.field, (count))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+typedef struct {
+    uint64_t        waits;          /* calls that did not find an event at once */
+    uint64_t        spins;          /* polls made while spinning */
+    uint64_t        spin_hits;      /* events found while spinning */
+    uint64_t        blocks;         /* GNI_CqWaitEvent calls or sleeps */
+    uint64_t        block_hits;     /* events found after blocking */
+    uint64_t        timeouts;       /* deadlines that passed */
+} cq_wait_stats_t;
+
+cq_wait_stats_t cq_wait_stats;
+static gni_cq_handle_t cq_noblock[CQ_NOBLOCK_MAXIMUM];
+static uint64_t cq_spin_budget;
+static double   cq_spin_seconds;
+static double   cq_wait_timeout;
+static pthread_once_t cq_wait_once = PTHREAD_ONCE_INIT;
+
+static void
+cq_wait_init(void)
+{
+    char           *p_ptr;
+
+    cq_spin_seconds = CQ_SPIN_USEC_DEFAULT * 1.0e-6;
+    p_ptr = getenv("CQ_SPIN_USEC");
+    if (p_ptr != NULL) {
+        cq_spin_seconds = atof(p_ptr) * 1.0e-6;
+    }
+
+    cq_wait_timeout = CQ_WAIT_TIMEOUT_DEFAULT;
+    p_ptr = getenv("CQ_WAIT_TIMEOUT");
+    if (p_ptr != NULL) {
+        cq_wait_timeout = atof(p_ptr);
+    }
+}
+
+/*
+ * cq_can_block checks whether a CQ has not rejected GNI_CqWaitEvent.
+ */
+
+static int
+cq_can_block(gni_cq_handle_t cq_handle)
+{
+    int             i;
+
+    for (i = 0; i < CQ_NOBLOCK_MAXIMUM; i++) {
+        if (cq_noblock[i] == cq_handle) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * cq_set_noblock remembers a CQ that rejected GNI_CqWaitEvent.  When the
+ * table is full the CQ is not remembered, and its waiters try to block
+ * again on their next wait.
+ */
+
+static void
+cq_set_noblock(gni_cq_handle_t cq_handle)
+{
+    int             i;
+
+    for (i = 0; i < CQ_NOBLOCK_MAXIMUM; i++) {
+        if ((cq_noblock[i] == cq_handle) ||
+            __sync_bool_compare_and_swap(&cq_noblock[i], NULL, cq_handle)) {
+            return;
+        }
+    }
+}
+
+/*
+ * cq_wait_event gets the next event from the completion queue, waiting
+ * for it when retry is set.
+ *
+ *   Returns:  the GNI_CqGetEvent or GNI_CqWaitEvent status,
+ *             GNI_RC_NOT_DONE when no event arrived before the deadline.
+ */
+
+static gni_return_t
+cq_wait_event(gni_cq_handle_t cq_handle, unsigned int retry,
+              gni_cq_entry_t *event_data)
+{
+    int             can_block;
+    double          deadline;
+    double          now;
+    double          spin_end;
+    uint64_t        polls;
+    uint64_t        spin_limit;
+    unsigned int    sleep_nsec = 1000;
+    gni_return_t    status;
+    struct timespec ts;
+    uint64_t        timeout_msec;
+
+    status = GNI_CqGetEvent(cq_handle, event_data);
+    if ((status != GNI_RC_NOT_DONE) || (retry == 0)) {
+        return status;
+    }
+
+    pthread_once(&cq_wait_once, cq_wait_init);
+    CQ_WAIT_STAT_ADD(waits, 1);
+
+    now = get_timestamp();
+    deadline = now + cq_wait_timeout;
+    spin_end = now + cq_spin_seconds;
+
+    /*
+     * Spin.  Until the budget is calibrated, read the clock every few
+     * polls to find the end of the budget.
+     */
+
+    spin_limit = (cq_spin_budget != 0) ? cq_spin_budget : UINT64_MAX;
+    polls = 0;
+    while (polls < spin_limit) {
+        polls++;
+        cpu_relax();
+        status = GNI_CqGetEvent(cq_handle, event_data);
+        if (status != GNI_RC_NOT_DONE) {
+            CQ_WAIT_STAT_ADD(spins, polls);
+            CQ_WAIT_STAT_ADD(spin_hits, 1);
+            return status;
+        }
+
+        if ((cq_spin_budget == 0) &&
+            ((polls % CQ_SPIN_CLOCK_INTERVAL) == 0) &&
+            (get_timestamp() >= spin_end)) {
+            cq_spin_budget = polls;
+            break;
+        }
+    }
+    CQ_WAIT_STAT_ADD(spins, polls);
+
+    /*
+     * Block until the deadline.
+     */
+
+    can_block = cq_can_block(cq_handle);
+
+    while ((now = get_timestamp()) < deadline) {
+        CQ_WAIT_STAT_ADD(blocks, 1);
+
+        if (can_block == 1) {
+            timeout_msec = (uint64_t) ((deadline - now) * 1000.0) + 1;
+            if (timeout_msec > CQ_WAIT_BLOCK_MSEC) {
+                timeout_msec = CQ_WAIT_BLOCK_MSEC;
+            }
+
+            status = GNI_CqWaitEvent(cq_handle, timeout_msec, event_data);
+            if (status == GNI_RC_INVALID_PARAM) {
+                /*
+                 * This CQ was not created with GNI_CQ_BLOCKING.  An
+                 * overrun, GNI_RC_ERROR_RESOURCE, goes back to the
+                 * caller at once.
+                 */
+
+                can_block = 0;
+                cq_set_noblock(cq_handle);
+            } else if (status != GNI_RC_TIMEOUT) {
+                CQ_WAIT_STAT_ADD(block_hits, 1);
+                return status;
+            }
+
+            continue;
+        }
+
+        ts.tv_sec = 0;
+        ts.tv_nsec = sleep_nsec;
+        nanosleep(&ts, NULL);
+        if (sleep_nsec < CQ_SLEEP_NSEC_MAXIMUM) {
+            sleep_nsec *= 2;
+        }
+
+        status = GNI_CqGetEvent(cq_handle, event_data);
+        if (status != GNI_RC_NOT_DONE) {
+            CQ_WAIT_STAT_ADD(block_hits, 1);
+            return status;
+        }
+    }
+
+    CQ_WAIT_STAT_ADD(timeouts, 1);
+
+    return GNI_RC_NOT_DONE;
+}
+
+/*
+ * print_cq_wait_statistics reduces the completion wait statistics to
+ * rank 0.  All of the ranks must call it.
+ */
+
+static void
+print_cq_wait_statistics(void)
+{
+    print_rank_statistic("CQ waits", (double) cq_wait_stats.waits, "waits",
+                         RESULT_NO_DIRECTION);
+    print_rank_statistic("CQ spin polls", (double) cq_wait_stats.spins, "polls",
+                         RESULT_NO_DIRECTION);
+    print_rank_statistic("CQ events found spinning",
+                         (double) cq_wait_stats.spin_hits, "events",
+                         RESULT_NO_DIRECTION);
+    print_rank_statistic("CQ blocks", (double) cq_wait_stats.blocks, "blocks",
+                         RESULT_NO_DIRECTION);
+    print_rank_statistic("CQ events found blocking",
+                         (double) cq_wait_stats.block_hits, "events",
+                         RESULT_NO_DIRECTION);
+    print_rank_statistic("CQ wait timeouts",
+                         (double) cq_wait_stats.timeouts, "timeouts",
+                         RESULT_NO_DIRECTION);
+}
+
 /*
  * get_cq_event will process events from the completion queue.
  *
@@ -373,8 +873,8 @@ get_cookie(void)
  *   rank_id is the rank of this process.
  *   source_cq determines if the CQ is a source or a
  *       destination completion queue. 
- *   retry determines if GNI_CqGetEvent should be called multiple
- *       times or only once to get an event.
+ *   retry determines if get_cq_event should wait for an event, see
+ *       cq_wait_event, or only poll once.
  *
  *   Returns:  gni_cq_entry_t for success
  *             0 on success
@@ -391,7 +891,6 @@ get_cq_event(gni_cq_handle_t cq_handle, struct utsname uts_info,
     gni_cq_entry_t  event_data = 0;
     uint64_t        event_type;
     gni_return_t    status = GNI_RC_SUCCESS;
-    int             wait_count = 0;
 
     status = GNI_RC_NOT_DONE;
     while (status == GNI_RC_NOT_DONE) {
@@ -400,7 +899,7 @@ get_cq_event(gni_cq_handle_t cq_handle, struct utsname uts_info,
          * Get the next event from the specified completion queue handle.
          */
 
-        status = GNI_CqGetEvent(cq_handle, &event_data);
+        status = cq_wait_event(cq_handle, retry, &event_data);
         if (status == GNI_RC_SUCCESS) {
             *next_event = event_data;
 
@@ -564,38 +1063,14 @@ get_cq_event(gni_cq_handle_t cq_handle, struct utsname uts_info,
         } else {
 
             /*
-             * An event has not been received yet.
-             */
-
-            wait_count++;
-
-            if (wait_count >= MAXIMUM_CQ_RETRY_COUNT) {
-                /*
-                 * This prevents an indefinite retry, which could hang the
-                 * application.
-                 */
-
-                fprintf(stdout,
-                        "[%s] Rank: %4i GNI_CqGetEvent    ERROR no event was received status: %d retry count: %d\n",
-                        uts_info.nodename, rank_id, status, wait_count);
-                return 3;
-            }
-
-            /*
-             * Release the cpu to allow the event to be received.
-             * This is basically a sleep, if other processes need to do some work.
+             * The deadline passed without an event.  This prevents an
+             * indefinite wait, which could hang the application.
              */
 
-            if ((wait_count % (MAXIMUM_CQ_RETRY_COUNT / 10)) == 0) {
-                /*
-                 * Sometimes it takes a little longer for
-                 * the datagram to arrive.
-                 */
-
-                sleep(1);
-            } else {
-                sched_yield();
-            }
+            fprintf(stdout,
+                    "[%s] Rank: %4i GNI_CqGetEvent    ERROR no event was received status: %d timeout: %.3f seconds\n",
+                    uts_info.nodename, rank_id, status, cq_wait_timeout);
+            return 3;
         }
     }
 
@@ -669,9 +1144,427 @@ get_ptag(void)
     return ptag;
 }
 
+/*
+ * The counts of one rank, as gathered by print_results.  Every rank
+ * receives the record of every other rank, so it is kept to 16 bytes.
+ * The abort count is clamped, a rank stops at its first abort anyway.
+ * node_leader is set on the lowest rank of each node, so that the nodes
+ * are counted without gathering the node names.
+ */
+
+typedef struct {
+    int32_t         passed;
+    int32_t         expected_passed;
+    int32_t         failed;
+    int16_t         aborted;
+    int16_t         node_leader;
+} result_rank_t;
+
+static char    *
+result_status(result_rank_t *result)
+{
+    if (result->aborted > 0) {
+        return "Aborted";
+    } else if (result->failed > 0) {
+        return "Failed";
+    } else if (result->passed != result->expected_passed) {
+        return "Indeterminate";
+    }
+
+    return "Passed";
+}
+
+/*
+ * is_node_leader determines if this rank is the lowest rank on its node.
+ *
+ *   Returns: 1 if it is, 0 if it is not.
+ */
+
+static int
+is_node_leader(void)
+{
+    int             i;
+    int             leader = 1;
+    int             number_of_ranks_on_node;
+    int            *ranks_on_node;
+    int             rc;
+
+    rc = PMI_Get_clique_size(&number_of_ranks_on_node);
+    assert(rc == PMI_SUCCESS);
+
+    ranks_on_node = (int *) calloc(number_of_ranks_on_node, sizeof(int));
+    assert(ranks_on_node != NULL);
+
+    rc = PMI_Get_clique_ranks(ranks_on_node, number_of_ranks_on_node);
+    assert(rc == PMI_SUCCESS);
+
+    for (i = 0; i < number_of_ranks_on_node; i++) {
+        if (ranks_on_node[i] < rank_id) {
+            leader = 0;
+            break;
+        }
+    }
+
+    free(ranks_on_node);
+
+    return leader;
+}
+
+/*
+ * write_json_string writes a string as a JSON string.
+ */
+
+static void
+write_json_string(FILE *file, char *string)
+{
+    fputc('"', file);
+    for (; *string != '\0'; string++) {
+        if ((*string == '"') || (*string == '\\')) {
+            fputc('\\', file);
+        }
+        fputc(*string, file);
+    }
+    fputc('"', file);
+}
+
+/*
+ * write_csv_string writes a string as a quoted CSV field, doubling the
+ * quotes in it, so that commas and quotes in a value do not break the row.
+ */
+
+static void
+write_csv_string(FILE *file, char *string)
+{
+    fputc('"', file);
+    for (; *string != '\0'; string++) {
+        if (*string == '"') {
+            fputc('"', file);
+        }
+        fputc(*string, file);
+    }
+    fputc('"', file);
+}
+
+/*
+ * write_results_object writes the members of the JSON object that
+ * describes the run, without the enclosing braces.
+ */
+
+static void
+write_results_object(FILE *file, char *status, int *totals,
+                     int *rank_counts, int ranks, int nodes)
+{
+    int             i;
+    result_statistic_t *statistic;
+
+    fprintf(file, "\"test\":");
+    write_json_string(file, command_name);
+    fprintf(file,
+            ",\"status\":\"%s\",\"ranks\":%i,\"nodes\":%i,"
+            "\"ranks_passed\":%i,\"ranks_failed\":%i,\"ranks_aborted\":%i,"
+            "\"ranks_indeterminate\":%i,"
+            "\"passed\":%i,\"expected_passed\":%i,\"failed\":%i,\"aborted\":%i,"
+            "\"metadata\":{",
+            status, ranks, nodes,
+            rank_counts[0], rank_counts[1], rank_counts[2], rank_counts[3],
+            totals[0], totals[1], totals[2], totals[3]);
+
+    for (i = 0; i < result_metadata_count; i++) {
+        fprintf(file, "%s", (i == 0) ? "" : ",");
+        write_json_string(file, result_metadata[i].key);
+        fputc(':', file);
+        write_json_string(file, result_metadata[i].value);
+    }
+
+    fprintf(file, "},\"statistics\":[");
+
+    for (i = 0; i < result_statistic_count; i++) {
+        statistic = &result_statistics[i];
+        fprintf(file, "%s{\"label\":", (i == 0) ? "" : ",");
+        write_json_string(file, statistic->label);
+        fprintf(file, ",\"units\":");
+        write_json_string(file, statistic->units);
+        fprintf(file,
+                ",\"min\":%.6g,\"min_rank\":%i,\"avg\":%.6g,\"max\":%.6g,\"max_rank\":%i,"
+                "\"count\":%i,\"variance\":%.6g,\"better\":\"%s\"}",
+                statistic->min, statistic->min_rank, statistic->avg,
+                statistic->max, statistic->max_rank, statistic->count,
+                statistic->variance,
+                (statistic->better == RESULT_HIGHER_IS_BETTER) ? "higher" :
+                (statistic->better == RESULT_LOWER_IS_BETTER) ? "lower" :
+                "none");
+    }
+
+    fprintf(file, "]");
+}
+
+static void
+write_results_json(char *file_name, char *status, int *totals,
+                   int *rank_counts, int ranks, int nodes)
+{
+    FILE           *file;
+
+    file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stdout, "[%s] Rank: %4i unable to open %s\n",
+                uts_info.nodename, rank_id, file_name);
+        return;
+    }
+
+    fprintf(file, "{");
+    write_results_object(file, status, totals, rank_counts, ranks, nodes);
+    fprintf(file, "}\n");
+    fclose(file);
+}
+
+/*
+ * write_results_store appends the run to the results store as one line.
+ * The line is built in memory and appended with a single write, so that
+ * runs finishing at the same time do not interleave their lines.
+ */
+
+static void
+write_results_store(char *file_name, char *status, int *totals,
+                    int *rank_counts, int ranks, int nodes)
+{
+    char           *buffer = NULL;
+    int             fd;
+    FILE           *file;
+    char           *p_ptr;
+    size_t          size = 0;
+
+    file = open_memstream(&buffer, &size);
+    assert(file != NULL);
+
+    p_ptr = getenv("RESULTS_SYSTEM");
+    fprintf(file, "{\"time\":%ld,\"system\":", (long) time(NULL));
+    write_json_string(file, (p_ptr != NULL) ? p_ptr : uts_info.nodename);
+
+    p_ptr = getenv("RESULTS_LABEL");
+    fprintf(file, ",\"label\":");
+    write_json_string(file, (p_ptr != NULL) ? p_ptr : "");
+
+    fprintf(file, ",");
+    write_results_object(file, status, totals, rank_counts, ranks, nodes);
+    fprintf(file, "}\n");
+    fclose(file);
+
+    fd = open(file_name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if ((fd < 0) || (write(fd, buffer, size) != (ssize_t) size)) {
+        fprintf(stdout, "[%s] Rank: %4i unable to append to %s\n",
+                uts_info.nodename, rank_id, file_name);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    free(buffer);
+}
+
+static void
+write_results_csv(char *file_name, char *status, int *totals, int ranks,
+                  int nodes)
+{
+    FILE           *file;
+    int             i;
+    char            metadata[MAX_RESULT_METADATA * RESULT_STRING_LENGTH * 2];
+    size_t          offset = 0;
+    struct stat     st;
+    result_statistic_t *statistic;
+
+    /*
+     * The metadata differs between tests, it is one column of
+     * key=value pairs so that all of the tests can share a file.
+     */
+
+    metadata[0] = '\0';
+    for (i = 0; i < result_metadata_count; i++) {
+        offset += snprintf(&metadata[offset], sizeof(metadata) - offset,
+                           "%s%s=%s", (i == 0) ? "" : ";",
+                           result_metadata[i].key, result_metadata[i].value);
+    }
+
+    i = stat(file_name, &st);
+
+    file = fopen(file_name, "a");
+    if (file == NULL) {
+        fprintf(stdout, "[%s] Rank: %4i unable to open %s\n",
+                uts_info.nodename, rank_id, file_name);
+        return;
+    }
+
+    if ((i != 0) || (st.st_size == 0)) {
+        fprintf(file,
+                "test,status,ranks,nodes,passed,expected_passed,failed,aborted,"
+                "metadata,statistic,units,min,min_rank,avg,max,max_rank\n");
+    }
+
+    for (i = 0; (i < result_statistic_count) || (i == 0); i++) {
+        write_csv_string(file, command_name);
+        fprintf(file, ",%s,%i,%i,%i,%i,%i,%i,", status, ranks, nodes,
+                totals[0], totals[1], totals[2], totals[3]);
+        write_csv_string(file, metadata);
+        fputc(',', file);
+
+        if (result_statistic_count == 0) {
+            fprintf(file, ",,,,,,\n");
+            break;
+        }
+
+        statistic = &result_statistics[i];
+        write_csv_string(file, statistic->label);
+        fputc(',', file);
+        write_csv_string(file, statistic->units);
+        fprintf(file, ",%.6g,%i,%.6g,%.6g,%i\n", statistic->min,
+                statistic->min_rank, statistic->avg, statistic->max,
+                statistic->max_rank);
+    }
+
+    fclose(file);
+}
+
+static void
+write_results_ranks(char *file_name, result_rank_t *results,
+                    char *nodenames, int ranks)
+{
+    FILE           *file;
+    int             i;
+
+    file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stdout, "[%s] Rank: %4i unable to open %s\n",
+                uts_info.nodename, rank_id, file_name);
+        return;
+    }
+
+    fprintf(file, "rank,node,status,passed,expected_passed,failed,aborted\n");
+    for (i = 0; i < ranks; i++) {
+        fprintf(file, "%i,", i);
+        write_csv_string(file, &nodenames[i * sizeof(uts_info.nodename)]);
+        fprintf(file, ",%s,%i,%i,%i,%i\n",
+                result_status(&results[i]), results[i].passed,
+                results[i].expected_passed, results[i].failed,
+                results[i].aborted);
+    }
+
+    fclose(file);
+}
+
+/*
+ * gather_results gathers the counts of all of the ranks to rank 0, which
+ * prints a summary of the run and writes the structured output.  The
+ * node names are only gathered for the per rank file, RESULTS_RANKS,
+ * which has to be set for all of the ranks.
+ */
+
+static void
+gather_results(void)
+{
+    result_rank_t   my_result;
+    result_rank_t  *all_results;
+    char           *nodenames = NULL;
+    int             i;
+    int             nodes = 0;
+    char           *p_ptr;
+    char           *ranks_file;
+    int             rank_counts[4] = { 0, 0, 0, 0 };
+    int             ranks;
+    int             rc;
+    char           *status;
+    int             totals[4] = { 0, 0, 0, 0 };
+
+    rc = PMI_Get_size(&ranks);
+    assert(rc == PMI_SUCCESS);
+
+    memset(&my_result, 0, sizeof(my_result));
+    my_result.passed = passed;
+    my_result.expected_passed = expected_passed;
+    my_result.failed = failed;
+    my_result.aborted = (aborted < INT16_MAX) ? aborted : INT16_MAX;
+    my_result.node_leader = is_node_leader();
+
+    all_results = (result_rank_t *) malloc(ranks * sizeof(result_rank_t));
+    assert(all_results != NULL);
+
+    allgather(&my_result, all_results, sizeof(result_rank_t));
+
+    ranks_file = getenv("RESULTS_RANKS");
+    if (ranks_file != NULL) {
+        nodenames = (char *) malloc(ranks * sizeof(uts_info.nodename));
+        assert(nodenames != NULL);
+
+        allgather(uts_info.nodename, nodenames, sizeof(uts_info.nodename));
+    }
+
+    if (rank_id == 0) {
+        for (i = 0; i < ranks; i++) {
+            totals[0] += all_results[i].passed;
+            totals[1] += all_results[i].expected_passed;
+            totals[2] += all_results[i].failed;
+            totals[3] += all_results[i].aborted;
+
+            status = result_status(&all_results[i]);
+            if (strcmp(status, "Passed") == 0) {
+                rank_counts[0]++;
+            } else if (strcmp(status, "Failed") == 0) {
+                rank_counts[1]++;
+            } else if (strcmp(status, "Aborted") == 0) {
+                rank_counts[2]++;
+            } else {
+                rank_counts[3]++;
+            }
+
+            nodes += all_results[i].node_leader;
+        }
+
+        if (rank_counts[2] > 0) {
+            status = "Aborted";
+        } else if (rank_counts[1] > 0) {
+            status = "Failed";
+        } else if (rank_counts[3] > 0) {
+            status = "Indeterminate";
+        } else {
+            status = "Passed";
+        }
+
+        fprintf(stdout,
+                "[%s] Rank: %4i %s:    %-13s    Summary         Ranks: %i Nodes: %i Passed: %i Failed: %i Aborted: %i Indeterminate: %i Passes: %i/%i\n",
+                uts_info.nodename, rank_id, command_name, status, ranks, nodes,
+                rank_counts[0], rank_counts[1], rank_counts[2], rank_counts[3],
+                totals[0], totals[1]);
+
+        p_ptr = getenv("RESULTS_JSON");
+        if (p_ptr != NULL) {
+            write_results_json(p_ptr, status, totals, rank_counts, ranks,
+                               nodes);
+        }
+
+        p_ptr = getenv("RESULTS_CSV");
+        if (p_ptr != NULL) {
+            write_results_csv(p_ptr, status, totals, ranks, nodes);
+        }
+
+        p_ptr = getenv("RESULTS_STORE");
+        if (p_ptr != NULL) {
+            write_results_store(p_ptr, status, totals, rank_counts, ranks,
+                                nodes);
+        }
+
+        if (ranks_file != NULL) {
+            write_results_ranks(ranks_file, all_results, nodenames, ranks);
+        }
+    }
+
+    free(nodenames);
+    free(all_results);
+}
+
 /*
  * print_results will determine if the test was successful or not
  *               and then print a message according to this result.
+ *               Each rank prints its own result only if it did not
+ *               pass, or with -v.  See gather_results for the summary.
  *
  *   Returns:  0 for a success
  *            -1 for a failure
@@ -683,6 +1576,8 @@ print_results(void)
 {
     char            abort_string[256];
     char           *exit_status;
+    char           *p_ptr;
+    int             print_rank_line = v_option;
     int             rc;
 
 
@@ -693,6 +1588,15 @@ print_results(void)
     rc = PMI_Barrier();
     assert(rc == PMI_SUCCESS);
 
+    /*
+     * CQ_WAIT_STATS=1 reports how the completion waits were satisfied.
+     */
+
+    p_ptr = getenv("CQ_WAIT_STATS");
+    if ((p_ptr != NULL) && (atoi(p_ptr) != 0)) {
+        print_cq_wait_statistics();
+    }
+
     if (aborted > 0) {
 
         /*
@@ -700,6 +1604,7 @@ print_results(void)
          */
 
         exit_status = "Aborted      ";
+        print_rank_line = 1;
         rc = -2;
     } else if (failed > 0) {
 
@@ -708,6 +1613,7 @@ print_results(void)
          */
 
         exit_status = "Failed       ";
+        print_rank_line = 1;
         rc = -1;
     } else if (passed != expected_passed) {
 
@@ -716,6 +1622,7 @@ print_results(void)
          */
 
         exit_status = "Indeterminate";
+        print_rank_line = 1;
         rc = 0;
     } else {
         /*
@@ -727,12 +1634,17 @@ print_results(void)
     }
 
     /*
-     * Print the results from this test.
+     * Print the results from this rank if it did not pass, rank 0 prints
+     * the summary of all of the ranks.
      */
 
-    fprintf(stdout, "[%s] Rank: %4i %s:    %s    Test Results    Passed: %i/%i Failed: %i Aborted: %i\n",
-            uts_info.nodename, rank_id, command_name, exit_status,
-            passed, expected_passed, failed, aborted);
+    if (print_rank_line) {
+        fprintf(stdout, "[%s] Rank: %4i %s:    %s    Test Results    Passed: %i/%i Failed: %i Aborted: %i\n",
+                uts_info.nodename, rank_id, command_name, exit_status,
+                passed, expected_passed, failed, aborted);
+    }
+
+    gather_results();
 
     if (aborted > 0) {
 
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2011 Cray Inc.  All Rights Reserved.
+ */
+
+/*
+ * This header file contains the functions used to verify the received
+ * data on a background thread, so that the verification is not part of
+ * the communication loop.
+ *
+ * The receiving thread hands each completed transfer to the verification
+ * thread through a single producer, single consumer ring.  The ring is
+ * lock free, the producer only writes the tail and the consumer only
+ * writes the head.  The results are added to the passed and failed
+ * counts when the verification thread is stopped.
+ */
+
+#ifndef VERIFY_FUNCTIONS_H
+#define VERIFY_FUNCTIONS_H
+
+#include <pthread.h>
+#include "pattern_functions.h"
+
+#define VERIFY_QUEUE_SIZE        1024   /* must be a power of 2 */
+
+typedef struct {
+    uint64_t       *data;
+    size_t          count;
+    uint64_t        expected;
+    int             transfer;
+    int             pattern;
+} verify_request_t;
+
+typedef struct {
+    volatile uint64_t head __attribute__ ((aligned(64)));
+    volatile uint64_t tail __attribute__ ((aligned(64)));
+    verify_request_t requests[VERIFY_QUEUE_SIZE] __attribute__ ((aligned(64)));
+    int             failed;
+    int             passed;
+    pthread_t       thread;
+} verify_queue_t;
+
+/*
+ * verify_request checks one transfer.  The expected value is the value of
+ * every element, the value of the first element of a position pattern, or
+ * for a checksum the flag that carries it.
+ *
+ *   Returns: 0 if the data is correct, 1 if it is not.
+ */
+
+static int
+verify_request(verify_request_t *request)
+{
+    uint32_t        checksum;
+    size_t          element;
+    uint64_t        expected;
+
+    if (request->pattern == PATTERN_RANDOM) {
+        checksum = crc32c(0, request->data,
+                          request->count * sizeof(uint64_t));
+
+        if (checksum != (uint32_t) request->expected) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Received data ERROR in transfer: %4i checksum: 0x%08x expected checksum: 0x%08x\n",
+                    uts_info.nodename, rank_id, request->transfer, checksum,
+                    (uint32_t) request->expected);
+            return 1;
+        }
+    } else {
+        if (request->pattern == PATTERN_POSITION) {
+            element = verify_position_pattern(request->data, request->count,
+                                              request->expected);
+            expected = request->expected + element;
+        } else {
+            element = verify_pattern(request->data, request->count,
+                                     request->expected);
+            expected = request->expected;
+        }
+
+        if (element < request->count) {
+            fprintf(stdout,
+                    "[%s] Rank: %4i Received data ERROR in transfer: %4i element: %4i (address %p)"
+                    " received data: 0x%016lx expected data: 0x%016lx\n",
+                    uts_info.nodename, rank_id, request->transfer,
+                    (int) element, &request->data[element],
+                    request->data[element], expected);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * verify_thread is the body of the verification thread, it checks the
+ * transfers in the order they were queued until it is stopped.
+ */
+
+static void *
+verify_thread(void *arg)
+{
+    uint64_t        head;
+    verify_queue_t *queue = (verify_queue_t *) arg;
+    verify_request_t *request;
+
+    for (;;) {
+        head = queue->head;
+
+        while (__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == head) {
+            sched_yield();
+        }
+
+        request = &queue->requests[head & (VERIFY_QUEUE_SIZE - 1)];
+
+        /*
+         * A request without any data stops the thread.
+         */
+
+        if (request->data == NULL) {
+            break;
+        }
+
+        if (verify_request(request) == 0) {
+            queue->passed++;
+        } else {
+            queue->failed++;
+        }
+
+        __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+/*
+ * start_verify_thread creates the queue and the verification thread.
+ *
+ *   Returns: the queue.
+ */
+
+static verify_queue_t *
+start_verify_thread(void)
+{
+    verify_queue_t *queue;
+    int             rc;
+
+    rc = posix_memalign((void **) &queue, 64, sizeof(verify_queue_t));
+    assert(rc == 0);
+
+    memset(queue, 0, sizeof(verify_queue_t));
+
+    rc = pthread_create(&queue->thread, NULL, verify_thread, queue);
+    assert(rc == 0);
+
+    return queue;
+}
+
+/*
+ * queue_verify_request hands a transfer to the verification thread.  It
+ * only waits when the verification thread has fallen a whole queue
+ * behind.
+ */
+
+static void
+queue_verify_request(verify_queue_t *queue, uint64_t *data, size_t count,
+                     uint64_t expected, int transfer, int pattern)
+{
+    verify_request_t *request;
+    uint64_t        tail = queue->tail;
+
+    while ((tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) >=
+           VERIFY_QUEUE_SIZE) {
+        sched_yield();
+    }
+
+    request = &queue->requests[tail & (VERIFY_QUEUE_SIZE - 1)];
+    request->data = data;
+    request->count = count;
+    request->expected = expected;
+    request->transfer = transfer;
+    request->pattern = pattern;
+
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * verified_requests returns the number of transfers the verification
+ * thread has checked, the buffers of those transfers may be reused.
+ */
+
+static inline uint64_t
+verified_requests(verify_queue_t *queue)
+{
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * stop_verify_thread waits for all of the queued transfers to be checked,
+ * adds the results to the passed and failed counts and frees the queue.
+ */
+
+static void
+stop_verify_thread(verify_queue_t *queue)
+{
+    queue_verify_request(queue, NULL, 0, 0, 0, 0);
+
+    pthread_join(queue->thread, NULL);
+
+    passed += queue->passed;
+    failed += queue->failed;
+
+    free(queue);
+}
+
+#endif /* VERIFY_FUNCTIONS_H */